@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#include "core/jet.hpp"
+#include "core/least_squares.hpp"
+
+namespace core {
+
+// a CostFunction whose jacobians come from forward-mode differentiation of
+// a functor written once for any scalar type,
+//
+//   template <typename T>
+//   bool operator()(const T* x0, ..., const T* xm-1, T* residuals) const;
+//
+// with one pointer per parameter block. residual-only evaluations call it
+// with T = double, jacobian evaluations with jets of one lane per parameter
+// across all blocks, each seeded with its own lane, so a single call gives
+// every jacobian exactly. the jets live on the stack.
+template <typename Functor, size_t NumResiduals, size_t... BlockSizes>
+class AutoDiffCostFunction final : public CostFunction {
+  static_assert(NumResiduals > 0);
+  static_assert(sizeof...(BlockSizes) > 0 && ((BlockSizes > 0) && ...));
+
+ public:
+  static constexpr size_t kNumBlocks = sizeof...(BlockSizes);
+  static constexpr size_t kNumParameters = (BlockSizes + ...);
+  using JetType = Jet<double, kNumParameters>;
+
+  explicit AutoDiffCostFunction(Functor functor = {})
+      : CostFunction(NumResiduals, {BlockSizes...}),
+        functor_(std::move(functor)) {}
+
+  [[nodiscard]] bool evaluate(const double* const* parameters,
+                              double* residuals,
+                              double* const* jacobians) const override {
+    constexpr std::array<size_t, kNumBlocks> sizes{BlockSizes...};
+    constexpr std::array<size_t, kNumBlocks> offsets = block_offsets();
+    bool constant = true;
+    for (size_t b = 0; jacobians != nullptr && b < kNumBlocks; ++b) {
+      constant = constant && jacobians[b] == nullptr;
+    }
+    if (constant) {
+      return call(parameters, residuals);
+    }
+
+    JetType values[kNumParameters];
+    const JetType* blocks[kNumBlocks];
+    for (size_t b = 0; b < kNumBlocks; ++b) {
+      for (size_t k = 0; k < sizes[b]; ++k) {
+        values[offsets[b] + k] =
+            JetType(parameters[b][k], offsets[b] + k);
+      }
+      blocks[b] = values + offsets[b];
+    }
+    JetType outputs[NumResiduals];
+    if (!call(blocks, outputs)) {
+      return false;
+    }
+    for (size_t r = 0; r < NumResiduals; ++r) {
+      residuals[r] = outputs[r].value;
+    }
+    for (size_t b = 0; b < kNumBlocks; ++b) {
+      if (jacobians[b] == nullptr) {
+        continue;
+      }
+      for (size_t r = 0; r < NumResiduals; ++r) {
+        const double* lanes = outputs[r].derivatives + offsets[b];
+        std::copy(lanes, lanes + sizes[b], jacobians[b] + r * sizes[b]);
+      }
+    }
+    return true;
+  }
+
+  [[nodiscard]] const Functor& functor() const noexcept { return functor_; }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  static constexpr std::array<size_t, kNumBlocks> block_offsets() noexcept {
+    constexpr std::array<size_t, kNumBlocks> sizes{BlockSizes...};
+    std::array<size_t, kNumBlocks> offsets{};
+    for (size_t b = 1; b < kNumBlocks; ++b) {
+      offsets[b] = offsets[b - 1] + sizes[b - 1];
+    }
+    return offsets;
+  }
+
+  template <typename T>
+  bool call(const T* const* blocks, T* residuals) const {
+    return [&]<size_t... I>(std::index_sequence<I...>) {
+      return static_cast<bool>(functor_(blocks[I]..., residuals));
+    }(std::make_index_sequence<kNumBlocks>{});
+  }
+
+  Functor functor_;
+};
+
+};  // namespace core
@@ -0,0 +1,282 @@
+#include "core/batched_solver.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+// matrices per tile, an n = 12 tile of factors is 36 KB
+constexpr size_t kLanes = 64;
+// multiply-adds per parallel chunk
+constexpr size_t kMinWorkPerChunk = size_t{1} << 18;
+
+void ensure_shape(Mat& mat, const size_t rows, const size_t cols,
+                  const size_t channels) {
+  if (mat.rows() != rows || mat.cols() != cols ||
+      mat.channels() != channels) {
+    mat = Mat(rows, cols, channels);
+  }
+}
+
+size_t min_chunk(const size_t n) {
+  return std::max(kLanes, kMinWorkPerChunk / (n * n * n));
+}
+
+// runs fn(first, width, scratch) over tiles of at most kLanes matrices in
+// parallel, scratch holds scratch_size floats per chunk
+template <typename Fn>
+void for_each_tile(const size_t batch, const size_t n,
+                   const size_t scratch_size, Fn&& fn) {
+  parallel_for(
+      0, batch,
+      [&](const size_t lo, const size_t hi) {
+        std::vector<float> scratch(scratch_size);
+        for (size_t first = lo; first < hi; first += kLanes) {
+          fn(first, std::min(kLanes, hi - first), scratch.data());
+        }
+      },
+      min_chunk(n));
+}
+
+// row -= a * b across the lanes of a tile
+void subtract_product(float* __restrict row, const float* __restrict a,
+                      const float* __restrict b, const size_t width) {
+  for (size_t l = 0; l < width; ++l) {
+    row[l] -= a[l] * b[l];
+  }
+}
+
+void scale(float* __restrict row, const float* __restrict factors,
+           const size_t width) {
+  for (size_t l = 0; l < width; ++l) {
+    row[l] *= factors[l];
+  }
+}
+
+// zeroes the lanes of a row whose mask is 0, also clearing nans
+void mask(float* __restrict row, const float* __restrict valid,
+          const size_t width) {
+  for (size_t l = 0; l < width; ++l) {
+    row[l] = valid[l] != 0.0f ? row[l] : 0.0f;
+  }
+}
+
+// column by column on a full tile of n*n x kLanes, each entry of L updated
+// by the earlier columns then scaled by the reciprocal of the diagonal.
+// returns 1 per lane that factorised in `valid`. the fixed width lets the
+// lane loops compile without remainders.
+void cholesky_tile(float* factors, float* inverse_diagonal, const size_t n,
+                   float* valid) {
+  const auto entry = [&](const size_t r, const size_t c) {
+    return factors + (r * n + c) * kLanes;
+  };
+  for (size_t j = 0; j < n; ++j) {
+    for (size_t i = j; i < n; ++i) {
+      for (size_t k = 0; k < j; ++k) {
+        subtract_product(entry(i, j), entry(i, k), entry(j, k), kLanes);
+      }
+    }
+    // the square roots stay scalar, the errno check on negative inputs
+    // keeps them from vectorising
+    float* diagonal = entry(j, j);
+    float* inverse = inverse_diagonal + j * kLanes;
+    for (size_t l = 0; l < kLanes; ++l) {
+      const bool positive = diagonal[l] > 0.0f;
+      valid[l] = positive ? valid[l] : 0.0f;
+      diagonal[l] = std::sqrt(positive ? diagonal[l] : 1.0f);
+      inverse[l] = 1.0f / diagonal[l];
+    }
+    for (size_t i = j + 1; i < n; ++i) {
+      scale(entry(i, j), inverse, kLanes);
+    }
+  }
+}
+
+// the same order for A = L D L^T with the products L_jk D_k of row j kept
+// in `scaled`, n x kLanes
+void ldlt_tile(float* factors, float* inverse_diagonal, const size_t n,
+               float* valid, float* scaled) {
+  const auto entry = [&](const size_t r, const size_t c) {
+    return factors + (r * n + c) * kLanes;
+  };
+  for (size_t j = 0; j < n; ++j) {
+    float* diagonal = entry(j, j);
+    for (size_t k = 0; k < j; ++k) {
+      float* __restrict product = scaled + k * kLanes;
+      const float* __restrict ljk = entry(j, k);
+      const float* __restrict dk = entry(k, k);
+      for (size_t l = 0; l < kLanes; ++l) {
+        product[l] = ljk[l] * dk[l];
+      }
+      subtract_product(diagonal, ljk, product, kLanes);
+    }
+    float* __restrict inverse = inverse_diagonal + j * kLanes;
+    for (size_t l = 0; l < kLanes; ++l) {
+      const bool nonzero = diagonal[l] != 0.0f;
+      valid[l] = nonzero ? valid[l] : 0.0f;
+      inverse[l] = 1.0f / (nonzero ? diagonal[l] : 1.0f);
+    }
+    for (size_t i = j + 1; i < n; ++i) {
+      for (size_t k = 0; k < j; ++k) {
+        subtract_product(entry(i, j), entry(i, k), scaled + k * kLanes,
+                         kLanes);
+      }
+      scale(entry(i, j), inverse, kLanes);
+    }
+  }
+}
+
+}  // namespace
+
+std::expected<void, MatError> BatchedSolver::factorize(const Mat& matrices) {
+  if (matrices.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (matrices.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  const size_t n = static_cast<size_t>(
+      std::lround(std::sqrt(static_cast<double>(matrices.rows()))));
+  if (n * n != matrices.rows()) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  const size_t batch = matrices.cols();
+  n_ = n;
+  ensure_shape(factors_, n * n, batch, 1);
+  ensure_shape(inverse_diagonal_, n, batch, 1);
+  valid_.assign(batch, 0);
+
+  const float* source = matrices.data();
+  float* factors = factors_.data();
+  float* inverse_diagonal = inverse_diagonal_.data();
+  const bool cholesky = method_ == BatchFactorization::Cholesky;
+  // a contiguous copy of the tile, its inverse diagonal and for ldlt the
+  // products L_jk D_k. rows of the Mats are a whole batch apart, too many
+  // streams at large strides for the caches and prefetchers.
+  const size_t scratch_size = (n * n + (cholesky ? 1 : 2) * n) * kLanes;
+  for_each_tile(
+      batch, n, scratch_size,
+      [&](const size_t first, const size_t width, float* scratch) {
+        float* tile = scratch;
+        float* inverse = tile + n * n * kLanes;
+        // lanes past the batch hold zero matrices, which fail harmlessly
+        for (size_t r = 0; r < n; ++r) {
+          for (size_t c = 0; c <= r; ++c) {
+            float* row = tile + (r * n + c) * kLanes;
+            std::memcpy(row, source + (r * n + c) * batch + first,
+                        width * sizeof(float));
+            std::fill(row + width, row + kLanes, 0.0f);
+          }
+        }
+        float valid[kLanes];
+        std::fill(valid, valid + kLanes, 1.0f);
+        if (cholesky) {
+          cholesky_tile(tile, inverse, n, valid);
+        } else {
+          ldlt_tile(tile, inverse, n, valid, inverse + n * kLanes);
+        }
+        // failed matrices solve to zero through a zero inverse diagonal
+        for (size_t r = 0; r < n; ++r) {
+          mask(inverse + r * kLanes, valid, width);
+          std::memcpy(inverse_diagonal + r * batch + first,
+                      inverse + r * kLanes, width * sizeof(float));
+          for (size_t c = 0; c < n; ++c) {
+            float* out = factors + (r * n + c) * batch + first;
+            if (c <= r) {
+              mask(tile + (r * n + c) * kLanes, valid, width);
+              std::memcpy(out, tile + (r * n + c) * kLanes,
+                          width * sizeof(float));
+            } else {
+              std::fill(out, out + width, 0.0f);
+            }
+          }
+        }
+        for (size_t l = 0; l < width; ++l) {
+          valid_[first + l] = valid[l] != 0.0f ? 1 : 0;
+        }
+      });
+  failures_ =
+      static_cast<size_t>(std::count(valid_.begin(), valid_.end(), 0));
+  return {};
+}
+
+std::expected<void, MatError> BatchedSolver::solve(const Mat& rhs,
+                                                   Mat& solutions) const {
+  if (n_ == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (rhs.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  const size_t batch = factors_.cols();
+  if (rhs.cols() != batch || rhs.rows() == 0 || rhs.rows() % n_ != 0) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (&solutions != &rhs) {
+    ensure_shape(solutions, rhs.rows(), batch, 1);
+    std::memcpy(solutions.data(), rhs.data(), rhs.size() * sizeof(float));
+  }
+
+  const size_t n = n_;
+  const size_t k = rhs.rows() / n;
+  const float* factors = factors_.data();
+  const float* inverse_diagonal = inverse_diagonal_.data();
+  float* x = solutions.data();
+  const bool cholesky = method_ == BatchFactorization::Cholesky;
+  for_each_tile(
+      batch, n, 0, [&](const size_t first, const size_t width, float*) {
+        const auto entry = [&](const size_t r, const size_t c) {
+          return factors + (r * n + c) * batch + first;
+        };
+        const auto inverse = [&](const size_t r) {
+          return inverse_diagonal + r * batch + first;
+        };
+        for (size_t column = 0; column < k; ++column) {
+          const auto value = [&](const size_t r) {
+            return x + (r * k + column) * batch + first;
+          };
+          // L y = b, then D z = y for ldlt, then L^T x = z
+          for (size_t i = 0; i < n; ++i) {
+            for (size_t p = 0; p < i; ++p) {
+              subtract_product(value(i), entry(i, p), value(p), width);
+            }
+            if (cholesky) {
+              scale(value(i), inverse(i), width);
+            }
+          }
+          if (!cholesky) {
+            for (size_t i = 0; i < n; ++i) {
+              scale(value(i), inverse(i), width);
+            }
+          }
+          for (size_t i = n; i-- > 0;) {
+            for (size_t p = i + 1; p < n; ++p) {
+              subtract_product(value(i), entry(p, i), value(p), width);
+            }
+            if (cholesky) {
+              scale(value(i), inverse(i), width);
+            }
+          }
+        }
+      });
+  return {};
+}
+
+std::expected<size_t, MatError> solve_batched(const Mat& matrices,
+                                              const Mat& rhs, Mat& solutions,
+                                              const BatchFactorization method) {
+  BatchedSolver solver(method);
+  if (auto factorized = solver.factorize(matrices); !factorized) {
+    return std::unexpected(factorized.error());
+  }
+  if (auto solved = solver.solve(rhs, solutions); !solved) {
+    return std::unexpected(solved.error());
+  }
+  return solver.failures();
+}
+
+};  // namespace core
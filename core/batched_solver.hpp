@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+enum class BatchFactorization {
+  Cholesky,  // A = L L^T, for symmetric positive definite matrices
+  Ldlt,      // A = L D L^T with unit L, no square roots, and symmetric
+             // indefinite matrices work as long as no pivot is zero
+};
+
+// factorises and solves many small symmetric systems at once, e.g. the
+// per-landmark or per-pixel normal equations of a least squares problem.
+//
+// a batch of B n x n matrices is an n*n x B single channel Mat with entry
+// (r, c) of matrix b at (r * n + c, b), and a batch of n x k right-hand
+// sides is n*k x B with entry (r, c) at (r * k + c, b). every row holds one
+// entry of all the matrices, so the kernels run across the batch with one
+// matrix per vector lane, over tiles of lanes that stay in cache.
+class BatchedSolver {
+ public:
+  explicit BatchedSolver(
+      BatchFactorization method = BatchFactorization::Cholesky) noexcept
+      : method_(method) {}
+
+  // reads the lower triangles. matrices whose factorisation breaks down, on
+  // a non-positive pivot for cholesky or a zero one for ldlt, are marked in
+  // valid() and solve to zero, the others are unaffected.
+  [[nodiscard]] std::expected<void, MatError> factorize(const Mat& matrices);
+  // solutions may be rhs
+  [[nodiscard]] std::expected<void, MatError> solve(const Mat& rhs,
+                                                    Mat& solutions) const;
+
+  [[nodiscard]] BatchFactorization method() const noexcept {
+    return method_;
+  }
+  [[nodiscard]] size_t dimension() const noexcept { return n_; }
+  [[nodiscard]] size_t batch_size() const noexcept { return factors_.cols(); }
+  // 1 for the matrices that factorised
+  [[nodiscard]] std::span<const uint8_t> valid() const noexcept {
+    return valid_;
+  }
+  [[nodiscard]] size_t failures() const noexcept { return failures_; }
+  // L in the batch layout with a zero upper triangle, the diagonal holds D
+  // for ldlt where L has a unit diagonal
+  [[nodiscard]] const Mat& factors() const noexcept { return factors_; }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  BatchFactorization method_;
+  size_t n_ = 0;
+  Mat factors_;
+  // reciprocals of the diagonal of L for cholesky and of D for ldlt, n x B
+  // and zero for invalid matrices
+  Mat inverse_diagonal_;
+  std::vector<uint8_t> valid_;
+  size_t failures_ = 0;
+};
+
+// factorises and solves in one go, returning the number of matrices that
+// failed to factorise and were solved to zero
+[[nodiscard]] std::expected<size_t, MatError> solve_batched(
+    const Mat& matrices, const Mat& rhs, Mat& solutions,
+    BatchFactorization method = BatchFactorization::Cholesky);
+
+};  // namespace core
@@ -0,0 +1,353 @@
+#include "core/connected_components.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 16;  // block or pixel rows
+// labels are stored as floats, exact up to 2^24
+constexpr size_t kMaxComponents = size_t{1} << 24;
+
+// union-find over provisional labels where a parent is never larger than
+// its child, so the root of a set is its smallest label. label 0 is the
+// background and never part of a set.
+uint32_t find_root(uint32_t* parent, uint32_t label) {
+  uint32_t root = label;
+  while (parent[root] != root) {
+    root = parent[root];
+  }
+  while (parent[label] != root) {
+    const uint32_t next = parent[label];
+    parent[label] = root;
+    label = next;
+  }
+  return root;
+}
+
+// only for labels of the calling thread's stripe
+uint32_t unite(uint32_t* parent, const uint32_t a, const uint32_t b) {
+  const uint32_t ra = find_root(parent, a);
+  const uint32_t rb = find_root(parent, b);
+  const auto [low, high] = std::minmax(ra, rb);
+  parent[high] = low;
+  return low;
+}
+
+// lock-free across stripes: a root is only ever relinked by a successful
+// compare-and-swap that still finds it a root, so concurrent unions retry
+// from the new roots instead of losing a link
+void unite_shared(uint32_t* parent, uint32_t a, uint32_t b) {
+  const auto find = [parent](uint32_t label) {
+    for (;;) {
+      const uint32_t next =
+          std::atomic_ref(parent[label]).load(std::memory_order_acquire);
+      if (next == label) {
+        return label;
+      }
+      label = next;
+    }
+  };
+  for (;;) {
+    a = find(a);
+    b = find(b);
+    if (a == b) {
+      return;
+    }
+    if (a < b) {
+      std::swap(a, b);
+    }
+    uint32_t expected = a;
+    if (std::atomic_ref(parent[a]).compare_exchange_strong(
+            expected, b, std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+}
+
+// calls join(label) for every block of the row above that is 8-connected
+// to the block at column bx with top row `top` and bottom row `bottom`
+// (nullptr past the last image row). the pixels next to the block are
+//
+//   h | i j | k     row above, blocks bx - 1, bx, bx + 1 of `above`
+//   n | o p |       top
+//   r | s t |       bottom
+//
+// and a pixel pair on different sides of a seam connects the blocks.
+template <typename Join>
+void join_above(const float* row_above, const float* top,
+                const uint32_t* above, const size_t cols, const size_t bx,
+                Join&& join) {
+  const size_t x = 2 * bx;
+  const bool right = x + 1 < cols;
+  const bool o = top[x] != 0.0f;
+  const bool p = right && top[x + 1] != 0.0f;
+  if (o && x > 0 && row_above[x - 1] != 0.0f) {
+    join(above[bx - 1]);
+  }
+  if ((o || p) &&
+      (row_above[x] != 0.0f || (right && row_above[x + 1] != 0.0f))) {
+    join(above[bx]);
+  }
+  if (p && x + 2 < cols && row_above[x + 2] != 0.0f) {
+    join(above[bx + 1]);
+  }
+}
+
+// provisional labels of the 2x2 blocks in block rows [lo, hi), the first
+// new label is `next`. returns one past the last label handed out.
+uint32_t label_blocks(const Mat& mask, uint32_t* blocks, uint32_t* parent,
+                      const size_t lo, const size_t hi, uint32_t next) {
+  const size_t rows = mask.rows(), cols = mask.cols();
+  const size_t block_cols = (cols + 1) / 2;
+  for (size_t by = lo; by < hi; ++by) {
+    const size_t y = 2 * by;
+    const float* top = mask.data() + y * cols;
+    const float* bottom = y + 1 < rows ? top + cols : nullptr;
+    uint32_t* out = blocks + by * block_cols;
+    for (size_t bx = 0; bx < block_cols; ++bx) {
+      const size_t x = 2 * bx;
+      const bool right = x + 1 < cols;
+      const bool o = top[x] != 0.0f;
+      const bool p = right && top[x + 1] != 0.0f;
+      const bool s = bottom != nullptr && bottom[x] != 0.0f;
+      const bool t = bottom != nullptr && right && bottom[x + 1] != 0.0f;
+      if (!(o || p || s || t)) {
+        out[bx] = 0;
+        continue;
+      }
+
+      uint32_t label = 0;
+      const auto join = [&](const uint32_t other) {
+        if (label == 0) {
+          label = other;
+        } else if (label != other) {
+          label = unite(parent, label, other);
+        }
+      };
+      // the row above the stripe is joined at the seams
+      if (by > lo) {
+        join_above(top - cols, top, out - block_cols, cols, bx, join);
+      }
+      const bool left =
+          x > 0 && (top[x - 1] != 0.0f ||
+                    (bottom != nullptr && bottom[x - 1] != 0.0f));
+      if (left && (o || s)) {
+        join(out[bx - 1]);
+      }
+      if (label == 0) {
+        label = next++;
+        parent[label] = label;
+      }
+      out[bx] = label;
+    }
+  }
+  return next;
+}
+
+// provisional labels of the pixels in rows [lo, hi), as label_blocks
+uint32_t label_pixels(const Mat& mask, uint32_t* pixels, uint32_t* parent,
+                      const size_t lo, const size_t hi, uint32_t next) {
+  const size_t cols = mask.cols();
+  for (size_t y = lo; y < hi; ++y) {
+    const float* row = mask.data() + y * cols;
+    uint32_t* out = pixels + y * cols;
+    const uint32_t* above = y > lo ? out - cols : nullptr;
+    for (size_t x = 0; x < cols; ++x) {
+      if (row[x] == 0.0f) {
+        out[x] = 0;
+        continue;
+      }
+      const uint32_t up = above != nullptr ? above[x] : 0;
+      const uint32_t left = x > 0 ? out[x - 1] : 0;
+      uint32_t label = up != 0 ? up : left;
+      if (up != 0 && left != 0 && up != left) {
+        label = unite(parent, up, left);
+      } else if (label == 0) {
+        label = next++;
+        parent[label] = label;
+      }
+      out[x] = label;
+    }
+  }
+  return next;
+}
+
+// writes the final labels of pixel rows [lo, hi) and accumulates the stats
+// of every run of equal labels in a row at once
+template <bool Blocks, typename Accumulator>
+void finish_rows(const Mat& mask, const uint32_t* cells,
+                 const uint32_t* final_labels, const size_t lo,
+                 const size_t hi, float* labels, Accumulator* stats) {
+  const size_t cols = mask.cols();
+  const size_t cell_cols = Blocks ? (cols + 1) / 2 : cols;
+  for (size_t y = lo; y < hi; ++y) {
+    const float* in = mask.data() + y * cols;
+    const uint32_t* cell_row = cells + (Blocks ? y / 2 : y) * cell_cols;
+    float* out = labels + y * cols;
+    size_t run_start = 0;
+    uint32_t run_label = 0;
+    for (size_t x = 0; x < cols; ++x) {
+      const uint32_t label =
+          in[x] != 0.0f ? final_labels[cell_row[Blocks ? x / 2 : x]] : 0;
+      if (label != run_label) {
+        if (run_label != 0) {
+          stats[run_label - 1].add_run(run_start, x, y);
+        }
+        run_label = label;
+        run_start = x;
+      }
+      out[x] = static_cast<float>(label);
+    }
+    if (run_label != 0) {
+      stats[run_label - 1].add_run(run_start, cols, y);
+    }
+  }
+}
+
+}  // namespace
+
+std::expected<void, MatError> ComponentLabeler::label(
+    const Mat& mask, Components& components) {
+  if (mask.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (mask.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  const size_t rows = mask.rows(), cols = mask.cols();
+  const bool blocks = connectivity_ == Connectivity::Eight;
+  const size_t cell_rows = blocks ? (rows + 1) / 2 : rows;
+  const size_t cell_cols = blocks ? (cols + 1) / 2 : cols;
+  const size_t num_cells = cell_rows * cell_cols;
+  if (num_cells >= std::numeric_limits<uint32_t>::max()) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+
+  // a stripe starting at cell row lo hands out labels from lo * cell_cols +
+  // 1, which no stripe above can reach, so stripes label independently and
+  // label order follows raster order. every cell is written, and every
+  // parent that is read was written first, so nothing is cleared.
+  cells_.resize(num_cells);
+  parent_.resize(num_cells + 1);
+  const size_t stripes = num_chunks(cell_rows, kMinRowsPerChunk);
+  stripe_begin_.resize(stripes);
+  stripe_end_.resize(stripes);
+  uint32_t* const cells = cells_.data();
+  uint32_t* const parent = parent_.data();
+  parallel_for_chunks(
+      0, cell_rows,
+      [&](const size_t stripe, const size_t lo, const size_t hi) {
+        const auto first = static_cast<uint32_t>(lo * cell_cols + 1);
+        stripe_begin_[stripe] = lo;
+        const auto label = blocks ? label_blocks : label_pixels;
+        stripe_end_[stripe] = label(mask, cells, parent, lo, hi, first);
+      },
+      kMinRowsPerChunk);
+
+  // seams between stripes
+  parallel_for(1, stripes, [&](const size_t lo, const size_t hi) {
+    for (size_t stripe = lo; stripe < hi; ++stripe) {
+      const size_t row = stripe_begin_[stripe];
+      const uint32_t* below = cells + row * cell_cols;
+      const uint32_t* above = below - cell_cols;
+      for (size_t x = 0; x < cell_cols; ++x) {
+        if (below[x] == 0) {
+          continue;
+        }
+        const auto join = [&](const uint32_t other) {
+          unite_shared(parent, below[x], other);
+        };
+        if (!blocks) {
+          if (above[x] != 0) {
+            join(above[x]);
+          }
+          continue;
+        }
+        const float* top = mask.data() + 2 * row * cols;
+        join_above(top - cols, top, above, cols, x, join);
+      }
+    }
+  });
+
+  // roots become consecutive final labels in increasing order. parents are
+  // smaller than their children, so by the time a label is reached its
+  // parent already holds the final label.
+  uint32_t count = 0;
+  for (size_t stripe = 0; stripe < stripes; ++stripe) {
+    const auto first =
+        static_cast<uint32_t>(stripe_begin_[stripe] * cell_cols + 1);
+    for (uint32_t label = first; label < stripe_end_[stripe]; ++label) {
+      parent[label] = parent[label] == label ? ++count : parent[parent[label]];
+    }
+  }
+  if (count > kMaxComponents) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+
+  // final labels and stats, with per chunk accumulators. their number is
+  // capped so they take at most a few bytes per pixel when there are many
+  // components.
+  Mat& labels = components.labels;
+  if (labels.rows() != rows || labels.cols() != cols ||
+      labels.channels() != 1) {
+    labels = Mat(rows, cols, 1);
+  }
+  const size_t min_rows =
+      std::max(kMinRowsPerChunk, 4 * static_cast<size_t>(count) / cols);
+  accumulators_.resize(num_chunks(rows, min_rows));
+  parallel_for_chunks(
+      0, rows,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        std::vector<Accumulator>& stats = accumulators_[chunk];
+        stats.assign(count, Accumulator{});
+        const auto finish = blocks ? finish_rows<true, Accumulator>
+                                   : finish_rows<false, Accumulator>;
+        finish(mask, cells, parent, lo, hi, labels.data(), stats.data());
+      },
+      min_rows);
+
+  components.stats.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    Accumulator total = accumulators_[0][i];
+    for (size_t chunk = 1; chunk < accumulators_.size(); ++chunk) {
+      const Accumulator& other = accumulators_[chunk][i];
+      total.area += other.area;
+      total.sum_x += other.sum_x;
+      total.sum_y += other.sum_y;
+      total.min_x = std::min(total.min_x, other.min_x);
+      total.min_y = std::min(total.min_y, other.min_y);
+      total.max_x = std::max(total.max_x, other.max_x);
+      total.max_y = std::max(total.max_y, other.max_y);
+    }
+    ComponentStats& stats = components.stats[i];
+    stats.area = total.area;
+    stats.min_x = total.min_x;
+    stats.min_y = total.min_y;
+    stats.max_x = total.max_x;
+    stats.max_y = total.max_y;
+    stats.centroid_x = static_cast<float>(static_cast<double>(total.sum_x) /
+                                          static_cast<double>(total.area));
+    stats.centroid_y = static_cast<float>(static_cast<double>(total.sum_y) /
+                                          static_cast<double>(total.area));
+  }
+  return {};
+}
+
+std::expected<Components, MatError> connected_components(
+    const Mat& mask, const Connectivity connectivity) {
+  Components components;
+  ComponentLabeler labeler(connectivity);
+  if (auto status = labeler.label(mask, components); !status) {
+    return std::unexpected(status.error());
+  }
+  return components;
+}
+
+};  // namespace core
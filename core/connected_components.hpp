@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <expected>
+#include <limits>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+enum class Connectivity {
+  Four,   // edge neighbours
+  Eight,  // edge and corner neighbours
+};
+
+struct ComponentStats {
+  size_t area = 0;  // pixels
+  // inclusive bounding box
+  size_t min_x = 0;
+  size_t min_y = 0;
+  size_t max_x = 0;
+  size_t max_y = 0;
+  float centroid_x = 0.0f;
+  float centroid_y = 0.0f;
+};
+
+struct Components {
+  // rows x cols, 0 on the background and i + 1 on the pixels of component i
+  Mat labels;
+  std::vector<ComponentStats> stats;
+};
+
+// labels the connected nonzero pixels of a single channel mask. the mask is
+// split into horizontal stripes that are scanned in parallel, with
+// 8-connectivity over 2x2 blocks (Grana et al. 2010) so a block needs one
+// provisional label and at most four neighbour tests, and with
+// 4-connectivity per pixel. provisional labels are merged by a union-find
+// that always links the larger root below the smaller one, plainly within
+// a stripe and by compare-and-swap across stripe seams. components are
+// numbered in raster order of their first block (pixel for
+// Connectivity::Four) whatever the number of threads, and their stats are
+// gathered per run of equal labels while the final labels are written. the
+// labeler keeps its buffers between calls.
+class ComponentLabeler {
+ public:
+  explicit ComponentLabeler(
+      const Connectivity connectivity = Connectivity::Eight)
+      : connectivity_(connectivity) {}
+
+  // `components.labels` keeps its buffer when the mask shape is unchanged
+  [[nodiscard]] std::expected<void, MatError> label(const Mat& mask,
+                                                    Components& components);
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  // sums of one component over a band of rows
+  struct Accumulator {
+    size_t area = 0;
+    size_t sum_x = 0;
+    size_t sum_y = 0;
+    size_t min_x = std::numeric_limits<size_t>::max();
+    size_t min_y = std::numeric_limits<size_t>::max();
+    size_t max_x = 0;
+    size_t max_y = 0;
+
+    // pixels [x0, x1) of row y
+    void add_run(const size_t x0, const size_t x1, const size_t y) noexcept {
+      const size_t n = x1 - x0;
+      area += n;
+      sum_x += n * (x0 + x1 - 1) / 2;
+      sum_y += n * y;
+      min_x = std::min(min_x, x0);
+      min_y = std::min(min_y, y);
+      max_x = std::max(max_x, x1 - 1);
+      max_y = std::max(max_y, y);
+    }
+  };
+
+  Connectivity connectivity_;
+  // provisional label of every 2x2 block or pixel, and the union-find
+  // parent of every provisional label, later its final label
+  std::vector<uint32_t> cells_;
+  std::vector<uint32_t> parent_;
+  // first cell row and one past the last label handed out, per stripe
+  std::vector<size_t> stripe_begin_;
+  std::vector<uint32_t> stripe_end_;
+  // per chunk of the final pass
+  std::vector<std::vector<Accumulator>> accumulators_;
+};
+
+// convenience wrapper around a temporary ComponentLabeler
+[[nodiscard]] std::expected<Components, MatError> connected_components(
+    const Mat& mask, Connectivity connectivity = Connectivity::Eight);
+
+};  // namespace core
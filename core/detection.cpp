@@ -0,0 +1,298 @@
+#include "core/detection.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 16;
+// kept boxes a candidate is tested against before checking for an early out
+constexpr size_t kIouBlock = 64;
+constexpr size_t kLanes = 8;
+
+void iou_kernel(const float ax0, const float ay0, const float ax1,
+                const float ay1, const float* __restrict bx0,
+                const float* __restrict by0, const float* __restrict bx1,
+                const float* __restrict by1, const size_t n,
+                float* __restrict out) noexcept {
+  const float area = (ax1 - ax0) * (ay1 - ay0);
+  for (size_t i = 0; i < n; ++i) {
+    const float w = std::max(std::min(ax1, bx1[i]) - std::max(ax0, bx0[i]),
+                             0.0f);
+    const float h = std::max(std::min(ay1, by1[i]) - std::max(ay0, by0[i]),
+                             0.0f);
+    const float intersection = w * h;
+    const float union_area =
+        area + (bx1[i] - bx0[i]) * (by1[i] - by0[i]) - intersection;
+    // the intersection is 0 whenever the union is, so no branch is needed
+    out[i] = intersection /
+             std::max(union_area, std::numeric_limits<float>::min());
+  }
+}
+
+// independent running maxima so the reduction vectorises
+float max_score(const float* scores, const size_t n) noexcept {
+  float lanes[kLanes];
+  std::fill(lanes, lanes + kLanes, -std::numeric_limits<float>::infinity());
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (size_t k = 0; k < kLanes; ++k) {
+      lanes[k] = std::max(lanes[k], scores[i + k]);
+    }
+  }
+  for (; i < n; ++i) {
+    lanes[0] = std::max(lanes[0], scores[i]);
+  }
+  return *std::max_element(lanes, lanes + kLanes);
+}
+
+bool consistent(const Boxes& boxes) noexcept {
+  const size_t n = boxes.size();
+  return boxes.x0.size() == n && boxes.y0.size() == n &&
+         boxes.x1.size() == n && boxes.y1.size() == n &&
+         boxes.classes.size() == n;
+}
+
+float sigmoid(const float x) noexcept { return 1.0f / (1.0f + std::exp(-x)); }
+
+}  // namespace
+
+void box_iou(const float x0, const float y0, const float x1, const float y1,
+             const Boxes& boxes, const size_t n, float* out) noexcept {
+  iou_kernel(x0, y0, x1, y1, boxes.x0.data(), boxes.y0.data(),
+             boxes.x1.data(), boxes.y1.data(), n, out);
+}
+
+Mat box_iou(const Boxes& a, const Boxes& b) {
+  Mat ious(a.size(), b.size(), 1);
+  parallel_for(
+      0, a.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          box_iou(a.x0[i], a.y0[i], a.x1[i], a.y1[i], b, b.size(),
+                  ious.data() + i * b.size());
+        }
+      },
+      kMinRowsPerChunk);
+  return ious;
+}
+
+std::vector<uint32_t> top_k(std::span<const float> scores, size_t k) {
+  std::vector<uint32_t> indices(scores.size());
+  std::iota(indices.begin(), indices.end(), 0u);
+  const auto before = [scores](const uint32_t a, const uint32_t b) {
+    return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+  };
+  k = std::min(k, indices.size());
+  if (k < indices.size()) {
+    std::nth_element(indices.begin(), indices.begin() + k, indices.end(),
+                     before);
+    indices.resize(k);
+  }
+  std::sort(indices.begin(), indices.end(), before);
+  return indices;
+}
+
+std::expected<std::vector<uint32_t>, MatError> non_max_suppression(
+    const Boxes& boxes, const NmsParams& params) {
+  if (!consistent(boxes)) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (!(params.iou_threshold >= 0.0f && params.iou_threshold <= 1.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  // max heap on (score, lower index)
+  std::vector<uint32_t> heap;
+  heap.reserve(boxes.size());
+  for (size_t i = 0; i < boxes.size(); ++i) {
+    if (boxes.scores[i] > params.score_threshold) {
+      heap.push_back(static_cast<uint32_t>(i));
+    }
+  }
+  const auto worse = [&](const uint32_t a, const uint32_t b) {
+    const float sa = boxes.scores[a], sb = boxes.scores[b];
+    return sa < sb || (sa == sb && a > b);
+  };
+  std::make_heap(heap.begin(), heap.end(), worse);
+
+  std::vector<uint32_t> keep;
+  Boxes kept;
+  float ious[kIouBlock];
+  while (!heap.empty() && keep.size() < params.max_detections) {
+    std::pop_heap(heap.begin(), heap.end(), worse);
+    const uint32_t c = heap.back();
+    heap.pop_back();
+    const uint32_t class_id = boxes.classes[c];
+
+    bool suppressed = false;
+    for (size_t begin = 0; begin < kept.size() && !suppressed;
+         begin += kIouBlock) {
+      const size_t n = std::min(kIouBlock, kept.size() - begin);
+      iou_kernel(boxes.x0[c], boxes.y0[c], boxes.x1[c], boxes.y1[c],
+                 kept.x0.data() + begin, kept.y0.data() + begin,
+                 kept.x1.data() + begin, kept.y1.data() + begin, n, ious);
+      const uint32_t* classes = kept.classes.data() + begin;
+      uint32_t any = 0;
+      for (size_t i = 0; i < n; ++i) {
+        const bool same = !params.class_aware || classes[i] == class_id;
+        any |= (ious[i] > params.iou_threshold && same) ? 1u : 0u;
+      }
+      suppressed = any != 0;
+    }
+    if (!suppressed) {
+      keep.push_back(c);
+      kept.push_back(boxes.x0[c], boxes.y0[c], boxes.x1[c], boxes.y1[c],
+                     boxes.scores[c], class_id);
+    }
+  }
+  return keep;
+}
+
+std::expected<std::vector<ScoredIndex>, MatError> soft_nms(
+    const Boxes& boxes, const SoftNmsParams& params) {
+  if (!consistent(boxes)) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (!(params.sigma > 0.0f) ||
+      !(params.iou_threshold >= 0.0f && params.iou_threshold <= 1.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  // remaining candidates in no particular order, removed by moving the
+  // last one into their slot
+  Boxes work;
+  std::vector<uint32_t> index;
+  for (size_t i = 0; i < boxes.size(); ++i) {
+    if (boxes.scores[i] > params.score_threshold) {
+      work.push_back(boxes.x0[i], boxes.y0[i], boxes.x1[i], boxes.y1[i],
+                     boxes.scores[i], boxes.classes[i]);
+      index.push_back(static_cast<uint32_t>(i));
+    }
+  }
+  std::vector<float> ious(work.size());
+  std::vector<uint32_t> overlapping(work.size());
+  size_t m = work.size();
+  const auto remove = [&](const size_t i) {
+    --m;
+    work.x0[i] = work.x0[m];
+    work.y0[i] = work.y0[m];
+    work.x1[i] = work.x1[m];
+    work.y1[i] = work.y1[m];
+    work.scores[i] = work.scores[m];
+    work.classes[i] = work.classes[m];
+    index[i] = index[m];
+    ious[i] = ious[m];
+  };
+
+  std::vector<ScoredIndex> keep;
+  const float inverse_sigma = 1.0f / params.sigma;
+  while (m > 0 && keep.size() < params.max_detections) {
+    // highest score, ties to the lower index
+    const float top = max_score(work.scores.data(), m);
+    uint32_t lowest = std::numeric_limits<uint32_t>::max();
+    for (size_t i = 0; i < m; ++i) {
+      lowest = std::min(lowest, work.scores[i] == top ? index[i] : lowest);
+    }
+    const auto best = static_cast<size_t>(
+        std::find(index.begin(), index.begin() + m, lowest) - index.begin());
+    const float bx0 = work.x0[best], by0 = work.y0[best];
+    const float bx1 = work.x1[best], by1 = work.y1[best];
+    const uint32_t class_id = work.classes[best];
+    keep.push_back({index[best], work.scores[best]});
+    remove(best);
+    box_iou(bx0, by0, bx1, by1, work, m, ious.data());
+
+    // most candidates do not overlap the kept box and keep their score, so
+    // the overlapping ones are gathered without branches first. they are
+    // decayed from the back, where a removal only moves in a candidate that
+    // was already handled or does not overlap.
+    size_t num_overlapping = 0;
+    for (size_t i = 0; i < m; ++i) {
+      const bool same = !params.class_aware || work.classes[i] == class_id;
+      overlapping[num_overlapping] = static_cast<uint32_t>(i);
+      num_overlapping += ious[i] > 0.0f && same ? 1 : 0;
+    }
+    for (size_t j = num_overlapping; j-- > 0;) {
+      const size_t i = overlapping[j];
+      const float iou = ious[i];
+      float& score = work.scores[i];
+      if (params.decay == SoftNmsDecay::Gaussian) {
+        score *= std::exp(-iou * iou * inverse_sigma);
+      } else if (iou > params.iou_threshold) {
+        score *= 1.0f - iou;
+      }
+      if (!(score > params.score_threshold)) {
+        remove(i);
+      }
+    }
+  }
+  return keep;
+}
+
+std::expected<void, MatError> decode_yolo(const Mat& output,
+                                          const float stride,
+                                          std::span<const Anchor> anchors,
+                                          const DecodeParams& params,
+                                          Boxes& boxes) {
+  const float threshold = params.score_threshold;
+  if (params.num_classes == 0 || !(stride > 0.0f) ||
+      !(threshold >= 0.0f && threshold < 1.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  const size_t per_box = 5 + params.num_classes;
+  const size_t num_anchors = anchors.empty() ? 1 : anchors.size();
+  if (output.channels() != num_anchors * per_box) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+
+  // sigmoid(objectness) <= threshold bounds the score by the threshold
+  const float objectness_threshold =
+      threshold > 0.0f ? std::log(threshold / (1.0f - threshold))
+                       : -std::numeric_limits<float>::infinity();
+  const size_t channels = output.channels();
+  for (size_t y = 0; y < output.rows(); ++y) {
+    for (size_t x = 0; x < output.cols(); ++x) {
+      const float* cell = output.data() + (y * output.cols() + x) * channels;
+      for (size_t a = 0; a < num_anchors; ++a) {
+        const float* t = cell + a * per_box;
+        if (!(t[4] > objectness_threshold)) {
+          continue;
+        }
+        const float* classes = t + 5;
+        const size_t best = static_cast<size_t>(
+            std::max_element(classes, classes + params.num_classes) -
+            classes);
+        const float score = sigmoid(t[4]) * sigmoid(classes[best]);
+        if (!(score > threshold)) {
+          continue;
+        }
+
+        float cx = 0.0f, cy = 0.0f, w = 0.0f, h = 0.0f;
+        if (anchors.empty()) {
+          cx = (t[0] + static_cast<float>(x)) * stride;
+          cy = (t[1] + static_cast<float>(y)) * stride;
+          w = std::exp(t[2]) * stride;
+          h = std::exp(t[3]) * stride;
+        } else {
+          cx = (2.0f * sigmoid(t[0]) - 0.5f + static_cast<float>(x)) * stride;
+          cy = (2.0f * sigmoid(t[1]) - 0.5f + static_cast<float>(y)) * stride;
+          const float sw = 2.0f * sigmoid(t[2]);
+          const float sh = 2.0f * sigmoid(t[3]);
+          w = sw * sw * anchors[a].width;
+          h = sh * sh * anchors[a].height;
+        }
+        boxes.push_back(cx - 0.5f * w, cy - 0.5f * h, cx + 0.5f * w,
+                        cy + 0.5f * h, score, static_cast<uint32_t>(best));
+      }
+    }
+  }
+  return {};
+}
+
+};  // namespace core
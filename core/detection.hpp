@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+// axis aligned boxes in structure of arrays form, corners in pixels with
+// x0 <= x1 and y0 <= y1. buffers keep their capacity across clear(), so a
+// detector can refill the same boxes every frame without allocating.
+struct Boxes {
+  std::vector<float> x0;
+  std::vector<float> y0;
+  std::vector<float> x1;
+  std::vector<float> y1;
+  std::vector<float> scores;
+  std::vector<uint32_t> classes;
+
+  [[nodiscard]] size_t size() const noexcept { return scores.size(); }
+  [[nodiscard]] bool empty() const noexcept { return scores.empty(); }
+
+  void clear() noexcept {
+    x0.clear();
+    y0.clear();
+    x1.clear();
+    y1.clear();
+    scores.clear();
+    classes.clear();
+  }
+
+  void resize(const size_t n) {
+    x0.resize(n);
+    y0.resize(n);
+    x1.resize(n);
+    y1.resize(n);
+    scores.resize(n);
+    classes.resize(n);
+  }
+
+  void reserve(const size_t n) {
+    x0.reserve(n);
+    y0.reserve(n);
+    x1.reserve(n);
+    y1.reserve(n);
+    scores.reserve(n);
+    classes.reserve(n);
+  }
+
+  void push_back(const float left, const float top, const float right,
+                 const float bottom, const float score,
+                 const uint32_t class_id) {
+    x0.push_back(left);
+    y0.push_back(top);
+    x1.push_back(right);
+    y1.push_back(bottom);
+    scores.push_back(score);
+    classes.push_back(class_id);
+  }
+};
+
+// intersection over union of box (x0, y0, x1, y1) with boxes [0, n) of
+// `boxes`, into out[0, n). written over flat arrays so it vectorises.
+void box_iou(float x0, float y0, float x1, float y1, const Boxes& boxes,
+             size_t n, float* out) noexcept;
+
+// a.size() x b.size() matrix of pairwise intersections over union, rows in
+// parallel
+[[nodiscard]] Mat box_iou(const Boxes& a, const Boxes& b);
+
+// indices of the k highest scores, highest first and ties by lower index
+[[nodiscard]] std::vector<uint32_t> top_k(std::span<const float> scores,
+                                          size_t k);
+
+struct NmsParams {
+  // a box is suppressed by a kept box that overlaps it by more than this
+  float iou_threshold = 0.5f;
+  // boxes scoring at or below this are dropped up front
+  float score_threshold = 0.0f;
+  size_t max_detections = 300;
+  // only boxes of the same class suppress each other
+  bool class_aware = true;
+};
+
+// greedy non-maximum suppression. candidates are ordered lazily through a
+// heap, so with max_detections reached early most of them are never
+// sorted, and every candidate is tested against the kept boxes with the
+// batched iou in blocks that stop at the first suppressing box. returns
+// the kept indices by decreasing score.
+[[nodiscard]] std::expected<std::vector<uint32_t>, MatError>
+non_max_suppression(const Boxes& boxes, const NmsParams& params = {});
+
+enum class SoftNmsDecay {
+  Linear,    // score * (1 - iou) above iou_threshold
+  Gaussian,  // score * exp(-iou^2 / sigma)
+};
+
+struct SoftNmsParams {
+  SoftNmsDecay decay = SoftNmsDecay::Gaussian;
+  float sigma = 0.5f;
+  float iou_threshold = 0.3f;  // linear decay only
+  // boxes whose score decays to or below this are dropped
+  float score_threshold = 0.001f;
+  size_t max_detections = 300;
+  bool class_aware = true;
+};
+
+struct ScoredIndex {
+  uint32_t index = 0;
+  float score = 0.0f;  // after decay
+};
+
+// soft-nms (Bodla et al. 2017): instead of discarding overlapping boxes the
+// best remaining box decays their scores. the remaining candidates live in
+// compact arrays, so every kept box costs one batched iou pass and decays
+// only the candidates it overlaps. ties go to the lower index, and the kept
+// boxes are returned in the order they were selected.
+[[nodiscard]] std::expected<std::vector<ScoredIndex>, MatError> soft_nms(
+    const Boxes& boxes, const SoftNmsParams& params = {});
+
+struct Anchor {
+  float width = 0.0f;  // pixels
+  float height = 0.0f;
+};
+
+struct DecodeParams {
+  size_t num_classes = 80;
+  // objectness times the best class probability must exceed this
+  float score_threshold = 0.25f;
+};
+
+// appends the boxes of one raw yolo head to `boxes`. `output` holds the
+// logits of a grid_rows x grid_cols grid with, per cell and anchor, 5 +
+// num_classes channels (tx, ty, tw, th, objectness, classes...), anchors
+// outermost. with anchors, boxes follow yolov5: center (2 sigmoid(t) - 0.5
+// + cell) * stride and size (2 sigmoid(t))^2 * anchor. without, one box
+// per cell follows yolox: center (t + cell) * stride and size exp(t) *
+// stride. cells whose objectness logit is already below the threshold are
+// skipped before any exp and the best class is taken on logits, so only
+// surviving cells pay for exps, and nothing is allocated beyond `boxes`.
+[[nodiscard]] std::expected<void, MatError> decode_yolo(
+    const Mat& output, float stride, std::span<const Anchor> anchors,
+    const DecodeParams& params, Boxes& boxes);
+
+};  // namespace core
@@ -0,0 +1,203 @@
+#include "core/distance_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinColsPerChunk = 64;
+constexpr size_t kMinRowsPerChunk = 16;
+constexpr size_t kMaxSide = size_t{1} << 20;
+
+// nearest feature row of every pixel of columns [lo, hi) within its column,
+// or kNoFeature. the sweep down keeps the nearest feature at or above, the
+// sweep up the nearest at or below, and both run across the band.
+void column_pass(const Mat& mask, uint32_t* nearest, const size_t lo,
+                 const size_t hi) {
+  const size_t rows = mask.rows(), cols = mask.cols();
+  const size_t width = hi - lo;
+  for (size_t y = 0; y < rows; ++y) {
+    const float* in = mask.data() + y * cols + lo;
+    uint32_t* out = nearest + y * cols + lo;
+    const auto row = static_cast<uint32_t>(y);
+    if (y == 0) {
+      for (size_t i = 0; i < width; ++i) {
+        out[i] = in[i] != 0.0f ? row : kNoFeature;
+      }
+      continue;
+    }
+    const uint32_t* above = out - cols;
+    for (size_t i = 0; i < width; ++i) {
+      out[i] = in[i] != 0.0f ? row : above[i];
+    }
+  }
+
+  std::vector<uint32_t> below(width, kNoFeature);
+  for (size_t y = rows; y-- > 0;) {
+    const float* in = mask.data() + y * cols + lo;
+    uint32_t* out = nearest + y * cols + lo;
+    const auto row = static_cast<uint32_t>(y);
+    for (size_t i = 0; i < width; ++i) {
+      const uint32_t down = in[i] != 0.0f ? row : below[i];
+      below[i] = down;
+      const uint32_t up = out[i];
+      const uint32_t up_distance = up == kNoFeature ? kNoFeature : row - up;
+      const uint32_t down_distance =
+          down == kNoFeature ? kNoFeature : down - row;
+      out[i] = down_distance < up_distance ? down : up;
+    }
+  }
+}
+
+// per thread buffers of the row pass
+struct Envelope {
+  std::vector<uint32_t> rows;  // nearest feature row per column
+  std::vector<int64_t> h;      // parabola height at x = 0 per column
+  std::vector<uint32_t> v;     // columns of the parabolas in the envelope
+  // parabola k > 0 is the lowest from z_num[k] / z_den[k] on
+  std::vector<int64_t> z_num;
+  std::vector<int64_t> z_den;
+};
+
+// lower envelope of the parabolas (x - q)^2 + f(q) over the columns q of row
+// y that have a feature in their column. their intersections are kept as
+// exact fractions, so no division is on the path of the envelope updates.
+// with `indices` the nearest rows of the row are replaced by the row major
+// index of the nearest feature.
+void row_pass(const size_t y, const size_t cols, uint32_t* nearest,
+              const bool indices, float* distances, Envelope& envelope) {
+  uint32_t* nearest_row = nearest + y * cols;
+  uint32_t* rows = envelope.rows.data();
+  int64_t* h = envelope.h.data();
+  uint32_t* v = envelope.v.data();
+  int64_t* z_num = envelope.z_num.data();
+  int64_t* z_den = envelope.z_den.data();
+  std::copy(nearest_row, nearest_row + cols, rows);
+
+  size_t k = 0;
+  bool empty = true;
+  for (size_t x = 0; x < cols; ++x) {
+    if (rows[x] == kNoFeature) {
+      continue;
+    }
+    const int64_t q = static_cast<int64_t>(x);
+    const int64_t dy = static_cast<int64_t>(y) - rows[x];
+    h[x] = dy * dy + q * q;
+    if (empty) {
+      empty = false;
+      v[0] = static_cast<uint32_t>(x);
+      continue;
+    }
+    // pop parabolas that start at or after the intersection with the new
+    // one, the first parabola starts at -inf
+    int64_t num = 0, den = 1;
+    for (;;) {
+      const int64_t p = v[k];
+      num = h[x] - h[p];
+      den = 2 * (q - p);
+      if (k == 0 || num * z_den[k] > z_num[k] * den) {
+        break;
+      }
+      --k;
+    }
+    ++k;
+    v[k] = static_cast<uint32_t>(x);
+    z_num[k] = num;
+    z_den[k] = den;
+  }
+
+  float* out = distances + y * cols;
+  if (empty) {
+    std::fill(out, out + cols, std::numeric_limits<float>::infinity());
+    return;
+  }
+  // parabola i is the lowest on the columns x with z[i] < x <= z[i + 1],
+  // so it ends before floor(z[i + 1]) + 1
+  size_t begin = 0;
+  for (size_t i = 0; i <= k; ++i) {
+    size_t end = cols;
+    if (i < k) {
+      const int64_t num = z_num[i + 1], den = z_den[i + 1];
+      const int64_t last = num >= 0 ? num / den : -((den - 1 - num) / den);
+      end = static_cast<size_t>(std::clamp<int64_t>(
+          last + 1, static_cast<int64_t>(begin),
+          static_cast<int64_t>(cols)));
+    }
+    const uint32_t p = v[i];
+    const auto fp = static_cast<float>(h[p] - int64_t{p} * p);
+    for (size_t x = begin; x < end; ++x) {
+      const float dx = static_cast<float>(x) - static_cast<float>(p);
+      out[x] = std::sqrt(dx * dx + fp);
+    }
+    if (indices) {
+      std::fill(nearest_row + begin, nearest_row + end,
+                rows[p] * static_cast<uint32_t>(cols) + p);
+    }
+    begin = end;
+  }
+}
+
+std::expected<Mat, MatError> transform(const Mat& mask,
+                                       std::vector<uint32_t>& nearest,
+                                       const bool indices) {
+  if (mask.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (mask.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  // indices must stay below kNoFeature, and the cross products of envelope
+  // intersections within 64 bits
+  if (mask.size() >= kNoFeature || mask.rows() > kMaxSide ||
+      mask.cols() > kMaxSide) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  const size_t rows = mask.rows(), cols = mask.cols();
+  nearest.resize(mask.size());
+  parallel_for(
+      0, cols,
+      [&](const size_t lo, const size_t hi) {
+        column_pass(mask, nearest.data(), lo, hi);
+      },
+      kMinColsPerChunk);
+
+  Mat distances(rows, cols, 1);
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        Envelope envelope;
+        envelope.rows.resize(cols);
+        envelope.h.resize(cols);
+        envelope.v.resize(cols);
+        envelope.z_num.resize(cols);
+        envelope.z_den.resize(cols);
+        for (size_t y = lo; y < hi; ++y) {
+          row_pass(y, cols, nearest.data(), indices, distances.data(),
+                   envelope);
+        }
+      },
+      kMinRowsPerChunk);
+  return distances;
+}
+
+}  // namespace
+
+std::expected<Mat, MatError> distance_transform(const Mat& mask) {
+  std::vector<uint32_t> nearest_rows;
+  return transform(mask, nearest_rows, false);
+}
+
+std::expected<Mat, MatError> distance_transform(
+    const Mat& mask, std::vector<uint32_t>& nearest) {
+  auto distances = transform(mask, nearest, true);
+  if (!distances) {
+    nearest.clear();
+  }
+  return distances;
+}
+
+};  // namespace core
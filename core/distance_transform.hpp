@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <limits>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+// nearest feature index of every pixel when the mask has no features
+inline constexpr uint32_t kNoFeature = std::numeric_limits<uint32_t>::max();
+
+// exact euclidean distance from every pixel to the nearest nonzero pixel
+// (feature) of a single channel mask, 0 on features and infinity everywhere
+// when there are none. separable in linear time (Felzenszwalb & Huttenlocher
+// 2012): the column pass tracks the nearest feature row of every pixel with
+// one sweep down and one up, over bands of columns in parallel and
+// vectorised across the columns of a band, and the row pass takes the lower
+// envelope of the parabolas rooted at every column of a row, rows in
+// parallel.
+[[nodiscard]] std::expected<Mat, MatError> distance_transform(const Mat& mask);
+
+// also fills `nearest` with the row major index y * cols + x of the nearest
+// feature of every pixel, or kNoFeature
+[[nodiscard]] std::expected<Mat, MatError> distance_transform(
+    const Mat& mask, std::vector<uint32_t>& nearest);
+
+};  // namespace core
@@ -0,0 +1,618 @@
+#include "core/edge_filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 16;
+constexpr size_t kMinCellRowsPerChunk = 2;
+// empty cells on both ends of every grid axis, the reach of the blur
+constexpr size_t kPad = 2;
+// range cells at most, which keeps the depth well within a size_t
+constexpr float kMaxDepth = 4096.0f;
+// grid cells per image pixel at most, past a floor that leaves small
+// images their padding. finer sigmas make a grid larger than the image,
+// where filtering directly is cheaper anyway.
+constexpr size_t kMaxCellsPerPixel = 4;
+constexpr size_t kMinMaxCells = size_t{1} << 16;
+constexpr size_t kLanes = 8;
+
+void ensure_shape(Mat& mat, const size_t rows, const size_t cols,
+                  const size_t channels) {
+  if (mat.rows() != rows || mat.cols() != cols ||
+      mat.channels() != channels) {
+    mat = Mat(rows, cols, channels);
+  }
+}
+
+struct GridShape {
+  size_t height = 0;  // cells, padding included
+  size_t width = 0;
+  size_t depth = 0;
+  size_t values = 0;  // per cell
+  float inverse_spatial = 0.0f;
+  float inverse_range = 0.0f;
+  float low = 0.0f;    // edge value at range cell kPad
+  float max_z = 0.0f;  // largest range coordinate of a pixel
+
+  [[nodiscard]] size_t cell_stride() const noexcept { return depth * values; }
+  [[nodiscard]] size_t row_stride() const noexcept {
+    return width * cell_stride();
+  }
+};
+
+// smallest and largest edge value, nans are skipped
+void value_range(const Mat& edge, float& low, float& high) {
+  float lows[kLanes], highs[kLanes];
+  std::fill(lows, lows + kLanes, std::numeric_limits<float>::infinity());
+  std::fill(highs, highs + kLanes, -std::numeric_limits<float>::infinity());
+  const float* values = edge.data();
+  const size_t n = edge.size();
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (size_t k = 0; k < kLanes; ++k) {
+      lows[k] = std::min(lows[k], values[i + k]);
+      highs[k] = std::max(highs[k], values[i + k]);
+    }
+  }
+  for (; i < n; ++i) {
+    lows[0] = std::min(lows[0], values[i]);
+    highs[0] = std::max(highs[0], values[i]);
+  }
+  low = *std::min_element(lows, lows + kLanes);
+  high = *std::max_element(highs, highs + kLanes);
+  if (!(low <= high)) {
+    low = high = 0.0f;
+  }
+}
+
+// floor of a non-negative grid coordinate, through int since converting a
+// float to size_t takes a branch on x86
+inline size_t cell_of(const float coordinate) {
+  return static_cast<size_t>(static_cast<int>(coordinate));
+}
+
+// range coordinate of an edge value, nans go to the first cell
+inline float range_coordinate(const GridShape& shape, const float value) {
+  return std::min(shape.max_z,
+                  std::max(0.0f, (value - shape.low) * shape.inverse_range));
+}
+
+// adds (pixel, 1) of the pixels of one image row to their nearest cells in
+// grid row `cells`. Channels is 0 when the channel count is only known at
+// run time.
+template <size_t Channels>
+void splat_row(const float* pixels, const float* edges, const size_t cols,
+               const GridShape& shape, float* cells) {
+  const size_t values = Channels > 0 ? Channels + 1 : shape.values;
+  const size_t channels = values - 1;
+  const size_t next_x = shape.cell_stride();
+  for (size_t x = 0; x < cols; ++x) {
+    const size_t cx =
+        cell_of(static_cast<float>(x) * shape.inverse_spatial + 0.5f);
+    const size_t cz = cell_of(range_coordinate(shape, edges[x]) + 0.5f);
+    const float* pixel = pixels + x * channels;
+    float* cell = cells + (cx + kPad) * next_x + (cz + kPad) * values;
+    for (size_t c = 0; c < channels; ++c) {
+      cell[c] += pixel[c];
+    }
+    cell[channels] += 1.0f;
+  }
+}
+
+// splats the image rows whose nearest grid row is in [lo, hi), so bands of
+// grid rows fill in parallel without sharing cells
+template <size_t Channels>
+void splat(const Mat& image, const Mat& edge, const GridShape& shape,
+           float* grid, const size_t lo, const size_t hi) {
+  const size_t rows = image.rows(), cols = image.cols();
+  const size_t channels = image.channels();
+  const size_t stride = shape.row_stride();
+  std::fill(grid + lo * stride, grid + hi * stride, 0.0f);
+
+  // the image rows of the band, widened by a row against rounding and
+  // checked per row below
+  const auto to_image = [&](const size_t cell_row) {
+    const double y = (static_cast<double>(cell_row) - kPad - 0.5) /
+                     static_cast<double>(shape.inverse_spatial);
+    return static_cast<size_t>(std::clamp(y, 0.0, static_cast<double>(rows)));
+  };
+  const size_t first = to_image(lo);
+  const size_t last = std::min(rows, to_image(hi) + 1);
+  for (size_t y = first > 0 ? first - 1 : 0; y < last; ++y) {
+    const size_t cy =
+        cell_of(static_cast<float>(y) * shape.inverse_spatial + 0.5f) + kPad;
+    if (cy >= lo && cy < hi) {
+      splat_row<Channels>(image.data() + y * cols * channels,
+                          edge.data() + y * cols, cols, shape,
+                          grid + cy * stride);
+    }
+  }
+}
+
+// [1 4 6 4 1] / 16 over `length` floats whose neighbours along the blurred
+// axis are `stride` floats apart
+void binomial(const float* __restrict in, float* __restrict out,
+              const size_t stride, const size_t length) {
+  const float* far_before = in - 2 * stride;
+  const float* before = in - stride;
+  const float* after = in + stride;
+  const float* far_after = in + 2 * stride;
+  for (size_t i = 0; i < length; ++i) {
+    out[i] = ((far_before[i] + far_after[i]) + 4.0f * (before[i] + after[i]) +
+              6.0f * in[i]) *
+             (1.0f / 16.0f);
+  }
+}
+
+// blurs grid rows [lo, hi) of `in` along one axis into `out`. padding cells
+// are written as zero, so the grid stays empty outside the splatted cells
+// and the blur never needs a bounds check.
+void blur_x(const float* in, float* out, const GridShape& shape,
+            const size_t lo, const size_t hi) {
+  const size_t cell = shape.cell_stride(), stride = shape.row_stride();
+  for (size_t y = lo; y < hi; ++y) {
+    const float* row_in = in + y * stride;
+    float* row_out = out + y * stride;
+    std::fill(row_out, row_out + kPad * cell, 0.0f);
+    binomial(row_in + kPad * cell, row_out + kPad * cell, cell,
+             (shape.width - 2 * kPad) * cell);
+    std::fill(row_out + (shape.width - kPad) * cell, row_out + stride, 0.0f);
+  }
+}
+
+void blur_y(const float* in, float* out, const GridShape& shape,
+            const size_t lo, const size_t hi) {
+  const size_t stride = shape.row_stride();
+  for (size_t y = lo; y < hi; ++y) {
+    float* row_out = out + y * stride;
+    if (y < kPad || y + kPad >= shape.height) {
+      std::fill(row_out, row_out + stride, 0.0f);
+    } else {
+      binomial(in + y * stride, row_out, stride, stride);
+    }
+  }
+}
+
+void blur_z(const float* in, float* out, const GridShape& shape,
+            const size_t lo, const size_t hi) {
+  const size_t cell = shape.cell_stride(), values = shape.values;
+  const size_t pad = kPad * values;
+  for (size_t y = lo; y < hi; ++y) {
+    for (size_t x = 0; x < shape.width; ++x) {
+      const size_t offset = (y * shape.width + x) * cell;
+      const float* column_in = in + offset;
+      float* column_out = out + offset;
+      std::fill(column_out, column_out + pad, 0.0f);
+      binomial(column_in + pad, column_out + pad, values, cell - 2 * pad);
+      std::fill(column_out + cell - pad, column_out + cell, 0.0f);
+    }
+  }
+}
+
+// trilinear interpolation of the blurred grid at the pixels of image rows
+// [lo, hi), normalised by the interpolated weight. the two grid rows around
+// an image row are blended once for the whole row, which leaves a bilinear
+// lookup per pixel.
+template <size_t Channels>
+void slice(const Mat& image, const Mat& edge, const GridShape& shape,
+           const float* grid, Mat& out, const size_t lo, const size_t hi) {
+  const size_t cols = image.cols();
+  const size_t values = Channels > 0 ? Channels + 1 : shape.values;
+  const size_t channels = values - 1;
+  const size_t next_x = shape.cell_stride(), stride = shape.row_stride();
+  std::vector<float> blended(stride);
+  float fixed[Channels + 1];
+  std::vector<float> buffer(Channels > 0 ? 0 : values);
+  float* sums = Channels > 0 ? fixed : buffer.data();
+  for (size_t y = lo; y < hi; ++y) {
+    const float fy = static_cast<float>(y) * shape.inverse_spatial;
+    const size_t cy = cell_of(fy);
+    const float wy = fy - static_cast<float>(cy);
+    const float* top = grid + (cy + kPad) * stride;
+    const float* bottom = top + stride;
+    for (size_t i = 0; i < stride; ++i) {
+      blended[i] = top[i] + wy * (bottom[i] - top[i]);
+    }
+
+    const float* pixels = image.data() + y * cols * channels;
+    const float* edges = edge.data() + y * cols;
+    float* filtered = out.data() + y * cols * channels;
+    for (size_t x = 0; x < cols; ++x) {
+      const float fx = static_cast<float>(x) * shape.inverse_spatial;
+      const size_t cx = cell_of(fx);
+      const float wx = fx - static_cast<float>(cx);
+      const float fz = range_coordinate(shape, edges[x]);
+      const size_t cz = cell_of(fz);
+      const float wz = fz - static_cast<float>(cz);
+
+      const float* cell =
+          blended.data() + (cx + kPad) * next_x + (cz + kPad) * values;
+      const float* right = cell + next_x;
+      const float w00 = (1.0f - wx) * (1.0f - wz), w01 = (1.0f - wx) * wz;
+      const float w10 = wx * (1.0f - wz), w11 = wx * wz;
+      for (size_t c = 0; c < values; ++c) {
+        sums[c] = w00 * cell[c] + w01 * cell[values + c] + w10 * right[c] +
+                  w11 * right[values + c];
+      }
+
+      const float* pixel = pixels + x * channels;
+      float* result = filtered + x * channels;
+      const float weight = sums[channels];
+      for (size_t c = 0; c < channels; ++c) {
+        result[c] = weight > 0.0f ? sums[c] / weight : pixel[c];
+      }
+    }
+  }
+}
+
+// mean of every channel over the (2 * radius + 1)^2 window around each
+// pixel, cut at the borders. bands of rows keep running column sums that
+// gain the row entering the window and lose the one leaving it, and every
+// row is then averaged through a prefix sum of its column sums, so the cost
+// does not depend on the radius. the sums are doubles so they do not drift
+// over tall images.
+void box_mean(const Mat& src, const size_t radius, Mat& dst) {
+  const size_t rows = src.rows(), cols = src.cols();
+  const size_t channels = src.channels(), width = cols * channels;
+  ensure_shape(dst, rows, cols, channels);
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        std::vector<double> sums(width, 0.0);
+        std::vector<double> prefix(width + channels, 0.0);
+        const auto add = [&](const size_t y) {
+          const float* in = src.data() + y * width;
+          for (size_t i = 0; i < width; ++i) {
+            sums[i] += in[i];
+          }
+        };
+        const auto subtract = [&](const size_t y) {
+          const float* in = src.data() + y * width;
+          for (size_t i = 0; i < width; ++i) {
+            sums[i] -= in[i];
+          }
+        };
+        for (size_t y = lo > radius ? lo - radius : 0;
+             y < std::min(rows, lo + radius + 1); ++y) {
+          add(y);
+        }
+
+        for (size_t y = lo; y < hi; ++y) {
+          if (y > lo) {
+            if (y + radius < rows) {
+              add(y + radius);
+            }
+            if (y > radius) {
+              subtract(y - radius - 1);
+            }
+          }
+          const size_t top = y > radius ? y - radius : 0;
+          const size_t bottom = std::min(rows, y + radius + 1);
+          for (size_t i = 0; i < width; ++i) {
+            prefix[i + channels] = prefix[i] + sums[i];
+          }
+
+          float* out = dst.data() + y * width;
+          const auto window = [&](const size_t x) {
+            const size_t left = x > radius ? x - radius : 0;
+            const size_t right = std::min(cols, x + radius + 1);
+            const double scale =
+                1.0 / static_cast<double>((bottom - top) * (right - left));
+            for (size_t c = 0; c < channels; ++c) {
+              out[x * channels + c] = static_cast<float>(
+                  (prefix[right * channels + c] - prefix[left * channels + c]) *
+                  scale);
+            }
+          };
+          // windows inside the row share a size and vectorise as one loop
+          const size_t begin = std::min(radius, cols);
+          const size_t end = cols > radius ? cols - radius : 0;
+          for (size_t x = 0; x < begin; ++x) {
+            window(x);
+          }
+          const double scale = 1.0 / static_cast<double>(
+                                         (bottom - top) * (2 * radius + 1));
+          const size_t reach = (radius + 1) * channels;
+          const size_t behind = radius * channels;
+          for (size_t i = begin * channels; i < end * channels; ++i) {
+            out[i] = static_cast<float>(
+                (prefix[i + reach] - prefix[i - behind]) * scale);
+          }
+          for (size_t x = std::max(begin, end); x < cols; ++x) {
+            window(x);
+          }
+        }
+      },
+      kMinRowsPerChunk);
+}
+
+}  // namespace
+
+std::expected<void, MatError> BilateralGrid::filter(const Mat& image,
+                                                    const Mat& edge,
+                                                    Mat& out) {
+  if (image.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (edge.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (edge.rows() != image.rows() || edge.cols() != image.cols()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (!(params_.sigma_spatial >= 1.0f) || !(params_.sigma_range > 0.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  float low = 0.0f, high = 0.0f;
+  value_range(edge, low, high);
+  GridShape shape;
+  shape.inverse_spatial = 1.0f / params_.sigma_spatial;
+  shape.inverse_range = 1.0f / params_.sigma_range;
+  shape.low = low;
+  shape.max_z = (high - low) * shape.inverse_range;
+  if (!(shape.max_z < kMaxDepth)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  // the last pixel along every axis still has a cell after its own
+  const auto cells = [&](const size_t n) {
+    return static_cast<size_t>(static_cast<float>(n - 1) *
+                               shape.inverse_spatial) +
+           2 + 2 * kPad;
+  };
+  shape.height = cells(image.rows());
+  shape.width = cells(image.cols());
+  shape.depth = static_cast<size_t>(shape.max_z) + 2 + 2 * kPad;
+  shape.values = image.channels() + 1;
+  if (shape.height * shape.width * shape.depth >
+      std::max(kMinMaxCells,
+               kMaxCellsPerPixel * image.rows() * image.cols())) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  const size_t grid_size = shape.height * shape.row_stride();
+  grid_.resize(grid_size);
+  scratch_.resize(grid_size);
+
+  float* grid = grid_.data();
+  float* scratch = scratch_.data();
+  ensure_shape(out, image.rows(), image.cols(), image.channels());
+  const auto run = [&]<size_t Channels>() {
+    const auto over_grid_rows = [&](auto&& pass) {
+      parallel_for(0, shape.height, pass, kMinCellRowsPerChunk);
+    };
+    over_grid_rows([&](const size_t lo, const size_t hi) {
+      splat<Channels>(image, edge, shape, grid, lo, hi);
+      blur_x(grid, scratch, shape, lo, hi);
+    });
+    // blur_y reads two rows past its band, which the neighbouring band's
+    // blur_z would be overwriting, so the two get passes of their own
+    over_grid_rows([&](const size_t lo, const size_t hi) {
+      blur_y(scratch, grid, shape, lo, hi);
+    });
+    over_grid_rows([&](const size_t lo, const size_t hi) {
+      blur_z(grid, scratch, shape, lo, hi);
+    });
+    parallel_for(
+        0, image.rows(),
+        [&](const size_t lo, const size_t hi) {
+          slice<Channels>(image, edge, shape, scratch, out, lo, hi);
+        },
+        kMinRowsPerChunk);
+  };
+  // gray and color images get unrolled per pixel loops
+  if (image.channels() == 1) {
+    run.template operator()<1>();
+  } else if (image.channels() == 3) {
+    run.template operator()<3>();
+  } else {
+    run.template operator()<0>();
+  }
+  return {};
+}
+
+std::expected<Mat, MatError> bilateral_filter(const Mat& image,
+                                              const BilateralParams& params) {
+  if (image.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  return joint_bilateral_filter(image, image, params);
+}
+
+std::expected<Mat, MatError> joint_bilateral_filter(
+    const Mat& image, const Mat& edge, const BilateralParams& params) {
+  BilateralGrid grid(params);
+  Mat out;
+  auto filtered = grid.filter(image, edge, out);
+  if (!filtered) {
+    return std::unexpected(filtered.error());
+  }
+  return out;
+}
+
+std::expected<void, MatError> GuidedFilter::filter(const Mat& guide,
+                                                   const Mat& source,
+                                                   Mat& out) {
+  if (source.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (guide.rows() != source.rows() || guide.cols() != source.cols()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (guide.channels() != 1 && guide.channels() != 3) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (!(params_.epsilon > 0.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  const size_t rows = source.rows(), cols = source.cols();
+  const size_t channels = source.channels();
+  const float epsilon = params_.epsilon;
+  // the guide is taken about its mean, so the float window means of its
+  // squares do not cancel away the variance of a region far from zero
+  float offset[3] = {};
+  {
+    double sums[3] = {};
+    for (size_t i = 0; i < guide.size(); ++i) {
+      sums[i % guide.channels()] += guide.data()[i];
+    }
+    for (size_t c = 0; c < guide.channels(); ++c) {
+      offset[c] = static_cast<float>(sums[c] / static_cast<double>(
+                                                   rows * cols));
+    }
+  }
+  const auto over_rows = [&](auto&& pass) {
+    parallel_for(
+        0, rows,
+        [&](const size_t lo, const size_t hi) {
+          for (size_t i = lo * cols; i < hi * cols; ++i) {
+            pass(i);
+          }
+        },
+        kMinRowsPerChunk);
+  };
+
+  if (guide.channels() == 1) {
+    // statistics (I, I^2, p..., I p...), coefficients (a..., b...)
+    ensure_shape(statistics_, rows, cols, 2 + 2 * channels);
+    over_rows([&](const size_t i) {
+      const float g = guide.data()[i] - offset[0];
+      const float* p = source.data() + i * channels;
+      float* s = statistics_.data() + i * statistics_.channels();
+      s[0] = g;
+      s[1] = g * g;
+      for (size_t c = 0; c < channels; ++c) {
+        s[2 + c] = p[c];
+        s[2 + channels + c] = g * p[c];
+      }
+    });
+    box_mean(statistics_, params_.radius, statistic_means_);
+
+    ensure_shape(coefficients_, rows, cols, 2 * channels);
+    over_rows([&](const size_t i) {
+      const float* m = statistic_means_.data() + i * statistics_.channels();
+      float* ab = coefficients_.data() + i * 2 * channels;
+      // rounding may still leave a flat window a variance below zero
+      const float variance = std::max(0.0f, m[1] - m[0] * m[0]);
+      const float inverse = 1.0f / (variance + epsilon);
+      for (size_t c = 0; c < channels; ++c) {
+        const float mean_p = m[2 + c];
+        const float a = (m[2 + channels + c] - m[0] * mean_p) * inverse;
+        ab[c] = a;
+        ab[channels + c] = mean_p - a * m[0];
+      }
+    });
+    box_mean(coefficients_, params_.radius, coefficient_means_);
+
+    ensure_shape(out, rows, cols, channels);
+    over_rows([&](const size_t i) {
+      const float g = guide.data()[i] - offset[0];
+      const float* ab = coefficient_means_.data() + i * 2 * channels;
+      float* q = out.data() + i * channels;
+      for (size_t c = 0; c < channels; ++c) {
+        q[c] = ab[c] * g + ab[channels + c];
+      }
+    });
+    return {};
+  }
+
+  // statistics (r, g, b, rr, rg, rb, gg, gb, bb, p..., (r p, g p, b p)...)
+  // and coefficients (a_r, a_g, a_b, b) per source channel
+  ensure_shape(statistics_, rows, cols, 9 + 4 * channels);
+  over_rows([&](const size_t i) {
+    const float* pixel = guide.data() + i * 3;
+    const float g[3] = {pixel[0] - offset[0], pixel[1] - offset[1],
+                        pixel[2] - offset[2]};
+    const float* p = source.data() + i * channels;
+    float* s = statistics_.data() + i * statistics_.channels();
+    s[0] = g[0];
+    s[1] = g[1];
+    s[2] = g[2];
+    s[3] = g[0] * g[0];
+    s[4] = g[0] * g[1];
+    s[5] = g[0] * g[2];
+    s[6] = g[1] * g[1];
+    s[7] = g[1] * g[2];
+    s[8] = g[2] * g[2];
+    for (size_t c = 0; c < channels; ++c) {
+      s[9 + c] = p[c];
+      float* products = s + 9 + channels + 3 * c;
+      products[0] = g[0] * p[c];
+      products[1] = g[1] * p[c];
+      products[2] = g[2] * p[c];
+    }
+  });
+  box_mean(statistics_, params_.radius, statistic_means_);
+
+  ensure_shape(coefficients_, rows, cols, 4 * channels);
+  over_rows([&](const size_t i) {
+    const float* m = statistic_means_.data() + i * statistics_.channels();
+    float* ab = coefficients_.data() + i * 4 * channels;
+    // covariance of the guide plus epsilon, inverted through its cofactors
+    const float s00 = std::max(0.0f, m[3] - m[0] * m[0]) + epsilon;
+    const float s01 = m[4] - m[0] * m[1];
+    const float s02 = m[5] - m[0] * m[2];
+    const float s11 = std::max(0.0f, m[6] - m[1] * m[1]) + epsilon;
+    const float s12 = m[7] - m[1] * m[2];
+    const float s22 = std::max(0.0f, m[8] - m[2] * m[2]) + epsilon;
+    const float i00 = s11 * s22 - s12 * s12;
+    const float i01 = s02 * s12 - s01 * s22;
+    const float i02 = s01 * s12 - s02 * s11;
+    const float i11 = s00 * s22 - s02 * s02;
+    const float i12 = s01 * s02 - s00 * s12;
+    const float i22 = s00 * s11 - s01 * s01;
+    const float inverse_determinant =
+        1.0f / (s00 * i00 + s01 * i01 + s02 * i02);
+    for (size_t c = 0; c < channels; ++c) {
+      const float mean_p = m[9 + c];
+      const float* products = m + 9 + channels + 3 * c;
+      const float c0 = products[0] - m[0] * mean_p;
+      const float c1 = products[1] - m[1] * mean_p;
+      const float c2 = products[2] - m[2] * mean_p;
+      const float a0 = (i00 * c0 + i01 * c1 + i02 * c2) * inverse_determinant;
+      const float a1 = (i01 * c0 + i11 * c1 + i12 * c2) * inverse_determinant;
+      const float a2 = (i02 * c0 + i12 * c1 + i22 * c2) * inverse_determinant;
+      float* coefficient = ab + 4 * c;
+      coefficient[0] = a0;
+      coefficient[1] = a1;
+      coefficient[2] = a2;
+      coefficient[3] = mean_p - a0 * m[0] - a1 * m[1] - a2 * m[2];
+    }
+  });
+  box_mean(coefficients_, params_.radius, coefficient_means_);
+
+  ensure_shape(out, rows, cols, channels);
+  over_rows([&](const size_t i) {
+    const float* pixel = guide.data() + i * 3;
+    const float g[3] = {pixel[0] - offset[0], pixel[1] - offset[1],
+                        pixel[2] - offset[2]};
+    const float* ab = coefficient_means_.data() + i * 4 * channels;
+    float* q = out.data() + i * channels;
+    for (size_t c = 0; c < channels; ++c) {
+      const float* coefficient = ab + 4 * c;
+      q[c] = coefficient[0] * g[0] + coefficient[1] * g[1] +
+             coefficient[2] * g[2] + coefficient[3];
+    }
+  });
+  return {};
+}
+
+std::expected<Mat, MatError> guided_filter(const Mat& guide,
+                                           const Mat& source,
+                                           const GuidedFilterParams& params) {
+  GuidedFilter filter(params);
+  Mat out;
+  auto filtered = filter.filter(guide, source, out);
+  if (!filtered) {
+    return std::unexpected(filtered.error());
+  }
+  return out;
+}
+
+};  // namespace core
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <expected>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+struct BilateralParams {
+  // gaussian widths in pixels and in edge image units, also the grid cell
+  // size along the spatial and range axes. the spatial one is at least a
+  // pixel, the edge values may span at most 4096 range cells, and the grid
+  // may have at most 4 cells per pixel of all but small images.
+  float sigma_spatial = 16.0f;
+  float sigma_range = 0.1f;
+};
+
+// bilateral filter through a bilateral grid (Chen, Paris & Durand 2007):
+// every pixel is accumulated into its nearest cell of a grid downsampled by
+// the sigmas, the grid is blurred with a separable 5-tap binomial along its
+// three axes and the output is sliced back out of it trilinearly. the grid
+// shrinks as the sigmas grow, so the cost per pixel does not depend on
+// the filter size. grid rows are splatted and blurred in parallel, image
+// rows are sliced in parallel, and the grid keeps its buffers between
+// calls.
+class BilateralGrid {
+ public:
+  explicit BilateralGrid(const BilateralParams& params = {})
+      : params_(params) {}
+
+  // filters every channel of `image` with range weights taken from the
+  // single channel `edge` of the same shape, `out` keeps its buffer when
+  // the shape is unchanged
+  [[nodiscard]] std::expected<void, MatError> filter(const Mat& image,
+                                                     const Mat& edge,
+                                                     Mat& out);
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  BilateralParams params_;
+  // (rows, cols, depth) cells of channels + 1 values, the last one the
+  // homogeneous weight, and the buffer the blur alternates with
+  std::vector<float> grid_;
+  std::vector<float> scratch_;
+};
+
+// convenience wrappers around a temporary BilateralGrid, the first filters
+// a single channel image by its own values
+[[nodiscard]] std::expected<Mat, MatError> bilateral_filter(
+    const Mat& image, const BilateralParams& params = {});
+[[nodiscard]] std::expected<Mat, MatError> joint_bilateral_filter(
+    const Mat& image, const Mat& edge, const BilateralParams& params = {});
+
+struct GuidedFilterParams {
+  // windows of (2 * radius + 1)^2 pixels, cut at the image borders
+  size_t radius = 8;
+  // regularisation of the local linear models in squared guide units,
+  // larger values smooth more
+  float epsilon = 0.01f;
+};
+
+// guided filter (He, Sun & Tang 2013): the output is a linear function of
+// the guide in every window, fit to the source by least squares and
+// averaged over the windows covering a pixel. the guide has 1 or 3
+// channels and the source any number. every statistic the fit needs is
+// packed into one multi-channel image and averaged with a single
+// separable running-sum box filter, so the cost per pixel does not depend
+// on the radius. it streams rows rather than building IntegralImage tables,
+// which for that many channels cost more than the filter. the filter keeps
+// its buffers between calls.
+class GuidedFilter {
+ public:
+  explicit GuidedFilter(const GuidedFilterParams& params = {})
+      : params_(params) {}
+
+  // `out` gets the shape of `source` and keeps its buffer when the shape is
+  // unchanged
+  [[nodiscard]] std::expected<void, MatError> filter(const Mat& guide,
+                                                     const Mat& source,
+                                                     Mat& out);
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  GuidedFilterParams params_;
+  // guide and source products, then their window means
+  Mat statistics_;
+  Mat statistic_means_;
+  // per window linear coefficients, then their means
+  Mat coefficients_;
+  Mat coefficient_means_;
+};
+
+// convenience wrapper around a temporary GuidedFilter
+[[nodiscard]] std::expected<Mat, MatError> guided_filter(
+    const Mat& guide, const Mat& source, const GuidedFilterParams& params = {});
+
+};  // namespace core
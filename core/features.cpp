@@ -0,0 +1,605 @@
+#include "core/features.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+// keypoints stay this far from the level edges so the orientation patch and
+// every rotated descriptor test fit inside the image
+constexpr int kBorder = 16;
+constexpr int kPatchRadius = 15;
+constexpr int kPatternRadius = 13;
+constexpr int kHarrisRadius = 3;
+constexpr size_t kBandRows = 32;
+constexpr size_t kAngleBins = 32;
+constexpr size_t kDescriptorBits = 256;
+constexpr size_t kFastBlock = 16;
+
+// bresenham circle of radius 3 in ring order, as (dx, dy)
+constexpr int kRing[16][2] = {{0, -3}, {1, -3}, {2, -2}, {3, -1},
+                              {3, 0},  {3, 1},  {2, 2},  {1, 3},
+                              {0, 3},  {-1, 3}, {-2, 2}, {-3, 1},
+                              {-3, 0}, {-3, -1}, {-2, -2}, {-1, -3}};
+
+struct TestPair {
+  int8_t x0, y0, x1, y1;
+};
+using Pattern = std::array<TestPair, kDescriptorBits>;
+
+// brief test locations drawn from an isotropic distribution around the
+// patch center (sum of three uniforms, sigma ~ patch / 5) and kept within
+// kPatternRadius so every rotation stays inside the patch
+constexpr Pattern make_pattern() {
+  Pattern pattern{};
+  uint32_t state = 0x2545f491u;
+  const auto coordinate = [&state] {
+    int sum = 0;
+    for (int i = 0; i < 3; ++i) {
+      state = state * 1664525u + 1013904223u;
+      sum += static_cast<int>((state >> 16) % 13) - 6;
+    }
+    return sum;
+  };
+  const auto point = [&](int8_t& x, int8_t& y) {
+    int px = 0, py = 0;
+    do {
+      px = coordinate();
+      py = coordinate();
+    } while (px * px + py * py > kPatternRadius * kPatternRadius);
+    x = static_cast<int8_t>(px);
+    y = static_cast<int8_t>(py);
+  };
+  for (TestPair& pair : pattern) {
+    do {
+      point(pair.x0, pair.y0);
+      point(pair.x1, pair.y1);
+    } while (pair.x0 == pair.x1 && pair.y0 == pair.y1);
+  }
+  return pattern;
+}
+
+constexpr Pattern kPattern = make_pattern();
+
+// the pattern rotated to the center of every angle bin, rounded to pixels
+const std::array<Pattern, kAngleBins>& rotated_patterns() {
+  static const std::array<Pattern, kAngleBins> patterns = [] {
+    std::array<Pattern, kAngleBins> rotated{};
+    for (size_t bin = 0; bin < kAngleBins; ++bin) {
+      const double angle = 2.0 * std::numbers::pi * static_cast<double>(bin) /
+                           static_cast<double>(kAngleBins);
+      const double c = std::cos(angle), s = std::sin(angle);
+      const auto rotate = [&](const int8_t x, const int8_t y, int8_t& rx,
+                              int8_t& ry) {
+        rx = static_cast<int8_t>(std::lround(c * x - s * y));
+        ry = static_cast<int8_t>(std::lround(s * x + c * y));
+      };
+      for (size_t i = 0; i < kDescriptorBits; ++i) {
+        const TestPair& pair = kPattern[i];
+        rotate(pair.x0, pair.y0, rotated[bin][i].x0, rotated[bin][i].y0);
+        rotate(pair.x1, pair.y1, rotated[bin][i].x1, rotated[bin][i].y1);
+      }
+    }
+    return rotated;
+  }();
+  return patterns;
+}
+
+// half widths of the circular orientation patch per row offset
+const std::array<int, kPatchRadius + 1>& patch_half_widths() {
+  static const std::array<int, kPatchRadius + 1> widths = [] {
+    std::array<int, kPatchRadius + 1> w{};
+    for (int dy = 0; dy <= kPatchRadius; ++dy) {
+      const int squared = kPatchRadius * kPatchRadius - dy * dy;
+      w[dy] = static_cast<int>(std::sqrt(static_cast<double>(squared)));
+    }
+    return w;
+  }();
+  return widths;
+}
+
+// rotates a 16-bit ring mask right by n
+inline uint16_t rotate(const uint16_t mask, const int n) noexcept {
+  return static_cast<uint16_t>((mask >> n) | (mask << (16 - n)));
+}
+
+// nonzero when the 16-bit ring mask has 9 contiguous set bits, wrapping
+// around
+inline uint16_t has_arc9(const uint16_t mask) noexcept {
+  uint16_t run = mask & rotate(mask, 1);  // runs of 2
+  run &= rotate(run, 2);                  // 4
+  run &= rotate(run, 4);                  // 8
+  return run & rotate(mask, 8);           // 9
+}
+
+// appends the columns in [x0, x1) of one row that are fast corners, `high`,
+// `low` and `possible` hold x1 - x0 + kFastBlock bytes.
+//
+// any 9-arc covers two neighbouring compass points of the ring, so a
+// vectorised pass over the row tests those first and the full ring is only
+// compared for 16-pixel blocks holding a pixel that passed. within a block
+// the ring bits 0-7 and 8-15 are collected in separate byte masks so every
+// step runs on 16 byte lanes.
+void fast_row(const uint8_t* __restrict row, const ptrdiff_t stride,
+              const int x0, const int x1, const int threshold,
+              uint8_t* __restrict high, uint8_t* __restrict low,
+              uint8_t* __restrict possible, std::vector<int32_t>& corners) {
+  const size_t width = static_cast<size_t>(x1 - x0);
+  row += x0;
+  for (size_t x = 0; x < width + kFastBlock; ++x) {
+    high[x] = static_cast<uint8_t>(std::min(row[x] + threshold, 255));
+    low[x] = static_cast<uint8_t>(std::max(row[x] - threshold, 0));
+  }
+  const uint8_t* __restrict north = row - 3 * stride;
+  const uint8_t* __restrict south = row + 3 * stride;
+  for (size_t x = 0; x < width + kFastBlock; ++x) {
+    const bool bn = north[x] > high[x], dn = north[x] < low[x];
+    const bool be = row[x + 3] > high[x], de = row[x + 3] < low[x];
+    const bool bs = south[x] > high[x], ds = south[x] < low[x];
+    const bool bw = row[x - 3] > high[x], dw = row[x - 3] < low[x];
+    possible[x] = static_cast<uint8_t>(
+        ((bn & be) | (be & bs) | (bs & bw) | (bw & bn)) |
+        ((dn & de) | (de & ds) | (ds & dw) | (dw & dn)));
+  }
+
+  for (size_t bx = 0; bx < width; bx += kFastBlock) {
+    uint64_t any[2];
+    std::memcpy(any, possible + bx, sizeof(any));
+    if ((any[0] | any[1]) == 0) {
+      continue;
+    }
+    uint8_t brighter_low[kFastBlock] = {}, brighter_high[kFastBlock] = {};
+    uint8_t darker_low[kFastBlock] = {}, darker_high[kFastBlock] = {};
+    for (int k = 0; k < 16; ++k) {
+      const uint8_t* __restrict ring =
+          row + bx + kRing[k][1] * stride + kRing[k][0];
+      const auto bit = static_cast<uint8_t>(1u << (k & 7));
+      uint8_t* __restrict brighter = k < 8 ? brighter_low : brighter_high;
+      uint8_t* __restrict darker = k < 8 ? darker_low : darker_high;
+      for (size_t x = 0; x < kFastBlock; ++x) {
+        brighter[x] |= ring[x] > high[bx + x] ? bit : 0;
+        darker[x] |= ring[x] < low[bx + x] ? bit : 0;
+      }
+    }
+    uint8_t flags[kFastBlock];
+    for (size_t x = 0; x < kFastBlock; ++x) {
+      const auto brighter =
+          static_cast<uint16_t>(brighter_low[x] | (brighter_high[x] << 8));
+      const auto darker =
+          static_cast<uint16_t>(darker_low[x] | (darker_high[x] << 8));
+      flags[x] = (has_arc9(brighter) | has_arc9(darker)) != 0;
+    }
+    std::memcpy(any, flags, sizeof(any));
+    if ((any[0] | any[1]) == 0) {
+      continue;
+    }
+    for (size_t x = 0; x < std::min(kFastBlock, width - bx); ++x) {
+      if (flags[x]) {
+        corners.push_back(static_cast<int32_t>(x0 + bx + x));
+      }
+    }
+  }
+}
+
+// fast score: the larger of the summed excess brightness and darkness of
+// the ring pixels beyond the threshold
+uint16_t fast_score(const uint8_t* pixel, const ptrdiff_t stride,
+                    const int threshold) {
+  const int center = *pixel;
+  int brighter = 0, darker = 0;
+  for (const auto& offset : kRing) {
+    const int value = pixel[offset[1] * stride + offset[0]];
+    brighter += std::max(value - center - threshold, 0);
+    darker += std::max(center - value - threshold, 0);
+  }
+  return static_cast<uint16_t>(std::max(brighter, darker));
+}
+
+// harris response over a 7x7 window of central differences, scaled as if
+// computed on [0, 1] intensities
+float harris_response(const uint8_t* pixels, const ptrdiff_t stride,
+                      const int x, const int y, const float k) {
+  int sxx = 0, syy = 0, sxy = 0;
+  for (int dy = -kHarrisRadius; dy <= kHarrisRadius; ++dy) {
+    const uint8_t* row = pixels + (y + dy) * stride + x;
+    for (int dx = -kHarrisRadius; dx <= kHarrisRadius; ++dx) {
+      const int gx = row[dx + 1] - row[dx - 1];
+      const int gy = row[dx + stride] - row[dx - stride];
+      sxx += gx * gx;
+      syy += gy * gy;
+      sxy += gx * gy;
+    }
+  }
+  constexpr float kScale = 1.0f / (510.0f * 510.0f);
+  const float a = static_cast<float>(sxx) * kScale;
+  const float b = static_cast<float>(syy) * kScale;
+  const float c = static_cast<float>(sxy) * kScale;
+  return a * b - c * c - k * (a + b) * (a + b);
+}
+
+// orientation of the intensity centroid of the circular patch
+float centroid_angle(const uint8_t* pixels, const ptrdiff_t stride,
+                     const int x, const int y) {
+  const auto& widths = patch_half_widths();
+  const uint8_t* center = pixels + y * stride + x;
+  int m10 = 0, m01 = 0;
+  for (int dx = -kPatchRadius; dx <= kPatchRadius; ++dx) {
+    m10 += dx * center[dx];
+  }
+  for (int dy = 1; dy <= kPatchRadius; ++dy) {
+    const uint8_t* below = center + dy * stride;
+    const uint8_t* above = center - dy * stride;
+    int row_sum = 0;
+    for (int dx = -widths[dy]; dx <= widths[dy]; ++dx) {
+      m10 += dx * (below[dx] + above[dx]);
+      row_sum += below[dx] - above[dx];
+    }
+    m01 += dy * row_sum;
+  }
+  return std::atan2(static_cast<float>(m01), static_cast<float>(m10));
+}
+
+// the rotated test pairs of every angle bin as offsets into a level with
+// the given row stride
+void build_test_offsets(const ptrdiff_t stride, std::vector<int32_t>& offsets) {
+  const auto& patterns = rotated_patterns();
+  offsets.resize(kAngleBins * 2 * kDescriptorBits);
+  for (size_t bin = 0; bin < kAngleBins; ++bin) {
+    for (size_t i = 0; i < kDescriptorBits; ++i) {
+      const TestPair& pair = patterns[bin][i];
+      int32_t* out = offsets.data() + (bin * kDescriptorBits + i) * 2;
+      out[0] = static_cast<int32_t>(pair.y0 * stride + pair.x0);
+      out[1] = static_cast<int32_t>(pair.y1 * stride + pair.x1);
+    }
+  }
+}
+
+Descriptor describe(const uint8_t* center, const int32_t* test_offsets,
+                    const float angle) {
+  const float turns = angle / (2.0f * std::numbers::pi_v<float>);
+  const auto bin = static_cast<size_t>(static_cast<int>(std::lround(
+                       turns * static_cast<float>(kAngleBins)))) &
+                   (kAngleBins - 1);
+  const int32_t* offsets = test_offsets + bin * kDescriptorBits * 2;
+  Descriptor descriptor;
+  for (size_t word = 0; word < 4; ++word) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < 64; ++i) {
+      const int32_t* pair = offsets + (word * 64 + i) * 2;
+      bits |= static_cast<uint64_t>(center[pair[0]] < center[pair[1]]) << i;
+    }
+    descriptor.words[word] = bits;
+  }
+  return descriptor;
+}
+
+// [1 4 6 4 1]^2 / 256 binomial blur of rows [y0, y1), vertical pass first so
+// both passes run on 16-bit lanes
+void smooth_rows(const uint8_t* pixels, uint8_t* smoothed, const size_t rows,
+                 const size_t cols, const size_t y0, const size_t y1,
+                 std::vector<uint16_t>& column) {
+  column.resize(cols);
+  const auto clamp_row = [rows](const ptrdiff_t y) {
+    return static_cast<size_t>(
+        std::clamp<ptrdiff_t>(y, 0, static_cast<ptrdiff_t>(rows) - 1));
+  };
+  for (size_t y = y0; y < y1; ++y) {
+    const auto iy = static_cast<ptrdiff_t>(y);
+    const uint8_t* __restrict r0 = pixels + clamp_row(iy - 2) * cols;
+    const uint8_t* __restrict r1 = pixels + clamp_row(iy - 1) * cols;
+    const uint8_t* __restrict r2 = pixels + y * cols;
+    const uint8_t* __restrict r3 = pixels + clamp_row(iy + 1) * cols;
+    const uint8_t* __restrict r4 = pixels + clamp_row(iy + 2) * cols;
+    uint16_t* __restrict v = column.data();
+    for (size_t x = 0; x < cols; ++x) {
+      v[x] = static_cast<uint16_t>(r0[x] + 4 * (r1[x] + r3[x]) + 6 * r2[x] +
+                                   r4[x]);
+    }
+    uint8_t* __restrict out = smoothed + y * cols;
+    for (size_t x = 2; x + 2 < cols; ++x) {
+      out[x] = static_cast<uint8_t>(
+          (v[x - 2] + 4 * (v[x - 1] + v[x + 1]) + 6 * v[x] + v[x + 2] + 128) >>
+          8);
+    }
+    for (size_t x = 0; x < std::min<size_t>(2, cols); ++x) {
+      out[x] = static_cast<uint8_t>((v[x] + 8) >> 4);
+      out[cols - 1 - x] = static_cast<uint8_t>((v[cols - 1 - x] + 8) >> 4);
+    }
+  }
+}
+
+// box levels keep corners of the finer level where they are, and every
+// level needs room for keypoints inside the border
+PyramidParams pyramid_params(const OrbParams& params) {
+  PyramidParams pyramid;
+  pyramid.num_levels = params.num_levels;
+  pyramid.filter = PyramidFilter::Box;
+  pyramid.min_size = 2 * kBorder + 1;
+  return pyramid;
+}
+
+}  // namespace
+
+OrbExtractor::OrbExtractor(const OrbParams& params)
+    : params_(params),
+      pyramid_(pyramid_params(params)) {}
+
+std::expected<void, MatError> OrbExtractor::extract(const Mat& image,
+                                                    Features& out) {
+  if (image.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (params_.num_levels == 0 || params_.cell_size == 0 ||
+      !(params_.fast_threshold >= 0.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  out.keypoints.clear();
+  out.descriptors.clear();
+
+  // 8-bit copies of the levels of a factor-2 box pyramid, stopping once a
+  // level has no room for keypoints
+  if (image.rows() <= 2 * kBorder || image.cols() <= 2 * kBorder) {
+    return {};
+  }
+  if (auto built = pyramid_.build(image); !built) {
+    return std::unexpected(built.error());
+  }
+  const size_t num_levels = pyramid_.num_levels();
+  if (levels_.size() < num_levels) {
+    levels_.resize(num_levels);
+  }
+  for (size_t l = 0; l < num_levels; ++l) {
+    const Mat& source = pyramid_.level(l);
+    Level& level = levels_[l];
+    if (level.cols != source.cols() || level.test_offsets.empty()) {
+      build_test_offsets(static_cast<ptrdiff_t>(source.cols()),
+                         level.test_offsets);
+    }
+    level.rows = source.rows();
+    level.cols = source.cols();
+    level.pixels.resize(source.size());
+    level.smoothed.resize(source.size());
+  }
+  // rows of all levels as one range
+  std::vector<size_t> first_row(num_levels + 1, 0);
+  for (size_t l = 0; l < num_levels; ++l) {
+    first_row[l + 1] = first_row[l] + levels_[l].rows;
+  }
+  parallel_for(0, first_row.back(), [&](const size_t lo, const size_t hi) {
+    size_t l = 0;
+    for (size_t row = lo; row < hi; ++row) {
+      while (row >= first_row[l + 1]) {
+        ++l;
+      }
+      const size_t cols = levels_[l].cols, y = row - first_row[l];
+      const float* __restrict in = pyramid_.level(l).data() + y * cols;
+      uint8_t* __restrict pixels = levels_[l].pixels.data() + y * cols;
+      for (size_t x = 0; x < cols; ++x) {
+        pixels[x] = static_cast<uint8_t>(
+            std::clamp(in[x], 0.0f, 1.0f) * 255.0f + 0.5f);
+      }
+    }
+  });
+
+  // one task per row band of every level: smoothing, fast and harris
+  struct Band {
+    size_t level;
+    size_t y0;
+    size_t y1;
+  };
+  std::vector<Band> bands;
+  for (size_t l = 0; l < num_levels; ++l) {
+    for (size_t y = 0; y < levels_[l].rows; y += kBandRows) {
+      bands.push_back({l, y, std::min(y + kBandRows, levels_[l].rows)});
+    }
+  }
+  if (band_candidates_.size() < bands.size()) {
+    band_candidates_.resize(bands.size());
+  }
+  const int threshold = std::clamp(
+      static_cast<int>(std::lround(params_.fast_threshold * 255.0f)), 1, 255);
+  parallel_for(0, bands.size(), [&](const size_t lo, const size_t hi) {
+    thread_local std::vector<uint8_t> high, low, possible;
+    thread_local std::vector<uint16_t> column;
+    thread_local std::array<ScoreRow, 3> score_rows;
+    for (size_t b = lo; b < hi; ++b) {
+      const Band& band = bands[b];
+      Level& level = levels_[band.level];
+      smooth_rows(level.pixels.data(), level.smoothed.data(), level.rows,
+                  level.cols, band.y0, band.y1, column);
+
+      high.resize(level.cols + kFastBlock);
+      low.resize(level.cols + kFastBlock);
+      possible.resize(level.cols + kFastBlock);
+      std::vector<Candidate>& candidates = band_candidates_[b];
+      candidates.clear();
+      const auto stride = static_cast<ptrdiff_t>(level.cols);
+      const int x0 = kBorder, x1 = static_cast<int>(level.cols) - kBorder;
+      const size_t y_begin = std::max<size_t>(band.y0, kBorder);
+      const size_t y_end = std::min(band.y1, level.rows - kBorder);
+      if (y_begin >= y_end) {
+        continue;
+      }
+      // fast scores of one row, all zero outside the detection rows
+      // only the previous corners are nonzero, so a reused row is cleared
+      // sparsely
+      const auto score = [&](const size_t y, ScoreRow& scored) {
+        if (scored.scores.size() != level.cols) {
+          scored.scores.assign(level.cols, 0);
+        } else {
+          for (const int32_t x : scored.corners) {
+            scored.scores[x] = 0;
+          }
+        }
+        scored.corners.clear();
+        if (y < kBorder || y >= level.rows - kBorder) {
+          return;
+        }
+        const uint8_t* row = level.pixels.data() + y * level.cols;
+        fast_row(row, stride, x0, x1, threshold, high.data(), low.data(),
+                 possible.data(), scored.corners);
+        for (const int32_t x : scored.corners) {
+          scored.scores[x] = fast_score(row + x, stride, threshold);
+        }
+      };
+
+      // 3x3 non-maximum suppression over a rolling window of score rows,
+      // the band's edge rows are scored again by the neighbouring bands.
+      // ties go to the earlier corner in raster order.
+      ScoreRow* above = &score_rows[0];
+      ScoreRow* center = &score_rows[1];
+      ScoreRow* below = &score_rows[2];
+      score(y_begin - 1, *above);
+      score(y_begin, *center);
+      for (size_t y = y_begin; y < y_end; ++y) {
+        score(y + 1, *below);
+        const uint16_t* a = above->scores.data();
+        const uint16_t* c = center->scores.data();
+        const uint16_t* d = below->scores.data();
+        for (const int x : center->corners) {
+          const uint16_t v = c[x];
+          if (v > a[x - 1] && v > a[x] && v > a[x + 1] && v > c[x - 1] &&
+              v >= c[x + 1] && v >= d[x - 1] && v >= d[x] && v >= d[x + 1]) {
+            const auto iy = static_cast<int>(y);
+            candidates.push_back(
+                {x, iy,
+                 harris_response(level.pixels.data(), stride, x, iy,
+                                 params_.harris_k)});
+          }
+        }
+        std::swap(above, center);
+        std::swap(center, below);
+      }
+    }
+  });
+
+  // per level grid bucketing by harris response, coarsest first so budget a
+  // level cannot use passes to the finer ones
+  if (level_keypoints_.size() < num_levels) {
+    level_keypoints_.resize(num_levels);
+  }
+  std::vector<size_t> budgets(num_levels);
+  {
+    double share = 1.0, total = 0.0;
+    for (size_t l = 0; l < num_levels; ++l, share *= 0.5) {
+      total += share;
+    }
+    share = 1.0;
+    for (size_t l = 0; l < num_levels; ++l, share *= 0.5) {
+      budgets[l] = static_cast<size_t>(
+          static_cast<double>(params_.max_features) * share / total);
+    }
+  }
+  size_t carry = params_.max_features;
+  for (size_t l = 0; l < num_levels; ++l) {
+    carry -= budgets[l];
+  }
+
+  std::vector<Candidate> survivors, skipped;
+  std::vector<uint32_t> cell_counts;
+  size_t band_index = bands.size();
+  for (size_t l = num_levels; l-- > 0;) {
+    const Level& level = levels_[l];
+    // bands are ordered by level, so this level's are the ones before the
+    // coarser levels'
+    size_t first_band = band_index;
+    while (first_band > 0 && bands[first_band - 1].level == l) {
+      --first_band;
+    }
+    survivors.clear();
+    for (size_t b = first_band; b < band_index; ++b) {
+      for (const Candidate& c : band_candidates_[b]) {
+        if (c.response > 0.0f) {
+          survivors.push_back(c);
+        }
+      }
+    }
+    band_index = first_band;
+    std::sort(survivors.begin(), survivors.end(),
+              [](const Candidate& a, const Candidate& b) {
+                return a.response > b.response;
+              });
+
+    const size_t budget = budgets[l] + carry;
+    const size_t grid_cols = (level.cols + params_.cell_size - 1) /
+                             params_.cell_size;
+    const size_t grid_rows = (level.rows + params_.cell_size - 1) /
+                             params_.cell_size;
+    const size_t cap =
+        std::max<size_t>(1, (budget + grid_cols * grid_rows - 1) /
+                                (grid_cols * grid_rows));
+    cell_counts.assign(grid_cols * grid_rows, 0);
+    std::vector<Keypoint>& selected = level_keypoints_[l];
+    selected.clear();
+    skipped.clear();
+    const auto take = [&](const Candidate& c) {
+      selected.push_back({static_cast<float>(c.x), static_cast<float>(c.y),
+                          c.response, 0.0f, static_cast<int>(l)});
+    };
+    for (const Candidate& c : survivors) {
+      if (selected.size() == budget) {
+        break;
+      }
+      const size_t cell = (c.y / params_.cell_size) * grid_cols +
+                          c.x / params_.cell_size;
+      if (cell_counts[cell] < cap) {
+        ++cell_counts[cell];
+        take(c);
+      } else {
+        skipped.push_back(c);
+      }
+    }
+    // cells with fewer corners than the cap leave room for the strongest of
+    // the rest
+    for (size_t i = 0; i < skipped.size() && selected.size() < budget; ++i) {
+      take(skipped[i]);
+    }
+    carry = budget - selected.size();
+  }
+
+  // orientation and descriptors in parallel over all selected keypoints,
+  // still in level coordinates until written out
+  for (size_t l = 0; l < num_levels; ++l) {
+    out.keypoints.insert(out.keypoints.end(), level_keypoints_[l].begin(),
+                         level_keypoints_[l].end());
+  }
+  out.descriptors.resize(out.keypoints.size());
+  parallel_for(
+      0, out.keypoints.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          Keypoint& keypoint = out.keypoints[i];
+          const Level& level = levels_[keypoint.level];
+          const auto stride = static_cast<ptrdiff_t>(level.cols);
+          const auto x = static_cast<int>(keypoint.x);
+          const auto y = static_cast<int>(keypoint.y);
+          keypoint.angle = centroid_angle(level.pixels.data(), stride, x, y);
+          out.descriptors[i] =
+              describe(level.smoothed.data() + y * stride + x,
+                       level.test_offsets.data(), keypoint.angle);
+          // level pixel centers sit at (x + 0.5) * scale - 0.5 in level 0
+          const auto scale = static_cast<float>(1 << keypoint.level);
+          keypoint.x = (keypoint.x + 0.5f) * scale - 0.5f;
+          keypoint.y = (keypoint.y + 0.5f) * scale - 0.5f;
+        }
+      },
+      64);
+  return {};
+}
+
+std::expected<Features, MatError> extract_orb(const Mat& image,
+                                              const OrbParams& params) {
+  OrbExtractor extractor(params);
+  Features features;
+  if (auto extracted = extractor.extract(image, features); !extracted) {
+    return std::unexpected(extracted.error());
+  }
+  return features;
+}
+
+};  // namespace core
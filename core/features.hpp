@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <vector>
+
+#include "core/mat.hpp"
+#include "core/pyramid.hpp"
+
+namespace core {
+
+struct Keypoint {
+  float x = 0.0f;  // level 0 pixel coordinates
+  float y = 0.0f;
+  float response = 0.0f;  // harris corner response
+  float angle = 0.0f;     // orientation in radians, in (-pi, pi]
+  int level = 0;          // pyramid level the corner was detected on
+};
+
+// 256 binary intensity tests, test i is bit i % 64 of words[i / 64]
+struct alignas(32) Descriptor {
+  std::array<uint64_t, 4> words{};
+};
+
+struct OrbParams {
+  size_t max_features = 2000;
+  // levels of the factor-2 pyramid, each gets half the previous budget
+  size_t num_levels = 4;
+  // a pixel is a corner when 9 contiguous pixels of the radius-3 ring are
+  // all brighter or all darker than it by more than this, in [0, 1]
+  // intensity units
+  float fast_threshold = 0.08f;
+  // side of the square buckets features are spread over, in level pixels
+  size_t cell_size = 32;
+  float harris_k = 0.04f;
+};
+
+struct Features {
+  std::vector<Keypoint> keypoints;
+  std::vector<Descriptor> descriptors;  // one per keypoint
+};
+
+// FAST-9 corners thinned by 3x3 non-maximum suppression on the fast score,
+// ranked by harris response and bucketed over a grid, then oriented by
+// intensity centroid and described by steered BRIEF (ORB, Rublee et al.
+// 2011). the extractor keeps its pyramid and per-level tables between calls
+// so same-sized frames reuse them. row bands of all levels are processed in
+// parallel.
+class OrbExtractor {
+ public:
+  explicit OrbExtractor(const OrbParams& params = {});
+
+  // single channel image with intensities in [0, 1], `out` is overwritten
+  // and keeps its capacity
+  [[nodiscard]] std::expected<void, MatError> extract(const Mat& image,
+                                                      Features& out);
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  // 8-bit working copy of a pyramid level
+  struct Level {
+    size_t rows = 0;
+    size_t cols = 0;
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> smoothed;  // blurred copy sampled by the descriptor
+    // rotated descriptor tests as pixel offsets, rebuilt when cols changes
+    std::vector<int32_t> test_offsets;
+  };
+  struct Candidate {
+    int32_t x;
+    int32_t y;
+    float response;
+  };
+  // fast scores of one row and the columns of its corners
+  struct ScoreRow {
+    std::vector<uint16_t> scores;
+    std::vector<int32_t> corners;
+  };
+
+  OrbParams params_;
+  Pyramid pyramid_;
+  std::vector<Level> levels_;
+  // corners of every row band, bands are ordered by level then row
+  std::vector<std::vector<Candidate>> band_candidates_;
+  std::vector<std::vector<Keypoint>> level_keypoints_;
+};
+
+// convenience wrapper around a temporary OrbExtractor
+[[nodiscard]] std::expected<Features, MatError> extract_orb(
+    const Mat& image, const OrbParams& params = {});
+
+};  // namespace core
@@ -0,0 +1,518 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <expected>
+#include <optional>
+#include <type_traits>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+// entry types of FixedMat, floating point and the types that stand in for
+// it such as the jets of jet.hpp, which specialise this
+template <typename T>
+struct IsFixedMatScalar : std::is_floating_point<T> {};
+
+// R x C matrix of T with row-major storage on the stack, for the small
+// fixed-size math of kinematics and geometry. every operation is constexpr
+// and loops over compile-time bounds, which the compiler unrolls. products
+// accumulate whole rows of the right operand scaled by one entry of the
+// left, so a 4x4 float product runs as 16 four-wide multiply-adds, and
+// 4x4 float storage is 16-byte aligned for them.
+//
+// column vectors are R x 1 matrices. a default constructed matrix is zero.
+template <size_t R, size_t C, typename T = float>
+class FixedMat {
+  static_assert(R > 0 && C > 0);
+  static_assert(IsFixedMatScalar<T>::value);
+
+ public:
+  using value_type = T;
+  static constexpr size_t kRows = R;
+  static constexpr size_t kCols = C;
+  static constexpr size_t kSize = R * C;
+
+  constexpr FixedMat() noexcept = default;
+  // all R * C entries in row-major order
+  template <typename... Values>
+    requires(sizeof...(Values) == R * C && sizeof...(Values) > 1 &&
+             (std::is_convertible_v<Values, T> && ...))
+  constexpr FixedMat(const Values... values) noexcept
+      : data_{static_cast<T>(values)...} {}
+
+  [[nodiscard]] static constexpr FixedMat filled(const T value) noexcept {
+    FixedMat m;
+    for (size_t i = 0; i < kSize; ++i) {
+      m.data_[i] = value;
+    }
+    return m;
+  }
+  [[nodiscard]] static constexpr FixedMat zeros() noexcept { return {}; }
+  [[nodiscard]] static constexpr FixedMat identity() noexcept
+    requires(R == C)
+  {
+    FixedMat m;
+    for (size_t i = 0; i < R; ++i) {
+      m(i, i) = T{1};
+    }
+    return m;
+  }
+
+  // R x C single channel Mats only, IncompatibleDimensions otherwise
+  [[nodiscard]] static std::expected<FixedMat, MatError> from_mat(
+      const Mat& mat) {
+    if (mat.channels() != 1) {
+      return std::unexpected(MatError::InvalidChannelsForOperation);
+    }
+    if (mat.rows() != R || mat.cols() != C) {
+      return std::unexpected(MatError::IncompatibleDimensions);
+    }
+    FixedMat m;
+    for (size_t i = 0; i < kSize; ++i) {
+      m.data_[i] = static_cast<T>(mat.data()[i]);
+    }
+    return m;
+  }
+  [[nodiscard]] Mat to_mat() const {
+    Mat mat(R, C, 1);
+    for (size_t i = 0; i < kSize; ++i) {
+      mat.data()[i] = static_cast<float>(data_[i]);
+    }
+    return mat;
+  }
+
+  [[nodiscard]] static constexpr size_t rows() noexcept { return R; }
+  [[nodiscard]] static constexpr size_t cols() noexcept { return C; }
+  [[nodiscard]] static constexpr size_t size() noexcept { return kSize; }
+  [[nodiscard]] constexpr T* data() noexcept { return data_; }
+  [[nodiscard]] constexpr const T* data() const noexcept { return data_; }
+
+  // unchecked access
+  [[nodiscard]] constexpr T& operator()(const size_t row,
+                                        const size_t col) noexcept {
+    return data_[row * C + col];
+  }
+  [[nodiscard]] constexpr T operator()(const size_t row,
+                                       const size_t col) const noexcept {
+    return data_[row * C + col];
+  }
+  // row-major index, the natural one for vectors
+  [[nodiscard]] constexpr T& operator[](const size_t i) noexcept {
+    return data_[i];
+  }
+  [[nodiscard]] constexpr T operator[](const size_t i) const noexcept {
+    return data_[i];
+  }
+
+  [[nodiscard]] constexpr FixedMat<1, C, T> row(const size_t r) const noexcept {
+    return block<1, C>(r, 0);
+  }
+  [[nodiscard]] constexpr FixedMat<R, 1, T> col(const size_t c) const noexcept {
+    return block<R, 1>(0, c);
+  }
+  // the BR x BC block with top left entry (row, col)
+  template <size_t BR, size_t BC>
+  [[nodiscard]] constexpr FixedMat<BR, BC, T> block(
+      const size_t row, const size_t col) const noexcept {
+    static_assert(BR <= R && BC <= C);
+    FixedMat<BR, BC, T> out;
+    for (size_t r = 0; r < BR; ++r) {
+      for (size_t c = 0; c < BC; ++c) {
+        out(r, c) = (*this)(row + r, col + c);
+      }
+    }
+    return out;
+  }
+  template <size_t BR, size_t BC>
+  constexpr void set_block(const size_t row, const size_t col,
+                           const FixedMat<BR, BC, T>& values) noexcept {
+    static_assert(BR <= R && BC <= C);
+    for (size_t r = 0; r < BR; ++r) {
+      for (size_t c = 0; c < BC; ++c) {
+        (*this)(row + r, col + c) = values(r, c);
+      }
+    }
+  }
+
+  [[nodiscard]] constexpr FixedMat<C, R, T> transpose() const noexcept {
+    FixedMat<C, R, T> out;
+    for (size_t r = 0; r < R; ++r) {
+      for (size_t c = 0; c < C; ++c) {
+        out(c, r) = (*this)(r, c);
+      }
+    }
+    return out;
+  }
+  [[nodiscard]] constexpr T trace() const noexcept
+    requires(R == C)
+  {
+    T sum{0};
+    for (size_t i = 0; i < R; ++i) {
+      sum += (*this)(i, i);
+    }
+    return sum;
+  }
+
+  // entry-wise products summed, the dot product of vectors
+  [[nodiscard]] constexpr T dot(const FixedMat& other) const noexcept {
+    T sum{0};
+    for (size_t i = 0; i < kSize; ++i) {
+      sum += data_[i] * other.data_[i];
+    }
+    return sum;
+  }
+  [[nodiscard]] constexpr T squared_norm() const noexcept { return dot(*this); }
+  [[nodiscard]] T norm() const noexcept {
+    using std::sqrt;
+    return sqrt(squared_norm());
+  }
+  [[nodiscard]] FixedMat normalized() const noexcept {
+    return *this / norm();
+  }
+  [[nodiscard]] constexpr FixedMat cross(const FixedMat& other) const noexcept
+    requires(R == 3 && C == 1)
+  {
+    return FixedMat(data_[1] * other[2] - data_[2] * other[1],
+                    data_[2] * other[0] - data_[0] * other[2],
+                    data_[0] * other[1] - data_[1] * other[0]);
+  }
+  [[nodiscard]] constexpr FixedMat cwise_product(
+      const FixedMat& other) const noexcept {
+    FixedMat out;
+    for (size_t i = 0; i < kSize; ++i) {
+      out.data_[i] = data_[i] * other.data_[i];
+    }
+    return out;
+  }
+
+  constexpr FixedMat& operator+=(const FixedMat& other) noexcept {
+    for (size_t i = 0; i < kSize; ++i) {
+      data_[i] += other.data_[i];
+    }
+    return *this;
+  }
+  constexpr FixedMat& operator-=(const FixedMat& other) noexcept {
+    for (size_t i = 0; i < kSize; ++i) {
+      data_[i] -= other.data_[i];
+    }
+    return *this;
+  }
+  constexpr FixedMat& operator*=(const T scalar) noexcept {
+    for (size_t i = 0; i < kSize; ++i) {
+      data_[i] *= scalar;
+    }
+    return *this;
+  }
+  constexpr FixedMat& operator/=(const T scalar) noexcept {
+    return *this *= T{1} / scalar;
+  }
+
+  [[nodiscard]] constexpr FixedMat operator+(
+      const FixedMat& other) const noexcept {
+    FixedMat out = *this;
+    return out += other;
+  }
+  [[nodiscard]] constexpr FixedMat operator-(
+      const FixedMat& other) const noexcept {
+    FixedMat out = *this;
+    return out -= other;
+  }
+  [[nodiscard]] constexpr FixedMat operator-() const noexcept {
+    FixedMat out = *this;
+    return out *= T{-1};
+  }
+  [[nodiscard]] constexpr FixedMat operator*(const T scalar) const noexcept {
+    FixedMat out = *this;
+    return out *= scalar;
+  }
+  [[nodiscard]] constexpr FixedMat operator/(const T scalar) const noexcept {
+    FixedMat out = *this;
+    return out /= scalar;
+  }
+  [[nodiscard]] friend constexpr FixedMat operator*(
+      const T scalar, const FixedMat& m) noexcept {
+    return m * scalar;
+  }
+
+  template <size_t K>
+  [[nodiscard]] constexpr FixedMat<R, K, T> operator*(
+      const FixedMat<C, K, T>& other) const noexcept {
+    FixedMat<R, K, T> out;
+    for (size_t r = 0; r < R; ++r) {
+      T* __restrict row = out.data() + r * K;
+      for (size_t i = 0; i < C; ++i) {
+        const T scale = (*this)(r, i);
+        const T* source = other.data() + i * K;
+        for (size_t k = 0; k < K; ++k) {
+          row[k] += scale * source[k];
+        }
+      }
+    }
+    return out;
+  }
+
+  [[nodiscard]] constexpr bool operator==(
+      const FixedMat& other) const noexcept {
+    for (size_t i = 0; i < kSize; ++i) {
+      if (data_[i] != other.data_[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  static constexpr size_t kAlignment =
+      sizeof(T) * kSize % 16 == 0 ? 16 : alignof(T);
+
+  alignas(kAlignment) T data_[kSize]{};
+};
+
+template <size_t R, size_t C, typename T>
+[[nodiscard]] constexpr bool approx_equal(const FixedMat<R, C, T>& a,
+                                          const FixedMat<R, C, T>& b,
+                                          const T epsilon) noexcept {
+  for (size_t i = 0; i < R * C; ++i) {
+    const T difference = a[i] - b[i];
+    if (difference > epsilon || -difference > epsilon) {
+      return false;
+    }
+  }
+  return true;
+}
+
+namespace fixed_mat_detail {
+
+template <typename T>
+constexpr T magnitude(const T value) noexcept {
+  return value < T{0} ? -value : value;
+}
+
+// in-place lu factorisation with partial pivoting, P A = L U with unit
+// lower L below the diagonal of `lu`. false on a zero pivot.
+template <size_t N, typename T>
+constexpr bool lu_factorize(FixedMat<N, N, T>& lu, size_t (&pivots)[N],
+                            T& sign) noexcept {
+  sign = T{1};
+  for (size_t k = 0; k < N; ++k) {
+    size_t pivot = k;
+    for (size_t r = k + 1; r < N; ++r) {
+      if (magnitude(lu(r, k)) > magnitude(lu(pivot, k))) {
+        pivot = r;
+      }
+    }
+    pivots[k] = pivot;
+    if (lu(pivot, k) == T{0}) {
+      return false;
+    }
+    if (pivot != k) {
+      sign = -sign;
+      for (size_t c = 0; c < N; ++c) {
+        const T swapped = lu(k, c);
+        lu(k, c) = lu(pivot, c);
+        lu(pivot, c) = swapped;
+      }
+    }
+    const T inverse = T{1} / lu(k, k);
+    for (size_t r = k + 1; r < N; ++r) {
+      const T factor = lu(r, k) * inverse;
+      lu(r, k) = factor;
+      for (size_t c = k + 1; c < N; ++c) {
+        lu(r, c) -= factor * lu(k, c);
+      }
+    }
+  }
+  return true;
+}
+
+// solves A X = B from the factorisation of A
+template <size_t N, size_t K, typename T>
+constexpr FixedMat<N, K, T> lu_solve(const FixedMat<N, N, T>& lu,
+                                     const size_t (&pivots)[N],
+                                     FixedMat<N, K, T> b) noexcept {
+  for (size_t k = 0; k < N; ++k) {
+    if (pivots[k] != k) {
+      for (size_t c = 0; c < K; ++c) {
+        const T swapped = b(k, c);
+        b(k, c) = b(pivots[k], c);
+        b(pivots[k], c) = swapped;
+      }
+    }
+  }
+  for (size_t r = 1; r < N; ++r) {
+    for (size_t i = 0; i < r; ++i) {
+      for (size_t c = 0; c < K; ++c) {
+        b(r, c) -= lu(r, i) * b(i, c);
+      }
+    }
+  }
+  for (size_t r = N; r-- > 0;) {
+    for (size_t i = r + 1; i < N; ++i) {
+      for (size_t c = 0; c < K; ++c) {
+        b(r, c) -= lu(r, i) * b(i, c);
+      }
+    }
+    const T inverse = T{1} / lu(r, r);
+    for (size_t c = 0; c < K; ++c) {
+      b(r, c) *= inverse;
+    }
+  }
+  return b;
+}
+
+}  // namespace fixed_mat_detail
+
+// closed forms up to 4x4, lu with partial pivoting above
+template <size_t N, typename T>
+[[nodiscard]] constexpr T determinant(const FixedMat<N, N, T>& m) noexcept {
+  if constexpr (N == 1) {
+    return m[0];
+  } else if constexpr (N == 2) {
+    return m[0] * m[3] - m[1] * m[2];
+  } else if constexpr (N == 3) {
+    return m[0] * (m[4] * m[8] - m[5] * m[7]) -
+           m[1] * (m[3] * m[8] - m[5] * m[6]) +
+           m[2] * (m[3] * m[7] - m[4] * m[6]);
+  } else if constexpr (N == 4) {
+    // 2x2 minors of the top two rows times the complementary ones below
+    const T s0 = m[0] * m[5] - m[4] * m[1];
+    const T s1 = m[0] * m[6] - m[4] * m[2];
+    const T s2 = m[0] * m[7] - m[4] * m[3];
+    const T s3 = m[1] * m[6] - m[5] * m[2];
+    const T s4 = m[1] * m[7] - m[5] * m[3];
+    const T s5 = m[2] * m[7] - m[6] * m[3];
+    const T c5 = m[10] * m[15] - m[14] * m[11];
+    const T c4 = m[9] * m[15] - m[13] * m[11];
+    const T c3 = m[9] * m[14] - m[13] * m[10];
+    const T c2 = m[8] * m[15] - m[12] * m[11];
+    const T c1 = m[8] * m[14] - m[12] * m[10];
+    const T c0 = m[8] * m[13] - m[12] * m[9];
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+  } else {
+    FixedMat<N, N, T> lu = m;
+    size_t pivots[N]{};
+    T sign{1};
+    if (!fixed_mat_detail::lu_factorize(lu, pivots, sign)) {
+      return T{0};
+    }
+    T product = sign;
+    for (size_t i = 0; i < N; ++i) {
+      product *= lu(i, i);
+    }
+    return product;
+  }
+}
+
+// nullopt for singular matrices, those with a zero determinant up to 4x4
+// and with a zero pivot above
+template <size_t N, typename T>
+[[nodiscard]] constexpr std::optional<FixedMat<N, N, T>> inverse(
+    const FixedMat<N, N, T>& m) noexcept {
+  if constexpr (N == 1) {
+    if (m[0] == T{0}) {
+      return std::nullopt;
+    }
+    return FixedMat<1, 1, T>::filled(T{1} / m[0]);
+  } else if constexpr (N == 2) {
+    const T det = determinant(m);
+    if (det == T{0}) {
+      return std::nullopt;
+    }
+    const T s = T{1} / det;
+    return FixedMat<2, 2, T>(m[3] * s, -m[1] * s, -m[2] * s, m[0] * s);
+  } else if constexpr (N == 3) {
+    const T c0 = m[4] * m[8] - m[5] * m[7];
+    const T c1 = m[5] * m[6] - m[3] * m[8];
+    const T c2 = m[3] * m[7] - m[4] * m[6];
+    const T det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+    if (det == T{0}) {
+      return std::nullopt;
+    }
+    const T s = T{1} / det;
+    return FixedMat<3, 3, T>(
+        c0 * s, (m[2] * m[7] - m[1] * m[8]) * s,
+        (m[1] * m[5] - m[2] * m[4]) * s, c1 * s,
+        (m[0] * m[8] - m[2] * m[6]) * s, (m[2] * m[3] - m[0] * m[5]) * s,
+        c2 * s, (m[1] * m[6] - m[0] * m[7]) * s,
+        (m[0] * m[4] - m[1] * m[3]) * s);
+  } else if constexpr (N == 4) {
+    const T s0 = m[0] * m[5] - m[4] * m[1];
+    const T s1 = m[0] * m[6] - m[4] * m[2];
+    const T s2 = m[0] * m[7] - m[4] * m[3];
+    const T s3 = m[1] * m[6] - m[5] * m[2];
+    const T s4 = m[1] * m[7] - m[5] * m[3];
+    const T s5 = m[2] * m[7] - m[6] * m[3];
+    const T c5 = m[10] * m[15] - m[14] * m[11];
+    const T c4 = m[9] * m[15] - m[13] * m[11];
+    const T c3 = m[9] * m[14] - m[13] * m[10];
+    const T c2 = m[8] * m[15] - m[12] * m[11];
+    const T c1 = m[8] * m[14] - m[12] * m[10];
+    const T c0 = m[8] * m[13] - m[12] * m[9];
+    const T det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if (det == T{0}) {
+      return std::nullopt;
+    }
+    const T s = T{1} / det;
+    return FixedMat<4, 4, T>(
+        (m[5] * c5 - m[6] * c4 + m[7] * c3) * s,
+        (-m[1] * c5 + m[2] * c4 - m[3] * c3) * s,
+        (m[13] * s5 - m[14] * s4 + m[15] * s3) * s,
+        (-m[9] * s5 + m[10] * s4 - m[11] * s3) * s,
+        (-m[4] * c5 + m[6] * c2 - m[7] * c1) * s,
+        (m[0] * c5 - m[2] * c2 + m[3] * c1) * s,
+        (-m[12] * s5 + m[14] * s2 - m[15] * s1) * s,
+        (m[8] * s5 - m[10] * s2 + m[11] * s1) * s,
+        (m[4] * c4 - m[5] * c2 + m[7] * c0) * s,
+        (-m[0] * c4 + m[1] * c2 - m[3] * c0) * s,
+        (m[12] * s4 - m[13] * s2 + m[15] * s0) * s,
+        (-m[8] * s4 + m[9] * s2 - m[11] * s0) * s,
+        (-m[4] * c3 + m[5] * c1 - m[6] * c0) * s,
+        (m[0] * c3 - m[1] * c1 + m[2] * c0) * s,
+        (-m[12] * s3 + m[13] * s1 - m[14] * s0) * s,
+        (m[8] * s3 - m[9] * s1 + m[10] * s0) * s);
+  } else {
+    FixedMat<N, N, T> lu = m;
+    size_t pivots[N]{};
+    T sign{1};
+    if (!fixed_mat_detail::lu_factorize(lu, pivots, sign)) {
+      return std::nullopt;
+    }
+    return fixed_mat_detail::lu_solve(lu, pivots,
+                                      FixedMat<N, N, T>::identity());
+  }
+}
+
+// x with a x = b by lu with partial pivoting, nullopt on a zero pivot
+template <size_t N, size_t K, typename T>
+[[nodiscard]] constexpr std::optional<FixedMat<N, K, T>> solve(
+    const FixedMat<N, N, T>& a, const FixedMat<N, K, T>& b) noexcept {
+  FixedMat<N, N, T> lu = a;
+  size_t pivots[N]{};
+  T sign{1};
+  if (!fixed_mat_detail::lu_factorize(lu, pivots, sign)) {
+    return std::nullopt;
+  }
+  return fixed_mat_detail::lu_solve(lu, pivots, b);
+}
+
+using Mat2f = FixedMat<2, 2, float>;
+using Mat3f = FixedMat<3, 3, float>;
+using Mat4f = FixedMat<4, 4, float>;
+using Mat6f = FixedMat<6, 6, float>;
+using Mat2d = FixedMat<2, 2, double>;
+using Mat3d = FixedMat<3, 3, double>;
+using Mat4d = FixedMat<4, 4, double>;
+using Mat6d = FixedMat<6, 6, double>;
+using Vec2f = FixedMat<2, 1, float>;
+using Vec3f = FixedMat<3, 1, float>;
+using Vec4f = FixedMat<4, 1, float>;
+using Vec6f = FixedMat<6, 1, float>;
+using Vec2d = FixedMat<2, 1, double>;
+using Vec3d = FixedMat<3, 1, double>;
+using Vec4d = FixedMat<4, 1, double>;
+using Vec6d = FixedMat<6, 1, double>;
+
+};  // namespace core
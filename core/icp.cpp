@@ -0,0 +1,518 @@
+#include "core/icp.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+#include "core/kd_tree.hpp"
+#include "core/parallel.hpp"
+#include "core/point_cloud_filter.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinPointsPerChunk = 1024;
+
+// rigid transform in double precision, updates are composed in this form and
+// only rounded to float when reported
+struct Pose {
+  double r[9];
+  double t[3];
+};
+
+Pose to_pose(const RigidTransform& transform) {
+  Pose pose;
+  for (size_t i = 0; i < 9; ++i) {
+    pose.r[i] = transform.rotation[i];
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    pose.t[i] = transform.translation[i];
+  }
+  return pose;
+}
+
+RigidTransform to_transform(const Pose& pose) {
+  RigidTransform transform;
+  for (size_t i = 0; i < 9; ++i) {
+    transform.rotation[i] = static_cast<float>(pose.r[i]);
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    transform.translation[i] = static_cast<float>(pose.t[i]);
+  }
+  return transform;
+}
+
+// rotation by angle |w| about w / |w|
+void rodrigues(const double* w, double* r) {
+  const double theta_sq = w[0] * w[0] + w[1] * w[1] + w[2] * w[2];
+  const double theta = std::sqrt(theta_sq);
+  // taylor expansions keep small angles accurate
+  const double a =
+      theta < 1e-6 ? 1.0 - theta_sq / 6.0 : std::sin(theta) / theta;
+  const double b = theta < 1e-6 ? 0.5 - theta_sq / 24.0
+                                : (1.0 - std::cos(theta)) / theta_sq;
+  r[0] = 1.0 - b * (w[1] * w[1] + w[2] * w[2]);
+  r[1] = b * w[0] * w[1] - a * w[2];
+  r[2] = b * w[0] * w[2] + a * w[1];
+  r[3] = b * w[0] * w[1] + a * w[2];
+  r[4] = 1.0 - b * (w[0] * w[0] + w[2] * w[2]);
+  r[5] = b * w[1] * w[2] - a * w[0];
+  r[6] = b * w[0] * w[2] - a * w[1];
+  r[7] = b * w[1] * w[2] + a * w[0];
+  r[8] = 1.0 - b * (w[0] * w[0] + w[1] * w[1]);
+}
+
+// pose <- (exp(w), v) * pose
+void left_update(const double* delta, Pose& pose) {
+  double dr[9];
+  rodrigues(delta, dr);
+  Pose out;
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      out.r[i * 3 + j] = dr[i * 3] * pose.r[j] + dr[i * 3 + 1] * pose.r[3 + j] +
+                         dr[i * 3 + 2] * pose.r[6 + j];
+    }
+    out.t[i] = dr[i * 3] * pose.t[0] + dr[i * 3 + 1] * pose.t[1] +
+               dr[i * 3 + 2] * pose.t[2] + delta[3 + i];
+  }
+  pose = out;
+}
+
+// J^T J, J^T r and the squared residuals of one chunk of correspondences
+struct NormalEquations {
+  double ata[36] = {};
+  double atr[6] = {};
+  double error = 0.0;
+  size_t count = 0;
+
+  // one residual row, written so the 6x6 outer product vectorises
+  void add(const double* j, const double r) noexcept {
+    for (size_t a = 0; a < 6; ++a) {
+      for (size_t b = 0; b < 6; ++b) {
+        ata[a * 6 + b] += j[a] * j[b];
+      }
+      atr[a] += j[a] * r;
+    }
+    error += r * r;
+  }
+
+  void merge(const NormalEquations& other) noexcept {
+    for (size_t i = 0; i < 36; ++i) {
+      ata[i] += other.ata[i];
+    }
+    for (size_t i = 0; i < 6; ++i) {
+      atr[i] += other.atr[i];
+    }
+    error += other.error;
+    count += other.count;
+  }
+};
+
+// one fused pass: transform, nearest neighbour, linearise, accumulate
+template <IcpMethod Method>
+NormalEquations accumulate(const PointCloud& source, const PointCloud& target,
+                           const KdTree& tree, const Pose& pose,
+                           const float max_distance) {
+  float r[9], t[3];
+  for (size_t i = 0; i < 9; ++i) {
+    r[i] = static_cast<float>(pose.r[i]);
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    t[i] = static_cast<float>(pose.t[i]);
+  }
+  const float max_distance_sq = max_distance * max_distance;
+
+  std::vector<NormalEquations> partial(
+      num_chunks(source.size(), kMinPointsPerChunk));
+  parallel_for_chunks(
+      0, source.size(),
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        NormalEquations equations;
+        const float* sx = source.x();
+        const float* sy = source.y();
+        const float* sz = source.z();
+        for (size_t i = lo; i < hi; ++i) {
+          const float p[3] = {
+              r[0] * sx[i] + r[1] * sy[i] + r[2] * sz[i] + t[0],
+              r[3] * sx[i] + r[4] * sy[i] + r[5] * sz[i] + t[1],
+              r[6] * sx[i] + r[7] * sy[i] + r[8] * sz[i] + t[2]};
+          uint32_t nearest;
+          float distance_sq;
+          if (tree.knn(p, 1, &nearest, &distance_sq, max_distance_sq) ==
+              0) {
+            continue;
+          }
+          const double px = p[0], py = p[1], pz = p[2];
+          const double dx = px - target.x()[nearest];
+          const double dy = py - target.y()[nearest];
+          const double dz = pz - target.z()[nearest];
+          ++equations.count;
+          if constexpr (Method == IcpMethod::PointToPoint) {
+            // d(w x p + v) / d(w, v) = [-[p]x | I]
+            const double jx[6] = {0.0, pz, -py, 1.0, 0.0, 0.0};
+            const double jy[6] = {-pz, 0.0, px, 0.0, 1.0, 0.0};
+            const double jz[6] = {py, -px, 0.0, 0.0, 0.0, 1.0};
+            equations.add(jx, dx);
+            equations.add(jy, dy);
+            equations.add(jz, dz);
+          } else {
+            const double nx = target.nx()[nearest];
+            const double ny = target.ny()[nearest];
+            const double nz = target.nz()[nearest];
+            // d(n . (w x p + v)) / d(w, v) = [p x n | n]
+            const double j[6] = {py * nz - pz * ny, pz * nx - px * nz,
+                                 px * ny - py * nx, nx, ny, nz};
+            equations.add(j, nx * dx + ny * dy + nz * dz);
+          }
+        }
+        partial[chunk] = equations;
+      },
+      kMinPointsPerChunk);
+
+  // merged in chunk order so the result does not depend on scheduling
+  NormalEquations total;
+  for (const NormalEquations& equations : partial) {
+    total.merge(equations);
+  }
+  return total;
+}
+
+// solves (J^T J) x = -J^T r by Cholesky, false if the system is degenerate,
+// e.g. all correspondences on one plane for point-to-plane
+bool solve(const NormalEquations& equations, double* x) {
+  double l[36];
+  double scale = 0.0;
+  for (size_t i = 0; i < 6; ++i) {
+    scale = std::max(scale, equations.ata[i * 7]);
+  }
+  for (size_t i = 0; i < 6; ++i) {
+    for (size_t j = 0; j <= i; ++j) {
+      double sum = equations.ata[i * 6 + j];
+      for (size_t k = 0; k < j; ++k) {
+        sum -= l[i * 6 + k] * l[j * 6 + k];
+      }
+      if (i == j) {
+        if (!(sum > 1e-12 * scale)) {
+          return false;
+        }
+        l[i * 6 + i] = std::sqrt(sum);
+      } else {
+        l[i * 6 + j] = sum / l[j * 6 + j];
+      }
+    }
+  }
+  double y[6];
+  for (size_t i = 0; i < 6; ++i) {
+    double sum = -equations.atr[i];
+    for (size_t k = 0; k < i; ++k) {
+      sum -= l[i * 6 + k] * y[k];
+    }
+    y[i] = sum / l[i * 6 + i];
+  }
+  for (size_t i = 6; i-- > 0;) {
+    double sum = y[i];
+    for (size_t k = i + 1; k < 6; ++k) {
+      sum -= l[k * 6 + i] * x[k];
+    }
+    x[i] = sum / l[i * 6 + i];
+  }
+  return true;
+}
+
+// eigenvector of the smallest eigenvalue of a symmetric 3x3 matrix
+// (a, b, c on the diagonal, d = (0, 1), e = (0, 2), f = (1, 2))
+void smallest_eigenvector(const double a, const double b, const double c,
+                          const double d, const double e, const double f,
+                          float* out) {
+  // trigonometric solution of the characteristic cubic
+  const double mean = (a + b + c) / 3.0;
+  const double off = d * d + e * e + f * f;
+  const double q = ((a - mean) * (a - mean) + (b - mean) * (b - mean) +
+                    (c - mean) * (c - mean) + 2.0 * off) /
+                   6.0;
+  double lambda = mean;
+  if (q > 0.0) {
+    const double s = std::sqrt(q);
+    const double ba = (a - mean) / s, bb = (b - mean) / s, bc = (c - mean) / s;
+    const double bd = d / s, be = e / s, bf = f / s;
+    const double det = ba * (bb * bc - bf * bf) - bd * (bd * bc - bf * be) +
+                       be * (bd * bf - bb * be);
+    const double phi = std::acos(std::clamp(det / 2.0, -1.0, 1.0)) / 3.0;
+    lambda = mean + 2.0 * s * std::cos(phi + 2.0 * std::numbers::pi / 3.0);
+  }
+
+  // the null space of A - lambda I is orthogonal to its rows, take the
+  // best conditioned cross product of two rows
+  const double r0[3] = {a - lambda, d, e};
+  const double r1[3] = {d, b - lambda, f};
+  const double r2[3] = {e, f, c - lambda};
+  const auto cross = [](const double* u, const double* v, double* w) {
+    w[0] = u[1] * v[2] - u[2] * v[1];
+    w[1] = u[2] * v[0] - u[0] * v[2];
+    w[2] = u[0] * v[1] - u[1] * v[0];
+    return w[0] * w[0] + w[1] * w[1] + w[2] * w[2];
+  };
+  double candidates[3][3];
+  const double norms[3] = {cross(r0, r1, candidates[0]),
+                           cross(r0, r2, candidates[1]),
+                           cross(r1, r2, candidates[2])};
+  size_t best = 0;
+  for (size_t i = 1; i < 3; ++i) {
+    if (norms[i] > norms[best]) {
+      best = i;
+    }
+  }
+  if (!(norms[best] > 0.0)) {
+    // isotropic or rank deficient neighbourhood, any axis will do
+    out[0] = 0.0f;
+    out[1] = 0.0f;
+    out[2] = 1.0f;
+    return;
+  }
+  const double inv = 1.0 / std::sqrt(norms[best]);
+  for (size_t i = 0; i < 3; ++i) {
+    out[i] = static_cast<float>(candidates[best][i] * inv);
+  }
+}
+
+// source and target as registered at one level, pointing either at the
+// inputs or at downsampled copies owned by this or a finer level
+struct LevelClouds {
+  PointCloud source_storage;
+  PointCloud target_storage;
+  const PointCloud* source = nullptr;
+  const PointCloud* target = nullptr;
+};
+
+// builds every level finest first so each coarser level is downsampled from
+// the next finer one rather than from the full input, and target normals are
+// estimated once at the finest level and averaged into the coarser ones.
+// levels is sized once up front so the pointers stay valid.
+std::expected<void, MatError> build_levels(const PointCloud& source,
+                                           const PointCloud& target,
+                                           const IcpParams& params,
+                                           std::vector<LevelClouds>& levels) {
+  levels.resize(params.levels.size());
+  const PointCloud* finer_source = &source;
+  const PointCloud* finer_target = &target;
+  for (size_t i = levels.size(); i-- > 0;) {
+    LevelClouds& clouds = levels[i];
+    clouds.source = finer_source;
+    clouds.target = finer_target;
+    const float voxel_size = params.levels[i].voxel_size;
+    if (voxel_size > 0.0f) {
+      auto source_down = voxel_downsample(*finer_source, voxel_size);
+      auto target_down = voxel_downsample(*finer_target, voxel_size);
+      if (!source_down || !target_down) {
+        return std::unexpected(MatError::InvalidParameter);
+      }
+      clouds.source_storage = std::move(*source_down);
+      clouds.target_storage = std::move(*target_down);
+      clouds.source = &clouds.source_storage;
+      clouds.target = &clouds.target_storage;
+    }
+    if (params.method == IcpMethod::PointToPlane &&
+        !clouds.target->has_normals()) {
+      if (clouds.target != &clouds.target_storage) {
+        clouds.target_storage = *clouds.target;
+        clouds.target = &clouds.target_storage;
+      }
+      if (auto normals = estimate_normals(clouds.target_storage,
+                                          params.normal_neighbors);
+          !normals) {
+        return std::unexpected(normals.error());
+      }
+    }
+    finer_source = clouds.source;
+    finer_target = clouds.target;
+  }
+  return {};
+}
+
+}  // namespace
+
+void RigidTransform::apply(PointCloud& cloud) const noexcept {
+  const auto& r = rotation;
+  const auto& t = translation;
+  float* x = cloud.x();
+  float* y = cloud.y();
+  float* z = cloud.z();
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    const float px = x[i], py = y[i], pz = z[i];
+    x[i] = r[0] * px + r[1] * py + r[2] * pz + t[0];
+    y[i] = r[3] * px + r[4] * py + r[5] * pz + t[1];
+    z[i] = r[6] * px + r[7] * py + r[8] * pz + t[2];
+  }
+  if (!cloud.has_normals()) {
+    return;
+  }
+  float* nx = cloud.nx();
+  float* ny = cloud.ny();
+  float* nz = cloud.nz();
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    const float px = nx[i], py = ny[i], pz = nz[i];
+    nx[i] = r[0] * px + r[1] * py + r[2] * pz;
+    ny[i] = r[3] * px + r[4] * py + r[5] * pz;
+    nz[i] = r[6] * px + r[7] * py + r[8] * pz;
+  }
+}
+
+RigidTransform RigidTransform::compose(
+    const RigidTransform& other) const noexcept {
+  RigidTransform out;
+  const auto& a = rotation;
+  const auto& b = other.rotation;
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      out.rotation[i * 3 + j] = a[i * 3] * b[j] + a[i * 3 + 1] * b[3 + j] +
+                                a[i * 3 + 2] * b[6 + j];
+    }
+    out.translation[i] = a[i * 3] * other.translation[0] +
+                         a[i * 3 + 1] * other.translation[1] +
+                         a[i * 3 + 2] * other.translation[2] + translation[i];
+  }
+  return out;
+}
+
+std::expected<IcpResult, MatError> icp(const PointCloud& source,
+                                       const PointCloud& target,
+                                       const IcpParams& params,
+                                       const RigidTransform& initial) {
+  if (source.empty() || target.empty()) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (params.levels.empty()) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  for (size_t i = 0; i < params.levels.size(); ++i) {
+    const IcpLevel& level = params.levels[i];
+    if (!(level.max_correspondence_distance > 0.0f) ||
+        !(level.voxel_size >= 0.0f) ||
+        (i > 0 && level.voxel_size > params.levels[i - 1].voxel_size)) {
+      return std::unexpected(MatError::InvalidParameter);
+    }
+  }
+  std::vector<LevelClouds> levels;
+  if (auto built = build_levels(source, target, params, levels); !built) {
+    return std::unexpected(built.error());
+  }
+
+  IcpResult result;
+  Pose pose = to_pose(initial);
+  for (size_t i = 0; i < params.levels.size(); ++i) {
+    const IcpLevel& level = params.levels[i];
+    const PointCloud& level_source = *levels[i].source;
+    const PointCloud& level_target = *levels[i].target;
+    auto tree = KdTree::build(level_target);
+    if (!tree) {
+      return std::unexpected(tree.error());
+    }
+
+    result.converged = false;
+    for (size_t iteration = 0; iteration < level.max_iterations; ++iteration) {
+      const NormalEquations equations =
+          params.method == IcpMethod::PointToPoint
+              ? accumulate<IcpMethod::PointToPoint>(
+                    level_source, level_target, *tree, pose,
+                    level.max_correspondence_distance)
+              : accumulate<IcpMethod::PointToPlane>(
+                    level_source, level_target, *tree, pose,
+                    level.max_correspondence_distance);
+      ++result.iterations;
+      result.correspondences = equations.count;
+      result.rmse =
+          equations.count == 0
+              ? 0.0f
+              : static_cast<float>(std::sqrt(
+                    equations.error / static_cast<double>(equations.count)));
+
+      double delta[6];
+      if (!solve(equations, delta)) {
+        break;
+      }
+      left_update(delta, pose);
+      const double rotation_sq =
+          delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2];
+      const double translation_sq =
+          delta[3] * delta[3] + delta[4] * delta[4] + delta[5] * delta[5];
+      if (rotation_sq < static_cast<double>(params.rotation_tolerance) *
+                            params.rotation_tolerance &&
+          translation_sq < static_cast<double>(params.translation_tolerance) *
+                               params.translation_tolerance) {
+        result.converged = true;
+        break;
+      }
+    }
+  }
+  result.transform = to_transform(pose);
+  return result;
+}
+
+std::expected<void, MatError> estimate_normals(PointCloud& cloud,
+                                               const size_t k) {
+  if (k < 3) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  auto tree = KdTree::build(cloud);
+  if (!tree) {
+    return std::unexpected(tree.error());
+  }
+  cloud.enable_normals();
+
+  parallel_for(
+      0, cloud.size(),
+      [&](const size_t lo, const size_t hi) {
+        std::vector<uint32_t> neighbors(k);
+        std::vector<float> distances(k);
+        const float* x = cloud.x();
+        const float* y = cloud.y();
+        const float* z = cloud.z();
+        for (size_t i = lo; i < hi; ++i) {
+          const float query[3] = {x[i], y[i], z[i]};
+          const size_t found =
+              tree->knn(query, k, neighbors.data(), distances.data());
+          // covariance about the neighbourhood mean, centred on the query
+          // first to keep the single pass sums well conditioned
+          double sum[3] = {}, prod[6] = {};
+          for (size_t j = 0; j < found; ++j) {
+            const double dx = x[neighbors[j]] - query[0];
+            const double dy = y[neighbors[j]] - query[1];
+            const double dz = z[neighbors[j]] - query[2];
+            sum[0] += dx;
+            sum[1] += dy;
+            sum[2] += dz;
+            prod[0] += dx * dx;
+            prod[1] += dy * dy;
+            prod[2] += dz * dz;
+            prod[3] += dx * dy;
+            prod[4] += dx * dz;
+            prod[5] += dy * dz;
+          }
+          float normal[3] = {0.0f, 0.0f, 0.0f};
+          if (found >= 3) {
+            const double inv = 1.0 / static_cast<double>(found);
+            const double mx = sum[0] * inv, my = sum[1] * inv,
+                         mz = sum[2] * inv;
+            smallest_eigenvector(
+                prod[0] * inv - mx * mx, prod[1] * inv - my * my,
+                prod[2] * inv - mz * mz, prod[3] * inv - mx * my,
+                prod[4] * inv - mx * mz, prod[5] * inv - my * mz, normal);
+            if (normal[0] * query[0] + normal[1] * query[1] +
+                    normal[2] * query[2] >
+                0.0f) {
+              normal[0] = -normal[0];
+              normal[1] = -normal[1];
+              normal[2] = -normal[2];
+            }
+          }
+          cloud.nx()[i] = normal[0];
+          cloud.ny()[i] = normal[1];
+          cloud.nz()[i] = normal[2];
+        }
+      },
+      kMinPointsPerChunk);
+  return {};
+}
+
+};  // namespace core
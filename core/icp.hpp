@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <expected>
+#include <vector>
+
+#include "core/point_cloud.hpp"
+
+namespace core {
+
+// x' = rotation * x + translation, rotation is row-major
+struct RigidTransform {
+  std::array<float, 9> rotation{1.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+                                0.0f, 0.0f, 0.0f, 1.0f};
+  std::array<float, 3> translation{0.0f, 0.0f, 0.0f};
+
+  // applies the transform to every point in place, normals are rotated
+  void apply(PointCloud& cloud) const noexcept;
+  // this * other, i.e. other is applied first
+  [[nodiscard]] RigidTransform compose(
+      const RigidTransform& other) const noexcept;
+};
+
+enum class IcpMethod {
+  PointToPoint,  // minimises squared distances to the nearest target points
+  PointToPlane,  // minimises squared distances along the target normals
+};
+
+// one stage of the coarse-to-fine schedule. both clouds are voxel
+// downsampled with voxel_size first, 0 registers them at full resolution.
+struct IcpLevel {
+  float voxel_size = 0.0f;
+  float max_correspondence_distance = 1.0f;
+  size_t max_iterations = 30;
+};
+
+struct IcpParams {
+  IcpMethod method = IcpMethod::PointToPlane;
+  // ordered coarse to fine, each level starts from the previous estimate
+  std::vector<IcpLevel> levels{{0.0f, 1.0f, 30}};
+  // a level stops once an update rotates less than this (radians) and
+  // translates less than translation_tolerance
+  float rotation_tolerance = 1e-5f;
+  float translation_tolerance = 1e-5f;
+  // neighbours used to estimate target normals for point-to-plane when the
+  // target has none
+  size_t normal_neighbors = 10;
+};
+
+struct IcpResult {
+  RigidTransform transform;      // maps source onto target
+  float rmse = 0.0f;             // over the final level's correspondences
+  size_t correspondences = 0;    // in the final iteration
+  size_t iterations = 0;         // summed over levels
+  bool converged = false;        // the final level met the tolerances
+};
+
+// rigid registration of source onto target by iterative closest point.
+// every iteration is one parallel pass over the source that finds each
+// point's nearest target point in a kd-tree and accumulates its terms of the
+// 6x6 Gauss-Newton normal equations directly, no correspondence arrays are
+// kept. points without a target within max_correspondence_distance are
+// ignored.
+[[nodiscard]] std::expected<IcpResult, MatError> icp(
+    const PointCloud& source, const PointCloud& target,
+    const IcpParams& params = {}, const RigidTransform& initial = {});
+
+// unit normals from the smallest principal axis of each point's k nearest
+// neighbours, oriented towards the origin. enables normals on the cloud.
+[[nodiscard]] std::expected<void, MatError> estimate_normals(
+    PointCloud& cloud, const size_t k);
+
+};  // namespace core
@@ -0,0 +1,286 @@
+#include "core/integral.hpp"
+
+#include <algorithm>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 16;
+
+void ensure_shape(Mat& mat, const size_t rows, const size_t cols,
+                  const size_t channels) {
+  if (mat.rows() != rows || mat.cols() != cols ||
+      mat.channels() != channels) {
+    mat = Mat(rows, cols, channels);
+  }
+}
+
+// one table row from the image row `in`, or its squares, and the table row
+// above it: the running sums along the row plus the sums above. a lone
+// channel keeps its running sum in a register, interleaved channels keep
+// theirs in `running` and vectorise across the channels of a pixel.
+template <typename T, bool Squares>
+void integrate_row(const float* __restrict in, const T* __restrict above,
+                   const size_t cols, const size_t channels,
+                   T* __restrict running, T* __restrict row) {
+  std::fill(row, row + channels, T{0});
+  if (channels == 1) {
+    T total = 0;
+    for (size_t x = 0; x < cols; ++x) {
+      const T value = in[x];
+      total += Squares ? value * value : value;
+      row[x + 1] = above[x + 1] + total;
+    }
+    return;
+  }
+  std::fill(running, running + channels, T{0});
+  for (size_t x = 0; x < cols; ++x) {
+    const size_t offset = x * channels;
+    for (size_t c = 0; c < channels; ++c) {
+      const T value = in[offset + c];
+      running[c] += Squares ? value * value : value;
+      row[offset + channels + c] = above[offset + channels + c] + running[c];
+    }
+  }
+}
+
+// adds `offset` to table rows [lo, hi)
+template <typename T>
+void add_row(T* table, const size_t stride, const T* __restrict offset,
+             const size_t lo, const size_t hi) {
+  for (size_t y = lo; y < hi; ++y) {
+    T* __restrict row = table + y * stride;
+    for (size_t i = 0; i < stride; ++i) {
+      row[i] += offset[i];
+    }
+  }
+}
+
+// window means of one output row from the table rows `upper` and `lower`
+// that bound its windows, `height` rows apart, and with Variance the
+// variances from the squared tables too. the windows that are not cut by
+// the left or right border share their size and vectorise as one loop.
+template <typename T, bool Variance>
+void box_row(const T* upper, const T* lower, const T* upper_squared,
+             const T* lower_squared, const size_t cols,
+             const size_t channels, const size_t radius, const size_t height,
+             float* mean, float* variance) {
+  const auto store = [&](const size_t i, const size_t left,
+                         const size_t right, const T scale) {
+    const T m = (lower[right] - lower[left] - upper[right] + upper[left]) *
+                scale;
+    mean[i] = static_cast<float>(m);
+    if constexpr (Variance) {
+      const T s = (lower_squared[right] - lower_squared[left] -
+                   upper_squared[right] + upper_squared[left]) *
+                  scale;
+      variance[i] = static_cast<float>(std::max(s - m * m, T{0}));
+    }
+  };
+  const auto window = [&](const size_t x) {
+    const size_t left = x > radius ? x - radius : 0;
+    const size_t right = std::min(cols, x + radius + 1);
+    const T scale = T{1} / static_cast<T>(height * (right - left));
+    for (size_t c = 0; c < channels; ++c) {
+      store(x * channels + c, left * channels + c, right * channels + c,
+            scale);
+    }
+  };
+
+  const size_t begin = std::min(radius, cols);
+  const size_t end = cols > radius ? cols - radius : 0;
+  for (size_t x = 0; x < begin; ++x) {
+    window(x);
+  }
+  const T scale = T{1} / static_cast<T>(height * (2 * radius + 1));
+  const size_t reach = (radius + 1) * channels, behind = radius * channels;
+  for (size_t i = begin * channels; i < end * channels; ++i) {
+    store(i, i - behind, i + reach, scale);
+  }
+  for (size_t x = std::max(begin, end); x < cols; ++x) {
+    window(x);
+  }
+}
+
+template <typename T, bool Variance>
+void box_rows(const std::vector<T>& sums, const std::vector<T>& squared_sums,
+              const size_t rows, const size_t cols, const size_t channels,
+              const size_t radius, Mat& mean, Mat* variance) {
+  const size_t stride = (cols + 1) * channels;
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t y = lo; y < hi; ++y) {
+          const size_t top = y > radius ? y - radius : 0;
+          const size_t bottom = std::min(rows, y + radius + 1);
+          const size_t offset = y * cols * channels;
+          const T* upper_squared = nullptr;
+          const T* lower_squared = nullptr;
+          float* variances = nullptr;
+          if constexpr (Variance) {
+            upper_squared = squared_sums.data() + top * stride;
+            lower_squared = squared_sums.data() + bottom * stride;
+            variances = variance->data() + offset;
+          }
+          box_row<T, Variance>(sums.data() + top * stride,
+                               sums.data() + bottom * stride, upper_squared,
+                               lower_squared, cols, channels, radius,
+                               bottom - top, mean.data() + offset, variances);
+        }
+      },
+      kMinRowsPerChunk);
+}
+
+}  // namespace
+
+template <typename T>
+std::expected<void, MatError> IntegralImage<T>::compute(const Mat& image,
+                                                        const bool squares) {
+  if (image.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  rows_ = image.rows();
+  cols_ = image.cols();
+  channels_ = image.channels();
+  squares_ = squares;
+  const size_t stride = (cols_ + 1) * channels_;
+  const size_t size = (rows_ + 1) * stride;
+  sums_.resize(size);
+  squared_sums_.resize(squares ? size : 0);
+  std::fill(sums_.begin(), sums_.begin() + stride, T{0});
+  if (squares) {
+    std::fill(squared_sums_.begin(), squared_sums_.begin() + stride, T{0});
+  }
+
+  // bands of rows are integrated from zero in parallel, the last row of
+  // every band then carries the totals above it to the next one
+  const size_t chunks = num_chunks(rows_, kMinRowsPerChunk);
+  std::vector<size_t> ends(chunks);
+  parallel_for_chunks(
+      0, rows_,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        std::vector<T> running(channels_);
+        for (size_t y = lo; y < hi; ++y) {
+          const float* in = image.data() + y * cols_ * channels_;
+          const size_t above = y > lo ? y * stride : 0;
+          const size_t row = (y + 1) * stride;
+          integrate_row<T, false>(in, sums_.data() + above, cols_, channels_,
+                                  running.data(), sums_.data() + row);
+          if (squares) {
+            integrate_row<T, true>(in, squared_sums_.data() + above, cols_,
+                                   channels_, running.data(),
+                                   squared_sums_.data() + row);
+          }
+        }
+        ends[chunk] = hi;
+      },
+      kMinRowsPerChunk);
+  if (chunks == 1) {
+    return {};
+  }
+  const auto carry = [&](std::vector<T>& table) {
+    for (size_t chunk = 1; chunk < chunks; ++chunk) {
+      add_row(table.data(), stride, table.data() + ends[chunk - 1] * stride,
+              ends[chunk], ends[chunk] + 1);
+    }
+    parallel_for_chunks(
+        0, chunks,
+        [&](size_t, const size_t lo, const size_t hi) {
+          for (size_t chunk = std::max<size_t>(lo, 1); chunk < hi; ++chunk) {
+            add_row(table.data(), stride,
+                    table.data() + ends[chunk - 1] * stride,
+                    ends[chunk - 1] + 1, ends[chunk]);
+          }
+        });
+  };
+  carry(sums_);
+  if (squares) {
+    carry(squared_sums_);
+  }
+  return {};
+}
+
+template <typename T>
+std::expected<void, MatError> IntegralImage<T>::box_mean(const size_t radius,
+                                                         Mat& mean) const {
+  if (rows_ == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  ensure_shape(mean, rows_, cols_, channels_);
+  box_rows<T, false>(sums_, squared_sums_, rows_, cols_, channels_, radius,
+                     mean, nullptr);
+  return {};
+}
+
+template <typename T>
+std::expected<void, MatError> IntegralImage<T>::box_mean_variance(
+    const size_t radius, Mat& mean, Mat& variance) const {
+  if (rows_ == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (!squares_) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  ensure_shape(mean, rows_, cols_, channels_);
+  ensure_shape(variance, rows_, cols_, channels_);
+  box_rows<T, true>(sums_, squared_sums_, rows_, cols_, channels_, radius,
+                    mean, &variance);
+  return {};
+}
+
+template <typename T>
+std::expected<IntegralImage<T>, MatError> integral(const Mat& image) {
+  IntegralImage<T> tables;
+  auto computed = tables.compute(image);
+  if (!computed) {
+    return std::unexpected(computed.error());
+  }
+  return tables;
+}
+
+template <typename T>
+std::expected<Mat, MatError> box_filter(const Mat& image,
+                                        const size_t radius) {
+  IntegralImage<T> tables;
+  auto computed = tables.compute(image, false);
+  if (!computed) {
+    return std::unexpected(computed.error());
+  }
+  Mat mean;
+  auto filtered = tables.box_mean(radius, mean);
+  if (!filtered) {
+    return std::unexpected(filtered.error());
+  }
+  return mean;
+}
+
+template <typename T>
+std::expected<void, MatError> box_mean_variance(const Mat& image,
+                                                const size_t radius,
+                                                Mat& mean, Mat& variance) {
+  IntegralImage<T> tables;
+  auto computed = tables.compute(image);
+  if (!computed) {
+    return std::unexpected(computed.error());
+  }
+  return tables.box_mean_variance(radius, mean, variance);
+}
+
+template class IntegralImage<float>;
+template class IntegralImage<double>;
+template std::expected<IntegralImage<float>, MatError> integral<float>(
+    const Mat&);
+template std::expected<IntegralImage<double>, MatError> integral<double>(
+    const Mat&);
+template std::expected<Mat, MatError> box_filter<float>(const Mat&, size_t);
+template std::expected<Mat, MatError> box_filter<double>(const Mat&, size_t);
+template std::expected<void, MatError> box_mean_variance<float>(const Mat&,
+                                                                size_t, Mat&,
+                                                                Mat&);
+template std::expected<void, MatError> box_mean_variance<double>(const Mat&,
+                                                                 size_t, Mat&,
+                                                                 Mat&);
+
+};  // namespace core
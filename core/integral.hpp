@@ -0,0 +1,101 @@
+#pragma once
+
+#include <expected>
+#include <span>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+// summed area tables of an image and of its squares. the tables are
+// (rows + 1) x (cols + 1) x channels with a zero first row and column,
+// entry (y, x) holding the sums over the pixels above and left of pixel
+// (y, x), so any rectangle sums with four lookups.
+//
+// every table row is the running sums along its image row added to the
+// table row above, in one pass that vectorises across the channels of a
+// pixel and over the row above. bands of rows are integrated in parallel
+// and the totals of the bands above are added afterwards. T is float or
+// double: float tables are half the size but lose precision once the
+// totals grow, double keeps box sums of large images exact to float
+// precision. the tables keep their buffers between calls.
+template <typename T>
+class IntegralImage {
+ public:
+  // tables of `image`, and of its squares with `squares`
+  [[nodiscard]] std::expected<void, MatError> compute(const Mat& image,
+                                                      bool squares = true);
+
+  [[nodiscard]] size_t rows() const noexcept { return rows_; }
+  [[nodiscard]] size_t cols() const noexcept { return cols_; }
+  [[nodiscard]] size_t channels() const noexcept { return channels_; }
+  [[nodiscard]] bool has_squares() const noexcept { return squares_; }
+
+  [[nodiscard]] std::span<const T> sums() const noexcept { return sums_; }
+  [[nodiscard]] std::span<const T> squared_sums() const noexcept {
+    return squared_sums_;
+  }
+
+  // sums of channel `channel` over rows [top, bottom) and cols [left, right)
+  [[nodiscard]] T sum(const size_t top, const size_t left,
+                      const size_t bottom, const size_t right,
+                      const size_t channel = 0) const noexcept {
+    return rectangle(sums_, top, left, bottom, right, channel);
+  }
+  [[nodiscard]] T squared_sum(const size_t top, const size_t left,
+                              const size_t bottom, const size_t right,
+                              const size_t channel = 0) const noexcept {
+    return rectangle(squared_sums_, top, left, bottom, right, channel);
+  }
+
+  // mean of every channel over the (2 * radius + 1)^2 window around each
+  // pixel, cut at the image borders. `mean` keeps its buffer when the shape
+  // is unchanged.
+  [[nodiscard]] std::expected<void, MatError> box_mean(size_t radius,
+                                                       Mat& mean) const;
+  // the same means and the variances around them, needs the squares
+  [[nodiscard]] std::expected<void, MatError> box_mean_variance(
+      size_t radius, Mat& mean, Mat& variance) const;
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  [[nodiscard]] T rectangle(const std::vector<T>& table, const size_t top,
+                            const size_t left, const size_t bottom,
+                            const size_t right,
+                            const size_t channel) const noexcept {
+    const size_t stride = (cols_ + 1) * channels_;
+    const T* upper = table.data() + top * stride + channel;
+    const T* lower = table.data() + bottom * stride + channel;
+    return lower[right * channels_] - lower[left * channels_] -
+           upper[right * channels_] + upper[left * channels_];
+  }
+
+  size_t rows_ = 0;
+  size_t cols_ = 0;
+  size_t channels_ = 0;
+  bool squares_ = false;
+  std::vector<T> sums_;
+  std::vector<T> squared_sums_;
+};
+
+extern template class IntegralImage<float>;
+extern template class IntegralImage<double>;
+
+// tables of `image` and of its squares
+template <typename T = double>
+[[nodiscard]] std::expected<IntegralImage<T>, MatError> integral(
+    const Mat& image);
+
+// mean of every channel over the (2 * radius + 1)^2 window around each
+// pixel, cut at the image borders, through tables accumulated in T
+template <typename T = double>
+[[nodiscard]] std::expected<Mat, MatError> box_filter(const Mat& image,
+                                                      size_t radius);
+
+// windowed means and variances of every channel, as box_filter
+template <typename T = double>
+[[nodiscard]] std::expected<void, MatError> box_mean_variance(
+    const Mat& image, size_t radius, Mat& mean, Mat& variance);
+
+};  // namespace core
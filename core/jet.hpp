@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cmath>
+#include <compare>
+#include <cstddef>
+#include <type_traits>
+
+#include "core/fixed_mat.hpp"
+
+namespace core {
+
+namespace jet_detail {
+
+template <typename S>
+concept Arithmetic = std::is_arithmetic_v<S>;
+
+}  // namespace jet_detail
+
+// a dual number value + sum_i derivatives[i] e_i with e_i e_j = 0, which
+// carries a value and its partial derivatives in N variables through plain
+// arithmetic, forward-mode automatic differentiation. N is a compile-time
+// constant so a jet lives on the stack and each operation is one loop over
+// N contiguous lanes, vectorised like the rows of FixedMat.
+//
+// jets are FixedMat entries, so matrix products, inverses and solves
+// differentiate too. comparisons look at the values only. the <cmath>
+// functions below are found by argument-dependent lookup, generic code
+// calls them unqualified after using std::sqrt and friends so that the same
+// source compiles for T and for jets.
+template <typename T, size_t N>
+class Jet {
+  static_assert(std::is_floating_point_v<T>);
+  static_assert(N > 0);
+
+ public:
+  using value_type = T;
+  static constexpr size_t kSize = N;
+
+  constexpr Jet() noexcept = default;
+  // a constant, implicit so that scalars mix with jets in expressions
+  constexpr Jet(const T v) noexcept : value(v) {}
+  // variable k < N, with derivative 1 in lane k
+  constexpr Jet(const T v, const size_t k) noexcept : value(v) {
+    derivatives[k] = T{1};
+  }
+
+  constexpr Jet& operator+=(const Jet& other) noexcept {
+    for (size_t i = 0; i < N; ++i) {
+      derivatives[i] += other.derivatives[i];
+    }
+    value += other.value;
+    return *this;
+  }
+  constexpr Jet& operator-=(const Jet& other) noexcept {
+    for (size_t i = 0; i < N; ++i) {
+      derivatives[i] -= other.derivatives[i];
+    }
+    value -= other.value;
+    return *this;
+  }
+  constexpr Jet& operator*=(const Jet& other) noexcept {
+    for (size_t i = 0; i < N; ++i) {
+      derivatives[i] =
+          derivatives[i] * other.value + value * other.derivatives[i];
+    }
+    value *= other.value;
+    return *this;
+  }
+  constexpr Jet& operator/=(const Jet& other) noexcept {
+    const T inverse = T{1} / other.value;
+    value *= inverse;
+    for (size_t i = 0; i < N; ++i) {
+      derivatives[i] =
+          (derivatives[i] - value * other.derivatives[i]) * inverse;
+    }
+    return *this;
+  }
+  // scalars leave the derivatives alone or scale them, cheaper than
+  // promoting them to jets with zero derivatives
+  template <jet_detail::Arithmetic S>
+  constexpr Jet& operator+=(const S scalar) noexcept {
+    value += static_cast<T>(scalar);
+    return *this;
+  }
+  template <jet_detail::Arithmetic S>
+  constexpr Jet& operator-=(const S scalar) noexcept {
+    value -= static_cast<T>(scalar);
+    return *this;
+  }
+  template <jet_detail::Arithmetic S>
+  constexpr Jet& operator*=(const S scalar) noexcept {
+    const T s = static_cast<T>(scalar);
+    for (size_t i = 0; i < N; ++i) {
+      derivatives[i] *= s;
+    }
+    value *= s;
+    return *this;
+  }
+  template <jet_detail::Arithmetic S>
+  constexpr Jet& operator/=(const S scalar) noexcept {
+    return *this *= T{1} / static_cast<T>(scalar);
+  }
+
+  [[nodiscard]] constexpr Jet operator+() const noexcept { return *this; }
+  [[nodiscard]] constexpr Jet operator-() const noexcept {
+    Jet out = *this;
+    return out *= T{-1};
+  }
+
+  [[nodiscard]] friend constexpr Jet operator+(Jet x, const Jet& y) noexcept {
+    return x += y;
+  }
+  [[nodiscard]] friend constexpr Jet operator-(Jet x, const Jet& y) noexcept {
+    return x -= y;
+  }
+  [[nodiscard]] friend constexpr Jet operator*(Jet x, const Jet& y) noexcept {
+    return x *= y;
+  }
+  [[nodiscard]] friend constexpr Jet operator/(Jet x, const Jet& y) noexcept {
+    return x /= y;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend constexpr Jet operator+(Jet x, const S s) noexcept {
+    return x += s;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend constexpr Jet operator+(const S s, Jet x) noexcept {
+    return x += s;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend constexpr Jet operator-(Jet x, const S s) noexcept {
+    return x -= s;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend constexpr Jet operator-(const S s,
+                                               const Jet& x) noexcept {
+    Jet out = -x;
+    return out += s;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend constexpr Jet operator*(Jet x, const S s) noexcept {
+    return x *= s;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend constexpr Jet operator*(const S s, Jet x) noexcept {
+    return x *= s;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend constexpr Jet operator/(Jet x, const S s) noexcept {
+    return x /= s;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend constexpr Jet operator/(const S s,
+                                               const Jet& x) noexcept {
+    const T quotient = static_cast<T>(s) / x.value;
+    return chain(x, quotient, -quotient / x.value);
+  }
+
+  [[nodiscard]] friend constexpr bool operator==(const Jet& x,
+                                                 const Jet& y) noexcept {
+    return x.value == y.value;
+  }
+  [[nodiscard]] friend constexpr std::partial_ordering operator<=>(
+      const Jet& x, const Jet& y) noexcept {
+    return x.value <=> y.value;
+  }
+
+  [[nodiscard]] friend Jet abs(const Jet& x) noexcept {
+    return x.value < T{0} ? -x : x;
+  }
+  [[nodiscard]] friend Jet sqrt(const Jet& x) noexcept {
+    const T root = std::sqrt(x.value);
+    return chain(x, root, T{0.5} / root);
+  }
+  [[nodiscard]] friend Jet cbrt(const Jet& x) noexcept {
+    const T root = std::cbrt(x.value);
+    return chain(x, root, T{1} / (3 * root * root));
+  }
+  [[nodiscard]] friend Jet exp(const Jet& x) noexcept {
+    const T e = std::exp(x.value);
+    return chain(x, e, e);
+  }
+  [[nodiscard]] friend Jet log(const Jet& x) noexcept {
+    return chain(x, std::log(x.value), T{1} / x.value);
+  }
+  [[nodiscard]] friend Jet sin(const Jet& x) noexcept {
+    return chain(x, std::sin(x.value), std::cos(x.value));
+  }
+  [[nodiscard]] friend Jet cos(const Jet& x) noexcept {
+    return chain(x, std::cos(x.value), -std::sin(x.value));
+  }
+  [[nodiscard]] friend Jet tan(const Jet& x) noexcept {
+    const T t = std::tan(x.value);
+    return chain(x, t, T{1} + t * t);
+  }
+  [[nodiscard]] friend Jet asin(const Jet& x) noexcept {
+    return chain(x, std::asin(x.value),
+                 T{1} / std::sqrt(T{1} - x.value * x.value));
+  }
+  [[nodiscard]] friend Jet acos(const Jet& x) noexcept {
+    return chain(x, std::acos(x.value),
+                 T{-1} / std::sqrt(T{1} - x.value * x.value));
+  }
+  [[nodiscard]] friend Jet atan(const Jet& x) noexcept {
+    return chain(x, std::atan(x.value), T{1} / (T{1} + x.value * x.value));
+  }
+  // d atan2(y, x) = (x dy - y dx) / (x^2 + y^2)
+  [[nodiscard]] friend Jet atan2(const Jet& y, const Jet& x) noexcept {
+    const T inverse = T{1} / (x.value * x.value + y.value * y.value);
+    Jet out(std::atan2(y.value, x.value));
+    for (size_t i = 0; i < N; ++i) {
+      out.derivatives[i] =
+          (x.value * y.derivatives[i] - y.value * x.derivatives[i]) * inverse;
+    }
+    return out;
+  }
+  [[nodiscard]] friend Jet hypot(const Jet& x, const Jet& y) noexcept {
+    const T h = std::hypot(x.value, y.value);
+    const T inverse = T{1} / h;
+    Jet out(h);
+    for (size_t i = 0; i < N; ++i) {
+      out.derivatives[i] =
+          (x.value * x.derivatives[i] + y.value * y.derivatives[i]) * inverse;
+    }
+    return out;
+  }
+  template <jet_detail::Arithmetic S>
+  [[nodiscard]] friend Jet pow(const Jet& x, const S exponent) noexcept {
+    const T p = static_cast<T>(exponent);
+    return chain(x, std::pow(x.value, p), p * std::pow(x.value, p - T{1}));
+  }
+  // the value and every derivative
+  [[nodiscard]] friend bool isfinite(const Jet& x) noexcept {
+    bool finite = std::isfinite(x.value);
+    for (size_t i = 0; i < N; ++i) {
+      finite = finite && std::isfinite(x.derivatives[i]);
+    }
+    return finite;
+  }
+
+  // 16-byte aligned when the lanes fill whole vectors
+  alignas(sizeof(T) * N % 16 == 0 ? 16 : alignof(T)) T derivatives[N]{};
+  T value{};
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  // f(x) from f and f' at the value of x
+  [[nodiscard]] static constexpr Jet chain(const Jet& x, const T f,
+                                           const T derivative) noexcept {
+    Jet out(f);
+    for (size_t i = 0; i < N; ++i) {
+      out.derivatives[i] = derivative * x.derivatives[i];
+    }
+    return out;
+  }
+};
+
+template <typename T, size_t N>
+struct IsFixedMatScalar<Jet<T, N>> : std::true_type {};
+
+};  // namespace core
@@ -0,0 +1,463 @@
+#include "core/kd_tree.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+// subtrees this small are scanned linearly
+constexpr uint32_t kLeafSize = 12;
+// the stack holds at most one pending far child per level plus the current
+// node, 64 covers any tree indexable by uint32_t
+constexpr int kMaxStack = 64;
+constexpr size_t kMinQueriesPerChunk = 64;
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+// point i, axis a lives at coords[a][i * stride]
+struct PointView {
+  std::array<const float*, 3> coords{};
+  size_t stride = 1;
+  size_t size = 0;
+  size_t dims = 0;
+
+  [[nodiscard]] float operator()(const size_t i,
+                                 const size_t axis) const noexcept {
+    return coords[axis][i * stride];
+  }
+};
+
+std::expected<PointView, MatError> view_of(const Mat& points) {
+  size_t dims = 0;
+  if (points.channels() == 1) {
+    dims = points.cols();
+  } else if (points.cols() == 1) {
+    dims = points.channels();
+  }
+  if (dims != 2 && dims != 3) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+
+  PointView view;
+  for (size_t axis = 0; axis < dims; ++axis) {
+    view.coords[axis] = points.data() + axis;
+  }
+  view.stride = dims;
+  view.size = points.rows();
+  view.dims = dims;
+  return view;
+}
+
+PointView view_of(const PointCloud& cloud) {
+  return PointView{{cloud.x(), cloud.y(), cloud.z()}, 1, cloud.size(), 3};
+}
+
+struct Range {
+  uint32_t lo;
+  uint32_t hi;
+};
+
+// partitions [lo, hi) around its middle slot along the widest axis
+uint8_t split(const PointView& view, uint32_t* perm, const uint32_t lo,
+              const uint32_t hi) {
+  std::array<float, 3> low{kInfinity, kInfinity, kInfinity};
+  std::array<float, 3> high{-kInfinity, -kInfinity, -kInfinity};
+  for (uint32_t i = lo; i < hi; ++i) {
+    for (size_t axis = 0; axis < view.dims; ++axis) {
+      const float value = view(perm[i], axis);
+      low[axis] = std::min(low[axis], value);
+      high[axis] = std::max(high[axis], value);
+    }
+  }
+  uint8_t axis = 0;
+  for (uint8_t a = 1; a < view.dims; ++a) {
+    if (high[a] - low[a] > high[axis] - low[axis]) {
+      axis = a;
+    }
+  }
+
+  const uint32_t mid = lo + (hi - lo) / 2;
+  std::nth_element(perm + lo, perm + mid, perm + hi,
+                   [&](const uint32_t a, const uint32_t b) {
+                     return view(a, axis) < view(b, axis);
+                   });
+  return axis;
+}
+
+void build_subtree(const PointView& view, uint32_t* perm, uint8_t* split_dims,
+                   const uint32_t lo, const uint32_t hi) {
+  if (hi - lo <= kLeafSize) {
+    return;
+  }
+  const uint32_t mid = lo + (hi - lo) / 2;
+  split_dims[mid] = split(view, perm, lo, hi);
+  build_subtree(view, perm, split_dims, lo, mid);
+  build_subtree(view, perm, split_dims, mid + 1, hi);
+}
+
+template <int D>
+inline float distance_sq(const float* a, const float* b) noexcept {
+  float sum = 0.0f;
+  for (int axis = 0; axis < D; ++axis) {
+    const float diff = a[axis] - b[axis];
+    sum += diff * diff;
+  }
+  return sum;
+}
+
+// keeps the k best (slot, distance) pairs in ascending order
+inline void insert_nearest(const uint32_t slot, const float distance,
+                           uint32_t* slots, float* distances, size_t& found,
+                           const size_t k) noexcept {
+  size_t i = found < k ? found++ : k - 1;
+  while (i > 0 && distances[i - 1] > distance) {
+    slots[i] = slots[i - 1];
+    distances[i] = distances[i - 1];
+    --i;
+  }
+  slots[i] = slot;
+  distances[i] = distance;
+}
+
+struct Frame {
+  uint32_t lo;
+  uint32_t hi;
+  float bound;  // squared distance from the query to the subtree's cell
+};
+
+template <int D>
+size_t knn_search(const float* coords, const uint8_t* split_dims,
+                  const uint32_t n, const float* query, const size_t k,
+                  uint32_t* slots, float* distances,
+                  const float max_distance_sq) noexcept {
+  size_t found = 0;
+  const auto worst = [&] {
+    return found < k ? max_distance_sq : distances[k - 1];
+  };
+
+  Frame stack[kMaxStack];
+  int top = 0;
+  stack[top++] = {0, n, 0.0f};
+  while (top > 0) {
+    const Frame frame = stack[--top];
+    if (frame.bound > worst()) {
+      continue;
+    }
+    if (frame.hi - frame.lo <= kLeafSize) {
+      for (uint32_t i = frame.lo; i < frame.hi; ++i) {
+        const float d = distance_sq<D>(query, coords + i * D);
+        if (d < worst()) {
+          insert_nearest(i, d, slots, distances, found, k);
+        }
+      }
+      continue;
+    }
+
+    const uint32_t mid = frame.lo + (frame.hi - frame.lo) / 2;
+    const float* point = coords + mid * D;
+    const float d = distance_sq<D>(query, point);
+    if (d < worst()) {
+      insert_nearest(mid, d, slots, distances, found, k);
+    }
+    const uint8_t axis = split_dims[mid];
+    const float diff = query[axis] - point[axis];
+    const Frame low{frame.lo, mid, diff < 0.0f ? frame.bound
+                                               : std::max(frame.bound,
+                                                          diff * diff)};
+    const Frame high{mid + 1, frame.hi,
+                     diff < 0.0f ? std::max(frame.bound, diff * diff)
+                                 : frame.bound};
+    // near side is popped first
+    stack[top++] = diff < 0.0f ? high : low;
+    stack[top++] = diff < 0.0f ? low : high;
+  }
+  return found;
+}
+
+template <int D>
+void radius_search_impl(const float* coords, const uint8_t* split_dims,
+                        const uint32_t n, const float* query,
+                        const float radius_sq,
+                        std::vector<std::pair<float, uint32_t>>& hits) {
+  Frame stack[kMaxStack];
+  int top = 0;
+  stack[top++] = {0, n, 0.0f};
+  while (top > 0) {
+    const Frame frame = stack[--top];
+    if (frame.bound > radius_sq) {
+      continue;
+    }
+    if (frame.hi - frame.lo <= kLeafSize) {
+      for (uint32_t i = frame.lo; i < frame.hi; ++i) {
+        const float d = distance_sq<D>(query, coords + i * D);
+        if (d <= radius_sq) {
+          hits.emplace_back(d, i);
+        }
+      }
+      continue;
+    }
+
+    const uint32_t mid = frame.lo + (frame.hi - frame.lo) / 2;
+    const float* point = coords + mid * D;
+    const float d = distance_sq<D>(query, point);
+    if (d <= radius_sq) {
+      hits.emplace_back(d, mid);
+    }
+    const uint8_t axis = split_dims[mid];
+    const float diff = query[axis] - point[axis];
+    const float far_bound = std::max(frame.bound, diff * diff);
+    stack[top++] = {frame.lo, mid, diff < 0.0f ? frame.bound : far_bound};
+    stack[top++] = {mid + 1, frame.hi, diff < 0.0f ? far_bound : frame.bound};
+  }
+}
+
+std::expected<void, MatError> check_queries(const PointView& queries,
+                                            const size_t dims) {
+  if (queries.dims != dims) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  return {};
+}
+
+KnnResult batch_knn(const KdTree& tree, const PointView& queries,
+                    const size_t k) {
+  KnnResult result;
+  result.k = k;
+  result.indices.assign(queries.size * k, kNoNeighbor);
+  result.distances_sq.assign(queries.size * k, kInfinity);
+  parallel_for(
+      0, queries.size,
+      [&](const size_t lo, const size_t hi) {
+        float query[3];
+        for (size_t i = lo; i < hi; ++i) {
+          for (size_t axis = 0; axis < queries.dims; ++axis) {
+            query[axis] = queries(i, axis);
+          }
+          tree.knn(query, k, result.indices.data() + i * k,
+                   result.distances_sq.data() + i * k);
+        }
+      },
+      kMinQueriesPerChunk);
+  return result;
+}
+
+RadiusResult batch_radius(const KdTree& tree, const PointView& queries,
+                          const float radius) {
+  const size_t chunks = num_chunks(queries.size, kMinQueriesPerChunk);
+  std::vector<std::vector<uint32_t>> chunk_indices(chunks);
+  std::vector<std::vector<float>> chunk_distances(chunks);
+  RadiusResult result;
+  result.offsets.assign(queries.size + 1, 0);
+
+  parallel_for_chunks(
+      0, queries.size,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        float query[3];
+        for (size_t i = lo; i < hi; ++i) {
+          for (size_t axis = 0; axis < queries.dims; ++axis) {
+            query[axis] = queries(i, axis);
+          }
+          const size_t before = chunk_indices[chunk].size();
+          tree.radius_search(query, radius, chunk_indices[chunk],
+                             chunk_distances[chunk]);
+          result.offsets[i + 1] = chunk_indices[chunk].size() - before;
+        }
+      },
+      kMinQueriesPerChunk);
+
+  // chunks cover consecutive queries so concatenation matches the offsets
+  for (size_t i = 0; i < queries.size; ++i) {
+    result.offsets[i + 1] += result.offsets[i];
+  }
+  result.indices.reserve(result.offsets.back());
+  result.distances_sq.reserve(result.offsets.back());
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    result.indices.insert(result.indices.end(), chunk_indices[chunk].begin(),
+                          chunk_indices[chunk].end());
+    result.distances_sq.insert(result.distances_sq.end(),
+                               chunk_distances[chunk].begin(),
+                               chunk_distances[chunk].end());
+  }
+  return result;
+}
+
+std::expected<void, MatError> build_nodes(const PointView& view,
+                                          std::vector<float>& coords,
+                                          std::vector<uint32_t>& indices,
+                                          std::vector<uint8_t>& split_dims) {
+  if (view.size >= std::numeric_limits<uint32_t>::max()) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  const auto n = static_cast<uint32_t>(view.size);
+  // a nan has no place in the median splits, nth_element needs a strict
+  // weak order
+  for (uint32_t i = 0; i < n; ++i) {
+    for (size_t axis = 0; axis < view.dims; ++axis) {
+      if (!std::isfinite(view(i, axis))) {
+        return std::unexpected(MatError::InvalidParameter);
+      }
+    }
+  }
+  indices.resize(n);
+  split_dims.assign(n, 0);
+  for (uint32_t i = 0; i < n; ++i) {
+    indices[i] = i;
+  }
+
+  // split the top levels on this thread until there is enough independent
+  // work, then finish the subtrees in parallel
+  std::vector<Range> frontier{{0, n}};
+  const size_t target = 4 * num_threads();
+  bool splittable = true;
+  while (frontier.size() < target && splittable) {
+    splittable = false;
+    std::vector<Range> next;
+    for (const Range range : frontier) {
+      if (range.hi - range.lo <= kLeafSize) {
+        next.push_back(range);
+        continue;
+      }
+      const uint32_t mid = range.lo + (range.hi - range.lo) / 2;
+      split_dims[mid] = split(view, indices.data(), range.lo, range.hi);
+      next.push_back({range.lo, mid});
+      next.push_back({mid + 1, range.hi});
+      splittable = true;
+    }
+    frontier = std::move(next);
+  }
+  parallel_for(0, frontier.size(), [&](const size_t lo, const size_t hi) {
+    for (size_t i = lo; i < hi; ++i) {
+      build_subtree(view, indices.data(), split_dims.data(), frontier[i].lo,
+                    frontier[i].hi);
+    }
+  });
+
+  coords.resize(static_cast<size_t>(n) * view.dims);
+  parallel_for(
+      0, n,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          for (size_t axis = 0; axis < view.dims; ++axis) {
+            coords[i * view.dims + axis] = view(indices[i], axis);
+          }
+        }
+      },
+      kMinQueriesPerChunk * 64);
+  return {};
+}
+
+};  // namespace
+
+std::expected<KdTree, MatError> KdTree::build(const Mat& points) {
+  auto view = view_of(points);
+  if (!view) {
+    return std::unexpected(view.error());
+  }
+  KdTree tree;
+  tree.dims_ = view->dims;
+  if (auto built =
+          build_nodes(*view, tree.coords_, tree.indices_, tree.split_dims_);
+      !built) {
+    return std::unexpected(built.error());
+  }
+  return tree;
+}
+
+std::expected<KdTree, MatError> KdTree::build(const PointCloud& cloud) {
+  KdTree tree;
+  tree.dims_ = 3;
+  if (auto built = build_nodes(view_of(cloud), tree.coords_, tree.indices_,
+                               tree.split_dims_);
+      !built) {
+    return std::unexpected(built.error());
+  }
+  return tree;
+}
+
+size_t KdTree::knn(const float* query, const size_t k, uint32_t* indices,
+                   float* distances_sq,
+                   const float max_distance_sq) const noexcept {
+  if (k == 0 || indices_.empty()) {
+    return 0;
+  }
+  const auto n = static_cast<uint32_t>(size());
+  const size_t found =
+      dims_ == 2
+          ? knn_search<2>(coords_.data(), split_dims_.data(), n, query, k,
+                          indices, distances_sq, max_distance_sq)
+          : knn_search<3>(coords_.data(), split_dims_.data(), n, query, k,
+                          indices, distances_sq, max_distance_sq);
+  for (size_t i = 0; i < found; ++i) {
+    indices[i] = indices_[indices[i]];
+  }
+  return found;
+}
+
+void KdTree::radius_search(const float* query, const float radius,
+                           std::vector<uint32_t>& indices,
+                           std::vector<float>& distances_sq) const {
+  if (indices_.empty() || !(radius >= 0.0f)) {
+    return;
+  }
+  thread_local std::vector<std::pair<float, uint32_t>> hits;
+  hits.clear();
+  const auto n = static_cast<uint32_t>(size());
+  if (dims_ == 2) {
+    radius_search_impl<2>(coords_.data(), split_dims_.data(), n, query,
+                          radius * radius, hits);
+  } else {
+    radius_search_impl<3>(coords_.data(), split_dims_.data(), n, query,
+                          radius * radius, hits);
+  }
+  std::sort(hits.begin(), hits.end());
+  for (const auto& [distance, slot] : hits) {
+    indices.push_back(indices_[slot]);
+    distances_sq.push_back(distance);
+  }
+}
+
+std::expected<KnnResult, MatError> KdTree::knn(const Mat& queries,
+                                               const size_t k) const {
+  auto view = view_of(queries);
+  if (!view) {
+    return std::unexpected(view.error());
+  }
+  if (auto valid = check_queries(*view, dims_); !valid) {
+    return std::unexpected(valid.error());
+  }
+  return batch_knn(*this, *view, k);
+}
+
+std::expected<KnnResult, MatError> KdTree::knn(const PointCloud& queries,
+                                               const size_t k) const {
+  if (auto valid = check_queries(view_of(queries), dims_); !valid) {
+    return std::unexpected(valid.error());
+  }
+  return batch_knn(*this, view_of(queries), k);
+}
+
+std::expected<RadiusResult, MatError> KdTree::radius_search(
+    const Mat& queries, const float radius) const {
+  auto view = view_of(queries);
+  if (!view) {
+    return std::unexpected(view.error());
+  }
+  if (auto valid = check_queries(*view, dims_); !valid) {
+    return std::unexpected(valid.error());
+  }
+  return batch_radius(*this, *view, radius);
+}
+
+std::expected<RadiusResult, MatError> KdTree::radius_search(
+    const PointCloud& queries, const float radius) const {
+  if (auto valid = check_queries(view_of(queries), dims_); !valid) {
+    return std::unexpected(valid.error());
+  }
+  return batch_radius(*this, view_of(queries), radius);
+}
+
+};  // namespace core
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <limits>
+#include <vector>
+
+#include "core/mat.hpp"
+#include "core/point_cloud.hpp"
+
+namespace core {
+
+// index reported for missing neighbours when fewer than k points exist
+inline constexpr uint32_t kNoNeighbor = std::numeric_limits<uint32_t>::max();
+
+// row-major num_queries x k, nearest first
+struct KnnResult {
+  size_t k = 0;
+  std::vector<uint32_t> indices;
+  std::vector<float> distances_sq;
+};
+
+// neighbours of query q are [offsets[q], offsets[q + 1]), nearest first
+struct RadiusResult {
+  std::vector<size_t> offsets;
+  std::vector<uint32_t> indices;
+  std::vector<float> distances_sq;
+};
+
+// static 2d/3d kd-tree. nodes live in one contiguous array in implicit
+// order: the subtree over [lo, hi) has its splitting point at the middle
+// slot with the halves on either side, so there are no child pointers and
+// small subtrees become flat buckets. input points are read in place while
+// building and the tree keeps its own node-ordered copy.
+class KdTree {
+ public:
+  KdTree() noexcept = default;
+
+  // N x D single channel or N x 1 x D points with D = 2 or 3, all finite,
+  // else InvalidParameter
+  [[nodiscard]] static std::expected<KdTree, MatError> build(
+      const Mat& points);
+  [[nodiscard]] static std::expected<KdTree, MatError> build(
+      const PointCloud& cloud);
+
+  [[nodiscard]] size_t size() const noexcept { return indices_.size(); }
+  [[nodiscard]] size_t dims() const noexcept { return dims_; }
+
+  // up to k nearest neighbours of a dims()-long query, returns the number
+  // found. only points closer than max_distance_sq are considered, a tight
+  // bound prunes most of the tree.
+  size_t knn(const float* query, const size_t k, uint32_t* indices,
+             float* distances_sq,
+             const float max_distance_sq =
+                 std::numeric_limits<float>::infinity()) const noexcept;
+  // all points within radius of the query, appended nearest first
+  void radius_search(const float* query, const float radius,
+                     std::vector<uint32_t>& indices,
+                     std::vector<float>& distances_sq) const;
+
+  // batched queries run in parallel, query points follow the build layouts
+  [[nodiscard]] std::expected<KnnResult, MatError> knn(const Mat& queries,
+                                                       const size_t k) const;
+  [[nodiscard]] std::expected<KnnResult, MatError> knn(
+      const PointCloud& queries, const size_t k) const;
+  [[nodiscard]] std::expected<RadiusResult, MatError> radius_search(
+      const Mat& queries, const float radius) const;
+  [[nodiscard]] std::expected<RadiusResult, MatError> radius_search(
+      const PointCloud& queries, const float radius) const;
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  size_t dims_ = 0;
+  std::vector<float> coords_;        // dims_ floats per node
+  std::vector<uint32_t> indices_;    // input index per node
+  std::vector<uint8_t> split_dims_;  // split axis per node
+};
+
+};  // namespace core
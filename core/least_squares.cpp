@@ -0,0 +1,1453 @@
+#include "core/least_squares.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <tuple>
+
+#include "core/lie_group.hpp"
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kNone = std::numeric_limits<size_t>::max();
+constexpr uint32_t kNoBlock = std::numeric_limits<uint32_t>::max();
+// residual, parameter and hessian blocks per parallel chunk
+constexpr size_t kMinBlocksPerChunk = 256;
+// rows of U finished together before the trailing rows are updated
+constexpr size_t kPanel = 32;
+// multiply-adds per parallel chunk of the dense trailing update
+constexpr size_t kMinDenseWork = size_t{1} << 16;
+// doubles in the per chunk copies of the schur complement
+constexpr size_t kMaxPartialSize = size_t{1} << 24;
+// marquardt's scaling clamps the diagonal of J^T J into this range, so that
+// parameters no residual constrains are still damped
+constexpr double kMinDiagonal = 1e-6;
+constexpr double kMaxDiagonal = 1e32;
+constexpr double kMaxLambda = 1e32;
+
+double dot(const double* a, const double* b, const size_t n) {
+  double sum = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// y -= a * x over n entries
+void subtract_scaled(double* __restrict y, const double* __restrict x,
+                     const double a, const size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    y[i] -= a * x[i];
+  }
+}
+
+// the jacobian and hessian blocks are a few entries wide, the kernels on
+// them are plain loops that inline rather than calls into vectorised ones
+
+// out (ra x cb) += a^T b for row-major a (m x ra) and b (m x cb)
+void add_transpose_product(const double* __restrict a,
+                           const double* __restrict b, const size_t m,
+                           const size_t ra, const size_t cb,
+                           double* __restrict out) {
+  for (size_t k = 0; k < m; ++k) {
+    const double* bk = b + k * cb;
+    for (size_t r = 0; r < ra; ++r) {
+      const double scale = a[k * ra + r];
+      double* o = out + r * cb;
+      for (size_t c = 0; c < cb; ++c) {
+        o[c] += scale * bk[c];
+      }
+    }
+  }
+}
+
+// out (ra x cb) -= a b for row-major a (ra x m) and b (m x cb), rows of out
+// `stride` apart
+void subtract_product(const double* __restrict a, const double* __restrict b,
+                      const size_t ra, const size_t m, const size_t cb,
+                      double* __restrict out, const size_t stride) {
+  for (size_t r = 0; r < ra; ++r) {
+    double* o = out + r * stride;
+    for (size_t k = 0; k < m; ++k) {
+      const double scale = a[r * m + k];
+      const double* bk = b + k * cb;
+      for (size_t c = 0; c < cb; ++c) {
+        o[c] -= scale * bk[c];
+      }
+    }
+  }
+}
+
+// y += sign * A x for row-major A (rows x cols)
+void multiply_add(const double* __restrict a, const size_t rows,
+                  const size_t cols, const double* __restrict x,
+                  const double sign, double* __restrict y) {
+  for (size_t r = 0; r < rows; ++r) {
+    double sum = 0.0;
+    for (size_t c = 0; c < cols; ++c) {
+      sum += a[r * cols + c] * x[c];
+    }
+    y[r] += sign * sum;
+  }
+}
+
+// y += sign * A^T x for row-major A (rows x cols)
+void multiply_transpose_add(const double* __restrict a, const size_t rows,
+                            const size_t cols, const double* __restrict x,
+                            const double sign, double* __restrict y) {
+  for (size_t r = 0; r < rows; ++r) {
+    const double scale = sign * x[r];
+    for (size_t c = 0; c < cols; ++c) {
+      y[c] += scale * a[r * cols + c];
+    }
+  }
+}
+
+// A = U^T U in place on the upper triangle of the row-major n x n matrix,
+// false on a pivot that is not positive. panels of rows are factorised in
+// turn and the rows below a panel are then updated by all of it in one
+// parallel pass, every update is an axpy along a contiguous row.
+bool cholesky_upper(double* a, const size_t n) {
+  for (size_t j0 = 0; j0 < n; j0 += kPanel) {
+    const size_t j1 = std::min(n, j0 + kPanel);
+    for (size_t j = j0; j < j1; ++j) {
+      double* row = a + j * n;
+      if (!(row[j] > 0.0)) {
+        return false;
+      }
+      row[j] = std::sqrt(row[j]);
+      const double inverse = 1.0 / row[j];
+      for (size_t c = j + 1; c < n; ++c) {
+        row[c] *= inverse;
+      }
+      for (size_t i = j + 1; i < j1; ++i) {
+        subtract_scaled(a + i * n + i, row + i, row[i], n - i);
+      }
+    }
+    const size_t width = std::max<size_t>(n - j1, 1);
+    parallel_for(
+        j1, n,
+        [&](const size_t lo, const size_t hi) {
+          for (size_t i = lo; i < hi; ++i) {
+            for (size_t k = j0; k < j1; ++k) {
+              const double* panel = a + k * n;
+              subtract_scaled(a + i * n + i, panel + i, panel[i], n - i);
+            }
+          }
+        },
+        std::max<size_t>(1, kMinDenseWork / (width * (j1 - j0))));
+  }
+  return true;
+}
+
+// solves U^T U x = b in place
+void cholesky_solve(const double* u, const size_t n, double* x) {
+  for (size_t i = 0; i < n; ++i) {
+    x[i] /= u[i * n + i];
+    subtract_scaled(x + i + 1, u + i * n + i + 1, x[i], n - i - 1);
+  }
+  for (size_t i = n; i-- > 0;) {
+    double sum = x[i];
+    for (size_t c = i + 1; c < n; ++c) {
+      sum -= u[i * n + c] * x[c];
+    }
+    x[i] = sum / u[i * n + i];
+  }
+}
+
+// inverse of the symmetric positive definite n x n matrix a, overwriting a
+bool invert_spd(double* a, const size_t n, double* inverse) {
+  if (!cholesky_upper(a, n)) {
+    return false;
+  }
+  // the inverse is symmetric, so column c is written as row c
+  for (size_t c = 0; c < n; ++c) {
+    double* column = inverse + c * n;
+    std::fill(column, column + n, 0.0);
+    column[c] = 1.0;
+    cholesky_solve(a, n, column);
+  }
+  return true;
+}
+
+// d(q * exp(phi)) / dphi at phi = 0 for q = (w, x, y, z), into the 4 rows
+// of a row-major jacobian with `stride` columns starting at `column`
+void quaternion_plus_jacobian(const double* q, double* jacobian,
+                              const size_t stride, const size_t column) {
+  const double w = q[0], x = q[1], y = q[2], z = q[3];
+  const double rows[4][3] = {
+      {-x, -y, -z}, {w, -z, y}, {z, w, -x}, {-y, x, w}};
+  for (size_t r = 0; r < 4; ++r) {
+    for (size_t c = 0; c < 3; ++c) {
+      jacobian[r * stride + column + c] = 0.5 * rows[r][c];
+    }
+  }
+}
+
+SO3d quaternion(const double* q) {
+  return SO3d::from_quaternion(q[0], q[1], q[2], q[3]);
+}
+
+void store_quaternion(const SO3d& rotation, double* q) {
+  q[0] = rotation.w();
+  q[1] = rotation.x();
+  q[2] = rotation.y();
+  q[3] = rotation.z();
+}
+
+}  // namespace
+
+void SE3Manifold::plus(const double* x, const double* delta,
+                       double* out) const {
+  const SE3d pose(quaternion(x + 3), Vec3d(x[0], x[1], x[2]));
+  const SE3d moved = pose * SE3d::exp(Vec6d(delta[0], delta[1], delta[2],
+                                            delta[3], delta[4], delta[5]));
+  for (size_t i = 0; i < 3; ++i) {
+    out[i] = moved.translation()[i];
+  }
+  store_quaternion(moved.rotation(), out + 3);
+}
+
+void SE3Manifold::plus_jacobian(const double* x, double* jacobian) const {
+  // the translation moves by R rho, the rotation only with phi
+  std::fill(jacobian, jacobian + 7 * 6, 0.0);
+  const Mat3d rotation = quaternion(x + 3).matrix();
+  for (size_t r = 0; r < 3; ++r) {
+    for (size_t c = 0; c < 3; ++c) {
+      jacobian[r * 6 + c] = rotation(r, c);
+    }
+  }
+  quaternion_plus_jacobian(x + 3, jacobian + 3 * 6, 6, 3);
+}
+
+void SO3Manifold::plus(const double* x, const double* delta,
+                       double* out) const {
+  store_quaternion(
+      quaternion(x) * SO3d::exp(Vec3d(delta[0], delta[1], delta[2])), out);
+}
+
+void SO3Manifold::plus_jacobian(const double* x, double* jacobian) const {
+  quaternion_plus_jacobian(x, jacobian, 3, 0);
+}
+
+std::expected<size_t, MatError> LeastSquaresProblem::add_parameter_block(
+    double* values, const size_t size) {
+  if (values == nullptr || size == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  parameters_.push_back({values, size, nullptr, false, false});
+  return parameters_.size() - 1;
+}
+
+std::expected<size_t, MatError> LeastSquaresProblem::add_residual_block(
+    std::shared_ptr<const CostFunction> cost, std::vector<size_t> blocks) {
+  if (cost == nullptr) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  if (cost->num_residuals() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  const auto sizes = cost->parameter_block_sizes();
+  if (sizes.size() != blocks.size()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  for (const size_t block : blocks) {
+    if (block >= parameters_.size()) {
+      return std::unexpected(MatError::OutOfBounds);
+    }
+  }
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (parameters_[blocks[i]].size != sizes[i]) {
+      return std::unexpected(MatError::IncompatibleDimensions);
+    }
+    if (std::find(blocks.begin(), blocks.begin() + i, blocks[i]) !=
+        blocks.begin() + i) {
+      return std::unexpected(MatError::InvalidParameter);
+    }
+  }
+  num_residuals_ += cost->num_residuals();
+  residuals_.push_back({std::move(cost), std::move(blocks)});
+  return residuals_.size() - 1;
+}
+
+std::expected<void, MatError> LeastSquaresProblem::set_manifold(
+    const size_t block, std::shared_ptr<const Manifold> manifold) {
+  if (block >= parameters_.size()) {
+    return std::unexpected(MatError::OutOfBounds);
+  }
+  if (manifold != nullptr &&
+      manifold->ambient_size() != parameters_[block].size) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  parameters_[block].manifold = std::move(manifold);
+  return {};
+}
+
+std::expected<void, MatError> LeastSquaresProblem::set_constant(
+    const size_t block, const bool constant) {
+  if (block >= parameters_.size()) {
+    return std::unexpected(MatError::OutOfBounds);
+  }
+  parameters_[block].constant = constant;
+  return {};
+}
+
+std::expected<void, MatError> LeastSquaresProblem::set_eliminated(
+    const size_t block, const bool eliminated) {
+  if (block >= parameters_.size()) {
+    return std::unexpected(MatError::OutOfBounds);
+  }
+  parameters_[block].eliminated = eliminated;
+  return {};
+}
+
+std::expected<double, MatError> LeastSquaresProblem::cost() const {
+  std::vector<const double*> values;
+  std::vector<double> residuals;
+  double cost = 0.0;
+  for (const ResidualBlock& block : residuals_) {
+    values.clear();
+    for (const size_t p : block.blocks) {
+      values.push_back(parameters_[p].values);
+    }
+    residuals.resize(block.cost->num_residuals());
+    if (!block.cost->evaluate(values.data(), residuals.data(), nullptr)) {
+      return std::unexpected(MatError::InvalidParameter);
+    }
+    cost += 0.5 * dot(residuals.data(), residuals.data(), residuals.size());
+  }
+  return cost;
+}
+
+std::expected<void, MatError> LeastSquaresSolver::analyse(
+    const LeastSquaresProblem& problem) {
+  const auto& parameters = problem.parameters_;
+  const auto& residuals = problem.residuals_;
+  if (residuals.empty()) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+
+  // active blocks, the reduced ones first
+  active_.clear();
+  active_index_.assign(parameters.size(), kNone);
+  for (const bool eliminated : {false, true}) {
+    for (size_t p = 0; p < parameters.size(); ++p) {
+      if (!parameters[p].constant && parameters[p].eliminated == eliminated) {
+        active_index_[p] = active_.size();
+        active_.push_back(static_cast<uint32_t>(p));
+      }
+    }
+    if (!eliminated) {
+      reduced_blocks_ = active_.size();
+    }
+  }
+  const size_t blocks = active_.size();
+  tangent_sizes_.resize(blocks);
+  tangent_offsets_.resize(blocks + 1);
+  value_offsets_.resize(blocks + 1);
+  square_offsets_.resize(blocks + 1);
+  plus_offsets_.assign(blocks, kNone);
+  tangent_offsets_[0] = value_offsets_[0] = square_offsets_[0] = 0;
+  size_t plus_size = 0;
+  for (size_t a = 0; a < blocks; ++a) {
+    const auto& block = parameters[active_[a]];
+    const size_t t =
+        block.manifold != nullptr ? block.manifold->tangent_size() : block.size;
+    if (block.manifold != nullptr) {
+      plus_offsets_[a] = plus_size;
+      plus_size += block.size * t;
+    }
+    tangent_sizes_[a] = t;
+    tangent_offsets_[a + 1] = tangent_offsets_[a] + t;
+    value_offsets_[a + 1] = value_offsets_[a] + block.size;
+    square_offsets_[a + 1] = square_offsets_[a] + t * t;
+  }
+  reduced_size_ = tangent_offsets_[reduced_blocks_];
+  tangent_size_ = tangent_offsets_[blocks];
+  plus_jacobians_.resize(plus_size);
+
+  // jacobian blocks in residual and slot order
+  residual_offsets_.resize(residuals.size() + 1);
+  residual_offsets_[0] = 0;
+  jacobian_first_.resize(residuals.size() + 1);
+  jacobian_blocks_.clear();
+  size_t jacobian_size = 0;
+  for (size_t i = 0; i < residuals.size(); ++i) {
+    const size_t m = residuals[i].cost->num_residuals();
+    residual_offsets_[i + 1] = residual_offsets_[i] + m;
+    jacobian_first_[i] = static_cast<uint32_t>(jacobian_blocks_.size());
+    size_t eliminated = 0;
+    for (const size_t p : residuals[i].blocks) {
+      const size_t a = active_index_[p];
+      if (a == kNone) {
+        continue;
+      }
+      eliminated += a >= reduced_blocks_ ? 1 : 0;
+      jacobian_blocks_.push_back({static_cast<uint32_t>(i),
+                                  static_cast<uint32_t>(a), jacobian_size});
+      jacobian_size += m * tangent_sizes_[a];
+    }
+    if (eliminated > 1) {
+      return std::unexpected(MatError::InvalidParameter);
+    }
+  }
+  jacobian_first_[residuals.size()] =
+      static_cast<uint32_t>(jacobian_blocks_.size());
+  jacobians_.resize(jacobian_size);
+  residuals_.resize(residual_offsets_.back());
+  candidate_residuals_.resize(residual_offsets_.back());
+
+  block_jacobian_first_.assign(blocks + 1, 0);
+  for (const JacobianBlock& j : jacobian_blocks_) {
+    ++block_jacobian_first_[j.block + 1];
+  }
+  for (size_t a = 0; a < blocks; ++a) {
+    block_jacobian_first_[a + 1] += block_jacobian_first_[a];
+  }
+  block_jacobians_.resize(jacobian_blocks_.size());
+  {
+    std::vector<uint32_t> cursor(block_jacobian_first_.begin(),
+                                 block_jacobian_first_.end() - 1);
+    for (size_t j = 0; j < jacobian_blocks_.size(); ++j) {
+      block_jacobians_[cursor[jacobian_blocks_[j].block]++] =
+          static_cast<uint32_t>(j);
+    }
+  }
+
+  // every product of two jacobian blocks of a residual block that lands in
+  // the upper reduced blocks, the couplings or the eliminated diagonal,
+  // keyed by (kind, row, col). the diagonal blocks get an empty entry so
+  // that they exist even without residuals to damp.
+  enum Kind : uint32_t { kReduced, kCoupling, kEliminated };
+  std::vector<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, uint32_t>>
+      entries;
+  for (size_t a = 0; a < blocks; ++a) {
+    const uint32_t b = static_cast<uint32_t>(a);
+    entries.emplace_back(a < reduced_blocks_ ? kReduced : kEliminated, b, b,
+                         kNoBlock, kNoBlock);
+  }
+  for (size_t i = 0; i < residuals.size(); ++i) {
+    for (uint32_t p = jacobian_first_[i]; p < jacobian_first_[i + 1]; ++p) {
+      const uint32_t a = jacobian_blocks_[p].block;
+      for (uint32_t q = jacobian_first_[i]; q < jacobian_first_[i + 1]; ++q) {
+        const uint32_t b = jacobian_blocks_[q].block;
+        if (a >= reduced_blocks_ && b >= reduced_blocks_) {
+          entries.emplace_back(kEliminated, a, b, p, q);
+        } else if (b >= reduced_blocks_) {
+          entries.emplace_back(kCoupling, b, a, p, q);
+        } else if (a < reduced_blocks_ && a <= b) {
+          entries.emplace_back(kReduced, a, b, p, q);
+        }
+      }
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+
+  // groups of equal keys become blocks, their contributions stay in order
+  struct Group {
+    uint32_t kind, row, col, first, last;
+  };
+  std::vector<Group> groups;
+  contributions_.clear();
+  for (const auto& [kind, row, col, p, q] : entries) {
+    if (groups.empty() || groups.back().kind != kind ||
+        groups.back().row != row || groups.back().col != col) {
+      const auto first = static_cast<uint32_t>(contributions_.size());
+      groups.push_back({kind, row, col, first, first});
+    }
+    if (p != kNoBlock) {
+      contributions_.emplace_back(p, q);
+      groups.back().last = static_cast<uint32_t>(contributions_.size());
+    }
+  }
+
+  // reduced rows hold the mirrors of the upper blocks above them first, then
+  // their own upper blocks, so every row runs in column order
+  hessian_blocks_.clear();
+  diagonal_blocks_.assign(blocks, kNoBlock);
+  size_t hessian_size = 0;
+  const auto push_block = [&](const uint32_t row, const uint32_t col,
+                              const uint32_t first, const uint32_t last,
+                              const uint32_t mirror) {
+    if (row == col) {
+      diagonal_blocks_[row] = static_cast<uint32_t>(hessian_blocks_.size());
+    }
+    hessian_blocks_.push_back({row, col, hessian_size, first, last, mirror});
+    hessian_size += tangent_sizes_[row] * tangent_sizes_[col];
+  };
+  size_t reduced_groups = 0;
+  while (reduced_groups < groups.size() &&
+         groups[reduced_groups].kind == kReduced) {
+    ++reduced_groups;
+  }
+  std::vector<uint32_t> column_first(reduced_blocks_ + 1, 0);
+  for (size_t g = 0; g < reduced_groups; ++g) {
+    if (groups[g].row != groups[g].col) {
+      ++column_first[groups[g].col + 1];
+    }
+  }
+  for (size_t c = 0; c < reduced_blocks_; ++c) {
+    column_first[c + 1] += column_first[c];
+  }
+  std::vector<uint32_t> by_column(column_first.back());
+  {
+    std::vector<uint32_t> cursor(column_first.begin(),
+                                 column_first.end() - 1);
+    for (size_t g = 0; g < reduced_groups; ++g) {
+      if (groups[g].row != groups[g].col) {
+        by_column[cursor[groups[g].col]++] = static_cast<uint32_t>(g);
+      }
+    }
+  }
+  std::vector<uint32_t> placed(reduced_groups);
+  reduced_row_first_.resize(reduced_blocks_ + 1);
+  size_t g = 0;
+  for (uint32_t r = 0; r < reduced_blocks_; ++r) {
+    reduced_row_first_[r] = static_cast<uint32_t>(hessian_blocks_.size());
+    for (uint32_t k = column_first[r]; k < column_first[r + 1]; ++k) {
+      push_block(r, groups[by_column[k]].row, 0, 0, placed[by_column[k]]);
+    }
+    for (; g < reduced_groups && groups[g].row == r; ++g) {
+      placed[g] = static_cast<uint32_t>(hessian_blocks_.size());
+      push_block(r, groups[g].col, groups[g].first, groups[g].last,
+                 kNoBlock);
+    }
+  }
+  reduced_row_first_[reduced_blocks_] =
+      static_cast<uint32_t>(hessian_blocks_.size());
+  // the upper reduced blocks are summed residual by residual instead
+  residual_pair_first_.assign(residuals.size() + 1, 0);
+  for (size_t group = 0; group < reduced_groups; ++group) {
+    for (uint32_t c = groups[group].first; c < groups[group].last; ++c) {
+      ++residual_pair_first_[jacobian_blocks_[contributions_[c].first]
+                                 .residual + 1];
+    }
+  }
+  for (size_t i = 0; i < residuals.size(); ++i) {
+    residual_pair_first_[i + 1] += residual_pair_first_[i];
+  }
+  residual_pairs_.resize(residual_pair_first_.back());
+  {
+    std::vector<uint32_t> cursor(residual_pair_first_.begin(),
+                                 residual_pair_first_.end() - 1);
+    for (size_t group = 0; group < reduced_groups; ++group) {
+      HessianBlock& block = hessian_blocks_[placed[group]];
+      for (uint32_t c = block.first; c < block.last; ++c) {
+        const auto [p, q] = contributions_[c];
+        residual_pairs_[cursor[jacobian_blocks_[p].residual]++] = {
+            p, q, block.offset};
+      }
+      block.first = block.last = 0;
+    }
+  }
+
+  // couplings as (reduced row, eliminated col) blocks in eliminated order
+  const size_t eliminated_blocks = blocks - reduced_blocks_;
+  eliminated_coupling_first_.assign(eliminated_blocks + 1, 0);
+  for (; g < groups.size() && groups[g].kind == kCoupling; ++g) {
+    ++eliminated_coupling_first_[groups[g].row - reduced_blocks_ + 1];
+    push_block(groups[g].col, groups[g].row, groups[g].first, groups[g].last,
+               kNoBlock);
+  }
+  const size_t coupling_first = reduced_row_first_[reduced_blocks_];
+  coupling_base_ = coupling_first < hessian_blocks_.size()
+                       ? hessian_blocks_[coupling_first].offset
+                       : hessian_size;
+  coupling_products_.resize(hessian_size - coupling_base_);
+  for (size_t e = 0; e < eliminated_blocks; ++e) {
+    eliminated_coupling_first_[e + 1] += eliminated_coupling_first_[e];
+  }
+  for (size_t e = 0; e <= eliminated_blocks; ++e) {
+    eliminated_coupling_first_[e] += static_cast<uint32_t>(coupling_first);
+  }
+  for (; g < groups.size(); ++g) {
+    push_block(groups[g].row, groups[g].col, groups[g].first, groups[g].last,
+               kNoBlock);
+  }
+
+  hessian_.resize(hessian_size);
+  gradient_.resize(tangent_size_);
+  diagonal_.resize(tangent_size_);
+  step_.resize(tangent_size_);
+  scratch_.resize(tangent_size_);
+  reduced_rhs_.resize(reduced_size_);
+  block_inverses_.resize(square_offsets_[blocks]);
+  saved_values_.resize(value_offsets_[blocks]);
+  if (params_.linear_solver == LinearSolverType::SparseCholesky &&
+      reduced_blocks_ > 0) {
+    return analyse_sparse();
+  }
+  return {};
+}
+
+std::expected<void, MatError> LeastSquaresSolver::analyse_sparse() {
+  // S_cd is structurally non-zero for d = c, for the reduced blocks of J^T J
+  // and for every pair of reduced neighbours of an eliminated block
+  const size_t reduced = reduced_blocks_;
+  std::vector<std::vector<uint32_t>> columns(reduced);
+  for (size_t c = 0; c < reduced; ++c) {
+    columns[c].push_back(static_cast<uint32_t>(c));
+    for (uint32_t b = reduced_row_first_[c]; b < reduced_row_first_[c + 1];
+         ++b) {
+      if (hessian_blocks_[b].col > c) {
+        columns[c].push_back(hessian_blocks_[b].col);
+      }
+    }
+  }
+  for (size_t e = 0; e + reduced < active_.size(); ++e) {
+    const uint32_t first = eliminated_coupling_first_[e];
+    const uint32_t last = eliminated_coupling_first_[e + 1];
+    for (uint32_t b = first; b < last; ++b) {
+      for (uint32_t k = first; k < last; ++k) {
+        const uint32_t c = hessian_blocks_[b].row;
+        const uint32_t d = hessian_blocks_[k].row;
+        if (d > c) {
+          columns[c].push_back(d);
+        }
+      }
+    }
+  }
+
+  // the scalar pattern, every row of block row c spanning all its blocks
+  const size_t n = reduced_size_;
+  sparse_block_first_.assign(1, 0);
+  sparse_block_columns_.clear();
+  sparse_block_positions_.clear();
+  sparse_row_offsets_.assign(1, 0);
+  std::vector<uint32_t> scalar_columns;
+  for (size_t c = 0; c < reduced; ++c) {
+    std::sort(columns[c].begin(), columns[c].end());
+    columns[c].erase(std::unique(columns[c].begin(), columns[c].end()),
+                     columns[c].end());
+    const size_t row_begin = scalar_columns.size();
+    for (const uint32_t d : columns[c]) {
+      sparse_block_columns_.push_back(d);
+      sparse_block_positions_.push_back(scalar_columns.size() - row_begin);
+      for (size_t j = 0; j < tangent_sizes_[d]; ++j) {
+        scalar_columns.push_back(
+            static_cast<uint32_t>(tangent_offsets_[d] + j));
+      }
+    }
+    sparse_block_first_.push_back(
+        static_cast<uint32_t>(sparse_block_columns_.size()));
+    const size_t length = scalar_columns.size() - row_begin;
+    for (size_t i = 1; i < tangent_sizes_[c]; ++i) {
+      scalar_columns.insert(scalar_columns.end(),
+                            scalar_columns.begin() +
+                                static_cast<ptrdiff_t>(row_begin),
+                            scalar_columns.begin() +
+                                static_cast<ptrdiff_t>(row_begin + length));
+    }
+    for (size_t i = 0; i < tangent_sizes_[c]; ++i) {
+      sparse_row_offsets_.push_back(sparse_row_offsets_.back() + length);
+    }
+  }
+  sparse_values_.resize(scalar_columns.size());
+  return sparse_.analyze(n, sparse_row_offsets_, scalar_columns);
+}
+
+bool LeastSquaresSolver::evaluate(const LeastSquaresProblem& problem,
+                                  const bool jacobians,
+                                  std::vector<double>& residuals,
+                                  std::vector<double>& jacobian_values,
+                                  double& cost) {
+  const auto& parameters = problem.parameters_;
+  if (jacobians) {
+    parallel_for(
+        0, active_.size(),
+        [&](const size_t lo, const size_t hi) {
+          for (size_t a = lo; a < hi; ++a) {
+            if (plus_offsets_[a] != kNone) {
+              const auto& block = parameters[active_[a]];
+              block.manifold->plus_jacobian(
+                  block.values, plus_jacobians_.data() + plus_offsets_[a]);
+            }
+          }
+        },
+        kMinBlocksPerChunk);
+  }
+
+  const size_t n = problem.residuals_.size();
+  const size_t chunks = num_chunks(n, kMinBlocksPerChunk);
+  std::vector<double> costs(chunks, 0.0);
+  std::vector<uint8_t> valid(chunks, 1);
+  parallel_for_chunks(
+      0, n,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        std::vector<const double*> values;
+        std::vector<double*> outputs;
+        // manifold blocks are differentiated with respect to their ambient
+        // parameters here, then chained to the tangent
+        std::vector<double> ambient;
+        for (size_t i = lo; i < hi; ++i) {
+          const auto& block = problem.residuals_[i];
+          const size_t m = block.cost->num_residuals();
+          double* r = residuals.data() + residual_offsets_[i];
+          values.clear();
+          outputs.clear();
+          size_t ambient_size = 0;
+          for (const size_t p : block.blocks) {
+            values.push_back(parameters[p].values);
+            const size_t a = active_index_[p];
+            if (a != kNone && plus_offsets_[a] != kNone) {
+              ambient_size += m * parameters[p].size;
+            }
+          }
+          ambient.resize(ambient_size);
+          if (jacobians) {
+            uint32_t j = jacobian_first_[i];
+            size_t used = 0;
+            for (const size_t p : block.blocks) {
+              const size_t a = active_index_[p];
+              if (a == kNone) {
+                outputs.push_back(nullptr);
+              } else if (plus_offsets_[a] != kNone) {
+                outputs.push_back(ambient.data() + used);
+                used += m * parameters[p].size;
+                ++j;
+              } else {
+                outputs.push_back(jacobian_values.data() +
+                                  jacobian_blocks_[j++].offset);
+              }
+            }
+          }
+          if (!block.cost->evaluate(values.data(), r,
+                                    jacobians ? outputs.data() : nullptr)) {
+            valid[chunk] = 0;
+            return;
+          }
+          costs[chunk] += 0.5 * dot(r, r, m);
+          if (!jacobians) {
+            continue;
+          }
+          uint32_t j = jacobian_first_[i];
+          for (size_t s = 0; s < block.blocks.size(); ++s) {
+            const size_t a = active_index_[block.blocks[s]];
+            if (a == kNone) {
+              continue;
+            }
+            const JacobianBlock& target = jacobian_blocks_[j++];
+            if (plus_offsets_[a] == kNone) {
+              continue;
+            }
+            const size_t size = parameters[block.blocks[s]].size;
+            const size_t t = tangent_sizes_[a];
+            double* out = jacobian_values.data() + target.offset;
+            std::fill(out, out + m * t, 0.0);
+            for (size_t k = 0; k < m; ++k) {
+              multiply_transpose_add(plus_jacobians_.data() + plus_offsets_[a],
+                                     size, t, outputs[s] + k * size, 1.0,
+                                     out + k * t);
+            }
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+
+  cost = 0.0;
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    if (valid[chunk] == 0) {
+      return false;
+    }
+    cost += costs[chunk];
+  }
+  return std::isfinite(cost);
+}
+
+void LeastSquaresSolver::build_normal_equations() {
+  const auto residual_size = [&](const uint32_t j) {
+    const uint32_t i = jacobian_blocks_[j].residual;
+    return residual_offsets_[i + 1] - residual_offsets_[i];
+  };
+  // the reduced blocks, few and touched by residuals all over the jacobian,
+  // are summed in one sequential pass over the residual blocks into a copy
+  // per chunk, together with their gradient. the copies are added up after.
+  const size_t residuals = residual_offsets_.size() - 1;
+  const size_t reduced_hessian = coupling_base_;
+  const size_t partial_size = reduced_hessian + reduced_size_;
+  const size_t chunks = num_chunks(residuals, kMinBlocksPerChunk);
+  partials_.assign((chunks - 1) * partial_size, 0.0);
+  std::fill(hessian_.begin(), hessian_.begin() + reduced_hessian, 0.0);
+  std::fill(gradient_.begin(), gradient_.begin() + reduced_size_, 0.0);
+  parallel_for_chunks(
+      0, residuals,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        double* h = chunk == 0
+                        ? hessian_.data()
+                        : partials_.data() + (chunk - 1) * partial_size;
+        double* g = chunk == 0 ? gradient_.data() : h + reduced_hessian;
+        for (size_t i = lo; i < hi; ++i) {
+          const size_t m = residual_offsets_[i + 1] - residual_offsets_[i];
+          for (uint32_t k = residual_pair_first_[i];
+               k < residual_pair_first_[i + 1]; ++k) {
+            const ReducedPair& pair = residual_pairs_[k];
+            const JacobianBlock& a = jacobian_blocks_[pair.p];
+            const JacobianBlock& b = jacobian_blocks_[pair.q];
+            add_transpose_product(jacobians_.data() + a.offset,
+                                  jacobians_.data() + b.offset, m,
+                                  tangent_sizes_[a.block],
+                                  tangent_sizes_[b.block], h + pair.offset);
+          }
+          for (uint32_t j = jacobian_first_[i]; j < jacobian_first_[i + 1];
+               ++j) {
+            const JacobianBlock& a = jacobian_blocks_[j];
+            if (a.block < reduced_blocks_) {
+              multiply_transpose_add(
+                  jacobians_.data() + a.offset, m, tangent_sizes_[a.block],
+                  residuals_.data() + residual_offsets_[i], 1.0,
+                  g + tangent_offsets_[a.block]);
+            }
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+  parallel_for(
+      0, partial_size,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t chunk = 1; chunk < chunks; ++chunk) {
+          const double* partial =
+              partials_.data() + (chunk - 1) * partial_size;
+          for (size_t k = lo; k < hi; ++k) {
+            (k < reduced_hessian ? hessian_[k]
+                                 : gradient_[k - reduced_hessian]) +=
+                partial[k];
+          }
+        }
+      },
+      kMinDenseWork);
+
+  // the couplings and eliminated blocks gather their contributions, the
+  // residual blocks of an eliminated block are usually close together
+  parallel_for(
+      reduced_row_first_.back(), hessian_blocks_.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t b = lo; b < hi; ++b) {
+          const HessianBlock& block = hessian_blocks_[b];
+          const size_t rows = tangent_sizes_[block.row];
+          const size_t cols = tangent_sizes_[block.col];
+          double* h = hessian_.data() + block.offset;
+          std::fill(h, h + rows * cols, 0.0);
+          for (uint32_t c = block.first; c < block.last; ++c) {
+            const auto [p, q] = contributions_[c];
+            const double* jacobians = jacobians_.data();
+            add_transpose_product(jacobians + jacobian_blocks_[p].offset,
+                                  jacobians + jacobian_blocks_[q].offset,
+                                  residual_size(p), rows, cols, h);
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+  // the lower reduced blocks are transposes of upper ones
+  parallel_for(
+      0, reduced_row_first_.back(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t b = lo; b < hi; ++b) {
+          const HessianBlock& block = hessian_blocks_[b];
+          if (block.mirror == kNoBlock) {
+            continue;
+          }
+          const size_t rows = tangent_sizes_[block.row];
+          const size_t cols = tangent_sizes_[block.col];
+          const double* source =
+              hessian_.data() + hessian_blocks_[block.mirror].offset;
+          double* h = hessian_.data() + block.offset;
+          for (size_t r = 0; r < rows; ++r) {
+            for (size_t c = 0; c < cols; ++c) {
+              h[r * cols + c] = source[c * rows + r];
+            }
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+
+  // the eliminated gradient and the clamped diagonal for the damping
+  parallel_for(
+      0, active_.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t a = lo; a < hi; ++a) {
+          const size_t t = tangent_sizes_[a];
+          double* g = gradient_.data() + tangent_offsets_[a];
+          if (a >= reduced_blocks_) {
+            std::fill(g, g + t, 0.0);
+          }
+          for (uint32_t k = a >= reduced_blocks_ ? block_jacobian_first_[a]
+                                                 : block_jacobian_first_[a + 1];
+               k < block_jacobian_first_[a + 1]; ++k) {
+            const JacobianBlock& j = jacobian_blocks_[block_jacobians_[k]];
+            const size_t m = residual_size(block_jacobians_[k]);
+            multiply_transpose_add(jacobians_.data() + j.offset, m, t,
+                                   residuals_.data() +
+                                       residual_offsets_[j.residual],
+                                   1.0, g);
+          }
+          const double* h =
+              hessian_.data() + hessian_blocks_[diagonal_blocks_[a]].offset;
+          for (size_t i = 0; i < t; ++i) {
+            diagonal_[tangent_offsets_[a] + i] =
+                std::clamp(h[i * t + i], kMinDiagonal, kMaxDiagonal);
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+}
+
+bool LeastSquaresSolver::solve_step(const double lambda) {
+  lambda_ = lambda;
+  const size_t reduced = reduced_blocks_;
+  const size_t blocks = active_.size();
+  const size_t n = reduced_size_;
+
+  // per eliminated block: the damped inverse, H_ee^-1 W_de^T for every
+  // coupling, shared by all the reduced blocks next to e, and the terms
+  // W_ce H_ee^-1 g_e of the reduced right-hand side in a copy per chunk
+  const size_t chunks = num_chunks(blocks - reduced, kMinBlocksPerChunk);
+  partials_.assign(chunks * n, 0.0);
+  std::vector<uint8_t> valid(chunks, 1);
+  parallel_for_chunks(
+      reduced, blocks,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        double* rhs = partials_.data() + chunk * n;
+        std::vector<double> work;
+        for (size_t e = lo; e < hi; ++e) {
+          const size_t t = tangent_sizes_[e];
+          const double* h =
+              hessian_.data() + hessian_blocks_[diagonal_blocks_[e]].offset;
+          work.assign(h, h + t * t);
+          for (size_t i = 0; i < t; ++i) {
+            work[i * t + i] += lambda * diagonal_[tangent_offsets_[e] + i];
+          }
+          double* inverse = block_inverses_.data() + square_offsets_[e];
+          if (!invert_spd(work.data(), t, inverse)) {
+            valid[chunk] = 0;
+            return;
+          }
+          double* z = scratch_.data() + tangent_offsets_[e];
+          std::fill(z, z + t, 0.0);
+          multiply_add(inverse, t, t, gradient_.data() + tangent_offsets_[e],
+                       1.0, z);
+          for (uint32_t b = eliminated_coupling_first_[e - reduced];
+               b < eliminated_coupling_first_[e - reduced + 1]; ++b) {
+            const HessianBlock& w = hessian_blocks_[b];
+            const size_t td = tangent_sizes_[w.row];
+            const double* coupling = hessian_.data() + w.offset;
+            double* product =
+                coupling_products_.data() + w.offset - coupling_base_;
+            for (size_t k = 0; k < t; ++k) {
+              for (size_t d = 0; d < td; ++d) {
+                product[k * td + d] =
+                    dot(inverse + k * t, coupling + d * t, t);
+              }
+            }
+            multiply_add(coupling, td, t, z, 1.0,
+                         rhs + tangent_offsets_[w.row]);
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+  if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+    return false;
+  }
+  // b = -g_c + sum_e W_ce H_ee^-1 g_e
+  for (size_t i = 0; i < n; ++i) {
+    double sum = -gradient_[i];
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+      sum += partials_[chunk * n + i];
+    }
+    reduced_rhs_[i] = sum;
+  }
+
+  if (reduced > 0) {
+    bool solved = false;
+    switch (params_.linear_solver) {
+      case LinearSolverType::DenseCholesky:
+        solved = solve_reduced_dense();
+        break;
+      case LinearSolverType::Pcg:
+        solved = solve_reduced_pcg();
+        break;
+      case LinearSolverType::SparseCholesky:
+        solved = solve_reduced_sparse();
+        break;
+    }
+    if (!solved) {
+      return false;
+    }
+  }
+
+  // delta_e = H_ee^-1 (-g_e - sum_c W_ce^T delta_c)
+  parallel_for(
+      reduced, blocks,
+      [&](const size_t lo, const size_t hi) {
+        std::vector<double> work;
+        for (size_t e = lo; e < hi; ++e) {
+          const size_t t = tangent_sizes_[e];
+          work.resize(t);
+          for (size_t i = 0; i < t; ++i) {
+            work[i] = -gradient_[tangent_offsets_[e] + i];
+          }
+          for (uint32_t b = eliminated_coupling_first_[e - reduced];
+               b < eliminated_coupling_first_[e - reduced + 1]; ++b) {
+            const HessianBlock& w = hessian_blocks_[b];
+            multiply_transpose_add(hessian_.data() + w.offset,
+                                   tangent_sizes_[w.row], t,
+                                   step_.data() + tangent_offsets_[w.row],
+                                   -1.0, work.data());
+          }
+          double* delta = step_.data() + tangent_offsets_[e];
+          std::fill(delta, delta + t, 0.0);
+          multiply_add(block_inverses_.data() + square_offsets_[e], t, t,
+                       work.data(), 1.0, delta);
+        }
+      },
+      kMinBlocksPerChunk);
+  return true;
+}
+
+void LeastSquaresSolver::subtract_eliminated(const ReducedForm form,
+                                             double* out) {
+  // S_cd -= W_ce (H_ee^-1 W_de^T) for every eliminated block e and pair of
+  // its reduced neighbours with d >= c, or only d = c. the eliminated
+  // blocks are walked in order, each reading its couplings once, and sum
+  // into a copy of out per chunk that is added up after.
+  const size_t n = reduced_size_;
+  const size_t reduced = reduced_blocks_;
+  const bool diagonal_only = form == ReducedForm::DiagonalBlocks;
+  size_t size = n * n;
+  if (diagonal_only) {
+    size = square_offsets_[reduced];
+  } else if (form == ReducedForm::SparseUpper) {
+    size = sparse_values_.size();
+  }
+  // the offset of S_cd in out and the stride of its rows
+  const auto locate = [&](const size_t c, const size_t d) {
+    switch (form) {
+      case ReducedForm::Dense:
+        return std::pair{tangent_offsets_[c] * n + tangent_offsets_[d], n};
+      case ReducedForm::DiagonalBlocks:
+        return std::pair{square_offsets_[c], tangent_sizes_[c]};
+      case ReducedForm::SparseUpper:
+        break;
+    }
+    const size_t row = tangent_offsets_[c];
+    const auto first = sparse_block_columns_.begin() + sparse_block_first_[c];
+    const auto last =
+        sparse_block_columns_.begin() + sparse_block_first_[c + 1];
+    const auto block = static_cast<size_t>(
+        std::lower_bound(first, last, static_cast<uint32_t>(d)) -
+        sparse_block_columns_.begin());
+    return std::pair{sparse_row_offsets_[row] + sparse_block_positions_[block],
+                     sparse_row_offsets_[row + 1] - sparse_row_offsets_[row]};
+  };
+  const size_t eliminated = active_.size() - reduced;
+  // at most kMaxPartialSize doubles of copies
+  const size_t copies = std::max<size_t>(1, kMaxPartialSize / size);
+  const size_t min_chunk =
+      std::max(kMinBlocksPerChunk, (eliminated + copies - 1) / copies);
+  const size_t chunks = num_chunks(eliminated, min_chunk);
+  partials_.assign((chunks - 1) * size, 0.0);
+  parallel_for_chunks(
+      reduced, active_.size(),
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        double* s =
+            chunk == 0 ? out : partials_.data() + (chunk - 1) * size;
+        for (size_t e = lo; e < hi; ++e) {
+          const uint32_t first = eliminated_coupling_first_[e - reduced];
+          const uint32_t last = eliminated_coupling_first_[e - reduced + 1];
+          for (uint32_t b = first; b < last; ++b) {
+            const HessianBlock& w = hessian_blocks_[b];
+            const size_t c = w.row;
+            for (uint32_t k = first; k < last; ++k) {
+              const size_t d = hessian_blocks_[k].row;
+              if (d < c || (diagonal_only && d != c)) {
+                continue;
+              }
+              const auto [offset, stride] = locate(c, d);
+              subtract_product(
+                  hessian_.data() + w.offset,
+                  coupling_products_.data() + hessian_blocks_[k].offset -
+                      coupling_base_,
+                  tangent_sizes_[c], tangent_sizes_[e], tangent_sizes_[d],
+                  s + offset, stride);
+            }
+          }
+        }
+      },
+      min_chunk);
+  parallel_for(
+      0, size,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t chunk = 1; chunk < chunks; ++chunk) {
+          const double* partial = partials_.data() + (chunk - 1) * size;
+          for (size_t k = lo; k < hi; ++k) {
+            out[k] += partial[k];
+          }
+        }
+      },
+      kMinDenseWork);
+}
+
+bool LeastSquaresSolver::solve_reduced_dense() {
+  const size_t n = reduced_size_;
+  reduced_matrix_.resize(n * n);
+  double* s = reduced_matrix_.data();
+  // the upper triangle of S = H_cc + lambda D - W H_ee^-1 W^T
+  parallel_for(
+      0, reduced_blocks_,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+          const size_t t = tangent_sizes_[c];
+          const size_t offset = tangent_offsets_[c];
+          std::fill(s + offset * n, s + (offset + t) * n, 0.0);
+          for (uint32_t b = reduced_row_first_[c];
+               b < reduced_row_first_[c + 1]; ++b) {
+            const HessianBlock& block = hessian_blocks_[b];
+            if (block.col < c) {
+              continue;
+            }
+            const size_t cols = tangent_sizes_[block.col];
+            for (size_t r = 0; r < t; ++r) {
+              std::memcpy(s + (offset + r) * n + tangent_offsets_[block.col],
+                          hessian_.data() + block.offset + r * cols,
+                          cols * sizeof(double));
+            }
+          }
+          for (size_t i = 0; i < t; ++i) {
+            s[(offset + i) * n + offset + i] += lambda_ * diagonal_[offset + i];
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+  subtract_eliminated(ReducedForm::Dense, s);
+  if (!cholesky_upper(s, n)) {
+    return false;
+  }
+  std::memcpy(step_.data(), reduced_rhs_.data(), n * sizeof(double));
+  cholesky_solve(s, n, step_.data());
+  return true;
+}
+
+bool LeastSquaresSolver::solve_reduced_sparse() {
+  const size_t n = reduced_size_;
+  double* s = sparse_values_.data();
+  // the upper blocks of S = H_cc + lambda D - W H_ee^-1 W^T into the panels
+  // of their block rows, the pattern fixed by analyse_sparse()
+  parallel_for(
+      0, reduced_blocks_,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+          const size_t t = tangent_sizes_[c];
+          const size_t row = tangent_offsets_[c];
+          const size_t base = sparse_row_offsets_[row];
+          const size_t length = sparse_row_offsets_[row + 1] - base;
+          std::fill(s + base, s + base + t * length, 0.0);
+          size_t k = sparse_block_first_[c];
+          for (uint32_t b = reduced_row_first_[c];
+               b < reduced_row_first_[c + 1]; ++b) {
+            const HessianBlock& block = hessian_blocks_[b];
+            if (block.col < c) {
+              continue;
+            }
+            while (sparse_block_columns_[k] != block.col) {
+              ++k;
+            }
+            const size_t cols = tangent_sizes_[block.col];
+            for (size_t r = 0; r < t; ++r) {
+              std::memcpy(s + base + r * length + sparse_block_positions_[k],
+                          hessian_.data() + block.offset + r * cols,
+                          cols * sizeof(double));
+            }
+          }
+          // the diagonal block leads its block row
+          for (size_t i = 0; i < t; ++i) {
+            s[base + i * length + i] += lambda_ * diagonal_[row + i];
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+  subtract_eliminated(ReducedForm::SparseUpper, s);
+  if (!sparse_.factorize(sparse_values_)) {
+    return false;
+  }
+  std::memcpy(step_.data(), reduced_rhs_.data(), n * sizeof(double));
+  return sparse_.solve(std::span<double>(step_.data(), n)).has_value();
+}
+
+void LeastSquaresSolver::reduced_product(const double* x, double* y) {
+  const size_t n = reduced_size_;
+  const size_t reduced = reduced_blocks_;
+  // W H_ee^-1 W_e^T x in one pass over the eliminated blocks, summed into a
+  // copy per chunk
+  const size_t chunks =
+      num_chunks(active_.size() - reduced, kMinBlocksPerChunk);
+  partials_.assign(chunks * n, 0.0);
+  parallel_for_chunks(
+      reduced, active_.size(),
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        double* sum = partials_.data() + chunk * n;
+        std::vector<double> work, u;
+        for (size_t e = lo; e < hi; ++e) {
+          const size_t t = tangent_sizes_[e];
+          const uint32_t first = eliminated_coupling_first_[e - reduced];
+          const uint32_t last = eliminated_coupling_first_[e - reduced + 1];
+          work.assign(t, 0.0);
+          for (uint32_t b = first; b < last; ++b) {
+            const HessianBlock& w = hessian_blocks_[b];
+            multiply_transpose_add(hessian_.data() + w.offset,
+                                   tangent_sizes_[w.row], t,
+                                   x + tangent_offsets_[w.row], 1.0,
+                                   work.data());
+          }
+          u.assign(t, 0.0);
+          multiply_add(block_inverses_.data() + square_offsets_[e], t, t,
+                       work.data(), 1.0, u.data());
+          for (uint32_t b = first; b < last; ++b) {
+            const HessianBlock& w = hessian_blocks_[b];
+            multiply_add(hessian_.data() + w.offset, tangent_sizes_[w.row], t,
+                         u.data(), 1.0, sum + tangent_offsets_[w.row]);
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+  // y_c = (H_cc + lambda D) x - the sums
+  parallel_for(
+      0, reduced,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+          const size_t t = tangent_sizes_[c];
+          const size_t offset = tangent_offsets_[c];
+          double* out = y + offset;
+          for (size_t i = 0; i < t; ++i) {
+            double value = lambda_ * diagonal_[offset + i] * x[offset + i];
+            for (size_t chunk = 0; chunk < chunks; ++chunk) {
+              value -= partials_[chunk * n + offset + i];
+            }
+            out[i] = value;
+          }
+          for (uint32_t b = reduced_row_first_[c];
+               b < reduced_row_first_[c + 1]; ++b) {
+            const HessianBlock& block = hessian_blocks_[b];
+            const size_t cols = tangent_sizes_[block.col];
+            const double* in = x + tangent_offsets_[block.col];
+            if (block.mirror == kNoBlock) {
+              multiply_add(hessian_.data() + block.offset, t, cols, in, 1.0,
+                           out);
+            } else {
+              multiply_transpose_add(
+                  hessian_.data() + hessian_blocks_[block.mirror].offset,
+                  cols, t, in, 1.0, out);
+            }
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+}
+
+bool LeastSquaresSolver::solve_reduced_pcg() {
+  const size_t n = reduced_size_;
+  const size_t reduced = reduced_blocks_;
+  // block jacobi preconditioner, the inverses of the diagonal blocks of S
+  reduced_matrix_.resize(square_offsets_[reduced]);
+  for (size_t c = 0; c < reduced; ++c) {
+    const size_t t = tangent_sizes_[c];
+    const double* h =
+        hessian_.data() + hessian_blocks_[diagonal_blocks_[c]].offset;
+    double* block = reduced_matrix_.data() + square_offsets_[c];
+    std::copy(h, h + t * t, block);
+    for (size_t i = 0; i < t; ++i) {
+      block[i * t + i] += lambda_ * diagonal_[tangent_offsets_[c] + i];
+    }
+  }
+  subtract_eliminated(ReducedForm::DiagonalBlocks, reduced_matrix_.data());
+  for (size_t c = 0; c < reduced; ++c) {
+    if (!invert_spd(reduced_matrix_.data() + square_offsets_[c],
+                    tangent_sizes_[c],
+                    block_inverses_.data() + square_offsets_[c])) {
+      return false;
+    }
+  }
+  const auto precondition = [&](const double* r, double* z) {
+    for (size_t c = 0; c < reduced; ++c) {
+      const size_t t = tangent_sizes_[c];
+      std::fill(z + tangent_offsets_[c], z + tangent_offsets_[c] + t, 0.0);
+      multiply_add(block_inverses_.data() + square_offsets_[c], t, t,
+                   r + tangent_offsets_[c], 1.0, z + tangent_offsets_[c]);
+    }
+  };
+
+  pcg_.resize(4 * n);
+  double* r = pcg_.data();
+  double* z = r + n;
+  double* p = z + n;
+  double* q = p + n;
+  double* x = step_.data();
+  std::fill(x, x + n, 0.0);
+  std::memcpy(r, reduced_rhs_.data(), n * sizeof(double));
+  const double threshold =
+      params_.linear_tolerance * std::sqrt(dot(r, r, n));
+  precondition(r, z);
+  std::memcpy(p, z, n * sizeof(double));
+  double rz = dot(r, z, n);
+  for (size_t iteration = 0; iteration < params_.max_linear_iterations;
+       ++iteration) {
+    if (std::sqrt(dot(r, r, n)) <= threshold) {
+      break;
+    }
+    ++linear_iterations_;
+    reduced_product(p, q);
+    const double curvature = dot(p, q, n);
+    if (!(curvature > 0.0)) {
+      return iteration > 0;
+    }
+    const double alpha = rz / curvature;
+    subtract_scaled(x, p, -alpha, n);
+    subtract_scaled(r, q, alpha, n);
+    precondition(r, z);
+    const double next = dot(r, z, n);
+    const double beta = next / rz;
+    rz = next;
+    for (size_t i = 0; i < n; ++i) {
+      p[i] = z[i] + beta * p[i];
+    }
+  }
+  return true;
+}
+
+double LeastSquaresSolver::model_decrease() const {
+  // L(0) - L(delta) = -g^T delta - delta^T H delta / 2, which for
+  // (H + lambda D) delta = -g is (lambda delta^T D delta - g^T delta) / 2
+  double damped = 0.0;
+  for (size_t i = 0; i < tangent_size_; ++i) {
+    damped += diagonal_[i] * step_[i] * step_[i];
+  }
+  return 0.5 * (lambda_ * damped - dot(gradient_.data(), step_.data(),
+                                       tangent_size_));
+}
+
+std::expected<LeastSquaresSummary, MatError> LeastSquaresSolver::solve(
+    LeastSquaresProblem& problem) {
+  if (auto analysed = analyse(problem); !analysed) {
+    return std::unexpected(analysed.error());
+  }
+  const auto& parameters = problem.parameters_;
+  LeastSquaresSummary summary;
+  double cost = 0.0;
+  if (!evaluate(problem, true, residuals_, jacobians_, cost)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  summary.initial_cost = cost;
+  linear_iterations_ = 0;
+
+  const bool levenberg = params_.method == NlsMethod::LevenbergMarquardt;
+  double lambda = levenberg ? params_.initial_lambda : 0.0;
+  double growth = 2.0;
+  const size_t blocks = active_.size();
+  for (size_t iteration = 0; iteration < params_.max_iterations;
+       ++iteration) {
+    build_normal_equations();
+    double largest = 0.0;
+    for (const double g : gradient_) {
+      largest = std::max(largest, std::fabs(g));
+    }
+    if (largest <= params_.gradient_tolerance) {
+      summary.converged = true;
+      break;
+    }
+    ++summary.iterations;
+    if (!solve_step(lambda)) {
+      if (!levenberg || lambda * growth > kMaxLambda) {
+        break;
+      }
+      lambda *= growth;
+      growth *= 2.0;
+      continue;
+    }
+
+    // x [+] delta into the caller's blocks, the old values kept
+    double step_norm = 0.0;
+    double value_norm = 0.0;
+    for (size_t a = 0; a < blocks; ++a) {
+      const auto& block = parameters[active_[a]];
+      double* saved = saved_values_.data() + value_offsets_[a];
+      const double* delta = step_.data() + tangent_offsets_[a];
+      std::memcpy(saved, block.values, block.size * sizeof(double));
+      value_norm += dot(saved, saved, block.size);
+      step_norm += dot(delta, delta, tangent_sizes_[a]);
+      if (block.manifold != nullptr) {
+        block.manifold->plus(saved, delta, block.values);
+      } else {
+        for (size_t i = 0; i < block.size; ++i) {
+          block.values[i] = saved[i] + delta[i];
+        }
+      }
+    }
+    const auto restore = [&] {
+      for (size_t a = 0; a < blocks; ++a) {
+        const auto& block = parameters[active_[a]];
+        std::memcpy(block.values, saved_values_.data() + value_offsets_[a],
+                    block.size * sizeof(double));
+      }
+    };
+    if (std::sqrt(step_norm) <=
+        params_.parameter_tolerance *
+            (std::sqrt(value_norm) + params_.parameter_tolerance)) {
+      restore();
+      summary.converged = true;
+      break;
+    }
+
+    // levenberg-marquardt rejects steps, so its trial point only needs its
+    // cost and the jacobians are evaluated along with the residuals again
+    // once the step is accepted. gauss-newton stops at the first step it
+    // rejects, and differentiates the trial point right away.
+    double candidate = 0.0;
+    const bool evaluated = evaluate(problem, !levenberg, candidate_residuals_,
+                                    jacobians_, candidate);
+    const double predicted = model_decrease();
+    const double actual = cost - candidate;
+    if (evaluated && actual >= 0.0 && (actual > 0.0 || !levenberg)) {
+      if (!levenberg) {
+        residuals_.swap(candidate_residuals_);
+      } else if (!evaluate(problem, true, residuals_, jacobians_,
+                           candidate)) {
+        restore();
+        break;
+      }
+      ++summary.accepted_steps;
+      const double previous = cost;
+      cost = candidate;
+      if (levenberg) {
+        // nielsen's update, shrinking lambda further the better the step
+        // matched the model
+        const double rho = predicted > 0.0 ? actual / predicted : 1.0;
+        const double factor = 2.0 * rho - 1.0;
+        lambda *= std::max(1.0 / 3.0, 1.0 - factor * factor * factor);
+        growth = 2.0;
+      }
+      if (previous - cost <= params_.function_tolerance * previous) {
+        summary.converged = true;
+        break;
+      }
+    } else {
+      restore();
+      if (!levenberg || lambda * growth > kMaxLambda) {
+        break;
+      }
+      lambda *= growth;
+      growth *= 2.0;
+    }
+  }
+  summary.final_cost = cost;
+  summary.linear_iterations = linear_iterations_;
+  return summary;
+}
+
+std::expected<LeastSquaresSummary, MatError> solve_least_squares(
+    LeastSquaresProblem& problem, const LeastSquaresParams& params) {
+  LeastSquaresSolver solver(params);
+  return solver.solve(problem);
+}
+
+};  // namespace core
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "core/mat.hpp"
+#include "core/sparse_cholesky.hpp"
+
+namespace core {
+
+// a residual block r(x_0, ..., x_m-1) of num_residuals() values over m
+// parameter blocks with the sizes of parameter_block_sizes(). evaluate is
+// called from several threads at once and must not modify shared state.
+class CostFunction {
+ public:
+  CostFunction(size_t num_residuals, std::vector<size_t> parameter_block_sizes)
+      : num_residuals_(num_residuals),
+        parameter_block_sizes_(std::move(parameter_block_sizes)) {}
+  virtual ~CostFunction() = default;
+
+  // parameters[i] points at block i. jacobians is null when only the
+  // residuals are needed, otherwise jacobians[i] receives the row-major
+  // num_residuals() x parameter_block_sizes()[i] derivative of the residuals
+  // with respect to block i, or is null when that block is held constant.
+  // returns false when the residuals cannot be evaluated, which rejects the
+  // step that led there. a point whose jacobians cannot be evaluated ends
+  // the solve at the point before it.
+  [[nodiscard]] virtual bool evaluate(const double* const* parameters,
+                                      double* residuals,
+                                      double* const* jacobians) const = 0;
+
+  [[nodiscard]] size_t num_residuals() const noexcept {
+    return num_residuals_;
+  }
+  [[nodiscard]] std::span<const size_t> parameter_block_sizes()
+      const noexcept {
+    return parameter_block_sizes_;
+  }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  size_t num_residuals_;
+  std::vector<size_t> parameter_block_sizes_;
+};
+
+// the update of a parameter block that is not a vector space, x [+] delta
+// with delta in a tangent space of tangent_size() <= ambient_size().
+// residual jacobians stay with respect to the ambient parameters, the solver
+// chains them with plus_jacobian.
+class Manifold {
+ public:
+  virtual ~Manifold() = default;
+
+  [[nodiscard]] virtual size_t ambient_size() const noexcept = 0;
+  [[nodiscard]] virtual size_t tangent_size() const noexcept = 0;
+  // out may not alias x
+  virtual void plus(const double* x, const double* delta,
+                    double* out) const = 0;
+  // the row-major ambient_size() x tangent_size() derivative of
+  // plus(x, delta) at delta = 0
+  virtual void plus_jacobian(const double* x, double* jacobian) const = 0;
+};
+
+// a pose (tx, ty, tz, qw, qx, qy, qz) as in the batched pose layout of
+// lie_group.hpp, updated on the right by x * exp(delta) with the SE3
+// tangent ordering (rho, phi)
+class SE3Manifold final : public Manifold {
+ public:
+  [[nodiscard]] size_t ambient_size() const noexcept override { return 7; }
+  [[nodiscard]] size_t tangent_size() const noexcept override { return 6; }
+  void plus(const double* x, const double* delta,
+            double* out) const override;
+  void plus_jacobian(const double* x, double* jacobian) const override;
+};
+
+// a unit quaternion (qw, qx, qy, qz) updated on the right by q * exp(delta)
+class SO3Manifold final : public Manifold {
+ public:
+  [[nodiscard]] size_t ambient_size() const noexcept override { return 4; }
+  [[nodiscard]] size_t tangent_size() const noexcept override { return 3; }
+  void plus(const double* x, const double* delta,
+            double* out) const override;
+  void plus_jacobian(const double* x, double* jacobian) const override;
+};
+
+// a factor graph of parameter blocks, owned by the caller and updated in
+// place by the solver, and residual blocks that connect them. blocks are
+// referred to by the indices add_parameter_block returns.
+class LeastSquaresProblem {
+ public:
+  // values must stay valid while the problem is solved
+  [[nodiscard]] std::expected<size_t, MatError> add_parameter_block(
+      double* values, size_t size);
+  [[nodiscard]] std::expected<size_t, MatError> add_residual_block(
+      std::shared_ptr<const CostFunction> cost, std::vector<size_t> blocks);
+
+  [[nodiscard]] std::expected<void, MatError> set_manifold(
+      size_t block, std::shared_ptr<const Manifold> manifold);
+  [[nodiscard]] std::expected<void, MatError> set_constant(
+      size_t block, bool constant = true);
+  // eliminated blocks, typically the landmarks of bundle adjustment, are
+  // removed from the normal equations by the schur complement before the
+  // linear solve and recovered afterwards. no residual block may connect two
+  // of them.
+  [[nodiscard]] std::expected<void, MatError> set_eliminated(
+      size_t block, bool eliminated = true);
+
+  [[nodiscard]] size_t num_parameter_blocks() const noexcept {
+    return parameters_.size();
+  }
+  [[nodiscard]] size_t num_residual_blocks() const noexcept {
+    return residuals_.size();
+  }
+  [[nodiscard]] size_t num_residuals() const noexcept {
+    return num_residuals_;
+  }
+  // half the sum of squared residuals at the current values
+  [[nodiscard]] std::expected<double, MatError> cost() const;
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  friend class LeastSquaresSolver;
+
+  struct ParameterBlock {
+    double* values = nullptr;
+    size_t size = 0;
+    std::shared_ptr<const Manifold> manifold;
+    bool constant = false;
+    bool eliminated = false;
+  };
+  struct ResidualBlock {
+    std::shared_ptr<const CostFunction> cost;
+    std::vector<size_t> blocks;
+  };
+
+  std::vector<ParameterBlock> parameters_;
+  std::vector<ResidualBlock> residuals_;
+  size_t num_residuals_ = 0;
+};
+
+enum class NlsMethod {
+  GaussNewton,        // undamped steps, stops once one fails to descend
+  LevenbergMarquardt  // steps damped by lambda * diag(J^T J), adapted
+                      // from how well the model predicted each step
+};
+
+enum class LinearSolverType {
+  // cholesky of the dense reduced system, exact and fine up to a few
+  // thousand non-eliminated parameters
+  DenseCholesky,
+  // conjugate gradients on the reduced system without forming it, each
+  // product goes through the blocks of J^T J and the eliminated inverses.
+  // preconditioned by the inverses of its diagonal blocks.
+  Pcg,
+  // supernodal sparse cholesky of the reduced system, for pose graphs and
+  // other problems whose reduced blocks are sparsely connected. the
+  // ordering and symbolic factorisation are computed once per solve.
+  SparseCholesky,
+};
+
+struct LeastSquaresParams {
+  NlsMethod method = NlsMethod::LevenbergMarquardt;
+  LinearSolverType linear_solver = LinearSolverType::DenseCholesky;
+  size_t max_iterations = 50;
+  // converged once an accepted step lowers the cost by less than this
+  // fraction of it
+  double function_tolerance = 1e-10;
+  // converged once the largest gradient entry falls below this
+  double gradient_tolerance = 1e-10;
+  // converged once |delta| < parameter_tolerance * (|x| + parameter_tolerance)
+  double parameter_tolerance = 1e-10;
+  double initial_lambda = 1e-4;
+  // pcg stops after this many iterations or once the residual of the reduced
+  // system shrinks by linear_tolerance
+  size_t max_linear_iterations = 200;
+  double linear_tolerance = 1e-8;
+};
+
+struct LeastSquaresSummary {
+  double initial_cost = 0.0;
+  double final_cost = 0.0;
+  size_t iterations = 0;
+  size_t accepted_steps = 0;
+  size_t linear_iterations = 0;  // pcg iterations over all steps
+  bool converged = false;        // one of the tolerances was met
+};
+
+// gauss-newton or levenberg-marquardt on a LeastSquaresProblem.
+//
+// the jacobian is block sparse, one dense block per residual block and
+// parameter block it touches, and so are the normal equations J^T J. each
+// iteration evaluates the residual blocks in parallel, then builds J^T J
+// without locks: the blocks between reduced (non-eliminated) parameters are
+// summed in one pass over the residual blocks into a copy per thread, the
+// blocks of each eliminated parameter are gathered from its own residual
+// blocks. the eliminated blocks are folded into the schur complement of the
+// others, again one pass over them with a copy per thread, and the reduced
+// system is solved densely, by sparse cholesky or by pcg. the structure is
+// analysed once per solve, the buffers are kept across solves.
+class LeastSquaresSolver {
+ public:
+  explicit LeastSquaresSolver(const LeastSquaresParams& params = {})
+      : params_(params) {}
+
+  // updates the parameter blocks in place, leaving them at the best values
+  // found
+  [[nodiscard]] std::expected<LeastSquaresSummary, MatError> solve(
+      LeastSquaresProblem& problem);
+
+  [[nodiscard]] const LeastSquaresParams& params() const noexcept {
+    return params_;
+  }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  // a dense block of J^T J, the sum of the products J_p^T J_q of the
+  // jacobian block pairs in contributions_[first, last), or the transpose of
+  // hessian_blocks_[mirror]
+  struct HessianBlock {
+    uint32_t row = 0;  // active block indices
+    uint32_t col = 0;
+    size_t offset = 0;  // into hessian_
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t mirror = 0;
+  };
+  // the derivative of residual block `residual` with respect to one of its
+  // active parameter blocks, tangent sized
+  struct JacobianBlock {
+    uint32_t residual = 0;
+    uint32_t block = 0;  // active block index
+    size_t offset = 0;   // into jacobians_
+  };
+
+  // a product J_p^T J_q of residual block p.residual that sums into the
+  // upper reduced block at `offset`
+  struct ReducedPair {
+    uint32_t p = 0;
+    uint32_t q = 0;
+    size_t offset = 0;
+  };
+
+  std::expected<void, MatError> analyse(const LeastSquaresProblem& problem);
+  bool evaluate(const LeastSquaresProblem& problem, bool jacobians,
+                std::vector<double>& residuals,
+                std::vector<double>& jacobian_values, double& cost);
+  void build_normal_equations();
+  // (H + lambda D) step = -g, false if a system is not positive definite
+  bool solve_step(double lambda);
+  // where subtract_eliminated() writes the schur complement
+  enum class ReducedForm {
+    Dense,           // the upper triangle of the dense S
+    DiagonalBlocks,  // its diagonal blocks at their square offsets
+    SparseUpper      // the upper blocks of S in sparse_values_
+  };
+
+  std::expected<void, MatError> analyse_sparse();
+  bool solve_reduced_dense();
+  bool solve_reduced_sparse();
+  bool solve_reduced_pcg();
+  void subtract_eliminated(ReducedForm form, double* out);
+  // y = S x for the damped reduced system S
+  void reduced_product(const double* x, double* y);
+  double model_decrease() const;
+
+  LeastSquaresParams params_;
+
+  // active (non-constant) parameter blocks as problem indices, the reduced
+  // ones first, with their tangent sizes and offsets into the tangent
+  // vector, offsets into their stacked values and into stacked t x t blocks
+  std::vector<uint32_t> active_;
+  std::vector<size_t> tangent_sizes_;
+  std::vector<size_t> tangent_offsets_;
+  std::vector<size_t> value_offsets_;
+  std::vector<size_t> square_offsets_;
+  size_t reduced_blocks_ = 0;
+  size_t reduced_size_ = 0;
+  size_t tangent_size_ = 0;
+  // problem block -> active block, npos for constant blocks
+  std::vector<size_t> active_index_;
+  // plus jacobians of the manifold blocks per active block, npos otherwise
+  std::vector<size_t> plus_offsets_;
+  std::vector<double> plus_jacobians_;
+
+  std::vector<size_t> residual_offsets_;
+  // jacobian blocks of residual block i in [first[i], first[i + 1])
+  std::vector<uint32_t> jacobian_first_;
+  std::vector<JacobianBlock> jacobian_blocks_;
+  // the jacobian blocks of each active block, in the same form
+  std::vector<uint32_t> block_jacobian_first_;
+  std::vector<uint32_t> block_jacobians_;
+
+  // the reduced blocks of J^T J with both triangles row by row, row c in
+  // [reduced_row_first_[c], reduced_row_first_[c + 1]). then the couplings
+  // W_ce between reduced and eliminated blocks grouped by e, from
+  // eliminated_coupling_first_[e - reduced_blocks_], and the eliminated
+  // diagonal blocks.
+  std::vector<HessianBlock> hessian_blocks_;
+  std::vector<uint32_t> reduced_row_first_;
+  std::vector<uint32_t> eliminated_coupling_first_;
+  std::vector<uint32_t> diagonal_blocks_;
+  // H_ee^-1 W_ce^T per coupling at the coupling's offset less coupling_base_
+  size_t coupling_base_ = 0;
+  std::vector<double> coupling_products_;
+  std::vector<std::pair<uint32_t, uint32_t>> contributions_;
+  // the reduced products of residual block i, from residual_pair_first_[i]
+  std::vector<uint32_t> residual_pair_first_;
+  std::vector<ReducedPair> residual_pairs_;
+  // per chunk sums of the reduced blocks and gradient
+  std::vector<double> partials_;
+  // the pattern of the upper blocks of S for the sparse solver, the block
+  // columns of block row c in [sparse_block_first_[c], [c + 1]) with their
+  // offsets into each of its scalar rows. the rows of a block row are as
+  // long, so it is a dense t x length panel of sparse_values_.
+  std::vector<uint32_t> sparse_block_first_;
+  std::vector<uint32_t> sparse_block_columns_;
+  std::vector<size_t> sparse_block_positions_;
+  std::vector<size_t> sparse_row_offsets_;
+  std::vector<double> sparse_values_;
+  SparseCholesky sparse_;
+
+  std::vector<double> residuals_;
+  std::vector<double> candidate_residuals_;
+  std::vector<double> jacobians_;
+  std::vector<double> hessian_;
+  std::vector<double> gradient_;
+  std::vector<double> diagonal_;
+  double lambda_ = 0.0;
+  // inverses of the damped eliminated diagonal blocks, and for pcg those of
+  // the diagonal blocks of S
+  std::vector<double> block_inverses_;
+  std::vector<double> reduced_rhs_;
+  std::vector<double> reduced_matrix_;
+  std::vector<double> pcg_;
+  std::vector<double> step_;
+  std::vector<double> saved_values_;
+  std::vector<double> scratch_;
+  size_t linear_iterations_ = 0;
+};
+
+// solves with a temporary solver
+[[nodiscard]] std::expected<LeastSquaresSummary, MatError>
+solve_least_squares(LeastSquaresProblem& problem,
+                    const LeastSquaresParams& params = {});
+
+};  // namespace core
@@ -0,0 +1,387 @@
+#include "core/lie_group.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+// columns per stack tile. kernels fill a tile which is then copied out, so
+// outputs may alias inputs without the kernels needing alias checks to
+// vectorise.
+constexpr size_t kTile = 64;
+constexpr size_t kMaxRows = 7;
+// columns per parallel chunk for the arithmetic and the trigonometric
+// kernels
+constexpr size_t kMinArithmeticChunk = 16384;
+constexpr size_t kMinTrigonometricChunk = 1024;
+// terms of the slerp weight series and the scale of the last one, fitted
+// to minimise the largest error over t and cosines in [0, 1]
+constexpr size_t kSlerpTerms = 16;
+constexpr float kSlerpTailScale = 1.92f;
+
+std::expected<void, MatError> check_columns(const Mat& mat,
+                                            const size_t rows) {
+  if (mat.rows() != rows || mat.cols() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (mat.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  return {};
+}
+
+// runs kernel(first, count, tile) over tiles of columns in parallel, the
+// kernel fills `rows` rows of count entries with stride kTile. an output of
+// the wrong shape is replaced only once every column is computed, since it
+// may be one of the inputs.
+template <typename Kernel>
+void write_columns(Mat& out, const size_t rows, const size_t n,
+                   const size_t min_chunk, Kernel&& kernel) {
+  const bool reshape =
+      out.rows() != rows || out.cols() != n || out.channels() != 1;
+  Mat fresh;
+  if (reshape) {
+    fresh = Mat(rows, n, 1);
+  }
+  float* target = reshape ? fresh.data() : out.data();
+  parallel_for(
+      0, n,
+      [&](const size_t lo, const size_t hi) {
+        alignas(64) float tile[kMaxRows * kTile];
+        for (size_t first = lo; first < hi; first += kTile) {
+          const size_t count = std::min(kTile, hi - first);
+          kernel(first, count, tile);
+          for (size_t r = 0; r < rows; ++r) {
+            std::memcpy(target + r * n + first, tile + r * kTile,
+                        count * sizeof(float));
+          }
+        }
+      },
+      min_chunk);
+  if (reshape) {
+    out = std::move(fresh);
+  }
+}
+
+// entry (row, i) of a structure-of-arrays Mat
+struct Strided {
+  const float* data;
+  size_t stride;
+
+  float operator()(const size_t row, const size_t i) const noexcept {
+    return data[row * stride + i];
+  }
+};
+
+// a single pose repeated for every column, copied so that the output may
+// replace the Mat it came from
+struct Repeated {
+  float values[kMaxRows];
+
+  explicit Repeated(const Mat& pose) noexcept {
+    std::copy(pose.data(), pose.data() + kMaxRows, values);
+  }
+  float operator()(const size_t row, size_t) const noexcept {
+    return values[row];
+  }
+};
+
+SE3f load_pose(const Strided& poses, const size_t i) noexcept {
+  return SE3f(SO3f::from_quaternion(poses(3, i), poses(4, i), poses(5, i),
+                                    poses(6, i)),
+              Vec3f(poses(0, i), poses(1, i), poses(2, i)));
+}
+
+void store_pose(const SE3f& pose, float* tile, const size_t j) noexcept {
+  tile[j] = pose.translation()[0];
+  tile[kTile + j] = pose.translation()[1];
+  tile[2 * kTile + j] = pose.translation()[2];
+  tile[3 * kTile + j] = pose.rotation().w();
+  tile[4 * kTile + j] = pose.rotation().x();
+  tile[5 * kTile + j] = pose.rotation().y();
+  tile[6 * kTile + j] = pose.rotation().z();
+}
+
+// a_i * b_i written into the tile, the quaternion product and the
+// translation rotated by a_i plus that of a_i
+template <typename A, typename B>
+void compose_tile(const A& a, const B& b, const size_t first,
+                  const size_t count, float* __restrict tile) {
+  for (size_t j = 0; j < count; ++j) {
+    const size_t i = first + j;
+    const float aw = a(3, i), ax = a(4, i), ay = a(5, i), az = a(6, i);
+    const float bw = b(3, i), bx = b(4, i), by = b(5, i), bz = b(6, i);
+    const float x = b(0, i), y = b(1, i), z = b(2, i);
+    // p + w u + v x u with u = 2 v x p
+    const float ux = 2.0f * (ay * z - az * y);
+    const float uy = 2.0f * (az * x - ax * z);
+    const float uz = 2.0f * (ax * y - ay * x);
+    tile[j] = x + aw * ux + ay * uz - az * uy + a(0, i);
+    tile[kTile + j] = y + aw * uy + az * ux - ax * uz + a(1, i);
+    tile[2 * kTile + j] = z + aw * uz + ax * uy - ay * ux + a(2, i);
+    tile[3 * kTile + j] = aw * bw - ax * bx - ay * by - az * bz;
+    tile[4 * kTile + j] = aw * bx + ax * bw + ay * bz - az * by;
+    tile[5 * kTile + j] = aw * by - ax * bz + ay * bw + az * bx;
+    tile[6 * kTile + j] = aw * bz + ax * by - ay * bx + az * bw;
+  }
+}
+
+}  // namespace
+
+Mat poses_to_mat(const std::span<const SE3f> poses) {
+  const size_t n = poses.size();
+  Mat mat(7, n, 1);
+  float* data = mat.data();
+  for (size_t i = 0; i < n; ++i) {
+    const SE3f& pose = poses[i];
+    data[i] = pose.translation()[0];
+    data[n + i] = pose.translation()[1];
+    data[2 * n + i] = pose.translation()[2];
+    data[3 * n + i] = pose.rotation().w();
+    data[4 * n + i] = pose.rotation().x();
+    data[5 * n + i] = pose.rotation().y();
+    data[6 * n + i] = pose.rotation().z();
+  }
+  return mat;
+}
+
+SE3f pose_at(const Mat& poses, const size_t i) noexcept {
+  return load_pose(Strided{poses.data(), poses.cols()}, i);
+}
+
+std::expected<void, MatError> transform_points(const SE3f& pose,
+                                               const Mat& points,
+                                               Mat& transformed) {
+  if (auto checked = check_columns(points, 3); !checked) {
+    return checked;
+  }
+  const size_t n = points.cols();
+  const Mat3f r = pose.rotation().matrix();
+  const Vec3f t = pose.translation();
+  const Strided p{points.data(), n};
+  write_columns(
+      transformed, 3, n, kMinArithmeticChunk,
+      [&](const size_t first, const size_t count, float* __restrict tile) {
+        for (size_t j = 0; j < count; ++j) {
+          const size_t i = first + j;
+          const float x = p(0, i), y = p(1, i), z = p(2, i);
+          tile[j] = r[0] * x + r[1] * y + r[2] * z + t[0];
+          tile[kTile + j] = r[3] * x + r[4] * y + r[5] * z + t[1];
+          tile[2 * kTile + j] = r[6] * x + r[7] * y + r[8] * z + t[2];
+        }
+      });
+  return {};
+}
+
+std::expected<void, MatError> transform_points(const Mat& poses,
+                                               const Mat& points,
+                                               Mat& transformed) {
+  if (auto checked = check_columns(poses, 7); !checked) {
+    return checked;
+  }
+  if (auto checked = check_columns(points, 3); !checked) {
+    return checked;
+  }
+  if (poses.cols() != points.cols()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  const size_t n = points.cols();
+  const Strided q{poses.data(), n};
+  const Strided p{points.data(), n};
+  write_columns(
+      transformed, 3, n, kMinArithmeticChunk,
+      [&](const size_t first, const size_t count, float* __restrict tile) {
+        for (size_t j = 0; j < count; ++j) {
+          const size_t i = first + j;
+          const float w = q(3, i), qx = q(4, i), qy = q(5, i), qz = q(6, i);
+          const float x = p(0, i), y = p(1, i), z = p(2, i);
+          const float ux = 2.0f * (qy * z - qz * y);
+          const float uy = 2.0f * (qz * x - qx * z);
+          const float uz = 2.0f * (qx * y - qy * x);
+          tile[j] = x + w * ux + qy * uz - qz * uy + q(0, i);
+          tile[kTile + j] = y + w * uy + qz * ux - qx * uz + q(1, i);
+          tile[2 * kTile + j] = z + w * uz + qx * uy - qy * ux + q(2, i);
+        }
+      });
+  return {};
+}
+
+std::expected<void, MatError> compose_poses(const Mat& a, const Mat& b,
+                                            Mat& composed) {
+  if (auto checked = check_columns(a, 7); !checked) {
+    return checked;
+  }
+  if (auto checked = check_columns(b, 7); !checked) {
+    return checked;
+  }
+  const size_t n = std::max(a.cols(), b.cols());
+  if (a.cols() != n && a.cols() != 1) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (b.cols() != n && b.cols() != 1) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  const auto run = [&](const auto& ca, const auto& cb) {
+    write_columns(composed, 7, n, kMinArithmeticChunk,
+                  [&](const size_t first, const size_t count, float* tile) {
+                    compose_tile(ca, cb, first, count, tile);
+                  });
+  };
+  const Strided sa{a.data(), n};
+  const Strided sb{b.data(), n};
+  if (a.cols() == n && b.cols() == n) {
+    run(sa, sb);
+  } else if (a.cols() == n) {
+    run(sa, Repeated(b));
+  } else {
+    run(Repeated(a), sb);
+  }
+  return {};
+}
+
+std::expected<void, MatError> invert_poses(const Mat& poses, Mat& inverted) {
+  if (auto checked = check_columns(poses, 7); !checked) {
+    return checked;
+  }
+  const size_t n = poses.cols();
+  const Strided q{poses.data(), n};
+  write_columns(
+      inverted, 7, n, kMinArithmeticChunk,
+      [&](const size_t first, const size_t count, float* __restrict tile) {
+        for (size_t j = 0; j < count; ++j) {
+          const size_t i = first + j;
+          // the conjugate rotation applied to -t
+          const float w = q(3, i), qx = -q(4, i), qy = -q(5, i),
+                      qz = -q(6, i);
+          const float x = -q(0, i), y = -q(1, i), z = -q(2, i);
+          const float ux = 2.0f * (qy * z - qz * y);
+          const float uy = 2.0f * (qz * x - qx * z);
+          const float uz = 2.0f * (qx * y - qy * x);
+          tile[j] = x + w * ux + qy * uz - qz * uy;
+          tile[kTile + j] = y + w * uy + qz * ux - qx * uz;
+          tile[2 * kTile + j] = z + w * uz + qx * uy - qy * ux;
+          tile[3 * kTile + j] = w;
+          tile[4 * kTile + j] = qx;
+          tile[5 * kTile + j] = qy;
+          tile[6 * kTile + j] = qz;
+        }
+      });
+  return {};
+}
+
+std::expected<void, MatError> interpolate_poses(const Mat& a, const Mat& b,
+                                                const float t,
+                                                Mat& interpolated) {
+  if (auto checked = check_columns(a, 7); !checked) {
+    return checked;
+  }
+  if (auto checked = check_columns(b, 7); !checked) {
+    return checked;
+  }
+  if (a.cols() != b.cols()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  // the fitted series only holds inside the interval
+  if (!(t >= 0.0f && t <= 1.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  const size_t n = a.cols();
+  const Strided sa{a.data(), n};
+  const Strided sb{b.data(), n};
+  // sin(t a) / sin(a) = t (1 + c_1 d (1 + c_2 d (1 + ...))) with
+  // d = cos(a) - 1 and c_i = (t^2 - i^2) / (i (2 i + 1)), so the factors
+  // only depend on t and are shared by every column. the last one is scaled
+  // to absorb the truncated tail, which keeps the weights within 1e-7 of
+  // the trigonometric ones.
+  float factors_a[kSlerpTerms], factors_b[kSlerpTerms];
+  for (size_t i = 1; i <= kSlerpTerms; ++i) {
+    const float u = 1.0f / static_cast<float>(i * (2 * i + 1));
+    const float v = static_cast<float>(i) / static_cast<float>(2 * i + 1);
+    const float tail = i == kSlerpTerms ? kSlerpTailScale : 1.0f;
+    factors_a[i - 1] = tail * (u * (1.0f - t) * (1.0f - t) - v);
+    factors_b[i - 1] = tail * (u * t * t - v);
+  }
+  write_columns(
+      interpolated, 7, n, kMinArithmeticChunk,
+      [&](const size_t first, const size_t count, float* __restrict tile) {
+        // separate passes over the tile, so that the series runs across
+        // columns
+        float signs[kTile], d[kTile], wa[kTile], wb[kTile];
+        for (size_t j = 0; j < count; ++j) {
+          const size_t i = first + j;
+          for (size_t r = 0; r < 3; ++r) {
+            tile[r * kTile + j] = sa(r, i) + (sb(r, i) - sa(r, i)) * t;
+          }
+          const float cosine = sa(3, i) * sb(3, i) + sa(4, i) * sb(4, i) +
+                               sa(5, i) * sb(5, i) + sa(6, i) * sb(6, i);
+          // q and -q are the same rotation, interpolate towards the nearer
+          signs[j] = cosine < 0.0f ? -1.0f : 1.0f;
+          d[j] = cosine * signs[j] - 1.0f;
+          wa[j] = 1.0f;
+          wb[j] = 1.0f;
+        }
+        for (size_t k = kSlerpTerms; k-- > 0;) {
+          const float factor_a = factors_a[k];
+          const float factor_b = factors_b[k];
+          for (size_t j = 0; j < count; ++j) {
+            wa[j] = 1.0f + factor_a * d[j] * wa[j];
+            wb[j] = 1.0f + factor_b * d[j] * wb[j];
+          }
+        }
+        // the weights are accurate enough that the result needs no
+        // renormalising
+        for (size_t j = 0; j < count; ++j) {
+          const size_t i = first + j;
+          const float weight_a = wa[j] * (1.0f - t);
+          const float weight_b = wb[j] * t * signs[j];
+          for (size_t r = 3; r < 7; ++r) {
+            tile[r * kTile + j] = weight_a * sa(r, i) + weight_b * sb(r, i);
+          }
+        }
+      });
+  return {};
+}
+
+std::expected<void, MatError> exp_poses(const Mat& tangents, Mat& poses) {
+  if (auto checked = check_columns(tangents, 6); !checked) {
+    return checked;
+  }
+  const size_t n = tangents.cols();
+  const Strided s{tangents.data(), n};
+  write_columns(poses, 7, n, kMinTrigonometricChunk,
+                [&](const size_t first, const size_t count, float* tile) {
+                  for (size_t j = 0; j < count; ++j) {
+                    const size_t i = first + j;
+                    Vec6f xi;
+                    for (size_t r = 0; r < 6; ++r) {
+                      xi[r] = s(r, i);
+                    }
+                    store_pose(SE3f::exp(xi), tile, j);
+                  }
+                });
+  return {};
+}
+
+std::expected<void, MatError> log_poses(const Mat& poses, Mat& tangents) {
+  if (auto checked = check_columns(poses, 7); !checked) {
+    return checked;
+  }
+  const size_t n = poses.cols();
+  const Strided s{poses.data(), n};
+  write_columns(tangents, 6, n, kMinTrigonometricChunk,
+                [&](const size_t first, const size_t count, float* tile) {
+                  for (size_t j = 0; j < count; ++j) {
+                    const Vec6f xi = load_pose(s, first + j).log();
+                    for (size_t r = 0; r < 6; ++r) {
+                      tile[r * kTile + j] = xi[r];
+                    }
+                  }
+                });
+  return {};
+}
+
+};  // namespace core
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <expected>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <type_traits>
+
+#include "core/fixed_mat.hpp"
+#include "core/mat.hpp"
+
+namespace core {
+
+// skew-symmetric matrix with hat(a) * b = a x b
+template <typename T>
+[[nodiscard]] constexpr FixedMat<3, 3, T> hat(
+    const FixedMat<3, 1, T>& v) noexcept {
+  return FixedMat<3, 3, T>(T{0}, -v[2], v[1],  //
+                           v[2], T{0}, -v[0],  //
+                           -v[1], v[0], T{0});
+}
+
+namespace lie_detail {
+
+// the closed forms of the coefficients below divide by powers of the angle.
+// sin(theta / 2) / theta and (1 - cos(theta)) / theta^2 stay within a few
+// ulp at any angle and only need a series near zero, where four terms are
+// exact to rounding in doubles up to kSmallAngleSquared. the other two
+// cancel, losing about eps / theta^2, so their series run up to
+// kCancellingAngleSquared with terms enough to be exact to rounding in
+// doubles there. past it their closed forms are within ~6 and ~40 ulp.
+inline constexpr double kSmallAngleSquared = 1e-3;
+inline constexpr double kCancellingAngleSquared = 1.0;
+
+// sin(theta / 2) / theta
+template <typename T>
+T half_sine_ratio(const T theta_squared) noexcept {
+  if (theta_squared < T(kSmallAngleSquared)) {
+    const T t = theta_squared;
+    return T(0.5) - t * (T(1) / 48 - t * (T(1) / 3840 - t * (T(1) / 645120)));
+  }
+  const T theta = std::sqrt(theta_squared);
+  return std::sin(theta / 2) / theta;
+}
+
+// (1 - cos(theta)) / theta^2 and (theta - sin(theta)) / theta^3, the
+// coefficients of hat(w) and hat(w)^2 in the left jacobian
+template <typename T>
+void jacobian_coefficients(const T theta_squared, T& a, T& b) noexcept {
+  const T t = theta_squared;
+  if (t < T(kSmallAngleSquared)) {
+    a = T(0.5) - t * (T(1) / 24 - t * (T(1) / 720 - t * (T(1) / 40320)));
+  } else {
+    const T half_sine = std::sin(std::sqrt(t) / 2);
+    a = 2 * half_sine * half_sine / t;
+  }
+  if (t < T(kCancellingAngleSquared)) {
+    // (-t)^k / (2k + 3)!
+    constexpr double kTerms[] = {1.0 / 6,
+                                 1.0 / 120,
+                                 1.0 / 5040,
+                                 1.0 / 362880,
+                                 1.0 / 39916800,
+                                 1.0 / 6227020800,
+                                 1.0 / 1307674368000,
+                                 1.0 / 355687428096000};
+    b = T(0);
+    for (size_t k = std::size(kTerms); k-- > 0;) {
+      b = T(kTerms[k]) - t * b;
+    }
+  } else {
+    const T theta = std::sqrt(t);
+    b = (theta - std::sin(theta)) / (t * theta);
+  }
+}
+
+// |B_2n| / (2n)! for the bernoulli numbers B_2n from n = 1, the terms of
+// x / (1 - e^-x) = 1 + x / 2 + x^2 / 12 - x^4 / 720 + ... with their signs
+// alternating. enough for double below t = 1.
+inline constexpr double kBernoulliTerms[] = {
+    1.0 / 12,
+    1.0 / 720,
+    1.0 / 30240,
+    1.0 / 1209600,
+    1.0 / 47900160,
+    691.0 / 1307674368000,
+    1.0 / 74724249600,
+    3617.0 / 10670622842880000,
+    43867.0 / 5109094217170944000,
+    174611.0 / 802857662698291200000.0,
+    77683.0 / 14101100039391805440000.0};
+
+// 1 / theta^2 - (1 + cos(theta)) / (2 theta sin(theta)), the coefficient of
+// hat(w)^2 in the inverse left jacobian
+template <typename T>
+T inverse_jacobian_coefficient(const T theta_squared) noexcept {
+  const T t = theta_squared;
+  if (t < T(kCancellingAngleSquared)) {
+    // the bernoulli series at x^2 = -t, all its terms positive
+    T c = T(0);
+    for (size_t k = std::size(kBernoulliTerms); k-- > 0;) {
+      c = T(kBernoulliTerms[k]) + t * c;
+    }
+    return c;
+  }
+  const T theta = std::sqrt(t);
+  return T(1) / t - (1 + std::cos(theta)) / (2 * theta * std::sin(theta));
+}
+
+}  // namespace lie_detail
+
+// rotation stored as a unit quaternion w + xi + yj + zk. tangent vectors
+// are rotation vectors, the axis scaled by the angle in radians.
+template <typename T = float>
+class SO3 {
+  static_assert(std::is_floating_point_v<T>);
+
+ public:
+  using Vector3 = FixedMat<3, 1, T>;
+  using Matrix3 = FixedMat<3, 3, T>;
+
+  constexpr SO3() noexcept = default;
+
+  // normalises, a zero quaternion gives the identity
+  [[nodiscard]] static SO3 from_quaternion(const T w, const T x, const T y,
+                                           const T z) noexcept {
+    const T norm = std::sqrt(w * w + x * x + y * y + z * z);
+    if (norm == T{0}) {
+      return {};
+    }
+    const T s = T{1} / norm;
+    return SO3(w * s, x * s, y * s, z * s);
+  }
+  // the nearest rotation to a rotation matrix by shepperd's method, which
+  // divides by the largest quaternion component
+  [[nodiscard]] static SO3 from_matrix(const Matrix3& m) noexcept {
+    const T trace = m.trace();
+    if (trace >= m(0, 0) && trace >= m(1, 1) && trace >= m(2, 2)) {
+      const T s = std::sqrt(T{1} + trace) * 2;
+      return from_quaternion(s / 4, (m(2, 1) - m(1, 2)) / s,
+                             (m(0, 2) - m(2, 0)) / s,
+                             (m(1, 0) - m(0, 1)) / s);
+    }
+    if (m(0, 0) >= m(1, 1) && m(0, 0) >= m(2, 2)) {
+      const T s = std::sqrt(T{1} + m(0, 0) - m(1, 1) - m(2, 2)) * 2;
+      return from_quaternion((m(2, 1) - m(1, 2)) / s, s / 4,
+                             (m(0, 1) + m(1, 0)) / s,
+                             (m(0, 2) + m(2, 0)) / s);
+    }
+    if (m(1, 1) >= m(2, 2)) {
+      const T s = std::sqrt(T{1} + m(1, 1) - m(0, 0) - m(2, 2)) * 2;
+      return from_quaternion((m(0, 2) - m(2, 0)) / s,
+                             (m(0, 1) + m(1, 0)) / s, s / 4,
+                             (m(1, 2) + m(2, 1)) / s);
+    }
+    const T s = std::sqrt(T{1} + m(2, 2) - m(0, 0) - m(1, 1)) * 2;
+    return from_quaternion((m(1, 0) - m(0, 1)) / s, (m(0, 2) + m(2, 0)) / s,
+                           (m(1, 2) + m(2, 1)) / s, s / 4);
+  }
+
+  [[nodiscard]] static SO3 exp(const Vector3& omega) noexcept {
+    const T theta_squared = omega.squared_norm();
+    const T k = lie_detail::half_sine_ratio(theta_squared);
+    return SO3(std::cos(std::sqrt(theta_squared) / 2), omega[0] * k,
+               omega[1] * k, omega[2] * k);
+  }
+  // rotation vector with angle in [0, pi]
+  [[nodiscard]] Vector3 log() const noexcept {
+    // q and -q are the same rotation, take the one with w >= 0
+    const T sign = w_ < T{0} ? T{-1} : T{1};
+    const T w = w_ * sign;
+    const T n_squared = x_ * x_ + y_ * y_ + z_ * z_;
+    T scale;
+    if (n_squared < std::numeric_limits<T>::epsilon()) {
+      scale = 2 / w * (T{1} - n_squared / (3 * w * w));
+    } else {
+      const T n = std::sqrt(n_squared);
+      scale = 2 * std::atan2(n, w) / n;
+    }
+    scale *= sign;
+    return Vector3(x_ * scale, y_ * scale, z_ * scale);
+  }
+
+  [[nodiscard]] constexpr T w() const noexcept { return w_; }
+  [[nodiscard]] constexpr T x() const noexcept { return x_; }
+  [[nodiscard]] constexpr T y() const noexcept { return y_; }
+  [[nodiscard]] constexpr T z() const noexcept { return z_; }
+
+  [[nodiscard]] constexpr Matrix3 matrix() const noexcept {
+    const T xx = x_ * x_, yy = y_ * y_, zz = z_ * z_;
+    const T xy = x_ * y_, xz = x_ * z_, yz = y_ * z_;
+    const T wx = w_ * x_, wy = w_ * y_, wz = w_ * z_;
+    return Matrix3(1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy),  //
+                   2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx),  //
+                   2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy));
+  }
+  // maps tangent vectors at this rotation to the identity, the rotation
+  // matrix itself for SO3
+  [[nodiscard]] constexpr Matrix3 adjoint() const noexcept {
+    return matrix();
+  }
+
+  [[nodiscard]] constexpr SO3 inverse() const noexcept {
+    return SO3(w_, -x_, -y_, -z_);
+  }
+  // this * other applies other first. products of unit quaternions stay
+  // unit up to rounding, long chains can renormalise with normalized().
+  [[nodiscard]] constexpr SO3 operator*(const SO3& other) const noexcept {
+    return SO3(w_ * other.w_ - x_ * other.x_ - y_ * other.y_ - z_ * other.z_,
+               w_ * other.x_ + x_ * other.w_ + y_ * other.z_ - z_ * other.y_,
+               w_ * other.y_ - x_ * other.z_ + y_ * other.w_ + z_ * other.x_,
+               w_ * other.z_ + x_ * other.y_ - y_ * other.x_ + z_ * other.w_);
+  }
+  [[nodiscard]] constexpr Vector3 operator*(const Vector3& p) const noexcept {
+    // p + w t + v x t with t = 2 v x p, cheaper than forming the matrix
+    const T tx = 2 * (y_ * p[2] - z_ * p[1]);
+    const T ty = 2 * (z_ * p[0] - x_ * p[2]);
+    const T tz = 2 * (x_ * p[1] - y_ * p[0]);
+    return Vector3(p[0] + w_ * tx + y_ * tz - z_ * ty,
+                   p[1] + w_ * ty + z_ * tx - x_ * tz,
+                   p[2] + w_ * tz + x_ * ty - y_ * tx);
+  }
+  constexpr SO3& operator*=(const SO3& other) noexcept {
+    return *this = *this * other;
+  }
+  [[nodiscard]] SO3 normalized() const noexcept {
+    return from_quaternion(w_, x_, y_, z_);
+  }
+
+  // exp(omega + d) ~= exp(J_l(omega) d) exp(omega)
+  [[nodiscard]] static Matrix3 left_jacobian(const Vector3& omega) noexcept {
+    T a, b;
+    lie_detail::jacobian_coefficients(omega.squared_norm(), a, b);
+    const Matrix3 k = hat(omega);
+    return Matrix3::identity() + k * a + k * k * b;
+  }
+  [[nodiscard]] static Matrix3 left_jacobian_inverse(
+      const Vector3& omega) noexcept {
+    const T c = lie_detail::inverse_jacobian_coefficient(omega.squared_norm());
+    const Matrix3 k = hat(omega);
+    return Matrix3::identity() - k * T(0.5) + k * k * c;
+  }
+  // exp(omega + d) ~= exp(omega) exp(J_r(omega) d)
+  [[nodiscard]] static Matrix3 right_jacobian(const Vector3& omega) noexcept {
+    return left_jacobian(-omega);
+  }
+  [[nodiscard]] static Matrix3 right_jacobian_inverse(
+      const Vector3& omega) noexcept {
+    return left_jacobian_inverse(-omega);
+  }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  constexpr SO3(const T w, const T x, const T y, const T z) noexcept
+      : w_(w), x_(x), y_(y), z_(z) {}
+
+  T w_ = 1;
+  T x_ = 0;
+  T y_ = 0;
+  T z_ = 0;
+};
+
+// rigid transform x' = R x + t. tangent vectors are (rho, phi) with the
+// translational part first, exp((rho, phi)) = (exp(phi), J_l(phi) rho).
+template <typename T = float>
+class SE3 {
+ public:
+  using Vector3 = FixedMat<3, 1, T>;
+  using Tangent = FixedMat<6, 1, T>;
+  using Matrix4 = FixedMat<4, 4, T>;
+  using Matrix6 = FixedMat<6, 6, T>;
+
+  constexpr SE3() noexcept = default;
+  constexpr SE3(const SO3<T>& rotation, const Vector3& translation) noexcept
+      : rotation_(rotation), translation_(translation) {}
+
+  // the rotation block is projected onto the nearest rotation
+  [[nodiscard]] static SE3 from_matrix(const Matrix4& m) noexcept {
+    return SE3(SO3<T>::from_matrix(m.template block<3, 3>(0, 0)),
+               m.template block<3, 1>(0, 3));
+  }
+  [[nodiscard]] constexpr Matrix4 matrix() const noexcept {
+    Matrix4 m = Matrix4::identity();
+    m.set_block(0, 0, rotation_.matrix());
+    m.set_block(0, 3, translation_);
+    return m;
+  }
+
+  [[nodiscard]] static SE3 exp(const Tangent& xi) noexcept {
+    const Vector3 phi = xi.template block<3, 1>(3, 0);
+    return SE3(SO3<T>::exp(phi),
+               SO3<T>::left_jacobian(phi) * xi.template block<3, 1>(0, 0));
+  }
+  [[nodiscard]] Tangent log() const noexcept {
+    const Vector3 phi = rotation_.log();
+    Tangent xi;
+    xi.set_block(0, 0, SO3<T>::left_jacobian_inverse(phi) * translation_);
+    xi.set_block(3, 0, phi);
+    return xi;
+  }
+
+  [[nodiscard]] constexpr const SO3<T>& rotation() const noexcept {
+    return rotation_;
+  }
+  [[nodiscard]] constexpr SO3<T>& rotation() noexcept { return rotation_; }
+  [[nodiscard]] constexpr const Vector3& translation() const noexcept {
+    return translation_;
+  }
+  [[nodiscard]] constexpr Vector3& translation() noexcept {
+    return translation_;
+  }
+
+  // [R, hat(t) R; 0, R] for (rho, phi) tangents, so that
+  // this * exp(xi) = exp(adjoint() * xi) * this
+  [[nodiscard]] constexpr Matrix6 adjoint() const noexcept {
+    const FixedMat<3, 3, T> r = rotation_.matrix();
+    Matrix6 m;
+    m.set_block(0, 0, r);
+    m.set_block(0, 3, hat(translation_) * r);
+    m.set_block(3, 3, r);
+    return m;
+  }
+
+  [[nodiscard]] constexpr SE3 inverse() const noexcept {
+    const SO3<T> inverse_rotation = rotation_.inverse();
+    return SE3(inverse_rotation, -(inverse_rotation * translation_));
+  }
+  // this * other applies other first
+  [[nodiscard]] constexpr SE3 operator*(const SE3& other) const noexcept {
+    return SE3(rotation_ * other.rotation_,
+               rotation_ * other.translation_ + translation_);
+  }
+  [[nodiscard]] constexpr Vector3 operator*(const Vector3& p) const noexcept {
+    return rotation_ * p + translation_;
+  }
+  constexpr SE3& operator*=(const SE3& other) noexcept {
+    return *this = *this * other;
+  }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  SO3<T> rotation_;
+  Vector3 translation_;
+};
+
+// shortest-arc spherical interpolation, t = 0 gives a and t = 1 gives b
+template <typename T>
+[[nodiscard]] SO3<T> slerp(const SO3<T>& a, const SO3<T>& b,
+                           const T t) noexcept {
+  T cosine = a.w() * b.w() + a.x() * b.x() + a.y() * b.y() + a.z() * b.z();
+  // q and -q are the same rotation, interpolate towards the nearer one
+  const T sign = cosine < T{0} ? T{-1} : T{1};
+  cosine *= sign;
+  T wa = 1 - t;
+  T wb = t;
+  // nearly equal rotations fall back to normalised linear interpolation.
+  // sin((1 - t) a) = sin(a) cos(t a) - cos(a) sin(t a) saves a sine.
+  if (cosine < T(0.9995)) {
+    const T angle = std::acos(cosine);
+    wb = std::sin(t * angle) / std::sqrt(1 - cosine * cosine);
+    wa = std::cos(t * angle) - cosine * wb;
+  }
+  wb *= sign;
+  return SO3<T>::from_quaternion(
+      wa * a.w() + wb * b.w(), wa * a.x() + wb * b.x(),
+      wa * a.y() + wb * b.y(), wa * a.z() + wb * b.z());
+}
+
+// slerp on the rotations and linear interpolation of the translations, the
+// usual interpolation of timestamped poses. unlike the screw motion
+// a * exp(t log(a^-1 b)) the translation moves along a straight line.
+template <typename T>
+[[nodiscard]] SE3<T> interpolate(const SE3<T>& a, const SE3<T>& b,
+                                 const T t) noexcept {
+  return SE3<T>(slerp(a.rotation(), b.rotation(), t),
+                a.translation() + (b.translation() - a.translation()) * t);
+}
+
+using SO3f = SO3<float>;
+using SO3d = SO3<double>;
+using SE3f = SE3<float>;
+using SE3d = SE3<double>;
+
+// batched operations on structure-of-arrays Mats, single channel with one
+// column per element: N points are 3 x N with rows x, y, z, N poses are
+// 7 x N with rows tx, ty, tz, qw, qx, qy, qz, and N tangents are 6 x N with
+// rows rho, phi as for SE3. each row is contiguous, so the arithmetic
+// kernels vectorise across elements. outputs keep their buffers when the
+// shape is unchanged and may be one of the inputs.
+
+[[nodiscard]] Mat poses_to_mat(std::span<const SE3f> poses);
+// the pose in column i, unchecked
+[[nodiscard]] SE3f pose_at(const Mat& poses, size_t i) noexcept;
+
+// one pose applied to every point
+[[nodiscard]] std::expected<void, MatError> transform_points(
+    const SE3f& pose, const Mat& points, Mat& transformed);
+// pose i applied to point i
+[[nodiscard]] std::expected<void, MatError> transform_points(
+    const Mat& poses, const Mat& points, Mat& transformed);
+
+// a_i * b_i, either side may be a single pose which is applied to all
+[[nodiscard]] std::expected<void, MatError> compose_poses(const Mat& a,
+                                                          const Mat& b,
+                                                          Mat& composed);
+[[nodiscard]] std::expected<void, MatError> invert_poses(const Mat& poses,
+                                                         Mat& inverted);
+// interpolate(a_i, b_i, t) for each column and t in [0, 1],
+// InvalidParameter otherwise. the slerp weights come from a polynomial in
+// the cosine between the rotations rather than trigonometric calls, so the
+// kernel vectorises, and agree with them to float rounding.
+[[nodiscard]] std::expected<void, MatError> interpolate_poses(
+    const Mat& a, const Mat& b, float t, Mat& interpolated);
+
+[[nodiscard]] std::expected<void, MatError> exp_poses(const Mat& tangents,
+                                                      Mat& poses);
+[[nodiscard]] std::expected<void, MatError> log_poses(const Mat& poses,
+                                                      Mat& tangents);
+
+};  // namespace core
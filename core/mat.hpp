@@ -19,6 +19,7 @@ enum class MatError {
   ProtoDataMismatch,
   InvalidChannelsForOperation,
   WriteImageFailed,
+  InvalidParameter,
 };
 
 static constexpr bool approx_equal(const float a, const float b,
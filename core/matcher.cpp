@@ -0,0 +1,481 @@
+#include "core/matcher.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "core/parallel.hpp"
+
+// baseline x86-64 has no popcnt instruction and std::popcount turns into a
+// library call there, so the distance loops are compiled a second time for
+// cpus with popcnt and picked at runtime
+#if defined(__x86_64__) || defined(__i386__)
+#define CORE_MATCHER_POPCNT_CLONES 1
+#endif
+
+namespace core {
+namespace {
+
+constexpr size_t kQueryBlock = 64;
+// 256 descriptors are 8 KiB, a tile stays in L1 while a query block is
+// scanned against it
+constexpr size_t kTrainBlock = 256;
+constexpr size_t kMinQueriesPerChunk = 64;
+constexpr uint64_t kNone = std::numeric_limits<uint64_t>::max();
+
+// (distance << 32 | index) keys, comparing keys breaks distance ties towards
+// the lower index
+constexpr uint64_t pack(const uint32_t distance, const uint32_t index) {
+  return (static_cast<uint64_t>(distance) << 32) | index;
+}
+constexpr uint32_t distance_of(const uint64_t key) {
+  return static_cast<uint32_t>(key >> 32);
+}
+constexpr uint32_t index_of(const uint64_t key) {
+  return static_cast<uint32_t>(key);
+}
+
+struct BestTwo {
+  uint64_t best = kNone;
+  uint64_t second = kNone;
+
+  void add(const uint64_t key) noexcept {
+    if (key < second) {
+      second = std::max(key, best);
+      best = std::min(key, best);
+    }
+  }
+};
+
+bool passes(const BestTwo& candidates, const MatchParams& params) {
+  if (candidates.best == kNone ||
+      distance_of(candidates.best) > params.max_distance) {
+    return false;
+  }
+  return params.ratio >= 1.0f || candidates.second == kNone ||
+         static_cast<float>(distance_of(candidates.best)) <
+             params.ratio * static_cast<float>(distance_of(candidates.second));
+}
+
+std::expected<void, MatError> validate(const MatchParams& params) {
+  if (!(params.ratio > 0.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  return {};
+}
+
+// best two of `lanes` consecutive queries over train [tb, te), each train
+// descriptor is loaded once for all of them
+template <size_t Lanes, bool CrossCheck>
+[[gnu::always_inline]] inline void scan_tile(
+    const Descriptor* queries, const size_t q, const Descriptor* train,
+    const size_t tb, const size_t te, BestTwo* best, uint64_t* train_best) {
+  BestTwo candidates[Lanes];
+  for (size_t lane = 0; lane < Lanes; ++lane) {
+    candidates[lane] = best[lane];
+  }
+  for (size_t t = tb; t < te; ++t) {
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+      const uint32_t distance = hamming_distance(queries[q + lane], train[t]);
+      candidates[lane].add(pack(distance, static_cast<uint32_t>(t)));
+      if constexpr (CrossCheck) {
+        train_best[t] = std::min(
+            train_best[t],
+            pack(distance, static_cast<uint32_t>(q + lane)));
+      }
+    }
+  }
+  for (size_t lane = 0; lane < Lanes; ++lane) {
+    best[lane] = candidates[lane];
+  }
+}
+
+// best two train descriptors of queries [q0, q1), and with CrossCheck the
+// best query of every train descriptor among them
+template <bool CrossCheck>
+[[gnu::always_inline]] inline void scan_blocks(
+    const Descriptor* queries, const size_t q0, const size_t q1,
+    const Descriptor* train, const size_t num_train, BestTwo* best,
+    uint64_t* train_best) {
+  constexpr size_t kLanes = 4;
+  for (size_t qb = q0; qb < q1; qb += kQueryBlock) {
+    const size_t qe = std::min(qb + kQueryBlock, q1);
+    for (size_t tb = 0; tb < num_train; tb += kTrainBlock) {
+      const size_t te = std::min(tb + kTrainBlock, num_train);
+      size_t q = qb;
+      for (; q + kLanes <= qe; q += kLanes) {
+        scan_tile<kLanes, CrossCheck>(queries, q, train, tb, te,
+                                      best + (q - q0), train_best);
+      }
+      for (; q < qe; ++q) {
+        scan_tile<1, CrossCheck>(queries, q, train, tb, te, best + (q - q0),
+                                 train_best);
+      }
+    }
+  }
+}
+
+template <bool CrossCheck>
+void scan_default(const Descriptor* queries, const size_t q0, const size_t q1,
+                  const Descriptor* train, const size_t num_train,
+                  BestTwo* best, uint64_t* train_best) {
+  scan_blocks<CrossCheck>(queries, q0, q1, train, num_train, best,
+                          train_best);
+}
+
+#ifdef CORE_MATCHER_POPCNT_CLONES
+template <bool CrossCheck>
+__attribute__((target("popcnt"))) void scan_popcnt(
+    const Descriptor* queries, const size_t q0, const size_t q1,
+    const Descriptor* train, const size_t num_train, BestTwo* best,
+    uint64_t* train_best) {
+  scan_blocks<CrossCheck>(queries, q0, q1, train, num_train, best,
+                          train_best);
+}
+#endif
+
+bool has_popcnt() {
+#ifdef CORE_MATCHER_POPCNT_CLONES
+  static const bool supported = __builtin_cpu_supports("popcnt");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+template <bool CrossCheck>
+void scan(const Descriptor* queries, const size_t q0, const size_t q1,
+          const Descriptor* train, const size_t num_train, BestTwo* best,
+          uint64_t* train_best) {
+#ifdef CORE_MATCHER_POPCNT_CLONES
+  if (has_popcnt()) {
+    scan_popcnt<CrossCheck>(queries, q0, q1, train, num_train, best,
+                            train_best);
+    return;
+  }
+#endif
+  scan_default<CrossCheck>(queries, q0, q1, train, num_train, best,
+                           train_best);
+}
+
+// bits [begin, begin + length) of a descriptor, length <= 32
+inline uint32_t substring(const Descriptor& descriptor, const uint32_t begin,
+                          const uint32_t length) noexcept {
+  const uint32_t word = begin / 64, shift = begin % 64;
+  uint64_t bits = descriptor.words[word] >> shift;
+  if (shift + length > 64) {
+    bits |= descriptor.words[word + 1] << (64 - shift);
+  }
+  return static_cast<uint32_t>(bits & ((uint64_t{1} << length) - 1));
+}
+
+// next larger integer with the same number of set bits (gosper's hack)
+inline uint32_t next_combination(const uint32_t mask) noexcept {
+  const uint32_t lowest = mask & (~mask + 1);
+  const uint32_t ripple = mask + lowest;
+  return ripple | (((mask ^ ripple) >> 2) / lowest);
+}
+
+struct HashLayout {
+  uint32_t bits;
+  uint32_t tables;
+};
+
+HashLayout layout_for(const size_t n) {
+  // substrings of about log2(n) bits leave around one descriptor per bucket
+  const auto bits = static_cast<uint32_t>(std::clamp(
+      std::lround(std::log2(static_cast<double>(std::max<size_t>(n, 2)))), 4L,
+      16L));
+  return {bits, (256 + bits - 1) / bits};
+}
+
+}  // namespace
+
+std::expected<std::vector<Match>, MatError> match_brute_force(
+    std::span<const Descriptor> queries, std::span<const Descriptor> train,
+    const MatchParams& params) {
+  if (auto valid = validate(params); !valid) {
+    return std::unexpected(valid.error());
+  }
+  std::vector<Match> matches;
+  if (queries.empty() || train.empty()) {
+    return matches;
+  }
+
+  std::vector<BestTwo> best(queries.size());
+  const size_t chunks = num_chunks(queries.size(), kMinQueriesPerChunk);
+  // per chunk copies of the reverse nearest neighbours, merged afterwards
+  std::vector<uint64_t> train_best(
+      params.cross_check ? chunks * train.size() : 0, kNone);
+  parallel_for_chunks(
+      0, queries.size(),
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        if (params.cross_check) {
+          scan<true>(queries.data(), lo, hi, train.data(), train.size(),
+                     best.data() + lo,
+                     train_best.data() + chunk * train.size());
+        } else {
+          scan<false>(queries.data(), lo, hi, train.data(), train.size(),
+                      best.data() + lo, nullptr);
+        }
+      },
+      kMinQueriesPerChunk);
+  for (size_t chunk = 1; chunk < chunks && params.cross_check; ++chunk) {
+    for (size_t t = 0; t < train.size(); ++t) {
+      train_best[t] = std::min(train_best[t],
+                               train_best[chunk * train.size() + t]);
+    }
+  }
+
+  for (size_t q = 0; q < queries.size(); ++q) {
+    if (!passes(best[q], params)) {
+      continue;
+    }
+    const uint32_t t = index_of(best[q].best);
+    if (params.cross_check && index_of(train_best[t]) != q) {
+      continue;
+    }
+    matches.push_back(
+        {static_cast<uint32_t>(q), t, distance_of(best[q].best)});
+  }
+  return matches;
+}
+
+MultiIndexHash MultiIndexHash::build(std::span<const Descriptor> train) {
+  MultiIndexHash index;
+  index.train_.assign(train.begin(), train.end());
+  const HashLayout layout = layout_for(train.size());
+  index.substring_bits_ = layout.bits;
+  index.num_tables_ = layout.tables;
+
+  // one counting sort per table
+  const size_t buckets = size_t{1} << layout.bits;
+  index.offsets_.assign(layout.tables * (buckets + 1), 0);
+  index.ids_.resize(layout.tables * train.size());
+  parallel_for(0, layout.tables, [&](const size_t lo, const size_t hi) {
+    for (size_t table = lo; table < hi; ++table) {
+      const auto begin = static_cast<uint32_t>(table * layout.bits);
+      const uint32_t length = std::min(layout.bits, 256 - begin);
+      uint32_t* offsets = index.offsets_.data() + table * (buckets + 1);
+      for (const Descriptor& descriptor : train) {
+        ++offsets[substring(descriptor, begin, length) + 1];
+      }
+      for (size_t k = 0; k < buckets; ++k) {
+        offsets[k + 1] += offsets[k];
+      }
+      uint32_t* ids = index.ids_.data() + table * train.size();
+      std::vector<uint32_t> cursor(offsets, offsets + buckets);
+      for (size_t i = 0; i < train.size(); ++i) {
+        ids[cursor[substring(train[i], begin, length)]++] =
+            static_cast<uint32_t>(i);
+      }
+    }
+  });
+  return index;
+}
+
+namespace {
+
+struct HashView {
+  const Descriptor* train;
+  size_t size;
+  uint32_t bits;
+  uint32_t tables;
+  const uint32_t* offsets;
+  const uint32_t* ids;
+};
+
+// descriptors a query is expected to visit up to `radius`, every table
+// probes C(bits, r) buckets of n / 2^bits descriptors at radius r
+double expected_visits(const HashView& index, const uint32_t radius) {
+  double combinations = 1.0, buckets = 1.0;
+  for (uint32_t r = 1; r <= radius && r <= index.bits; ++r) {
+    combinations *= static_cast<double>(index.bits - r + 1) / r;
+    buckets += combinations;
+  }
+  return index.tables * buckets * static_cast<double>(index.size) /
+         static_cast<double>(size_t{1} << index.bits);
+}
+
+// probes growing substring radii until the nearest two, or the match
+// decision, can no longer change. `seen` holds a stamp per train descriptor.
+[[gnu::always_inline]] inline BestTwo search_one(const HashView& index,
+                                                 const Descriptor& query,
+                                                 const MatchParams& params,
+                                                 std::vector<uint32_t>& seen,
+                                                 const uint32_t stamp) {
+  const size_t buckets = size_t{1} << index.bits;
+  const uint32_t last_length = 256 - (index.tables - 1) * index.bits;
+  BestTwo candidates;
+  for (uint32_t radius = 0;; ++radius) {
+    // the radius whose bound could settle the current best: above it for
+    // the best to be final, above best / ratio for the ratio test to pass
+    // and above max_distance to reject
+    if (radius > 0) {
+      double target = static_cast<double>(index.tables) * radius + 1.0;
+      if (candidates.best != kNone) {
+        const double best = distance_of(candidates.best);
+        target = std::max(target, params.ratio < 1.0f
+                                      ? best / params.ratio
+                                      : best + 1.0);
+        if (best > params.max_distance) {
+          target = std::min(target, params.max_distance + 1.0);
+        }
+      }
+      const auto needed = static_cast<uint32_t>(std::min(
+          std::ceil(target / index.tables) - 1.0,
+          static_cast<double>(std::min(index.bits, last_length))));
+      // a hashed visit costs about as much as scanning 16 descriptors
+      // linearly, far queries are cheaper to finish by a linear scan
+      if (16.0 * expected_visits(index, std::max(needed, radius)) >
+          static_cast<double>(index.size)) {
+        candidates = {};
+        for (size_t id = 0; id < index.size; ++id) {
+          candidates.add(pack(hamming_distance(query, index.train[id]),
+                              static_cast<uint32_t>(id)));
+        }
+        return candidates;
+      }
+    }
+    for (uint32_t table = 0; table < index.tables; ++table) {
+      const uint32_t begin = table * index.bits;
+      const uint32_t length = std::min(index.bits, 256 - begin);
+      if (radius > length) {
+        continue;
+      }
+      const uint32_t key = substring(query, begin, length);
+      const uint32_t* offsets = index.offsets + table * (buckets + 1);
+      const uint32_t* ids = index.ids + table * index.size;
+      const auto probe = [&](const uint32_t bucket) {
+        for (uint32_t i = offsets[bucket]; i < offsets[bucket + 1]; ++i) {
+          const uint32_t id = ids[i];
+          if (seen[id] != stamp) {
+            seen[id] = stamp;
+            candidates.add(
+                pack(hamming_distance(query, index.train[id]), id));
+          }
+        }
+      };
+      if (radius == 0) {
+        probe(key);
+        continue;
+      }
+      for (uint32_t flip = (1u << radius) - 1; flip < (1u << length);
+           flip = next_combination(flip)) {
+        probe(key ^ flip);
+      }
+    }
+
+    // tables no longer than the radius were enumerated completely, so
+    // everything has been seen. otherwise an unseen descriptor differs in
+    // more than radius bits of every substring.
+    if (radius >= std::min(index.bits, last_length)) {
+      return candidates;
+    }
+    const uint64_t bound = static_cast<uint64_t>(index.tables) * (radius + 1);
+    const uint64_t best = distance_of(candidates.best);
+    const uint64_t second = distance_of(candidates.second);
+    if (candidates.second != kNone && second < bound) {
+      return candidates;  // both nearest are final
+    }
+    if (candidates.best != kNone && best < bound) {
+      // the best is final, the true second best is at least
+      // min(second, bound)
+      if (params.ratio >= 1.0f ||
+          static_cast<float>(best) <
+              params.ratio * static_cast<float>(std::min(second, bound))) {
+        return candidates;
+      }
+    }
+    if (bound > params.max_distance &&
+        (candidates.best == kNone || best > params.max_distance)) {
+      return candidates;  // nothing within max_distance
+    }
+  }
+}
+
+void search_range(const HashView& index, const Descriptor* queries,
+                  const size_t lo, const size_t hi, const MatchParams& params,
+                  BestTwo* best) {
+  std::vector<uint32_t> seen(index.size, 0);
+  for (size_t q = lo; q < hi; ++q) {
+    best[q] = search_one(index, queries[q], params, seen,
+                         static_cast<uint32_t>(q - lo + 1));
+  }
+}
+
+#ifdef CORE_MATCHER_POPCNT_CLONES
+__attribute__((target("popcnt"))) void search_range_popcnt(
+    const HashView& index, const Descriptor* queries, const size_t lo,
+    const size_t hi, const MatchParams& params, BestTwo* best) {
+  std::vector<uint32_t> seen(index.size, 0);
+  for (size_t q = lo; q < hi; ++q) {
+    best[q] = search_one(index, queries[q], params, seen,
+                         static_cast<uint32_t>(q - lo + 1));
+  }
+}
+#endif
+
+}  // namespace
+
+std::expected<std::vector<Match>, MatError> MultiIndexHash::match(
+    std::span<const Descriptor> queries, const MatchParams& params) const {
+  if (auto valid = validate(params); !valid) {
+    return std::unexpected(valid.error());
+  }
+  std::vector<Match> matches;
+  if (queries.empty() || train_.empty()) {
+    return matches;
+  }
+
+  const HashView view{train_.data(), train_.size(), substring_bits_,
+                      num_tables_,   offsets_.data(), ids_.data()};
+  std::vector<BestTwo> best(queries.size());
+  parallel_for(
+      0, queries.size(),
+      [&](const size_t lo, const size_t hi) {
+#ifdef CORE_MATCHER_POPCNT_CLONES
+        if (has_popcnt()) {
+          search_range_popcnt(view, queries.data(), lo, hi, params,
+                              best.data());
+          return;
+        }
+#endif
+        search_range(view, queries.data(), lo, hi, params, best.data());
+      },
+      kMinQueriesPerChunk);
+
+  for (size_t q = 0; q < queries.size(); ++q) {
+    if (passes(best[q], params)) {
+      matches.push_back({static_cast<uint32_t>(q), index_of(best[q].best),
+                         distance_of(best[q].best)});
+    }
+  }
+  if (!params.cross_check || matches.empty()) {
+    return matches;
+  }
+
+  // reverse nearest neighbours of the matched train descriptors only
+  std::vector<Descriptor> matched_train(matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    matched_train[i] = train_[matches[i].train];
+  }
+  const MultiIndexHash reverse = build(queries);
+  MatchParams nearest;
+  nearest.ratio = 1.0f;
+  auto back = reverse.match(matched_train, nearest);
+  if (!back) {
+    return std::unexpected(back.error());
+  }
+  // every matched train descriptor has a nearest query, so back lines up
+  // with matches
+  std::vector<Match> kept;
+  for (size_t i = 0; i < matches.size(); ++i) {
+    if ((*back)[i].train == matches[i].query) {
+      kept.push_back(matches[i]);
+    }
+  }
+  return kept;
+}
+
+};  // namespace core
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <vector>
+
+#include "core/features.hpp"
+
+namespace core {
+
+struct Match {
+  uint32_t query = 0;
+  uint32_t train = 0;
+  uint32_t distance = 0;  // hamming distance in bits
+};
+
+struct MatchParams {
+  // lowe's ratio test, the best distance must be below ratio times the
+  // second best. values >= 1 disable it.
+  float ratio = 0.8f;
+  // keep a match only if the query is also the train descriptor's nearest
+  bool cross_check = false;
+  // matches further than this are dropped
+  uint32_t max_distance = 256;
+};
+
+[[nodiscard]] inline uint32_t hamming_distance(const Descriptor& a,
+                                               const Descriptor& b) noexcept {
+  uint32_t distance = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    distance += static_cast<uint32_t>(std::popcount(a.words[i] ^ b.words[i]));
+  }
+  return distance;
+}
+
+// exhaustive matching, blocked so a tile of train descriptors stays in L1
+// while a block of queries is scanned against it, and parallel over query
+// blocks. matches are ordered by query.
+[[nodiscard]] std::expected<std::vector<Match>, MatError> match_brute_force(
+    std::span<const Descriptor> queries, std::span<const Descriptor> train,
+    const MatchParams& params = {});
+
+// multi-index hashing (Norouzi et al. 2012): descriptors are split into m
+// substrings of about log2(n) bits, each indexed in its own table. a query
+// probes every table at growing substring radius r, and once radius r is done
+// every descriptor within m * (r + 1) - 1 bits has been seen, which bounds
+// the search for the nearest two. queries whose decision would need more
+// probes than a linear scan costs fall back to one, so it pays off for large
+// train sets and close matches. results equal match_brute_force.
+class MultiIndexHash {
+ public:
+  MultiIndexHash() noexcept = default;
+
+  // keeps a copy of the train descriptors
+  [[nodiscard]] static MultiIndexHash build(std::span<const Descriptor> train);
+
+  [[nodiscard]] size_t size() const noexcept { return train_.size(); }
+
+  [[nodiscard]] std::expected<std::vector<Match>, MatError> match(
+      std::span<const Descriptor> queries,
+      const MatchParams& params = {}) const;
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  std::vector<Descriptor> train_;
+  uint32_t substring_bits_ = 0;
+  uint32_t num_tables_ = 0;
+  // per table, bucket k holds ids_[offsets_[k]..offsets_[k + 1]) with
+  // (1 << substring_bits_) + 1 offsets per table
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> ids_;
+};
+
+};  // namespace core
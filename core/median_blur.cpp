@@ -0,0 +1,329 @@
+#include "core/median_blur.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 8;
+// outputs the 5x5 network sorts at once, one row of values per input
+constexpr size_t kBlock = 64;
+// a full window still counts into 16 bits
+constexpr size_t kMaxHistogramRadius = 127;
+constexpr size_t kLevels = 256;
+constexpr size_t kCoarse = 16;  // coarse bins of kCoarse fine bins each
+
+// compare-exchanges after which element 12 of 25 is their median
+// (Devillard 1998), checked on all 2^25 zero-one inputs
+constexpr std::array<std::pair<uint8_t, uint8_t>, 99> kMedian25 = {{
+    {0, 1},   {3, 4},   {2, 4},   {2, 3},   {6, 7},   {5, 7},   {5, 6},
+    {9, 10},  {8, 10},  {8, 9},   {12, 13}, {11, 13}, {11, 12}, {15, 16},
+    {14, 16}, {14, 15}, {18, 19}, {17, 19}, {17, 18}, {21, 22}, {20, 22},
+    {20, 21}, {23, 24}, {2, 5},   {3, 6},   {0, 6},   {0, 3},   {4, 7},
+    {1, 7},   {1, 4},   {11, 14}, {8, 14},  {8, 11},  {12, 15}, {9, 15},
+    {9, 12},  {13, 16}, {10, 16}, {10, 13}, {20, 23}, {17, 23}, {17, 20},
+    {21, 24}, {18, 24}, {18, 21}, {19, 22}, {8, 17},  {9, 18},  {0, 18},
+    {0, 9},   {10, 19}, {1, 19},  {1, 10},  {11, 20}, {2, 20},  {2, 11},
+    {12, 21}, {3, 21},  {3, 12},  {13, 22}, {4, 22},  {4, 13},  {14, 23},
+    {5, 23},  {5, 14},  {15, 24}, {6, 24},  {6, 15},  {7, 16},  {7, 19},
+    {13, 21}, {15, 23}, {7, 13},  {7, 15},  {1, 9},   {3, 11},  {5, 17},
+    {11, 17}, {9, 17},  {4, 10},  {6, 12},  {7, 14},  {4, 6},   {4, 7},
+    {12, 14}, {10, 14}, {6, 7},   {10, 12}, {6, 10},  {6, 17},  {12, 17},
+    {7, 17},  {7, 10},  {12, 18}, {7, 12},  {10, 18}, {12, 20}, {10, 20},
+    {10, 12},
+}};
+
+inline float median3(const float a, const float b, const float c) {
+  return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+// rows [first - radius, first + count - radius) of `image`, clamped to the
+// image and padded by `radius` replicated pixels on both sides
+void pad_rows(const Mat& image, const size_t first, const size_t count,
+              const size_t radius, std::vector<float>& padded) {
+  const size_t rows = image.rows(), cols = image.cols();
+  const size_t channels = image.channels();
+  const size_t width = (cols + 2 * radius) * channels;
+  padded.resize(count * width);
+  for (size_t i = 0; i < count; ++i) {
+    const size_t slot = first + i;
+    const size_t y = slot > radius ? std::min(slot - radius, rows - 1) : 0;
+    const float* in = image.data() + y * cols * channels;
+    float* out = padded.data() + i * width;
+    for (size_t x = 0; x < radius; ++x) {
+      std::copy(in, in + channels, out + x * channels);
+      std::copy(in + (cols - 1) * channels, in + cols * channels,
+                out + (radius + cols + x) * channels);
+    }
+    std::copy(in, in + cols * channels, out + radius * channels);
+  }
+}
+
+// 3x3 medians of rows [lo, hi). every padded column is sorted once, and a
+// pixel's median is the median of the largest of the three column minima,
+// the median of the column medians and the smallest of the column maxima.
+void median3x3(const Mat& image, Mat& out, const size_t lo, const size_t hi) {
+  const size_t channels = image.channels();
+  const size_t n = image.cols() * channels;
+  const size_t width = n + 2 * channels;
+  std::vector<float> padded;
+  pad_rows(image, lo, hi - lo + 2, 1, padded);
+  std::vector<float> low(width), middle(width), high(width);
+  for (size_t y = lo; y < hi; ++y) {
+    const float* a = padded.data() + (y - lo) * width;
+    const float* b = a + width;
+    const float* c = b + width;
+    for (size_t i = 0; i < width; ++i) {
+      const float small = std::min(a[i], b[i]), large = std::max(a[i], b[i]);
+      low[i] = std::min(small, c[i]);
+      middle[i] = std::min(large, std::max(small, c[i]));
+      high[i] = std::max(large, c[i]);
+    }
+
+    const float* l0 = low.data();
+    const float* l1 = l0 + channels;
+    const float* l2 = l1 + channels;
+    const float* m0 = middle.data();
+    const float* m1 = m0 + channels;
+    const float* m2 = m1 + channels;
+    const float* h0 = high.data();
+    const float* h1 = h0 + channels;
+    const float* h2 = h1 + channels;
+    float* result = out.data() + y * n;
+    for (size_t i = 0; i < n; ++i) {
+      const float largest_low = std::max(std::max(l0[i], l1[i]), l2[i]);
+      const float smallest_high = std::min(std::min(h0[i], h1[i]), h2[i]);
+      result[i] = median3(largest_low, median3(m0[i], m1[i], m2[i]),
+                          smallest_high);
+    }
+  }
+}
+
+// 5x5 medians of rows [lo, hi), the network runs on kBlock outputs at a
+// time with one array per window element so every exchange vectorises
+void median5x5(const Mat& image, Mat& out, const size_t lo, const size_t hi) {
+  const size_t channels = image.channels();
+  const size_t n = image.cols() * channels;
+  const size_t width = n + 4 * channels;
+  std::vector<float> padded;
+  pad_rows(image, lo, hi - lo + 4, 2, padded);
+  std::vector<float> window(25 * kBlock);
+  for (size_t y = lo; y < hi; ++y) {
+    const float* rows = padded.data() + (y - lo) * width;
+    for (size_t begin = 0; begin < n; begin += kBlock) {
+      const size_t count = std::min(kBlock, n - begin);
+      for (size_t k = 0; k < 25; ++k) {
+        const float* in = rows + (k / 5) * width + (k % 5) * channels + begin;
+        std::copy(in, in + count, window.data() + k * kBlock);
+      }
+      for (const auto& [a, b] : kMedian25) {
+        float* __restrict first = window.data() + a * kBlock;
+        float* __restrict second = window.data() + b * kBlock;
+        for (size_t j = 0; j < kBlock; ++j) {
+          const float small = std::min(first[j], second[j]);
+          second[j] = std::max(first[j], second[j]);
+          first[j] = small;
+        }
+      }
+      const float* median = window.data() + 12 * kBlock;
+      std::copy(median, median + count, out.data() + y * n + begin);
+    }
+  }
+}
+
+// bins [0, kCoarse) of `to` plus those of `from`. the bin updates stay out
+// of line, inlined gcc unrolls them into scalar code instead of vectorising
+[[gnu::noinline]] void add_bins(uint16_t* __restrict to,
+                                const uint16_t* __restrict from) noexcept {
+  for (size_t i = 0; i < kCoarse; ++i) {
+    to[i] += from[i];
+  }
+}
+
+// bins [0, kCoarse) of `to` plus those of `entering` minus those of
+// `leaving`, for windows moving by one column
+[[gnu::noinline]] void slide_bins(uint16_t* __restrict to,
+                                  const uint16_t* __restrict entering,
+                                  const uint16_t* __restrict leaving) noexcept {
+  for (size_t i = 0; i < kCoarse; ++i) {
+    to[i] += entering[i] - leaving[i];
+  }
+}
+
+// index of the bin among [0, kCoarse) that holds element `half` when
+// `below` elements precede the first bin, adding the elements of the bins
+// before it to `below`
+inline size_t find_bin(const uint16_t* bins, const size_t half,
+                       size_t& below) noexcept {
+  size_t index = 0;
+  while (below + bins[index] <= half) {
+    below += bins[index++];
+  }
+  return index;
+}
+
+// per thread histograms of the quantised path
+struct Histograms {
+  std::vector<uint16_t> columns;  // kLevels bins per column
+  std::vector<uint16_t> coarse_columns;  // kCoarse bins per column
+  std::array<uint16_t, kLevels> kernel{};  // fine, up to date per coarse bin
+  std::array<uint16_t, kCoarse> coarse_kernel{};
+  // column the fine bins of each coarse bin are up to date for
+  std::array<size_t, kCoarse> updated{};
+};
+
+// constant time median (Perreault & Hebert 2007) of one channel of the
+// quantised image over rows [lo, hi)
+void histogram_median(const std::vector<uint8_t>& levels, const Mat& image,
+                      const size_t channel, const size_t radius,
+                      const std::array<float, kLevels>& values, Mat& out,
+                      const size_t lo, const size_t hi, Histograms& h) {
+  const size_t rows = image.rows(), cols = image.cols();
+  const size_t channels = image.channels();
+  const auto level = [&](const size_t y, const size_t x) {
+    return levels[(y * cols + x) * channels + channel];
+  };
+  // window slot s - radius of an axis of n pixels, replicated at the borders
+  const auto clamped = [radius](const size_t s, const size_t n) {
+    return s > radius ? std::min(s - radius, n - 1) : 0;
+  };
+  const auto add_pixel = [&](const size_t y, const size_t x, const int sign) {
+    const uint8_t l = level(y, x);
+    h.columns[x * kLevels + l] += sign;
+    h.coarse_columns[x * kCoarse + l / kCoarse] += sign;
+  };
+
+  h.columns.assign(cols * kLevels, 0);
+  h.coarse_columns.assign(cols * kCoarse, 0);
+  for (size_t x = 0; x < cols; ++x) {
+    for (size_t s = lo; s <= lo + 2 * radius; ++s) {
+      add_pixel(clamped(s, rows), x, 1);
+    }
+  }
+
+  const size_t span = 2 * radius + 1;
+  const size_t half = span * span / 2;
+  // brings the fine bins of coarse bin b from column h.updated[b] to x, or
+  // sums them afresh when the windows no longer overlap
+  const auto refresh = [&](const size_t b, const size_t x) {
+    uint16_t* fine = h.kernel.data() + b * kCoarse;
+    const size_t offset = b * kCoarse;
+    if (h.updated[b] > x || x - h.updated[b] >= span) {
+      std::fill(fine, fine + kCoarse, 0);
+      for (size_t s = x; s < x + span; ++s) {
+        add_bins(fine, h.columns.data() + clamped(s, cols) * kLevels + offset);
+      }
+    } else {
+      const uint16_t* columns = h.columns.data() + offset;
+      for (size_t t = h.updated[b] + 1; t <= x; ++t) {
+        slide_bins(fine, columns + clamped(t + span - 1, cols) * kLevels,
+                   columns + clamped(t - 1, cols) * kLevels);
+      }
+    }
+    h.updated[b] = x;
+  };
+
+  for (size_t y = lo; y < hi; ++y) {
+    if (y > lo) {
+      const size_t leaving = clamped(y - 1, rows);
+      const size_t entering = clamped(y + 2 * radius, rows);
+      for (size_t x = 0; x < cols; ++x) {
+        add_pixel(leaving, x, -1);
+        add_pixel(entering, x, 1);
+      }
+    }
+
+    h.coarse_kernel.fill(0);
+    for (size_t s = 0; s < span; ++s) {
+      add_bins(h.coarse_kernel.data(),
+               h.coarse_columns.data() + clamped(s, cols) * kCoarse);
+    }
+    // no fine bins are valid on a new row
+    h.updated.fill(std::numeric_limits<size_t>::max());
+
+    float* result = out.data() + y * cols * channels + channel;
+    for (size_t x = 0; x < cols; ++x) {
+      if (x > 0) {
+        const uint16_t* columns = h.coarse_columns.data();
+        slide_bins(h.coarse_kernel.data(),
+                   columns + clamped(x + span - 1, cols) * kCoarse,
+                   columns + clamped(x - 1, cols) * kCoarse);
+      }
+      size_t below = 0;
+      const size_t b = find_bin(h.coarse_kernel.data(), half, below);
+      refresh(b, x);
+      const size_t k = find_bin(h.kernel.data() + b * kCoarse, half, below);
+      result[x * channels] = values[b * kCoarse + k];
+    }
+  }
+}
+
+}  // namespace
+
+std::expected<Mat, MatError> median_blur(const Mat& image,
+                                         const size_t radius, const float low,
+                                         const float high) {
+  if (image.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (radius > kMaxHistogramRadius || !(high > low)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  if (radius == 0) {
+    return image.clone();
+  }
+
+  Mat out(image.rows(), image.cols(), image.channels());
+  if (radius <= 2) {
+    parallel_for(
+        0, image.rows(),
+        [&](const size_t lo, const size_t hi) {
+          if (radius == 1) {
+            median3x3(image, out, lo, hi);
+          } else {
+            median5x5(image, out, lo, hi);
+          }
+        },
+        kMinRowsPerChunk);
+    return out;
+  }
+
+  const float scale = static_cast<float>(kLevels - 1) / (high - low);
+  std::vector<uint8_t> levels(image.size());
+  parallel_for(
+      0, image.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          // nans land on the lowest level
+          const float q = std::max(0.0f, (image.data()[i] - low) * scale);
+          levels[i] = static_cast<uint8_t>(
+              std::min(q + 0.5f, static_cast<float>(kLevels - 1)));
+        }
+      },
+      kMinRowsPerChunk * image.cols());
+  std::array<float, kLevels> values{};
+  for (size_t l = 0; l < kLevels; ++l) {
+    values[l] = low + static_cast<float>(l) / scale;
+  }
+
+  parallel_for(
+      0, image.rows(),
+      [&](const size_t lo, const size_t hi) {
+        Histograms histograms;
+        for (size_t c = 0; c < image.channels(); ++c) {
+          histogram_median(levels, image, c, radius, values, out, lo, hi,
+                           histograms);
+        }
+      },
+      kMinRowsPerChunk);
+  return out;
+}
+
+};  // namespace core
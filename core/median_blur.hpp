@@ -0,0 +1,28 @@
+#pragma once
+
+#include <expected>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+// median of every channel over the (2 * radius + 1)^2 window around each
+// pixel, with replicated borders and rows split across threads.
+//
+// radius 1 and 2 are exact on any float data. 3x3 windows take the median
+// of presorted columns shared by neighbouring pixels (Paeth 1990), 5x5
+// windows run a 99 comparator median network (Devillard 1998) over blocks
+// of pixels, and both vectorise along the row.
+//
+// radii from 3 to 127 follow Perreault & Hebert 2007 on values quantised to
+// 256 levels over [low, high], which is exact for 8-bit images loaded into
+// [0, 1]. column histograms slide down the rows and a coarse 16 bin kernel
+// histogram slides along them, while the fine bins of a coarse bin are only
+// brought up to date when the median falls into it, so the cost per pixel
+// does not depend on the radius. values outside [low, high] are clamped.
+[[nodiscard]] std::expected<Mat, MatError> median_blur(const Mat& image,
+                                                       size_t radius,
+                                                       float low = 0.0f,
+                                                       float high = 1.0f);
+
+};  // namespace core
@@ -0,0 +1,798 @@
+#include "core/optical_flow.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinPointsPerChunk = 16;
+
+// rows x cols bilinear samples on the pixel grid starting at (x, y), reading
+// past the image border repeats the border pixels
+void sample_patch(const Mat& image, const float x, const float y,
+                  const size_t rows, const size_t cols,
+                  float* __restrict out) {
+  const float fx = std::floor(x), fy = std::floor(y);
+  const auto x0 = static_cast<ptrdiff_t>(fx);
+  const auto y0 = static_cast<ptrdiff_t>(fy);
+  const float ax = x - fx, ay = y - fy;
+  const float w00 = (1.0f - ax) * (1.0f - ay), w01 = ax * (1.0f - ay);
+  const float w10 = (1.0f - ax) * ay, w11 = ax * ay;
+  const auto width = static_cast<ptrdiff_t>(image.cols());
+  const auto height = static_cast<ptrdiff_t>(image.rows());
+
+  if (x0 >= 0 && y0 >= 0 && x0 + static_cast<ptrdiff_t>(cols) < width &&
+      y0 + static_cast<ptrdiff_t>(rows) < height) {
+    for (size_t r = 0; r < rows; ++r) {
+      const float* __restrict a = image.data() + (y0 + r) * width + x0;
+      const float* __restrict b = a + width;
+      float* __restrict row = out + r * cols;
+      for (size_t c = 0; c < cols; ++c) {
+        row[c] = w00 * a[c] + w01 * a[c + 1] + w10 * b[c] + w11 * b[c + 1];
+      }
+    }
+    return;
+  }
+  const auto clamp = [](const ptrdiff_t i, const ptrdiff_t n) {
+    return std::clamp<ptrdiff_t>(i, 0, n - 1);
+  };
+  for (size_t r = 0; r < rows; ++r) {
+    const ptrdiff_t row_y = y0 + static_cast<ptrdiff_t>(r);
+    const float* a = image.data() + clamp(row_y, height) * width;
+    const float* b = image.data() + clamp(row_y + 1, height) * width;
+    for (size_t c = 0; c < cols; ++c) {
+      const ptrdiff_t left = clamp(x0 + static_cast<ptrdiff_t>(c), width);
+      const ptrdiff_t right =
+          clamp(x0 + static_cast<ptrdiff_t>(c) + 1, width);
+      out[r * cols + c] =
+          w00 * a[left] + w01 * a[right] + w10 * b[left] + w11 * b[right];
+    }
+  }
+}
+
+// partial sums of the patch reductions, independent lanes let the loops
+// vectorize without reassociating float additions
+constexpr size_t kLanes = 8;
+
+constexpr size_t padded_size(const size_t n) {
+  return (n + kLanes - 1) / kLanes * kLanes;
+}
+
+// sum over i of a[i] * c[i] and b[i] * c[i], n a multiple of kLanes
+inline void dot2(const float* __restrict a, const float* __restrict b,
+                 const float* __restrict c, const size_t n, float& ac,
+                 float& bc) {
+  float sum_a[kLanes] = {}, sum_b[kLanes] = {};
+  for (size_t i = 0; i < n; i += kLanes) {
+    for (size_t k = 0; k < kLanes; ++k) {
+      sum_a[k] += a[i + k] * c[i + k];
+      sum_b[k] += b[i + k] * c[i + k];
+    }
+  }
+  ac = bc = 0.0f;
+  for (size_t k = 0; k < kLanes; ++k) {
+    ac += sum_a[k];
+    bc += sum_b[k];
+  }
+}
+
+// sums of gx^2, gx * gy and gy^2, n a multiple of kLanes
+inline void structure_tensor(const float* __restrict gx,
+                             const float* __restrict gy, const size_t n,
+                             float& sxx, float& sxy, float& syy) {
+  float xx[kLanes] = {}, xy[kLanes] = {}, yy[kLanes] = {};
+  for (size_t i = 0; i < n; i += kLanes) {
+    for (size_t k = 0; k < kLanes; ++k) {
+      xx[k] += gx[i + k] * gx[i + k];
+      xy[k] += gx[i + k] * gy[i + k];
+      yy[k] += gy[i + k] * gy[i + k];
+    }
+  }
+  sxx = sxy = syy = 0.0f;
+  for (size_t k = 0; k < kLanes; ++k) {
+    sxx += xx[k];
+    sxy += xy[k];
+    syy += yy[k];
+  }
+}
+
+// per chunk patch buffers, the flat patches are zero padded to a multiple
+// of kLanes
+struct Workspace {
+  std::vector<float> border;  // template with a one pixel ring
+  std::vector<float> templ;
+  std::vector<float> gx;
+  std::vector<float> gy;
+  std::vector<float> warped;
+  std::vector<float> error;
+
+  explicit Workspace(const size_t side)
+      : border((side + 2) * (side + 2)),
+        templ(padded_size(side * side)),
+        gx(padded_size(side * side)),
+        gy(padded_size(side * side)),
+        warped(padded_size(side * side)),
+        error(padded_size(side * side)) {}
+};
+
+// tracks `start` from `from` into `to`, starting the search at `guess`
+Track track_point(const Pyramid& from, const Pyramid& to, const Point2 start,
+                  const Point2 guess, const KltParams& params,
+                  Workspace& work) {
+  const size_t radius = params.window_radius;
+  const size_t side = 2 * radius + 1, n = side * side;
+  const size_t padded = padded_size(n);
+  const auto offset = static_cast<float>(radius);
+  const float epsilon_sq = params.epsilon * params.epsilon;
+  const size_t top = from.num_levels() - 1;
+  Track track;
+  float qx = Pyramid::to_level(guess.x, top);
+  float qy = Pyramid::to_level(guess.y, top);
+
+  for (size_t l = top + 1; l-- > 0;) {
+    if (l != top) {
+      qx = Pyramid::from_level(qx, 1);
+      qy = Pyramid::from_level(qy, 1);
+    }
+    const Mat& previous = from.level(l);
+    const Mat& next = to.level(l);
+    const float px = Pyramid::to_level(start.x, l);
+    const float py = Pyramid::to_level(start.y, l);
+
+    // template, central difference gradients and structure tensor
+    const size_t border_side = side + 2;
+    sample_patch(previous, px - offset - 1.0f, py - offset - 1.0f,
+                 border_side, border_side, work.border.data());
+    for (size_t r = 0; r < side; ++r) {
+      const float* __restrict center = work.border.data() +
+                                       (r + 1) * border_side + 1;
+      const float* __restrict above = center - border_side;
+      const float* __restrict below = center + border_side;
+      float* __restrict templ = work.templ.data() + r * side;
+      float* __restrict gx = work.gx.data() + r * side;
+      float* __restrict gy = work.gy.data() + r * side;
+      for (size_t c = 0; c < side; ++c) {
+        templ[c] = center[c];
+        gx[c] = 0.5f * (center[c + 1] - center[c - 1]);
+        gy[c] = 0.5f * (below[c] - above[c]);
+      }
+    }
+    float sxx, sxy, syy;
+    structure_tensor(work.gx.data(), work.gy.data(), padded, sxx, sxy, syy);
+    const float trace = sxx + syy;
+    const float min_eigenvalue =
+        0.5f * (trace - std::sqrt((sxx - syy) * (sxx - syy) +
+                                  4.0f * sxy * sxy));
+    if (!(min_eigenvalue >= params.min_eigenvalue * static_cast<float>(n))) {
+      if (l == 0) {
+        track.status = TrackStatus::Untextured;
+        track.x = qx;
+        track.y = qy;
+        return track;
+      }
+      continue;  // coarse levels may be too blurred, keep the estimate
+    }
+    const float inv_det = 1.0f / (sxx * syy - sxy * sxy);
+
+    const auto width = static_cast<float>(next.cols());
+    const auto height = static_cast<float>(next.rows());
+    for (size_t iteration = 0; iteration < params.max_iterations;
+         ++iteration) {
+      if (!(qx >= -offset && qy >= -offset && qx <= width + offset &&
+            qy <= height + offset)) {
+        track.status = TrackStatus::Lost;
+        return track;
+      }
+      sample_patch(next, qx - offset, qy - offset, side, side,
+                   work.warped.data());
+      const float* __restrict warped = work.warped.data();
+      const float* __restrict templ = work.templ.data();
+      float* __restrict error = work.error.data();
+      for (size_t i = 0; i < padded; ++i) {
+        error[i] = warped[i] - templ[i];
+      }
+      float bx, by;
+      dot2(work.gx.data(), work.gy.data(), error, padded, bx, by);
+      // inverse composition of a translation subtracts the update
+      const float dx = inv_det * (syy * bx - sxy * by);
+      const float dy = inv_det * (sxx * by - sxy * bx);
+      qx -= dx;
+      qy -= dy;
+      if (dx * dx + dy * dy < epsilon_sq) {
+        break;
+      }
+    }
+  }
+
+  const Mat& base = to.level(0);
+  track.x = qx;
+  track.y = qy;
+  track.status =
+      qx >= 0.0f && qy >= 0.0f &&
+              qx <= static_cast<float>(base.cols() - 1) &&
+              qy <= static_cast<float>(base.rows() - 1)
+          ? TrackStatus::Tracked
+          : TrackStatus::Lost;
+  return track;
+}
+
+std::expected<void, MatError> validate_pyramids(const Pyramid& previous,
+                                               const Pyramid& next) {
+  if (previous.num_levels() == 0 ||
+      previous.num_levels() != next.num_levels()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  for (size_t l = 0; l < previous.num_levels(); ++l) {
+    const Mat& a = previous.level(l);
+    const Mat& b = next.level(l);
+    if (a.channels() != 1 || b.channels() != 1) {
+      return std::unexpected(MatError::InvalidChannelsForOperation);
+    }
+    if (a.rows() != b.rows() || a.cols() != b.cols()) {
+      return std::unexpected(MatError::IncompatibleDimensions);
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+std::expected<std::vector<Track>, MatError> track_klt(
+    const Pyramid& previous, const Pyramid& next,
+    std::span<const Point2> points, const KltParams& params,
+    std::span<const Point2> guesses) {
+  if (auto valid = validate_pyramids(previous, next); !valid) {
+    return std::unexpected(valid.error());
+  }
+  if (!guesses.empty() && guesses.size() != points.size()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (params.max_iterations == 0 || !(params.epsilon > 0.0f) ||
+      !(params.max_forward_backward_error >= 0.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  std::vector<Track> tracks(points.size());
+  const size_t side = 2 * params.window_radius + 1;
+  parallel_for(
+      0, points.size(),
+      [&](const size_t lo, const size_t hi) {
+        Workspace work(side);
+        for (size_t i = lo; i < hi; ++i) {
+          const Point2 guess = guesses.empty() ? points[i] : guesses[i];
+          Track& track = tracks[i];
+          track = track_point(previous, next, points[i], guess, params, work);
+          if (!params.forward_backward_check ||
+              track.status != TrackStatus::Tracked) {
+            continue;
+          }
+          const Point2 end{track.x, track.y};
+          const Track back =
+              track_point(next, previous, end, end, params, work);
+          track.forward_backward_error =
+              back.status == TrackStatus::Lost
+                  ? std::numeric_limits<float>::infinity()
+                  : std::hypot(back.x - points[i].x, back.y - points[i].y);
+          if (!(track.forward_backward_error <=
+                params.max_forward_backward_error)) {
+            track.status = TrackStatus::Inconsistent;
+          }
+        }
+      },
+      kMinPointsPerChunk);
+  return tracks;
+}
+
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 8;
+// about one 8-bit gray level, photometric errors below it weigh the same
+// when patch flows are blended
+constexpr float kMinBlendError = 1.0f / 255.0f;
+// of the robust penalties sqrt(s^2 + epsilon^2) in the refinement, in pixels
+constexpr float kRobustEpsilon = 1e-3f;
+// squared gradient added when normalising the refinement data terms, about
+// a tenth of an 8-bit gray level per pixel
+constexpr float kNormalization = 1.5e-7f;
+
+void ensure_shape(Mat& mat, const size_t rows, const size_t cols,
+                  const size_t channels) {
+  if (mat.rows() != rows || mat.cols() != cols ||
+      mat.channels() != channels) {
+    mat = Mat(rows, cols, channels);
+  }
+}
+
+// bilinear sample of channel `channel` with replicated borders
+inline float bilinear(const Mat& image, float x, float y,
+                      const size_t channel = 0) {
+  const size_t width = image.cols(), height = image.rows();
+  const size_t channels = image.channels();
+  x = std::clamp(x, 0.0f, static_cast<float>(width - 1));
+  y = std::clamp(y, 0.0f, static_cast<float>(height - 1));
+  const auto x0 = static_cast<size_t>(x), y0 = static_cast<size_t>(y);
+  const size_t x1 = std::min(x0 + 1, width - 1);
+  const size_t y1 = std::min(y0 + 1, height - 1);
+  const float ax = x - static_cast<float>(x0);
+  const float ay = y - static_cast<float>(y0);
+  const float* top = image.data() + y0 * width * channels + channel;
+  const float* bottom = image.data() + y1 * width * channels + channel;
+  return (1.0f - ay) * ((1.0f - ax) * top[x0 * channels] +
+                        ax * top[x1 * channels]) +
+         ay * ((1.0f - ax) * bottom[x0 * channels] +
+               ax * bottom[x1 * channels]);
+}
+
+// central differences with replicated borders
+void gradients(const Mat& image, float* gx, float* gy) {
+  const size_t width = image.cols(), height = image.rows();
+  parallel_for(
+      0, height,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t y = lo; y < hi; ++y) {
+          const float* __restrict row = image.data() + y * width;
+          const float* __restrict above =
+              image.data() + (y > 0 ? y - 1 : y) * width;
+          const float* __restrict below =
+              image.data() + std::min(y + 1, height - 1) * width;
+          float* __restrict out_x = gx + y * width;
+          float* __restrict out_y = gy + y * width;
+          for (size_t x = 0; x < width; ++x) {
+            out_y[x] = 0.5f * (below[x] - above[x]);
+          }
+          for (size_t x = 1; x + 1 < width; ++x) {
+            out_x[x] = 0.5f * (row[x + 1] - row[x - 1]);
+          }
+          out_x[0] = width > 1 ? 0.5f * (row[1] - row[0]) : 0.0f;
+          out_x[width - 1] =
+              width > 1 ? 0.5f * (row[width - 1] - row[width - 2]) : 0.0f;
+        }
+      },
+      kMinRowsPerChunk);
+}
+
+// flow of `coarse`, `levels` pyramid levels above `fine`, sampled on the
+// pixels of `fine` and scaled to its pixel units
+void upsample_flow(const Mat& coarse, Mat& fine, const size_t levels) {
+  const auto scale = static_cast<float>(size_t{1} << levels);
+  parallel_for(
+      0, fine.rows(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t y = lo; y < hi; ++y) {
+          const float cy = Pyramid::to_level(static_cast<float>(y), levels);
+          for (size_t x = 0; x < fine.cols(); ++x) {
+            const float cx =
+                Pyramid::to_level(static_cast<float>(x), levels);
+            fine(y, x, 0) = scale * bilinear(coarse, cx, cy, 0);
+            fine(y, x, 1) = scale * bilinear(coarse, cx, cy, 1);
+          }
+        }
+      },
+      kMinRowsPerChunk);
+}
+
+// patch origins every `stride` pixels, the last one flush with the border
+void patch_grid(const size_t extent, const size_t size, const size_t stride,
+                std::vector<size_t>& origins) {
+  origins.clear();
+  for (size_t origin = 0; origin + size <= extent; origin += stride) {
+    origins.push_back(origin);
+  }
+  if (origins.back() + size < extent) {
+    origins.push_back(extent - size);
+  }
+}
+
+// for every pixel the first and one past the last patch covering it
+void covering_patches(const std::vector<size_t>& origins, const size_t size,
+                      const size_t extent, std::vector<uint32_t>& first,
+                      std::vector<uint32_t>& last) {
+  first.resize(extent);
+  last.resize(extent);
+  size_t begin = 0, end = 0;
+  for (size_t p = 0; p < extent; ++p) {
+    while (end < origins.size() && origins[end] <= p) {
+      ++end;
+    }
+    while (origins[begin] + size <= p) {
+      ++begin;
+    }
+    first[p] = static_cast<uint32_t>(begin);
+    last[p] = static_cast<uint32_t>(end);
+  }
+}
+
+// sum of squares of e minus its mean over n values, padded to kLanes
+inline float centered_ssd(const float* __restrict e, const size_t padded,
+                          const size_t n) {
+  float sum[kLanes] = {}, sum_sq[kLanes] = {};
+  for (size_t i = 0; i < padded; i += kLanes) {
+    for (size_t k = 0; k < kLanes; ++k) {
+      sum[k] += e[i + k];
+      sum_sq[k] += e[i + k] * e[i + k];
+    }
+  }
+  float total = 0.0f, total_sq = 0.0f;
+  for (size_t k = 0; k < kLanes; ++k) {
+    total += sum[k];
+    total_sq += sum_sq[k];
+  }
+  return total_sq - total * total / static_cast<float>(n);
+}
+
+}  // namespace
+
+void DisFlow::search_patches(const Mat& previous, const Mat& next,
+                             const Mat& flow) {
+  const size_t size = params_.patch_size, n = size * size;
+  const size_t padded = padded_size(n);
+  const size_t width = previous.cols();
+  const size_t columns = patch_x_.size();
+  const auto limit = static_cast<float>(size);
+  patch_flow_.resize(2 * columns * patch_y_.size());
+  parallel_for(0, patch_y_.size(), [&](const size_t lo, const size_t hi) {
+    Workspace work(size);
+    float* __restrict templ = work.templ.data();
+    float* __restrict gx = work.gx.data();
+    float* __restrict gy = work.gy.data();
+    float* __restrict error = work.error.data();
+    const float* warped = work.warped.data();
+    for (size_t j = lo; j < hi; ++j) {
+      for (size_t i = 0; i < columns; ++i) {
+        const size_t x0 = patch_x_[i], y0 = patch_y_[j];
+        float* result = patch_flow_.data() + 2 * (j * columns + i);
+        const float u0 = flow(y0 + size / 2, x0 + size / 2, 0);
+        const float v0 = flow(y0 + size / 2, x0 + size / 2, 1);
+        result[0] = u0;
+        result[1] = v0;
+
+        // template and its mean-free gradients, which make the search
+        // insensitive to a brightness offset between the patches
+        float mean_x = 0.0f, mean_y = 0.0f;
+        for (size_t r = 0; r < size; ++r) {
+          const size_t offset = (y0 + r) * width + x0;
+          std::copy_n(previous.data() + offset, size, templ + r * size);
+          std::copy_n(grad_x_.data() + offset, size, gx + r * size);
+          std::copy_n(grad_y_.data() + offset, size, gy + r * size);
+        }
+        for (size_t k = 0; k < n; ++k) {
+          mean_x += gx[k];
+          mean_y += gy[k];
+        }
+        mean_x /= static_cast<float>(n);
+        mean_y /= static_cast<float>(n);
+        for (size_t k = 0; k < n; ++k) {
+          gx[k] -= mean_x;
+          gy[k] -= mean_y;
+        }
+        float sxx, sxy, syy;
+        structure_tensor(gx, gy, padded, sxx, sxy, syy);
+        const float det = sxx * syy - sxy * sxy;
+        if (!(det > 1e-6f * (sxx + syy) * (sxx + syy))) {
+          continue;  // flat or a straight edge
+        }
+        const float inv_det = 1.0f / det;
+
+        float u = u0, v = v0, initial_cost = 0.0f;
+        for (size_t iteration = 0;
+             iteration < params_.gradient_descent_iterations; ++iteration) {
+          sample_patch(next, static_cast<float>(x0) + u,
+                       static_cast<float>(y0) + v, size, size,
+                       work.warped.data());
+          for (size_t k = 0; k < padded; ++k) {
+            error[k] = warped[k] - templ[k];
+          }
+          if (iteration == 0) {
+            initial_cost = centered_ssd(error, padded, n);
+          }
+          float bx, by;
+          dot2(gx, gy, error, padded, bx, by);
+          const float du = inv_det * (syy * bx - sxy * by);
+          const float dv = inv_det * (sxx * by - sxy * bx);
+          u -= du;
+          v -= dv;
+          if (du * du + dv * dv < 1e-4f) {
+            break;
+          }
+        }
+        // keep the initial flow unless the search improved on it
+        sample_patch(next, static_cast<float>(x0) + u,
+                     static_cast<float>(y0) + v, size, size,
+                     work.warped.data());
+        for (size_t k = 0; k < padded; ++k) {
+          error[k] = warped[k] - templ[k];
+        }
+        if (centered_ssd(error, padded, n) < initial_cost &&
+            std::hypot(u - u0, v - v0) <= limit) {
+          result[0] = u;
+          result[1] = v;
+        }
+      }
+    }
+  });
+}
+
+void DisFlow::densify(const Mat& previous, const Mat& next, Mat& flow) {
+  const size_t size = params_.patch_size, columns = patch_x_.size();
+  std::vector<uint32_t> first_x, last_x, first_y, last_y;
+  covering_patches(patch_x_, size, previous.cols(), first_x, last_x);
+  covering_patches(patch_y_, size, previous.rows(), first_y, last_y);
+  parallel_for(
+      0, previous.rows(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t y = lo; y < hi; ++y) {
+          for (size_t x = 0; x < previous.cols(); ++x) {
+            const float reference = previous(y, x);
+            float sum_u = 0.0f, sum_v = 0.0f, sum_w = 0.0f;
+            for (size_t j = first_y[y]; j < last_y[y]; ++j) {
+              for (size_t i = first_x[x]; i < last_x[x]; ++i) {
+                const float* patch = patch_flow_.data() + 2 * (j * columns + i);
+                const float difference =
+                    bilinear(next, static_cast<float>(x) + patch[0],
+                             static_cast<float>(y) + patch[1]) -
+                    reference;
+                const float weight =
+                    1.0f / std::max(kMinBlendError, std::abs(difference));
+                sum_u += weight * patch[0];
+                sum_v += weight * patch[1];
+                sum_w += weight;
+              }
+            }
+            flow(y, x, 0) = sum_u / sum_w;
+            flow(y, x, 1) = sum_v / sum_w;
+          }
+        }
+      },
+      kMinRowsPerChunk);
+}
+
+void DisFlow::refine(const Mat& previous, const Mat& next, Mat& flow) {
+  const size_t width = previous.cols(), height = previous.rows();
+  const size_t n = width * height;
+  Refinement& f = refinement_;
+  for (std::vector<float>* buffer :
+       {&f.warped, &f.it, &f.ix, &f.iy, &f.ixt, &f.ixx, &f.ixy, &f.iyt,
+        &f.iyx, &f.iyy, &f.du, &f.dv, &f.smoothness, &f.a11, &f.a12, &f.a22,
+        &f.b1, &f.b2}) {
+    buffer->resize(n);
+  }
+  std::fill(f.du.begin(), f.du.end(), 0.0f);
+  std::fill(f.dv.begin(), f.dv.end(), 0.0f);
+
+  // next warped by the current flow, and the temporal differences of
+  // brightness and gradients against previous
+  parallel_for(
+      0, height,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t y = lo; y < hi; ++y) {
+          for (size_t x = 0; x < width; ++x) {
+            f.warped[y * width + x] =
+                bilinear(next, static_cast<float>(x) + flow(y, x, 0),
+                         static_cast<float>(y) + flow(y, x, 1));
+          }
+        }
+      },
+      kMinRowsPerChunk);
+  parallel_for(
+      0, height,
+      [&](const size_t lo, const size_t hi) {
+        const float* w = f.warped.data();
+        for (size_t y = lo; y < hi; ++y) {
+          const size_t up = (y > 0 ? y - 1 : y) * width;
+          const size_t down = std::min(y + 1, height - 1) * width;
+          const size_t row = y * width;
+          for (size_t x = 0; x < width; ++x) {
+            const size_t left = x > 0 ? x - 1 : x;
+            const size_t right = std::min(x + 1, width - 1);
+            const size_t p = row + x;
+            // no data term where the flow leaves the image
+            const float wx = static_cast<float>(x) + flow(y, x, 0);
+            const float wy = static_cast<float>(y) + flow(y, x, 1);
+            if (!(wx >= 0.0f && wy >= 0.0f &&
+                  wx <= static_cast<float>(width - 1) &&
+                  wy <= static_cast<float>(height - 1))) {
+              f.it[p] = f.ix[p] = f.iy[p] = f.ixx[p] = f.ixy[p] = f.iyx[p] =
+                  f.iyy[p] = f.ixt[p] = f.iyt[p] = 0.0f;
+              continue;
+            }
+            const float ix = 0.5f * (w[row + right] - w[row + left]);
+            const float iy = 0.5f * (w[down + x] - w[up + x]);
+            const float ixx = w[row + right] - 2.0f * w[p] + w[row + left];
+            const float iyy = w[down + x] - 2.0f * w[p] + w[up + x];
+            const float ixy = 0.25f * (w[down + right] - w[down + left] -
+                                       w[up + right] + w[up + left]);
+            // every constancy residual is divided by the gradient of its
+            // image, which turns it into a flow distance in pixels
+            const float brightness =
+                1.0f / std::sqrt(ix * ix + iy * iy + kNormalization);
+            const float gradient_x =
+                1.0f / std::sqrt(ixx * ixx + ixy * ixy + kNormalization);
+            const float gradient_y =
+                1.0f / std::sqrt(ixy * ixy + iyy * iyy + kNormalization);
+            f.it[p] = brightness * (w[p] - previous.data()[p]);
+            f.ix[p] = brightness * ix;
+            f.iy[p] = brightness * iy;
+            f.ixt[p] = gradient_x * (ix - grad_x_[p]);
+            f.ixx[p] = gradient_x * ixx;
+            f.ixy[p] = gradient_x * ixy;
+            f.iyt[p] = gradient_y * (iy - grad_y_[p]);
+            f.iyx[p] = gradient_y * ixy;
+            f.iyy[p] = gradient_y * iyy;
+          }
+        }
+      },
+      kMinRowsPerChunk);
+
+  const float epsilon_sq = kRobustEpsilon * kRobustEpsilon;
+  for (size_t outer = 0; outer < params_.variational_iterations; ++outer) {
+    // robust weights at the current increment: smoothness per pixel, used
+    // for the edges to its right and bottom neighbours, and the data terms
+    parallel_for(
+        0, height,
+        [&](const size_t lo, const size_t hi) {
+          for (size_t y = lo; y < hi; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+              const size_t p = y * width + x;
+              const size_t right = x + 1 < width ? p + 1 : p;
+              const size_t down = y + 1 < height ? p + width : p;
+              const float u = flow(y, x, 0) + f.du[p];
+              const float v = flow(y, x, 1) + f.dv[p];
+              const float* r = flow.data() + 2 * right;
+              const float* d = flow.data() + 2 * down;
+              const float ux = r[0] + f.du[right] - u;
+              const float vx = r[1] + f.dv[right] - v;
+              const float uy = d[0] + f.du[down] - u;
+              const float vy = d[1] + f.dv[down] - v;
+              f.smoothness[p] =
+                  0.5f * params_.alpha /
+                  std::sqrt(ux * ux + vx * vx + uy * uy + vy * vy +
+                            epsilon_sq);
+
+              const float du = f.du[p], dv = f.dv[p];
+              const float rb = f.it[p] + f.ix[p] * du + f.iy[p] * dv;
+              const float rx = f.ixt[p] + f.ixx[p] * du + f.ixy[p] * dv;
+              const float ry = f.iyt[p] + f.iyx[p] * du + f.iyy[p] * dv;
+              const float wb =
+                  0.5f * params_.delta / std::sqrt(rb * rb + epsilon_sq);
+              const float wg = 0.5f * params_.gamma /
+                               std::sqrt(rx * rx + ry * ry + epsilon_sq);
+              f.a11[p] = wb * f.ix[p] * f.ix[p] +
+                         wg * (f.ixx[p] * f.ixx[p] + f.iyx[p] * f.iyx[p]);
+              f.a12[p] = wb * f.ix[p] * f.iy[p] +
+                         wg * (f.ixx[p] * f.ixy[p] + f.iyx[p] * f.iyy[p]);
+              f.a22[p] = wb * f.iy[p] * f.iy[p] +
+                         wg * (f.ixy[p] * f.ixy[p] + f.iyy[p] * f.iyy[p]);
+              f.b1[p] = -(wb * f.ix[p] * f.it[p] +
+                          wg * (f.ixx[p] * f.ixt[p] + f.iyx[p] * f.iyt[p]));
+              f.b2[p] = -(wb * f.iy[p] * f.it[p] +
+                          wg * (f.ixy[p] * f.ixt[p] + f.iyy[p] * f.iyt[p]));
+            }
+          }
+        },
+        kMinRowsPerChunk);
+
+    // red-black SOR, a colour only reads pixels of the other one
+    for (size_t sweep = 0; sweep < 2 * params_.sor_iterations; ++sweep) {
+      const size_t color = sweep % 2;
+      parallel_for(
+          0, height,
+          [&](const size_t lo, const size_t hi) {
+            for (size_t y = lo; y < hi; ++y) {
+              for (size_t x = (y + color) % 2; x < width; x += 2) {
+                const size_t p = y * width + x;
+                const float u = flow.data()[2 * p];
+                const float v = flow.data()[2 * p + 1];
+                float sum_w = 0.0f, sum_u = 0.0f, sum_v = 0.0f;
+                const auto neighbour = [&](const size_t q, const float w) {
+                  sum_w += w;
+                  sum_u += w * (flow.data()[2 * q] + f.du[q] - u);
+                  sum_v += w * (flow.data()[2 * q + 1] + f.dv[q] - v);
+                };
+                if (x > 0) {
+                  neighbour(p - 1, f.smoothness[p - 1]);
+                }
+                if (x + 1 < width) {
+                  neighbour(p + 1, f.smoothness[p]);
+                }
+                if (y > 0) {
+                  neighbour(p - width, f.smoothness[p - width]);
+                }
+                if (y + 1 < height) {
+                  neighbour(p + width, f.smoothness[p]);
+                }
+                const float du =
+                    (f.b1[p] - f.a12[p] * f.dv[p] + sum_u) /
+                    (f.a11[p] + sum_w);
+                f.du[p] += params_.sor_omega * (du - f.du[p]);
+                const float dv =
+                    (f.b2[p] - f.a12[p] * f.du[p] + sum_v) /
+                    (f.a22[p] + sum_w);
+                f.dv[p] += params_.sor_omega * (dv - f.dv[p]);
+              }
+            }
+          },
+          kMinRowsPerChunk);
+    }
+  }
+
+  for (size_t p = 0; p < n; ++p) {
+    flow.data()[2 * p] += f.du[p];
+    flow.data()[2 * p + 1] += f.dv[p];
+  }
+}
+
+std::expected<void, MatError> DisFlow::compute(const Pyramid& previous,
+                                               const Pyramid& next,
+                                               Mat& flow) {
+  if (auto valid = validate_pyramids(previous, next); !valid) {
+    return std::unexpected(valid.error());
+  }
+  if (params_.patch_size < 2 || params_.patch_stride == 0 ||
+      params_.patch_stride > params_.patch_size ||
+      !(params_.sor_omega > 0.0f && params_.sor_omega < 2.0f) ||
+      !(params_.alpha > 0.0f) || !(params_.gamma >= 0.0f) ||
+      !(params_.delta >= 0.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  const size_t top = previous.num_levels() - 1;
+  const size_t finest = std::min(params_.finest_level, top);
+  if (flows_.size() < top + 1) {
+    flows_.resize(top + 1);
+  }
+  // level 0 flow goes straight into the output
+  const auto level_flow = [&](const size_t l) -> Mat& {
+    return l == 0 ? flow : flows_[l];
+  };
+  for (size_t l = top + 1; l-- > finest;) {
+    const Mat& first = previous.level(l);
+    const Mat& second = next.level(l);
+    Mat& current = level_flow(l);
+    ensure_shape(current, first.rows(), first.cols(), 2);
+    if (l == top) {
+      std::fill(current.data(), current.data() + current.size(), 0.0f);
+    } else {
+      upsample_flow(level_flow(l + 1), current, 1);
+    }
+
+    grad_x_.resize(first.rows() * first.cols());
+    grad_y_.resize(first.rows() * first.cols());
+    gradients(first, grad_x_.data(), grad_y_.data());
+    if (first.rows() >= params_.patch_size &&
+        first.cols() >= params_.patch_size) {
+      patch_grid(first.cols(), params_.patch_size, params_.patch_stride,
+                 patch_x_);
+      patch_grid(first.rows(), params_.patch_size, params_.patch_stride,
+                 patch_y_);
+      search_patches(first, second, current);
+      densify(first, second, current);
+    }
+    if (params_.variational_iterations > 0) {
+      refine(first, second, current);
+    }
+  }
+  if (finest > 0) {
+    const Mat& base = previous.level(0);
+    ensure_shape(flow, base.rows(), base.cols(), 2);
+    upsample_flow(flows_[finest], flow, finest);
+  }
+  return {};
+}
+
+std::expected<Mat, MatError> dis_flow(const Pyramid& previous,
+                                      const Pyramid& next,
+                                      const DisParams& params) {
+  DisFlow estimator(params);
+  Mat flow;
+  if (auto computed = estimator.compute(previous, next, flow); !computed) {
+    return std::unexpected(computed.error());
+  }
+  return flow;
+}
+
+};  // namespace core
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <vector>
+
+#include "core/mat.hpp"
+#include "core/pyramid.hpp"
+
+namespace core {
+
+struct Point2 {
+  float x = 0.0f;
+  float y = 0.0f;
+};
+
+enum class TrackStatus : uint8_t {
+  Tracked,
+  Lost,          // left the image or diverged
+  Untextured,    // gradients too weak to localise the patch
+  Inconsistent,  // tracking back did not return to the start
+};
+
+struct Track {
+  float x = 0.0f;  // level 0 position in the next image
+  float y = 0.0f;
+  TrackStatus status = TrackStatus::Lost;
+  // distance between the start and the point tracked back from (x, y), 0
+  // without the forward-backward check
+  float forward_backward_error = 0.0f;
+};
+
+struct KltParams {
+  // patches are (2 * window_radius + 1)^2 pixels on every level
+  size_t window_radius = 7;
+  size_t max_iterations = 30;
+  // iterations stop once an update moves less than this, in level pixels
+  float epsilon = 0.01f;
+  // smallest eigenvalue of the patch structure tensor per pixel, in squared
+  // [0, 1] intensity units per pixel, below which a patch is untextured
+  float min_eigenvalue = 1e-5f;
+  bool forward_backward_check = true;
+  // level 0 pixels
+  float max_forward_backward_error = 1.0f;
+};
+
+// pyramidal inverse-compositional lucas-kanade (Baker & Matthews 2004). the
+// template patch, its gradients and the inverse hessian are computed once
+// per level and point, so an iteration only resamples the next image and
+// accumulates two dot products over flat patch buffers. points are tracked
+// in parallel, and with the forward-backward check (Kalal et al. 2010) every
+// tracked point is tracked back and compared with its start.
+//
+// both pyramids must have the same single channel level shapes. `guesses`
+// are optional level 0 predictions of the positions in the next image, one
+// per point.
+[[nodiscard]] std::expected<std::vector<Track>, MatError> track_klt(
+    const Pyramid& previous, const Pyramid& next,
+    std::span<const Point2> points, const KltParams& params = {},
+    std::span<const Point2> guesses = {});
+
+struct DisParams {
+  // square patches of patch_size pixels placed every patch_stride pixels
+  size_t patch_size = 8;
+  size_t patch_stride = 4;
+  // flow is estimated from the coarsest pyramid level down to this one and
+  // upsampled from there to full resolution
+  size_t finest_level = 2;
+  size_t gradient_descent_iterations = 16;
+  // fixed point iterations of the variational refinement on every level,
+  // 0 disables it
+  size_t variational_iterations = 5;
+  size_t sor_iterations = 5;
+  float sor_omega = 1.6f;
+  // refinement weights of smoothness, gradient and brightness constancy
+  float alpha = 20.0f;
+  float gamma = 10.0f;
+  float delta = 5.0f;
+};
+
+// dense inverse search (Kroeger et al. 2016): on every level a grid of
+// overlapping patches is aligned by inverse-compositional search, patches
+// in parallel, from the upsampled flow of the coarser level. the patch
+// flows are blended per pixel, weighted by photometric error, and refined
+// by red-black SOR on a robust variational energy with brightness and
+// gradient constancy (Brox et al. 2004). the estimator keeps its buffers
+// between calls.
+class DisFlow {
+ public:
+  explicit DisFlow(const DisParams& params = {}) : params_(params) {}
+
+  // rows x cols x 2 level 0 flow (u, v) with previous(y, x) matching
+  // next(y + v, x + u). both pyramids must have the same single channel
+  // level shapes, and `flow` keeps its buffer when the shape is unchanged.
+  [[nodiscard]] std::expected<void, MatError> compute(const Pyramid& previous,
+                                                      const Pyramid& next,
+                                                      Mat& flow);
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  // per pixel terms of the linearised refinement energy
+  struct Refinement {
+    std::vector<float> warped;
+    // brightness residual and derivatives, then those of the x and y
+    // gradient residuals, each normalised by its image gradient
+    std::vector<float> it, ix, iy;
+    std::vector<float> ixt, ixx, ixy, iyt, iyx, iyy;
+    std::vector<float> du, dv, smoothness;
+    std::vector<float> a11, a12, a22, b1, b2;
+  };
+
+  void search_patches(const Mat& previous, const Mat& next, const Mat& flow);
+  void densify(const Mat& previous, const Mat& next, Mat& flow);
+  void refine(const Mat& previous, const Mat& next, Mat& flow);
+
+  DisParams params_;
+  // level flows, index l holds the flow of pyramid level l
+  std::vector<Mat> flows_;
+  std::vector<float> grad_x_, grad_y_;  // of the previous level
+  std::vector<size_t> patch_x_, patch_y_;
+  std::vector<float> patch_flow_;  // (u, v) per patch, row major
+  Refinement refinement_;
+};
+
+// convenience wrapper around a temporary DisFlow
+[[nodiscard]] std::expected<Mat, MatError> dis_flow(
+    const Pyramid& previous, const Pyramid& next, const DisParams& params = {});
+
+};  // namespace core
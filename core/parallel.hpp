@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+namespace parallel_detail {
+// set through set_num_threads, 0 for the hardware concurrency
+inline std::atomic<size_t> thread_limit{0};
+};  // namespace parallel_detail
+
+// the threads parallel_for splits work over from now on, 0 to go back to
+// the hardware concurrency. lets tests force several chunks on any machine.
+inline void set_num_threads(const size_t threads) noexcept {
+  parallel_detail::thread_limit.store(threads, std::memory_order_relaxed);
+}
+
+[[nodiscard]] inline size_t num_threads() noexcept {
+  const size_t limit =
+      parallel_detail::thread_limit.load(std::memory_order_relaxed);
+  if (limit > 0) {
+    return limit;
+  }
+  const unsigned int hardware = std::thread::hardware_concurrency();
+  return hardware == 0 ? 1 : static_cast<size_t>(hardware);
+}
+
+// number of chunks parallel_for_chunks splits [0, n) into
+[[nodiscard]] inline size_t num_chunks(const size_t n,
+                                       const size_t min_chunk = 1) noexcept {
+  const size_t by_size = n / std::max<size_t>(min_chunk, 1);
+  return std::clamp<size_t>(by_size, 1, num_threads());
+}
+
+// runs fn(chunk_index, chunk_begin, chunk_end) over contiguous chunks of
+// [begin, end), one thread per chunk, the last chunk on the calling thread.
+// chunk_index is in [0, num_chunks(end - begin, min_chunk)) so callers can
+// keep per-chunk accumulators without locking.
+template <typename Fn>
+void parallel_for_chunks(const size_t begin, const size_t end, Fn&& fn,
+                         const size_t min_chunk = 1) {
+  if (end <= begin) {
+    return;
+  }
+  const size_t n = end - begin;
+  const size_t chunks = num_chunks(n, min_chunk);
+  if (chunks == 1) {
+    fn(size_t{0}, begin, end);
+    return;
+  }
+
+  std::vector<std::jthread> workers;
+  workers.reserve(chunks - 1);
+  const size_t step = n / chunks;
+  const size_t remainder = n % chunks;
+  size_t lo = begin;
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    const size_t hi = lo + step + (chunk < remainder ? 1 : 0);
+    if (chunk + 1 == chunks) {
+      fn(chunk, lo, hi);
+    } else {
+      workers.emplace_back([&fn, chunk, lo, hi] { fn(chunk, lo, hi); });
+    }
+    lo = hi;
+  }
+}
+
+// runs fn(chunk_begin, chunk_end) over contiguous chunks of [begin, end)
+template <typename Fn>
+void parallel_for(const size_t begin, const size_t end, Fn&& fn,
+                  const size_t min_chunk = 1) {
+  parallel_for_chunks(
+      begin, end,
+      [&fn](size_t, const size_t lo, const size_t hi) { fn(lo, hi); },
+      min_chunk);
+}
+
+};  // namespace core
@@ -0,0 +1,213 @@
+#include "core/point_cloud.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 16;
+// bounds the per-chunk bookkeeping so it can live on the stack
+constexpr size_t kMaxChunks = 64;
+
+std::expected<void, MatError> validate(const Mat& depth,
+                                       const CameraIntrinsics& intrinsics,
+                                       const size_t stride) {
+  if (depth.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (stride == 0 || !(intrinsics.fx > 0.0f) || !(intrinsics.fy > 0.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  return {};
+}
+
+// rows are split into chunks that each write their points at the offset of
+// their first sample, the gaps left by invalid depth are closed afterwards
+template <bool kColor>
+void project(const Mat& depth, const Mat* color,
+             const CameraIntrinsics& intrinsics, const size_t stride,
+             PointCloud& out) {
+  const size_t cols = depth.cols();
+  const size_t sampled_rows = (depth.rows() + stride - 1) / stride;
+  const size_t sampled_cols = (cols + stride - 1) / stride;
+  out.resize(sampled_rows * sampled_cols);
+
+  const float inv_fx = 1.0f / intrinsics.fx;
+  const float inv_fy = 1.0f / intrinsics.fy;
+  const float max_depth = std::numeric_limits<float>::max();
+
+  const size_t min_chunk = std::max(
+      kMinRowsPerChunk, (sampled_rows + kMaxChunks - 1) / kMaxChunks);
+  std::array<size_t, kMaxChunks> chunk_begin{};
+  std::array<size_t, kMaxChunks> chunk_count{};
+
+  parallel_for_chunks(
+      0, sampled_rows,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        const size_t offset = lo * sampled_cols;
+        float* px = out.x() + offset;
+        float* py = out.y() + offset;
+        float* pz = out.z() + offset;
+        size_t n = 0;
+        for (size_t i = lo; i < hi; ++i) {
+          const size_t v = i * stride;
+          const float row_factor =
+              (static_cast<float>(v) - intrinsics.cy) * inv_fy;
+          const float* depth_row = depth.data() + v * cols;
+          for (size_t j = 0; j < sampled_cols; ++j) {
+            const size_t u = j * stride;
+            const float z = depth_row[u];
+            const float column_factor =
+                (static_cast<float>(u) - intrinsics.cx) * inv_fx;
+            px[n] = z * column_factor;
+            py[n] = z * row_factor;
+            pz[n] = z;
+            if constexpr (kColor) {
+              const float* rgb = color->data() + (v * cols + u) * 3;
+              out.r()[offset + n] = rgb[0];
+              out.g()[offset + n] = rgb[1];
+              out.b()[offset + n] = rgb[2];
+            }
+            // NaN fails both comparisons, the slot is simply overwritten
+            n += static_cast<size_t>((z > 0.0f) & (z <= max_depth));
+          }
+        }
+        chunk_begin[chunk] = offset;
+        chunk_count[chunk] = n;
+      },
+      min_chunk);
+
+  const size_t chunks = num_chunks(sampled_rows, min_chunk);
+  size_t total = chunk_count[0];
+  for (size_t chunk = 1; chunk < chunks; ++chunk) {
+    const size_t src = chunk_begin[chunk];
+    const size_t n = chunk_count[chunk];
+    const auto shift = [&](float* values) {
+      std::copy(values + src, values + src + n, values + total);
+    };
+    shift(out.x());
+    shift(out.y());
+    shift(out.z());
+    if constexpr (kColor) {
+      shift(out.r());
+      shift(out.g());
+      shift(out.b());
+    }
+    total += n;
+  }
+  out.resize(total);
+}
+
+};  // namespace
+
+PointCloud::PointCloud(const size_t size, const bool with_colors,
+                       const bool with_normals)
+    : x_(size), y_(size), z_(size) {
+  if (with_colors) {
+    enable_colors();
+  }
+  if (with_normals) {
+    enable_normals();
+  }
+}
+
+void PointCloud::resize(const size_t size) {
+  x_.resize(size);
+  y_.resize(size);
+  z_.resize(size);
+  if (has_colors_) {
+    r_.resize(size);
+    g_.resize(size);
+    b_.resize(size);
+  }
+  if (has_normals_) {
+    nx_.resize(size);
+    ny_.resize(size);
+    nz_.resize(size);
+  }
+}
+
+void PointCloud::reserve(const size_t capacity) {
+  x_.reserve(capacity);
+  y_.reserve(capacity);
+  z_.reserve(capacity);
+  if (has_colors_) {
+    r_.reserve(capacity);
+    g_.reserve(capacity);
+    b_.reserve(capacity);
+  }
+  if (has_normals_) {
+    nx_.reserve(capacity);
+    ny_.reserve(capacity);
+    nz_.reserve(capacity);
+  }
+}
+
+void PointCloud::enable_colors() {
+  has_colors_ = true;
+  r_.resize(size());
+  g_.resize(size());
+  b_.resize(size());
+}
+
+void PointCloud::enable_normals() {
+  has_normals_ = true;
+  nx_.resize(size());
+  ny_.resize(size());
+  nz_.resize(size());
+}
+
+Mat PointCloud::to_mat() const noexcept {
+  Mat mat(size(), 3, 1);
+  for (size_t i = 0; i < size(); ++i) {
+    mat(i, 0) = x_[i];
+    mat(i, 1) = y_[i];
+    mat(i, 2) = z_[i];
+  }
+  return mat;
+}
+
+std::expected<PointCloud, MatError> depth_to_points(
+    const Mat& depth, const CameraIntrinsics& intrinsics, const size_t stride) {
+  PointCloud cloud;
+  if (auto result = depth_to_points(depth, intrinsics, stride, cloud);
+      !result) {
+    return std::unexpected(result.error());
+  }
+  return cloud;
+}
+
+std::expected<void, MatError> depth_to_points(
+    const Mat& depth, const CameraIntrinsics& intrinsics, const size_t stride,
+    PointCloud& out) {
+  if (auto valid = validate(depth, intrinsics, stride); !valid) {
+    return valid;
+  }
+  project<false>(depth, nullptr, intrinsics, stride, out);
+  return {};
+}
+
+std::expected<void, MatError> depth_to_points(
+    const Mat& depth, const Mat& color, const CameraIntrinsics& intrinsics,
+    const size_t stride, PointCloud& out) {
+  if (auto valid = validate(depth, intrinsics, stride); !valid) {
+    return valid;
+  }
+  if (color.rows() != depth.rows() || color.cols() != depth.cols()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (color.channels() != 3) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (!out.has_colors()) {
+    out.enable_colors();
+  }
+  project<true>(depth, &color, intrinsics, stride, out);
+  return {};
+}
+
+};  // namespace core
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <expected>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+// pinhole camera, pixel (u, v) with depth z maps to
+// ((u - cx) * z / fx, (v - cy) * z / fy, z)
+struct CameraIntrinsics {
+  float fx = 1.0f;
+  float fy = 1.0f;
+  float cx = 0.0f;
+  float cy = 0.0f;
+};
+
+// structure-of-arrays point cloud, colors and normals are optional and sized
+// together with the coordinates once enabled. shrinking keeps capacity so a
+// cloud can be refilled every frame without allocating.
+class PointCloud {
+ public:
+  PointCloud() noexcept = default;
+  explicit PointCloud(const size_t size, const bool with_colors = false,
+                      const bool with_normals = false);
+
+  [[nodiscard]] size_t size() const noexcept { return x_.size(); }
+  [[nodiscard]] bool empty() const noexcept { return x_.empty(); }
+  [[nodiscard]] bool has_colors() const noexcept { return has_colors_; }
+  [[nodiscard]] bool has_normals() const noexcept { return has_normals_; }
+
+  void resize(const size_t size);
+  void reserve(const size_t capacity);
+  void clear() noexcept { resize(0); }
+  void enable_colors();
+  void enable_normals();
+
+  [[nodiscard]] float* x() noexcept { return x_.data(); }
+  [[nodiscard]] float* y() noexcept { return y_.data(); }
+  [[nodiscard]] float* z() noexcept { return z_.data(); }
+  [[nodiscard]] const float* x() const noexcept { return x_.data(); }
+  [[nodiscard]] const float* y() const noexcept { return y_.data(); }
+  [[nodiscard]] const float* z() const noexcept { return z_.data(); }
+
+  // nullptr unless colors are enabled
+  [[nodiscard]] float* r() noexcept { return r_.data(); }
+  [[nodiscard]] float* g() noexcept { return g_.data(); }
+  [[nodiscard]] float* b() noexcept { return b_.data(); }
+  [[nodiscard]] const float* r() const noexcept { return r_.data(); }
+  [[nodiscard]] const float* g() const noexcept { return g_.data(); }
+  [[nodiscard]] const float* b() const noexcept { return b_.data(); }
+
+  // nullptr unless normals are enabled
+  [[nodiscard]] float* nx() noexcept { return nx_.data(); }
+  [[nodiscard]] float* ny() noexcept { return ny_.data(); }
+  [[nodiscard]] float* nz() noexcept { return nz_.data(); }
+  [[nodiscard]] const float* nx() const noexcept { return nx_.data(); }
+  [[nodiscard]] const float* ny() const noexcept { return ny_.data(); }
+  [[nodiscard]] const float* nz() const noexcept { return nz_.data(); }
+
+  // N x 3 single channel Mat of coordinates
+  [[nodiscard]] Mat to_mat() const noexcept;
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  std::vector<float> x_, y_, z_;
+  std::vector<float> r_, g_, b_;
+  std::vector<float> nx_, ny_, nz_;
+  bool has_colors_ = false;
+  bool has_normals_ = false;
+};
+
+// upper bound on the points depth_to_points produces, for sizing buffers
+[[nodiscard]] constexpr size_t max_point_count(const size_t rows,
+                                               const size_t cols,
+                                               const size_t stride) noexcept {
+  return stride == 0 ? 0
+                     : ((rows + stride - 1) / stride) *
+                           ((cols + stride - 1) / stride);
+}
+
+// back-projects every stride-th pixel of a single channel depth map, pixels
+// with non-positive or non-finite depth are dropped
+[[nodiscard]] std::expected<PointCloud, MatError> depth_to_points(
+    const Mat& depth, const CameraIntrinsics& intrinsics,
+    const size_t stride = 1);
+
+// same as above but fills `out` in place, no allocation happens once `out`
+// has capacity for max_point_count points. colors or normals already enabled
+// on `out` are resized but not written.
+[[nodiscard]] std::expected<void, MatError> depth_to_points(
+    const Mat& depth, const CameraIntrinsics& intrinsics, const size_t stride,
+    PointCloud& out);
+
+// colored variant, color is a 3 channel image aligned with depth and `out`
+// gets colors enabled
+[[nodiscard]] std::expected<void, MatError> depth_to_points(
+    const Mat& depth, const Mat& color, const CameraIntrinsics& intrinsics,
+    const size_t stride, PointCloud& out);
+
+};  // namespace core
@@ -0,0 +1,517 @@
+#include "core/point_cloud_filter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "core/parallel.hpp"
+#include "core/radix_sort.hpp"
+
+namespace core {
+namespace {
+
+constexpr int kAxisBits = 21;
+constexpr uint64_t kAxisMask = (uint64_t{1} << kAxisBits) - 1;
+constexpr uint64_t kInvalidKey = ~uint64_t{0};
+constexpr size_t kMinPointsPerChunk = 1 << 14;
+constexpr size_t kMinCellsPerChunk = 64;
+
+inline bool is_finite(const float x, const float y, const float z) {
+  return std::isfinite(x) && std::isfinite(y) && std::isfinite(z);
+}
+
+struct Bounds {
+  std::array<float, 3> min{std::numeric_limits<float>::max(),
+                           std::numeric_limits<float>::max(),
+                           std::numeric_limits<float>::max()};
+  std::array<float, 3> max{std::numeric_limits<float>::lowest(),
+                           std::numeric_limits<float>::lowest(),
+                           std::numeric_limits<float>::lowest()};
+
+  [[nodiscard]] bool empty() const noexcept { return min[0] > max[0]; }
+  void merge(const Bounds& other) noexcept {
+    for (int axis = 0; axis < 3; ++axis) {
+      min[axis] = std::min(min[axis], other.min[axis]);
+      max[axis] = std::max(max[axis], other.max[axis]);
+    }
+  }
+};
+
+Bounds finite_bounds(const PointCloud& cloud) {
+  std::vector<Bounds> partial(num_chunks(cloud.size(), kMinPointsPerChunk));
+  parallel_for_chunks(
+      0, cloud.size(),
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        Bounds bounds;
+        for (size_t i = lo; i < hi; ++i) {
+          const std::array<float, 3> p{cloud.x()[i], cloud.y()[i],
+                                       cloud.z()[i]};
+          if (!is_finite(p[0], p[1], p[2])) {
+            continue;
+          }
+          for (int axis = 0; axis < 3; ++axis) {
+            bounds.min[axis] = std::min(bounds.min[axis], p[axis]);
+            bounds.max[axis] = std::max(bounds.max[axis], p[axis]);
+          }
+        }
+        partial[chunk] = bounds;
+      },
+      kMinPointsPerChunk);
+
+  Bounds bounds;
+  for (const Bounds& part : partial) {
+    bounds.merge(part);
+  }
+  return bounds;
+}
+
+// points bucketed by voxel through a stable radix sort of packed voxel keys,
+// points of neighbouring voxels along x are contiguous
+struct VoxelGrid {
+  float cell = 0.0f;
+  std::array<float, 3> origin{};
+  std::array<long, 3> dims{};
+  // keys pack x | y << shift_y | z << shift_z with just enough bits per axis
+  // for dims, fewer key bits means fewer radix passes
+  int shift_y = 0;
+  int shift_z = 0;
+  std::vector<uint64_t> keys;        // sorted, non-finite points last
+  std::vector<uint32_t> order;       // input index of every sorted point
+  std::vector<uint64_t> cell_keys;   // occupied voxels, ascending
+  std::vector<uint32_t> cell_start;  // first sorted point per voxel, + end
+
+  [[nodiscard]] size_t num_cells() const noexcept { return cell_keys.size(); }
+  [[nodiscard]] uint64_t pack_key(const uint64_t ix, const uint64_t iy,
+                                  const uint64_t iz) const noexcept {
+    return ix | (iy << shift_y) | (iz << shift_z);
+  }
+  [[nodiscard]] std::array<long, 3> unpack_key(
+      const uint64_t key) const noexcept {
+    const uint64_t mask_y = (uint64_t{1} << (shift_z - shift_y)) - 1;
+    return {static_cast<long>(key & ((uint64_t{1} << shift_y) - 1)),
+            static_cast<long>((key >> shift_y) & mask_y),
+            static_cast<long>(key >> shift_z)};
+  }
+  [[nodiscard]] size_t num_valid() const noexcept { return cell_start.back(); }
+
+  // sorted point range of voxels x0..x1 in the row (iy, iz)
+  [[nodiscard]] std::pair<uint32_t, uint32_t> row_points(
+      long x0, long x1, const long iy, const long iz) const noexcept {
+    x0 = std::max(x0, 0L);
+    x1 = std::min(x1, dims[0] - 1);
+    if (iy < 0 || iz < 0 || iy >= dims[1] || iz >= dims[2] || x0 > x1) {
+      return {0, 0};
+    }
+    const auto first = std::lower_bound(cell_keys.begin(), cell_keys.end(),
+                                        pack_key(x0, iy, iz));
+    const auto last =
+        std::upper_bound(first, cell_keys.end(), pack_key(x1, iy, iz));
+    return {cell_start[first - cell_keys.begin()],
+            cell_start[last - cell_keys.begin()]};
+  }
+};
+
+std::expected<VoxelGrid, MatError> build_grid(const PointCloud& cloud,
+                                              const float cell) {
+  if (!(cell > 0.0f) || !std::isfinite(cell)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  if (cloud.size() > std::numeric_limits<uint32_t>::max()) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+
+  VoxelGrid grid;
+  grid.cell = cell;
+  const Bounds bounds = finite_bounds(cloud);
+  if (!bounds.empty()) {
+    for (int axis = 0; axis < 3; ++axis) {
+      const float extent = (bounds.max[axis] - bounds.min[axis]) / cell;
+      if (!(extent < static_cast<float>(kAxisMask))) {
+        return std::unexpected(MatError::InvalidParameter);
+      }
+      grid.origin[axis] = bounds.min[axis];
+      grid.dims[axis] = static_cast<long>(extent) + 1;
+    }
+  }
+  grid.shift_y = std::bit_width(static_cast<uint64_t>(grid.dims[0]));
+  grid.shift_z =
+      grid.shift_y + std::bit_width(static_cast<uint64_t>(grid.dims[1]));
+
+  const size_t n = cloud.size();
+  grid.keys.resize(n);
+  grid.order.resize(n);
+  const float inv_cell = 1.0f / cell;
+  parallel_for(
+      0, n,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          grid.order[i] = static_cast<uint32_t>(i);
+          const float x = cloud.x()[i], y = cloud.y()[i], z = cloud.z()[i];
+          if (!is_finite(x, y, z)) {
+            grid.keys[i] = kInvalidKey;
+            continue;
+          }
+          const auto index = [&](const float value, const int axis) {
+            const long cell_index = static_cast<long>(
+                (value - grid.origin[axis]) * inv_cell);
+            return static_cast<uint64_t>(
+                std::clamp(cell_index, 0L, grid.dims[axis] - 1));
+          };
+          grid.keys[i] =
+              grid.pack_key(index(x, 0), index(y, 1), index(z, 2));
+        }
+      },
+      kMinPointsPerChunk);
+  radix_sort(grid.keys, grid.order);
+
+  // occupied voxels start where the sorted key changes
+  const size_t valid = static_cast<size_t>(
+      std::lower_bound(grid.keys.begin(), grid.keys.end(), kInvalidKey) -
+      grid.keys.begin());
+  const auto is_head = [&](const size_t i) {
+    return i == 0 || grid.keys[i] != grid.keys[i - 1];
+  };
+  std::vector<size_t> heads(num_chunks(valid, kMinPointsPerChunk) + 1, 0);
+  parallel_for_chunks(
+      0, valid,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        size_t count = 0;
+        for (size_t i = lo; i < hi; ++i) {
+          count += is_head(i);
+        }
+        heads[chunk + 1] = count;
+      },
+      kMinPointsPerChunk);
+  for (size_t chunk = 1; chunk < heads.size(); ++chunk) {
+    heads[chunk] += heads[chunk - 1];
+  }
+
+  grid.cell_keys.resize(heads.back());
+  grid.cell_start.resize(heads.back() + 1);
+  parallel_for_chunks(
+      0, valid,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        size_t cell_index = heads[chunk];
+        for (size_t i = lo; i < hi; ++i) {
+          if (is_head(i)) {
+            grid.cell_keys[cell_index] = grid.keys[i];
+            grid.cell_start[cell_index] = static_cast<uint32_t>(i);
+            ++cell_index;
+          }
+        }
+      },
+      kMinPointsPerChunk);
+  grid.cell_start.back() = static_cast<uint32_t>(valid);
+  return grid;
+}
+
+PointCloud gather(const PointCloud& cloud,
+                  const std::vector<uint32_t>& indices) {
+  PointCloud out(indices.size(), cloud.has_colors(), cloud.has_normals());
+  parallel_for(
+      0, indices.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          const uint32_t j = indices[i];
+          out.x()[i] = cloud.x()[j];
+          out.y()[i] = cloud.y()[j];
+          out.z()[i] = cloud.z()[j];
+          if (cloud.has_colors()) {
+            out.r()[i] = cloud.r()[j];
+            out.g()[i] = cloud.g()[j];
+            out.b()[i] = cloud.b()[j];
+          }
+          if (cloud.has_normals()) {
+            out.nx()[i] = cloud.nx()[j];
+            out.ny()[i] = cloud.ny()[j];
+            out.nz()[i] = cloud.nz()[j];
+          }
+        }
+      },
+      kMinPointsPerChunk);
+  return out;
+}
+
+PointCloud gather(const PointCloud& cloud, const std::vector<uint8_t>& keep) {
+  std::vector<uint32_t> indices;
+  indices.reserve(keep.size());
+  for (size_t i = 0; i < keep.size(); ++i) {
+    if (keep[i]) {
+      indices.push_back(static_cast<uint32_t>(i));
+    }
+  }
+  return gather(cloud, indices);
+}
+
+// coordinates in voxel order so neighbour scans read memory sequentially
+std::array<std::vector<float>, 3> sorted_coordinates(const PointCloud& cloud,
+                                                     const VoxelGrid& grid) {
+  const size_t valid = grid.num_valid();
+  std::array<std::vector<float>, 3> sorted{std::vector<float>(valid),
+                                           std::vector<float>(valid),
+                                           std::vector<float>(valid)};
+  parallel_for(
+      0, valid,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          sorted[0][i] = cloud.x()[grid.order[i]];
+          sorted[1][i] = cloud.y()[grid.order[i]];
+          sorted[2][i] = cloud.z()[grid.order[i]];
+        }
+      },
+      kMinPointsPerChunk);
+  return sorted;
+}
+
+// keeps the k smallest squared distances in ascending order
+inline void insert_nearest(const float distance_sq, float* nearest,
+                           size_t& found, const size_t k) {
+  if (found == k && distance_sq >= nearest[k - 1]) {
+    return;
+  }
+  size_t i = found < k ? found++ : k - 1;
+  while (i > 0 && nearest[i - 1] > distance_sq) {
+    nearest[i] = nearest[i - 1];
+    --i;
+  }
+  nearest[i] = distance_sq;
+}
+
+};  // namespace
+
+std::expected<PointCloud, MatError> voxel_downsample(const PointCloud& cloud,
+                                                     const float voxel_size,
+                                                     const VoxelMode mode) {
+  auto grid = build_grid(cloud, voxel_size);
+  if (!grid) {
+    return std::unexpected(grid.error());
+  }
+
+  const size_t cells = grid->num_cells();
+  if (mode == VoxelMode::First) {
+    // the sort is stable so a voxel's first slot holds its lowest index
+    std::vector<uint32_t> indices(cells);
+    for (size_t c = 0; c < cells; ++c) {
+      indices[c] = grid->order[grid->cell_start[c]];
+    }
+    return gather(cloud, indices);
+  }
+
+  PointCloud out(cells, cloud.has_colors(), cloud.has_normals());
+  parallel_for(
+      0, cells,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+          const uint32_t begin = grid->cell_start[c];
+          const uint32_t end = grid->cell_start[c + 1];
+          // double sums keep precision for dense voxels far from the origin
+          const auto mean = [&](const float* values) {
+            double sum = 0.0;
+            for (uint32_t i = begin; i < end; ++i) {
+              sum += values[grid->order[i]];
+            }
+            return static_cast<float>(sum / (end - begin));
+          };
+          out.x()[c] = mean(cloud.x());
+          out.y()[c] = mean(cloud.y());
+          out.z()[c] = mean(cloud.z());
+          if (cloud.has_colors()) {
+            out.r()[c] = mean(cloud.r());
+            out.g()[c] = mean(cloud.g());
+            out.b()[c] = mean(cloud.b());
+          }
+          if (cloud.has_normals()) {
+            const float nx = mean(cloud.nx());
+            const float ny = mean(cloud.ny());
+            const float nz = mean(cloud.nz());
+            const float norm = std::sqrt(nx * nx + ny * ny + nz * nz);
+            const float scale = norm > 0.0f ? 1.0f / norm : 0.0f;
+            out.nx()[c] = nx * scale;
+            out.ny()[c] = ny * scale;
+            out.nz()[c] = nz * scale;
+          }
+        }
+      },
+      kMinCellsPerChunk);
+  return out;
+}
+
+std::expected<PointCloud, MatError> remove_radius_outliers(
+    const PointCloud& cloud, const float radius, const size_t min_neighbors) {
+  // a voxel edge of radius puts all neighbours in the 27 surrounding voxels
+  auto grid = build_grid(cloud, radius);
+  if (!grid) {
+    return std::unexpected(grid.error());
+  }
+
+  const auto sorted = sorted_coordinates(cloud, *grid);
+  const float radius_sq = radius * radius;
+  std::vector<uint8_t> keep(cloud.size(), 0);
+  parallel_for(
+      0, grid->num_cells(),
+      [&](const size_t lo, const size_t hi) {
+        std::array<std::pair<uint32_t, uint32_t>, 9> rows;
+        for (size_t c = lo; c < hi; ++c) {
+          const auto [ix, iy, iz] = grid->unpack_key(grid->cell_keys[c]);
+          size_t num_rows = 0;
+          for (long dz = -1; dz <= 1; ++dz) {
+            for (long dy = -1; dy <= 1; ++dy) {
+              rows[num_rows++] = grid->row_points(ix - 1, ix + 1, iy + dy,
+                                                  iz + dz);
+            }
+          }
+
+          for (uint32_t p = grid->cell_start[c]; p < grid->cell_start[c + 1];
+               ++p) {
+            const float px = sorted[0][p], py = sorted[1][p],
+                        pz = sorted[2][p];
+            // counts p itself, so keep once it exceeds min_neighbors
+            size_t count = 0;
+            for (const auto& [begin, end] : rows) {
+              for (uint32_t q = begin; q < end && count <= min_neighbors;
+                   ++q) {
+                const float dx = sorted[0][q] - px;
+                const float dy = sorted[1][q] - py;
+                const float dz = sorted[2][q] - pz;
+                count += dx * dx + dy * dy + dz * dz <= radius_sq;
+              }
+            }
+            keep[grid->order[p]] = count > min_neighbors;
+          }
+        }
+      },
+      kMinCellsPerChunk);
+  return gather(cloud, keep);
+}
+
+std::expected<PointCloud, MatError> remove_statistical_outliers(
+    const PointCloud& cloud, const size_t k, const float std_ratio) {
+  if (k == 0 || !std::isfinite(std_ratio)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  // voxels sized to hold about k points if the cloud filled its bounds,
+  // surfaces pack denser which only makes the first rings sufficient sooner
+  const Bounds bounds = finite_bounds(cloud);
+  float cell = 1.0f;
+  if (!bounds.empty()) {
+    std::array<float, 3> extent{};
+    for (int axis = 0; axis < 3; ++axis) {
+      extent[axis] = bounds.max[axis] - bounds.min[axis];
+    }
+    const float largest = std::max({extent[0], extent[1], extent[2]});
+    if (largest > 0.0f) {
+      const float thinnest = largest / 1024.0f;
+      const double volume =
+          static_cast<double>(std::max(extent[0], thinnest)) *
+          std::max(extent[1], thinnest) * std::max(extent[2], thinnest);
+      cell = static_cast<float>(std::cbrt(volume * static_cast<double>(k) /
+                                          static_cast<double>(cloud.size())));
+      cell = std::max(cell, 4.0f * largest / static_cast<float>(kAxisMask));
+    }
+  }
+  auto grid = build_grid(cloud, cell);
+  if (!grid) {
+    return std::unexpected(grid.error());
+  }
+
+  const auto sorted = sorted_coordinates(cloud, *grid);
+  const size_t valid = grid->num_valid();
+  const long max_ring =
+      std::max({grid->dims[0], grid->dims[1], grid->dims[2]});
+  std::vector<float> mean_distance(valid, 0.0f);
+
+  parallel_for(
+      0, grid->num_cells(),
+      [&](const size_t lo, const size_t hi) {
+        std::vector<float> nearest(k);
+        for (size_t c = lo; c < hi; ++c) {
+          const auto center = grid->unpack_key(grid->cell_keys[c]);
+          const auto [ix, iy, iz] = center;
+          for (uint32_t p = grid->cell_start[c]; p < grid->cell_start[c + 1];
+               ++p) {
+            const std::array<float, 3> query{sorted[0][p], sorted[1][p],
+                                             sorted[2][p]};
+            size_t found = 0;
+            const auto scan = [&](const std::pair<uint32_t, uint32_t> range) {
+              for (uint32_t q = range.first; q < range.second; ++q) {
+                const float dx = sorted[0][q] - query[0];
+                const float dy = sorted[1][q] - query[1];
+                const float dz = sorted[2][q] - query[2];
+                if (q != p) {
+                  insert_nearest(dx * dx + dy * dy + dz * dz, nearest.data(),
+                                 found, k);
+                }
+              }
+            };
+
+            // expanding shells of voxels around the query's voxel, the search
+            // stops once the kth neighbour is closer than any unscanned voxel
+            for (long ring = 0; ring <= max_ring; ++ring) {
+              for (long dz = -ring; dz <= ring; ++dz) {
+                for (long dy = -ring; dy <= ring; ++dy) {
+                  if (std::max(std::abs(dy), std::abs(dz)) == ring) {
+                    scan(grid->row_points(ix - ring, ix + ring, iy + dy,
+                                          iz + dz));
+                  } else {
+                    scan(grid->row_points(ix - ring, ix - ring, iy + dy,
+                                          iz + dz));
+                    if (ring > 0) {
+                      scan(grid->row_points(ix + ring, ix + ring, iy + dy,
+                                            iz + dz));
+                    }
+                  }
+                }
+              }
+              float margin = std::numeric_limits<float>::max();
+              for (int axis = 0; axis < 3; ++axis) {
+                const float low =
+                    grid->origin[axis] +
+                    static_cast<float>(center[axis] - ring) * grid->cell;
+                margin = std::min({margin, query[axis] - low,
+                                   low + static_cast<float>(2 * ring + 1) *
+                                             grid->cell -
+                                       query[axis]});
+              }
+              if (found == k && nearest[k - 1] <= margin * margin) {
+                break;
+              }
+            }
+
+            float sum = 0.0f;
+            for (size_t i = 0; i < found; ++i) {
+              sum += std::sqrt(nearest[i]);
+            }
+            mean_distance[p] = found > 0 ? sum / static_cast<float>(found)
+                                         : 0.0f;
+          }
+        }
+      },
+      kMinCellsPerChunk);
+
+  double sum = 0.0, sum_sq = 0.0;
+  for (const float distance : mean_distance) {
+    sum += distance;
+    sum_sq += static_cast<double>(distance) * distance;
+  }
+  const double mean = valid > 0 ? sum / static_cast<double>(valid) : 0.0;
+  const double variance =
+      valid > 1 ? std::max(0.0, (sum_sq - sum * mean) /
+                                    static_cast<double>(valid - 1))
+                : 0.0;
+  const float threshold =
+      static_cast<float>(mean + std_ratio * std::sqrt(variance));
+
+  std::vector<uint8_t> keep(cloud.size(), 0);
+  for (size_t p = 0; p < valid; ++p) {
+    keep[grid->order[p]] = mean_distance[p] <= threshold;
+  }
+  return gather(cloud, keep);
+}
+
+};  // namespace core
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <expected>
+
+#include "core/point_cloud.hpp"
+
+namespace core {
+
+enum class VoxelMode {
+  Centroid,  // mean of the voxel's points, normals renormalised
+  First,     // the voxel's point with the lowest input index
+};
+
+// keeps one point per occupied cubic voxel of edge voxel_size, output is
+// ordered by voxel. points with non-finite coordinates are dropped.
+[[nodiscard]] std::expected<PointCloud, MatError> voxel_downsample(
+    const PointCloud& cloud, const float voxel_size,
+    const VoxelMode mode = VoxelMode::Centroid);
+
+// drops points with fewer than min_neighbors other points within radius.
+// points with non-finite coordinates have no neighbours and are dropped.
+[[nodiscard]] std::expected<PointCloud, MatError> remove_radius_outliers(
+    const PointCloud& cloud, const float radius, const size_t min_neighbors);
+
+// drops points whose mean distance to their k nearest neighbours is more than
+// std_ratio standard deviations above the mean of that distance over the cloud.
+// points with non-finite coordinates are dropped and take no part in it.
+[[nodiscard]] std::expected<PointCloud, MatError> remove_statistical_outliers(
+    const PointCloud& cloud, const size_t k, const float std_ratio);
+
+};  // namespace core
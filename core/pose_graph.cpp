@@ -0,0 +1,472 @@
+#include "core/pose_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kNone = std::numeric_limits<size_t>::max();
+// factors and variables per parallel chunk
+constexpr size_t kMinBlocksPerChunk = 256;
+constexpr size_t kTangent = 6;
+
+// ad(xi) = [hat(phi), hat(rho); 0, hat(phi)], exp(xi) exp(d) exp(-xi) =
+// exp(Ad d) with Ad = exp(ad(xi))
+Mat6d small_adjoint(const Vec6d& xi) {
+  const Mat3d rho = hat(Vec3d(xi[0], xi[1], xi[2]));
+  const Mat3d phi = hat(Vec3d(xi[3], xi[4], xi[5]));
+  Mat6d m;
+  m.set_block(0, 0, phi);
+  m.set_block(0, 3, rho);
+  m.set_block(3, 3, phi);
+  return m;
+}
+
+// log(exp(xi) exp(d)) ~= xi + J_r^-1(xi) d with the bernoulli series
+// J_r^-1 = I + ad / 2 + ad^2 / 12 - ad^4 / 720 + ..., cut once the next
+// term falls below rounding by the norm of ad^2. exact to rounding for
+// residual rotations up to about two radians and within 1e-6 at pi, the
+// largest a log returns.
+Mat6d right_jacobian_inverse(const Vec6d& xi) {
+  const Mat6d ad = small_adjoint(xi);
+  const Mat6d ad2 = ad * ad;
+  const double size = ad2.norm();
+  constexpr size_t kMaxTerms = std::size(lie_detail::kBernoulliTerms);
+  size_t terms = 1;
+  for (double power = size * size;
+       terms < kMaxTerms &&
+       lie_detail::kBernoulliTerms[terms] * power >
+           std::numeric_limits<double>::epsilon();
+       power *= size) {
+    ++terms;
+  }
+  // the even terms by horner's rule in ad^2
+  Mat6d even = Mat6d::identity() * lie_detail::kBernoulliTerms[terms - 1];
+  for (size_t k = terms - 1; k-- > 0;) {
+    even = Mat6d::identity() * lie_detail::kBernoulliTerms[k] - ad2 * even;
+  }
+  return Mat6d::identity() + ad * 0.5 + ad2 * even;
+}
+
+// log(measured^-1 from^-1 to) and its jacobians for from * exp(d_from) and
+// to * exp(d_to). with T = from^-1 to, exp(-d_from) T = T exp(-Ad(T^-1)
+// d_from), so the residual moves by J_r^-1 (d_to - Ad(T^-1) d_from).
+Vec6d relative_residual(const SE3d& measured_inverse, const SE3d& from,
+                        const SE3d& to, Mat6d* from_jacobian,
+                        Mat6d* to_jacobian) {
+  const SE3d relative = from.inverse() * to;
+  const Vec6d residual = (measured_inverse * relative).log();
+  if (from_jacobian != nullptr) {
+    *to_jacobian = right_jacobian_inverse(residual);
+    *from_jacobian = -(*to_jacobian * relative.inverse().adjoint());
+  }
+  return residual;
+}
+
+// rho(s) for the squared whitened residual s and its derivative, the
+// weight of the residual in the gauss-newton system
+double robust_loss(const RobustLoss loss, const double scale,
+                   const double s) {
+  switch (loss) {
+    case RobustLoss::None:
+      break;
+    case RobustLoss::Huber:
+      return s <= scale * scale ? s
+                                : 2.0 * scale * std::sqrt(s) - scale * scale;
+    case RobustLoss::Cauchy:
+      return scale * scale * std::log1p(s / (scale * scale));
+  }
+  return s;
+}
+
+double robust_weight(const RobustLoss loss, const double scale,
+                     const double s) {
+  switch (loss) {
+    case RobustLoss::None:
+      break;
+    case RobustLoss::Huber:
+      return s <= scale * scale ? 1.0 : scale / std::sqrt(s);
+    case RobustLoss::Cauchy:
+      return 1.0 / (1.0 + s / (scale * scale));
+  }
+  return 1.0;
+}
+
+// out (6 x 6 with rows `stride` apart) += block
+void add_block(const Mat6d& block, double* out, const size_t stride) {
+  for (size_t r = 0; r < kTangent; ++r) {
+    for (size_t c = 0; c < kTangent; ++c) {
+      out[r * stride + c] += block(r, c);
+    }
+  }
+}
+
+}  // namespace
+
+size_t PoseGraph::add_pose(const SE3d& initial, const bool fixed) {
+  const size_t index = estimates_.size();
+  estimates_.push_back(initial);
+  linearization_.push_back(initial);
+  variable_.push_back(fixed ? kNone : variable_poses_.size());
+  if (!fixed) {
+    variable_poses_.push_back(static_cast<uint32_t>(index));
+  }
+  return index;
+}
+
+std::expected<size_t, MatError> PoseGraph::add_factor(
+    const size_t from, const size_t to, const SE3d& measured,
+    const Mat6d& information) {
+  if (from >= estimates_.size() || to >= estimates_.size()) {
+    return std::unexpected(MatError::OutOfBounds);
+  }
+  if (from == to) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  Factor factor;
+  factor.from = static_cast<uint32_t>(from);
+  factor.to = static_cast<uint32_t>(to);
+  factor.measured_inverse = measured.inverse();
+  factor.information = information;
+  factors_.push_back(factor);
+  return factors_.size() - 1;
+}
+
+double PoseGraph::cost() const {
+  double total = 0.0;
+  for (const Factor& factor : factors_) {
+    const Vec6d r =
+        relative_residual(factor.measured_inverse, estimates_[factor.from],
+                          estimates_[factor.to], nullptr, nullptr);
+    total += robust_loss(params_.loss, params_.loss_scale,
+                         r.dot(factor.information * r));
+  }
+  return 0.5 * total;
+}
+
+bool PoseGraph::integrate(std::vector<uint32_t>& dirty) {
+  const size_t count = variable_poses_.size();
+  bool grew = count > integrated_variables_;
+  variable_factors_.resize(count);
+  neighbours_.resize(count);
+  for (size_t f = integrated_factors_; f < factors_.size(); ++f) {
+    dirty.push_back(static_cast<uint32_t>(f));
+    const size_t a = variable_[factors_[f].from];
+    const size_t b = variable_[factors_[f].to];
+    for (const size_t v : {a, b}) {
+      if (v != kNone) {
+        variable_factors_[v].push_back(static_cast<uint32_t>(f));
+      }
+    }
+    if (a == kNone || b == kNone) {
+      continue;
+    }
+    std::vector<uint32_t>& list = neighbours_[std::min(a, b)];
+    const auto later = static_cast<uint32_t>(std::max(a, b));
+    const auto it = std::lower_bound(list.begin(), list.end(), later);
+    if (it == list.end() || *it != later) {
+      list.insert(it, later);
+      grew = true;
+    }
+  }
+  integrated_factors_ = factors_.size();
+  integrated_variables_ = count;
+  return grew;
+}
+
+void PoseGraph::linearize(const std::vector<uint32_t>& factors) {
+  parallel_for(
+      0, factors.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t k = lo; k < hi; ++k) {
+          Factor& factor = factors_[factors[k]];
+          Mat6d from_jacobian, to_jacobian;
+          const Vec6d r = relative_residual(
+              factor.measured_inverse, linearization_[factor.from],
+              linearization_[factor.to], &from_jacobian, &to_jacobian);
+          const Vec6d whitened = factor.information * r;
+          const Mat6d weighted =
+              factor.information * robust_weight(params_.loss,
+                                                 params_.loss_scale,
+                                                 r.dot(whitened));
+          const Mat6d from_weighted = from_jacobian.transpose() * weighted;
+          const Mat6d to_weighted = to_jacobian.transpose() * weighted;
+          factor.hessian[0] = from_weighted * from_jacobian;
+          factor.hessian[1] = from_weighted * to_jacobian;
+          factor.hessian[2] = to_weighted * to_jacobian;
+          factor.gradient[0] = from_weighted * r;
+          factor.gradient[1] = to_weighted * r;
+        }
+      },
+      kMinBlocksPerChunk);
+}
+
+void PoseGraph::build_pattern() {
+  const size_t count = variable_poses_.size();
+  const std::vector<size_t> old_offsets = std::move(row_offsets_);
+  const std::vector<double> old_values = std::move(values_);
+  row_offsets_.assign(1, 0);
+  columns_.clear();
+  for (size_t v = 0; v < count; ++v) {
+    const size_t row_begin = columns_.size();
+    for (size_t j = 0; j < kTangent; ++j) {
+      columns_.push_back(static_cast<uint32_t>(kTangent * v + j));
+    }
+    for (const uint32_t w : neighbours_[v]) {
+      for (size_t j = 0; j < kTangent; ++j) {
+        columns_.push_back(static_cast<uint32_t>(kTangent * w + j));
+      }
+    }
+    const size_t length = columns_.size() - row_begin;
+    for (size_t i = 1; i < kTangent; ++i) {
+      columns_.insert(columns_.end(),
+                      columns_.begin() + static_cast<ptrdiff_t>(row_begin),
+                      columns_.begin() +
+                          static_cast<ptrdiff_t>(row_begin + length));
+    }
+    for (size_t i = 0; i < kTangent; ++i) {
+      row_offsets_.push_back(row_offsets_.back() + length);
+    }
+  }
+  // block rows that kept their length kept their neighbours and values
+  values_.assign(columns_.size(), 0.0);
+  for (size_t v = 0; kTangent * (v + 1) < old_offsets.size(); ++v) {
+    const size_t old_begin = old_offsets[kTangent * v];
+    const size_t old_end = old_offsets[kTangent * (v + 1)];
+    const size_t begin = row_offsets_[kTangent * v];
+    if (old_end - old_begin == row_offsets_[kTangent * (v + 1)] - begin) {
+      std::copy(old_values.begin() + static_cast<ptrdiff_t>(old_begin),
+                old_values.begin() + static_cast<ptrdiff_t>(old_end),
+                values_.begin() + static_cast<ptrdiff_t>(begin));
+    }
+  }
+  gradient_.resize(kTangent * count);
+}
+
+void PoseGraph::assemble(const std::vector<uint32_t>& variables) {
+  parallel_for(
+      0, variables.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t k = lo; k < hi; ++k) {
+          const size_t v = variables[k];
+          const size_t base = row_offsets_[kTangent * v];
+          const size_t length = row_offsets_[kTangent * v + 1] - base;
+          double* panel = values_.data() + base;
+          double* gradient = gradient_.data() + kTangent * v;
+          std::fill(panel, panel + kTangent * length, 0.0);
+          std::fill(gradient, gradient + kTangent, 0.0);
+          for (const uint32_t f : variable_factors_[v]) {
+            const Factor& factor = factors_[f];
+            const bool from = variable_[factor.from] == v;
+            const size_t other = variable_[from ? factor.to : factor.from];
+            add_block(factor.hessian[from ? 0 : 2], panel, length);
+            const Vec6d& g = factor.gradient[from ? 0 : 1];
+            for (size_t i = 0; i < kTangent; ++i) {
+              gradient[i] += g[i];
+            }
+            if (other == kNone || other < v) {
+              continue;
+            }
+            const std::vector<uint32_t>& list = neighbours_[v];
+            const auto position = static_cast<size_t>(
+                std::lower_bound(list.begin(), list.end(), other) -
+                list.begin());
+            add_block(from ? factor.hessian[1] : factor.hessian[1].transpose(),
+                      panel + kTangent * (position + 1), length);
+          }
+        }
+      },
+      kMinBlocksPerChunk);
+}
+
+std::expected<void, MatError> PoseGraph::reorder() {
+  if (auto analyzed = cholesky_.analyze(gradient_.size(), row_offsets_,
+                                        columns_);
+      !analyzed) {
+    return analyzed;
+  }
+  if (auto factored = cholesky_.factorize(values_); !factored) {
+    return factored;
+  }
+  reordered_fill_ = static_cast<double>(cholesky_.factor_size()) /
+                    static_cast<double>(values_.size());
+  return {};
+}
+
+std::expected<void, MatError> PoseGraph::solve_step() {
+  step_.resize(gradient_.size());
+  for (size_t i = 0; i < step_.size(); ++i) {
+    step_[i] = -gradient_[i];
+  }
+  if (auto solved = cholesky_.solve(step_); !solved) {
+    return solved;
+  }
+  parallel_for(
+      0, variable_poses_.size(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t v = lo; v < hi; ++v) {
+          const double* d = step_.data() + kTangent * v;
+          const uint32_t pose = variable_poses_[v];
+          estimates_[pose] = linearization_[pose] *
+                             SE3d::exp(Vec6d(d[0], d[1], d[2], d[3], d[4],
+                                             d[5]));
+        }
+      },
+      kMinBlocksPerChunk);
+  return {};
+}
+
+std::expected<PoseGraphSummary, MatError> PoseGraph::update() {
+  PoseGraphSummary summary;
+  summary.iterations = 1;
+  const size_t old_variables = integrated_variables_;
+  std::vector<uint32_t> dirty;
+  const bool grew = integrate(dirty);
+  const size_t count = variable_poses_.size();
+  if (count == 0) {
+    return summary;
+  }
+
+  // poses whose step left their linearisation point take it as the new
+  // one, their factors are linearised there along with the new factors
+  std::vector<uint8_t> factor_dirty(factors_.size(), 0);
+  for (const uint32_t f : dirty) {
+    factor_dirty[f] = 1;
+  }
+  for (size_t v = 0; v < old_variables && kTangent * v < step_.size(); ++v) {
+    const double* d = step_.data() + kTangent * v;
+    double largest = 0.0;
+    for (size_t i = 0; i < kTangent; ++i) {
+      largest = std::max(largest, std::fabs(d[i]));
+    }
+    if (largest <= params_.relinearize_threshold) {
+      continue;
+    }
+    linearization_[variable_poses_[v]] = estimates_[variable_poses_[v]];
+    ++summary.relinearized;
+    for (const uint32_t f : variable_factors_[v]) {
+      if (!factor_dirty[f]) {
+        factor_dirty[f] = 1;
+        dirty.push_back(f);
+      }
+    }
+  }
+  linearize(dirty);
+
+  // the block rows of the variables of those factors change, those of
+  // variables that gained a neighbour among them
+  std::vector<uint8_t> variable_changed(count, 0);
+  for (const uint32_t f : dirty) {
+    for (const uint32_t pose : {factors_[f].from, factors_[f].to}) {
+      if (variable_[pose] != kNone) {
+        variable_changed[variable_[pose]] = 1;
+      }
+    }
+  }
+  std::vector<uint32_t> changed;
+  std::vector<uint32_t> changed_rows;
+  for (size_t v = 0; v < count; ++v) {
+    if (variable_changed[v] || v >= old_variables) {
+      changed.push_back(static_cast<uint32_t>(v));
+    }
+    if (variable_changed[v] && v < old_variables) {
+      for (size_t i = 0; i < kTangent; ++i) {
+        changed_rows.push_back(static_cast<uint32_t>(kTangent * v + i));
+      }
+    }
+  }
+  if (grew) {
+    build_pattern();
+  }
+  assemble(changed);
+
+  if (!cholesky_.factorized()) {
+    if (auto reordered = reorder(); !reordered) {
+      return std::unexpected(reordered.error());
+    }
+    summary.reordered = true;
+    summary.recomputed_columns = gradient_.size();
+  } else if (grew) {
+    const auto columns = cholesky_.extend(gradient_.size(), row_offsets_,
+                                          columns_, values_, changed_rows);
+    if (!columns) {
+      return std::unexpected(columns.error());
+    }
+    summary.recomputed_columns = *columns;
+    const double fill = static_cast<double>(cholesky_.factor_size()) /
+                        static_cast<double>(values_.size());
+    if (fill > params_.max_fill_growth * reordered_fill_) {
+      if (auto reordered = reorder(); !reordered) {
+        return std::unexpected(reordered.error());
+      }
+      summary.reordered = true;
+      summary.recomputed_columns += gradient_.size();
+    }
+  } else if (!changed_rows.empty()) {
+    const auto columns = cholesky_.refactorize(values_, changed_rows);
+    if (!columns) {
+      return std::unexpected(columns.error());
+    }
+    summary.recomputed_columns = *columns;
+  }
+  if (auto solved = solve_step(); !solved) {
+    return std::unexpected(solved.error());
+  }
+  return summary;
+}
+
+std::expected<PoseGraphSummary, MatError> PoseGraph::optimize() {
+  PoseGraphSummary summary;
+  std::vector<uint32_t> dirty;
+  integrate(dirty);
+  const size_t count = variable_poses_.size();
+  if (count == 0) {
+    summary.converged = true;
+    return summary;
+  }
+  build_pattern();
+  std::vector<uint32_t> all_factors(factors_.size());
+  for (size_t f = 0; f < factors_.size(); ++f) {
+    all_factors[f] = static_cast<uint32_t>(f);
+  }
+  std::vector<uint32_t> all_variables(count);
+  for (size_t v = 0; v < count; ++v) {
+    all_variables[v] = static_cast<uint32_t>(v);
+  }
+
+  summary.reordered = true;
+  for (; summary.iterations < params_.max_iterations; ++summary.iterations) {
+    for (const uint32_t pose : variable_poses_) {
+      linearization_[pose] = estimates_[pose];
+    }
+    summary.relinearized += count;
+    linearize(all_factors);
+    assemble(all_variables);
+    auto factored = summary.iterations == 0 ? reorder()
+                                            : cholesky_.factorize(values_);
+    if (!factored) {
+      return std::unexpected(factored.error());
+    }
+    summary.recomputed_columns += gradient_.size();
+    if (auto solved = solve_step(); !solved) {
+      return std::unexpected(solved.error());
+    }
+    double largest = 0.0;
+    for (const double d : step_) {
+      largest = std::max(largest, std::fabs(d));
+    }
+    if (largest < params_.step_tolerance) {
+      summary.converged = true;
+      ++summary.iterations;
+      break;
+    }
+  }
+  return summary;
+}
+
+};  // namespace core
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <vector>
+
+#include "core/fixed_mat.hpp"
+#include "core/lie_group.hpp"
+#include "core/mat.hpp"
+#include "core/sparse_cholesky.hpp"
+
+namespace core {
+
+enum class RobustLoss {
+  None,    // squared error
+  Huber,   // quadratic up to loss_scale, linear beyond
+  Cauchy,  // log(1 + s / loss_scale^2), outliers lose influence as they grow
+};
+
+struct PoseGraphParams {
+  RobustLoss loss = RobustLoss::None;
+  // the whitened residual norm where the robust loss leaves the quadratic
+  double loss_scale = 1.0;
+  // update() relinearises a pose once its step from the linearisation
+  // point exceeds this in a tangent component
+  double relinearize_threshold = 0.01;
+  // update() reorders from scratch once the factor holds this many times
+  // more entries per entry of the system than after the last reordering
+  double max_fill_growth = 2.0;
+  // optimize() stops after this many iterations or once no step component
+  // exceeds step_tolerance
+  size_t max_iterations = 20;
+  double step_tolerance = 1e-8;
+};
+
+struct PoseGraphSummary {
+  size_t iterations = 0;
+  size_t relinearized = 0;        // poses relinearised, over all iterations
+  size_t recomputed_columns = 0;  // of the factor, over all iterations
+  bool reordered = false;         // the factorisation started over
+  bool converged = false;         // optimize() met step_tolerance
+};
+
+// SE(3) pose graph optimisation with relative-pose factors, incrementally
+// in the manner of isam. the poses are the variables, each factor measures
+// the relative pose from^-1 * to, and the residual log(measured^-1 *
+// from^-1 * to) is weighted by its information matrix and a robust loss.
+//
+// each pose keeps a linearisation point and the estimate is that point
+// moved by the solution of the gauss-newton system built there. update()
+// adds the poses and factors that arrived since the last call at the end
+// of the sparse cholesky factorisation, relinearises only the poses whose
+// step has grown past relinearize_threshold, together with their factors,
+// and recomputes only the part of the factor above the rows that changed.
+// new poses and loop closures touch the rows of their variables and
+// those after them in the elimination tree, the rest of the factor is
+// reused. the order the factorisation keeps is the fill reducing one of
+// the last reordering with new poses appended, it starts over once the
+// fill has grown by max_fill_growth. optimize() is the batch counterpart.
+//
+// poses are SE3d, tangents (rho, phi) as for SE3 with poses updated on the
+// right, pose * exp(delta).
+class PoseGraph {
+ public:
+  explicit PoseGraph(const PoseGraphParams& params = {}) : params_(params) {}
+
+  // fixed poses are never moved and anchor the graph, each connected part
+  // of it needs one
+  size_t add_pose(const SE3d& initial, bool fixed = false);
+  // a measurement of from^-1 * to with its information matrix in tangent
+  // order. OutOfBounds for unknown poses, InvalidParameter if from == to.
+  [[nodiscard]] std::expected<size_t, MatError> add_factor(
+      size_t from, size_t to, const SE3d& measured,
+      const Mat6d& information = Mat6d::identity());
+
+  // one incremental gauss-newton step. InvalidParameter if the system is
+  // singular, e.g. a part of the graph has no fixed pose.
+  [[nodiscard]] std::expected<PoseGraphSummary, MatError> update();
+  // gauss-newton from the current estimates, reordering and relinearising
+  // every pose in each iteration. update() continues from its result.
+  [[nodiscard]] std::expected<PoseGraphSummary, MatError> optimize();
+
+  [[nodiscard]] size_t num_poses() const noexcept {
+    return estimates_.size();
+  }
+  [[nodiscard]] size_t num_factors() const noexcept {
+    return factors_.size();
+  }
+  // unchecked
+  [[nodiscard]] const SE3d& pose(const size_t i) const noexcept {
+    return estimates_[i];
+  }
+  // half the sum of the robust losses of the factors at the estimates
+  [[nodiscard]] double cost() const;
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  struct Factor {
+    uint32_t from = 0;
+    uint32_t to = 0;
+    SE3d measured_inverse;
+    Mat6d information;
+    // at the linearisation points, with jacobians J_from and J_to and the
+    // information scaled by the robust weight W: J_from^T W J_from,
+    // J_from^T W J_to, J_to^T W J_to and J^T W r for both poses
+    Mat6d hessian[3];
+    Vec6d gradient[2];
+  };
+
+  void linearize(const std::vector<uint32_t>& factors);
+  // the pattern of the system from the neighbours of the variables, block
+  // rows whose neighbours are unchanged keep their values
+  void build_pattern();
+  // the block rows and gradients of the given variables from their factors
+  void assemble(const std::vector<uint32_t>& variables);
+  std::expected<void, MatError> reorder();
+  // the step from the linearisation points and the estimates it gives
+  std::expected<void, MatError> solve_step();
+  // poses and factors added since the last step, true if the pattern grew
+  bool integrate(std::vector<uint32_t>& dirty);
+
+  PoseGraphParams params_;
+  std::vector<SE3d> estimates_;
+  std::vector<SE3d> linearization_;
+  // pose -> variable, kNone for fixed poses, and back
+  std::vector<size_t> variable_;
+  std::vector<uint32_t> variable_poses_;
+  std::vector<Factor> factors_;
+  // factors whose variables the system holds, those after arrived since
+  size_t integrated_factors_ = 0;
+  size_t integrated_variables_ = 0;
+
+  // per variable the factors at it and the later variables it shares a
+  // factor with, ascending
+  std::vector<std::vector<uint32_t>> variable_factors_;
+  std::vector<std::vector<uint32_t>> neighbours_;
+  // the upper triangle of the system, block row v a dense 6 x 6 (1 +
+  // neighbours) panel of its own block then those of its neighbours
+  std::vector<size_t> row_offsets_;
+  std::vector<uint32_t> columns_;
+  std::vector<double> values_;
+  std::vector<double> gradient_;
+  std::vector<double> step_;
+  SparseCholesky cholesky_;
+  // factor entries per system entry after the last reordering
+  double reordered_fill_ = 0.0;
+};
+
+};  // namespace core
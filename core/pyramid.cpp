@@ -0,0 +1,124 @@
+#include "core/pyramid.hpp"
+
+#include <algorithm>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 16;
+
+// coarse rows [lo, hi): the fine rows under each coarse row are filtered
+// vertically into one padded row, which is then filtered horizontally at
+// every second column only. Channels is 0 when only known at runtime.
+template <size_t Channels>
+void decimate_rows(const Mat& fine, Mat& coarse, const PyramidFilter filter,
+                   const size_t lo, const size_t hi) {
+  const size_t channels = Channels != 0 ? Channels : fine.channels();
+  const size_t width = fine.cols() * channels;
+  const size_t coarse_cols = coarse.cols();
+  // one replicated pixel left and right of the fine row
+  std::vector<float> padded(width + 2 * channels);
+  float* const row = padded.data() + channels;
+  float* const left = padded.data();
+
+  for (size_t y = lo; y < hi; ++y) {
+    float* __restrict out = coarse.data() + y * coarse_cols * channels;
+    const float* __restrict r1 = fine.data() + 2 * y * width;
+    const float* __restrict r2 = r1 + width;
+    if (filter == PyramidFilter::Box) {
+      for (size_t i = 0; i < width; ++i) {
+        row[i] = r1[i] + r2[i];
+      }
+      for (size_t x = 0; x < coarse_cols; ++x) {
+        for (size_t c = 0; c < channels; ++c) {
+          out[x * channels + c] = 0.25f * (row[2 * x * channels + c] +
+                                           row[(2 * x + 1) * channels + c]);
+        }
+      }
+      continue;
+    }
+
+    const float* __restrict r0 = y > 0 ? r1 - width : r1;
+    const float* __restrict r3 = 2 * y + 2 < fine.rows() ? r2 + width : r2;
+    for (size_t i = 0; i < width; ++i) {
+      row[i] = r0[i] + 3.0f * (r1[i] + r2[i]) + r3[i];
+    }
+    for (size_t c = 0; c < channels; ++c) {
+      left[c] = row[c];
+      row[width + c] = row[width - channels + c];
+    }
+    for (size_t x = 0; x < coarse_cols; ++x) {
+      const float* taps = left + 2 * x * channels;
+      for (size_t c = 0; c < channels; ++c) {
+        out[x * channels + c] =
+            (1.0f / 64.0f) *
+            (taps[c] + 3.0f * (taps[channels + c] + taps[2 * channels + c]) +
+             taps[3 * channels + c]);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void pyramid_down(const Mat& fine, Mat& coarse, const PyramidFilter filter) {
+  const size_t rows = fine.rows() / 2, cols = fine.cols() / 2;
+  if (coarse.rows() != rows || coarse.cols() != cols ||
+      coarse.channels() != fine.channels()) {
+    coarse = Mat(rows, cols, fine.channels());
+  }
+  if (rows == 0 || cols == 0) {
+    return;
+  }
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        switch (fine.channels()) {
+          case 1:
+            decimate_rows<1>(fine, coarse, filter, lo, hi);
+            break;
+          case 3:
+            decimate_rows<3>(fine, coarse, filter, lo, hi);
+            break;
+          default:
+            decimate_rows<0>(fine, coarse, filter, lo, hi);
+        }
+      },
+      kMinRowsPerChunk);
+}
+
+std::expected<void, MatError> Pyramid::build(const Mat& image) {
+  if (image.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (params_.num_levels == 0 || params_.min_size == 0) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  num_levels_ = 1;
+  size_t rows = image.rows() / 2, cols = image.cols() / 2;
+  while (num_levels_ < params_.num_levels && rows >= params_.min_size &&
+         cols >= params_.min_size) {
+    ++num_levels_;
+    rows /= 2;
+    cols /= 2;
+  }
+  if (levels_.size() < num_levels_) {
+    levels_.resize(num_levels_);
+  }
+
+  Mat& base = levels_[0];
+  if (base.rows() != image.rows() || base.cols() != image.cols() ||
+      base.channels() != image.channels()) {
+    base = Mat(image.rows(), image.cols(), image.channels());
+  }
+  std::copy(image.data(), image.data() + image.size(), base.data());
+  for (size_t l = 1; l < num_levels_; ++l) {
+    pyramid_down(levels_[l - 1], levels_[l], params_.filter);
+  }
+  return {};
+}
+
+};  // namespace core
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <expected>
+#include <span>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+enum class PyramidFilter {
+  Box,       // 2x2 mean
+  Gaussian,  // separable [1 3 3 1] / 8 binomial
+};
+
+struct PyramidParams {
+  // upper bound on the number of levels including the full resolution one
+  size_t num_levels = 4;
+  PyramidFilter filter = PyramidFilter::Gaussian;
+  // no level gets fewer rows or cols than this
+  size_t min_size = 8;
+};
+
+// factor-2 image pyramid. every level is blurred and decimated in a single
+// pass over the finer one, and both filters are even so level l pixel x
+// covers level 0 pixels around (x + 0.5) * 2^l - 0.5. level buffers are
+// kept across builds and reused when the input shape does not change.
+class Pyramid {
+ public:
+  explicit Pyramid(const PyramidParams& params = {}) : params_(params) {}
+
+  // level 0 is a copy of `image`, level l + 1 has floor(rows / 2) x
+  // floor(cols / 2) pixels of level l
+  [[nodiscard]] std::expected<void, MatError> build(const Mat& image);
+
+  [[nodiscard]] size_t num_levels() const noexcept { return num_levels_; }
+  [[nodiscard]] const Mat& level(const size_t l) const noexcept {
+    return levels_[l];
+  }
+  [[nodiscard]] std::span<const Mat> levels() const noexcept {
+    return {levels_.data(), num_levels_};
+  }
+
+  // level l coordinates of a level 0 point and back
+  [[nodiscard]] static float to_level(const float coordinate,
+                                      const size_t l) noexcept {
+    return (coordinate + 0.5f) / static_cast<float>(size_t{1} << l) - 0.5f;
+  }
+  [[nodiscard]] static float from_level(const float coordinate,
+                                        const size_t l) noexcept {
+    return (coordinate + 0.5f) * static_cast<float>(size_t{1} << l) - 0.5f;
+  }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  PyramidParams params_;
+  size_t num_levels_ = 0;
+  // may hold more buffers than levels when an earlier frame was larger
+  std::vector<Mat> levels_;
+};
+
+// blurs and decimates `fine` into `coarse` by 2, `coarse` is reallocated only
+// if its shape differs
+void pyramid_down(const Mat& fine, Mat& coarse,
+                  PyramidFilter filter = PyramidFilter::Gaussian);
+
+};  // namespace core
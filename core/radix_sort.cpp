@@ -0,0 +1,99 @@
+#include "core/radix_sort.hpp"
+
+#include <array>
+#include <bit>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr int kRadixBits = 11;
+constexpr size_t kBuckets = size_t{1} << kRadixBits;
+constexpr size_t kMinKeysPerChunk = 1 << 14;
+
+using Histogram = std::array<size_t, kBuckets>;
+
+};  // namespace
+
+void radix_sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values) {
+  const size_t n = keys.size();
+  if (n < 2) {
+    return;
+  }
+
+  // bits that are not constant across keys
+  const size_t chunks = num_chunks(n, kMinKeysPerChunk);
+  std::vector<uint64_t> chunk_and(chunks), chunk_or(chunks);
+  parallel_for_chunks(
+      0, n,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        uint64_t all = ~uint64_t{0}, any = 0;
+        for (size_t i = lo; i < hi; ++i) {
+          all &= keys[i];
+          any |= keys[i];
+        }
+        chunk_and[chunk] = all;
+        chunk_or[chunk] = any;
+      },
+      kMinKeysPerChunk);
+  uint64_t all = ~uint64_t{0}, any = 0;
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    all &= chunk_and[chunk];
+    any |= chunk_or[chunk];
+  }
+  const uint64_t varying = all ^ any;
+  if (varying == 0) {
+    return;
+  }
+
+  std::vector<uint64_t> key_buffer(n);
+  std::vector<uint32_t> value_buffer(n);
+  std::vector<Histogram> histograms(chunks);
+
+  // digits cover only the span of varying bits
+  const int last_bit = std::bit_width(varying);
+  for (int shift = std::countr_zero(varying); shift < last_bit;
+       shift += kRadixBits) {
+    if (((varying >> shift) & (kBuckets - 1)) == 0) {
+      continue;
+    }
+
+    parallel_for_chunks(
+        0, n,
+        [&](const size_t chunk, const size_t lo, const size_t hi) {
+          Histogram& histogram = histograms[chunk];
+          histogram.fill(0);
+          for (size_t i = lo; i < hi; ++i) {
+            ++histogram[(keys[i] >> shift) & (kBuckets - 1)];
+          }
+        },
+        kMinKeysPerChunk);
+
+    // exclusive scan in (bucket, chunk) order keeps the sort stable
+    size_t offset = 0;
+    for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+      for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        const size_t count = histograms[chunk][bucket];
+        histograms[chunk][bucket] = offset;
+        offset += count;
+      }
+    }
+
+    parallel_for_chunks(
+        0, n,
+        [&](const size_t chunk, const size_t lo, const size_t hi) {
+          Histogram& next = histograms[chunk];
+          for (size_t i = lo; i < hi; ++i) {
+            const size_t dst = next[(keys[i] >> shift) & (kBuckets - 1)]++;
+            key_buffer[dst] = keys[i];
+            value_buffer[dst] = values[i];
+          }
+        },
+        kMinKeysPerChunk);
+    keys.swap(key_buffer);
+    values.swap(value_buffer);
+  }
+}
+
+};  // namespace core
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace core {
+
+// stable parallel lsd radix sort of keys, values (same length as keys) are
+// permuted alongside. only the span of bits that differ between keys is
+// sorted on, so small key ranges take fewer passes.
+void radix_sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values);
+
+};  // namespace core
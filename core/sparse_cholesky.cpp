@@ -0,0 +1,1485 @@
+#include "core/sparse_cholesky.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kNone = std::numeric_limits<size_t>::max();
+constexpr uint32_t kNoIndex = std::numeric_limits<uint32_t>::max();
+// rows of a supernode finished together before the rows below are updated
+constexpr size_t kPanel = 32;
+// multiply-adds per parallel chunk of the dense kernels
+constexpr size_t kMinDenseWork = size_t{1} << 16;
+// supernodes below this much work per thread are not worth a thread
+constexpr size_t kMinParallelWork = size_t{1} << 20;
+
+void ensure_shape(Mat& mat, const size_t rows, const size_t cols,
+                  const size_t channels) {
+  if (mat.rows() != rows || mat.cols() != cols ||
+      mat.channels() != channels) {
+    mat = Mat(rows, cols, channels);
+  }
+}
+
+// y -= a * x over n entries
+void subtract_scaled(double* __restrict y, const double* __restrict x,
+                     const double a, const size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    y[i] -= a * x[i];
+  }
+}
+
+// y -= a0 x0 + a1 x1 + a2 x2 + a3 x3, one pass over y for four updates
+void subtract_scaled4(double* __restrict y, const double* const* x,
+                      const double* a, const size_t n) {
+  const double* __restrict x0 = x[0];
+  const double* __restrict x1 = x[1];
+  const double* __restrict x2 = x[2];
+  const double* __restrict x3 = x[3];
+  for (size_t i = 0; i < n; ++i) {
+    y[i] -= a[0] * x0[i] + a[1] * x1[i] + a[2] * x2[i] + a[3] * x3[i];
+  }
+}
+
+// the approximate minimum degree ordering of amestoy, davis and duff on
+// the symmetric graph with the adjacency lists [cp[j], cp[j + 1]) of ci,
+// without self loops, in the formulation of davis' csparse. pivots are
+// picked from a quotient graph of variables and elements (eliminated
+// variables standing for the clique of their neighbours) by an upper bound
+// on their degree, variables with the same neighbourhood merge into
+// supervariables, and elements that stop mattering are absorbed. rows
+// denser than 10 sqrt(n) go last. returns new -> old.
+std::vector<uint32_t> amd_order(const int64_t n, std::vector<int64_t> cp,
+                                std::vector<int64_t> ci) {
+  const auto flip = [](const int64_t i) { return -i - 2; };
+  int64_t dense = std::max<int64_t>(
+      16, static_cast<int64_t>(10.0 * std::sqrt(static_cast<double>(n))));
+  dense = std::min(n - 2, dense);
+  int64_t cnz = cp[n];
+  // elbow room for the new elements
+  ci.resize(static_cast<size_t>(cnz + cnz / 5 + 2 * n + 1));
+  const int64_t nzmax = static_cast<int64_t>(ci.size());
+  const size_t size = static_cast<size_t>(n + 1);
+  std::vector<int64_t> len(size), nv(size), next(size), head(size),
+      elen(size), degree(size), w(size), hhead(size), last(size);
+
+  // w[i] < mark for every live i once this returns
+  const auto clear = [&](int64_t mark, const int64_t lemax) {
+    if (mark < 2 || mark + lemax < 0) {
+      for (int64_t k = 0; k < n; ++k) {
+        if (w[k] != 0) {
+          w[k] = 1;
+        }
+      }
+      mark = 2;
+    }
+    return mark;
+  };
+
+  for (int64_t k = 0; k < n; ++k) {
+    len[k] = cp[k + 1] - cp[k];
+  }
+  len[n] = 0;
+  for (int64_t i = 0; i <= n; ++i) {
+    head[i] = last[i] = next[i] = hhead[i] = -1;
+    nv[i] = 1;
+    w[i] = 1;
+    elen[i] = 0;
+    degree[i] = len[i];
+  }
+  int64_t mark = clear(0, 0);
+  // node n is the element that dense rows are absorbed into
+  elen[n] = -2;
+  cp[n] = -1;
+  w[n] = 0;
+  int64_t nel = 0;
+  for (int64_t i = 0; i < n; ++i) {
+    const int64_t d = degree[i];
+    if (d == 0) {
+      elen[i] = -2;
+      ++nel;
+      cp[i] = -1;
+      w[i] = 0;
+    } else if (d > dense) {
+      nv[i] = 0;
+      elen[i] = -1;
+      ++nel;
+      cp[i] = flip(n);
+      ++nv[n];
+    } else {
+      if (head[d] != -1) {
+        last[head[d]] = i;
+      }
+      next[i] = head[d];
+      head[d] = i;
+    }
+  }
+
+  int64_t mindeg = 0;
+  int64_t lemax = 0;
+  while (nel < n) {
+    // the variable k of least approximate degree
+    int64_t k = -1;
+    for (; mindeg < n && (k = head[mindeg]) == -1; ++mindeg) {
+    }
+    if (next[k] != -1) {
+      last[next[k]] = -1;
+    }
+    head[mindeg] = next[k];
+    const int64_t elenk = elen[k];
+    int64_t nvk = nv[k];
+    nel += nvk;
+
+    // compacts the lists when the new element may not fit
+    if (elenk > 0 && cnz + mindeg >= nzmax) {
+      for (int64_t j = 0; j < n; ++j) {
+        if (const int64_t p = cp[j]; p >= 0) {
+          cp[j] = ci[p];
+          ci[p] = flip(j);
+        }
+      }
+      int64_t q = 0;
+      for (int64_t p = 0; p < cnz;) {
+        if (const int64_t j = flip(ci[p++]); j >= 0) {
+          ci[q] = cp[j];
+          cp[j] = q++;
+          for (int64_t k3 = 0; k3 < len[j] - 1; ++k3) {
+            ci[q++] = ci[p++];
+          }
+        }
+      }
+      cnz = q;
+    }
+
+    // the new element Lk, the union of the variables of k and of the
+    // elements next to it, which it absorbs
+    int64_t dk = 0;
+    nv[k] = -nvk;
+    int64_t p = cp[k];
+    const int64_t pk1 = elenk == 0 ? p : cnz;
+    int64_t pk2 = pk1;
+    for (int64_t k1 = 1; k1 <= elenk + 1; ++k1) {
+      int64_t e, pj, ln;
+      if (k1 > elenk) {
+        e = k;
+        pj = p;
+        ln = len[k] - elenk;
+      } else {
+        e = ci[p++];
+        pj = cp[e];
+        ln = len[e];
+      }
+      for (int64_t k2 = 1; k2 <= ln; ++k2) {
+        const int64_t i = ci[pj++];
+        const int64_t nvi = nv[i];
+        if (nvi <= 0) {
+          continue;
+        }
+        dk += nvi;
+        nv[i] = -nvi;
+        ci[pk2++] = i;
+        if (next[i] != -1) {
+          last[next[i]] = last[i];
+        }
+        if (last[i] != -1) {
+          next[last[i]] = next[i];
+        } else {
+          head[degree[i]] = next[i];
+        }
+      }
+      if (e != k) {
+        cp[e] = flip(k);
+        w[e] = 0;
+      }
+    }
+    if (elenk != 0) {
+      cnz = pk2;
+    }
+    degree[k] = dk;
+    cp[k] = pk1;
+    len[k] = pk2 - pk1;
+    elen[k] = -2;
+
+    // |Le \ Lk| for every element e next to a variable of Lk
+    mark = clear(mark, lemax);
+    for (int64_t pk = pk1; pk < pk2; ++pk) {
+      const int64_t i = ci[pk];
+      const int64_t eln = elen[i];
+      if (eln <= 0) {
+        continue;
+      }
+      const int64_t nvi = -nv[i];
+      const int64_t wnvi = mark - nvi;
+      for (p = cp[i]; p <= cp[i] + eln - 1; ++p) {
+        const int64_t e = ci[p];
+        if (w[e] >= mark) {
+          w[e] -= nvi;
+        } else if (w[e] != 0) {
+          w[e] = degree[e] + wnvi;
+        }
+      }
+    }
+
+    // approximate degrees of the variables of Lk, absorbing the elements
+    // inside Lk and hashing the variables for supervariable detection
+    for (int64_t pk = pk1; pk < pk2; ++pk) {
+      const int64_t i = ci[pk];
+      const int64_t p1 = cp[i];
+      const int64_t p2 = p1 + elen[i] - 1;
+      int64_t pn = p1;
+      int64_t hash = 0;
+      int64_t d = 0;
+      for (p = p1; p <= p2; ++p) {
+        const int64_t e = ci[p];
+        if (w[e] != 0) {
+          const int64_t dext = w[e] - mark;
+          if (dext > 0) {
+            d += dext;
+            ci[pn++] = e;
+            hash += e;
+          } else {
+            cp[e] = flip(k);
+            w[e] = 0;
+          }
+        }
+      }
+      elen[i] = pn - p1 + 1;
+      const int64_t p3 = pn;
+      const int64_t p4 = p1 + len[i];
+      for (p = p2 + 1; p < p4; ++p) {
+        const int64_t j = ci[p];
+        const int64_t nvj = nv[j];
+        if (nvj <= 0) {
+          continue;
+        }
+        d += nvj;
+        ci[pn++] = j;
+        hash += j;
+      }
+      if (d == 0) {
+        // nothing outside Lk, eliminated along with k
+        cp[i] = flip(k);
+        const int64_t nvi = -nv[i];
+        dk -= nvi;
+        nvk += nvi;
+        nel += nvi;
+        nv[i] = 0;
+        elen[i] = -1;
+      } else {
+        degree[i] = std::min(degree[i], d);
+        ci[pn] = ci[p3];
+        ci[p3] = ci[p1];
+        ci[p1] = k;
+        len[i] = pn - p1 + 1;
+        hash %= n;
+        next[i] = hhead[hash];
+        hhead[hash] = i;
+        last[i] = hash;
+      }
+    }
+    degree[k] = dk;
+    lemax = std::max(lemax, dk);
+    mark = clear(mark + lemax, lemax);
+
+    // variables of Lk with the same hash and lists merge
+    for (int64_t pk = pk1; pk < pk2; ++pk) {
+      int64_t i = ci[pk];
+      if (nv[i] >= 0) {
+        continue;
+      }
+      const int64_t hash = last[i];
+      i = hhead[hash];
+      hhead[hash] = -1;
+      for (; i != -1 && next[i] != -1; i = next[i], ++mark) {
+        const int64_t ln = len[i];
+        const int64_t eln = elen[i];
+        for (p = cp[i] + 1; p <= cp[i] + ln - 1; ++p) {
+          w[ci[p]] = mark;
+        }
+        int64_t jlast = i;
+        for (int64_t j = next[i]; j != -1;) {
+          bool same = len[j] == ln && elen[j] == eln;
+          for (p = cp[j] + 1; same && p <= cp[j] + ln - 1; ++p) {
+            same = w[ci[p]] == mark;
+          }
+          if (same) {
+            cp[j] = flip(i);
+            nv[i] += nv[j];
+            nv[j] = 0;
+            elen[j] = -1;
+            j = next[j];
+            next[jlast] = j;
+          } else {
+            jlast = j;
+            j = next[j];
+          }
+        }
+      }
+    }
+
+    // the live variables of Lk go back into the degree lists
+    p = pk1;
+    for (int64_t pk = pk1; pk < pk2; ++pk) {
+      const int64_t i = ci[pk];
+      const int64_t nvi = -nv[i];
+      if (nvi <= 0) {
+        continue;
+      }
+      nv[i] = nvi;
+      const int64_t d = std::min(degree[i] + dk - nvi, n - nel - nvi);
+      if (head[d] != -1) {
+        last[head[d]] = i;
+      }
+      next[i] = head[d];
+      last[i] = -1;
+      head[d] = i;
+      mindeg = std::min(mindeg, d);
+      degree[i] = d;
+      ci[p++] = i;
+    }
+    nv[k] = nvk;
+    if ((len[k] = p - pk1) == 0) {
+      cp[k] = -1;
+      w[k] = 0;
+    }
+    if (elenk != 0) {
+      cnz = p;
+    }
+  }
+
+  // postorder of the assembly tree, absorbed variables next to the
+  // elements that took them
+  for (int64_t i = 0; i < n; ++i) {
+    cp[i] = flip(cp[i]);
+  }
+  std::fill(head.begin(), head.end(), -1);
+  for (int64_t j = n; j >= 0; --j) {
+    if (nv[j] > 0) {
+      continue;
+    }
+    next[j] = head[cp[j]];
+    head[cp[j]] = j;
+  }
+  for (int64_t e = n; e >= 0; --e) {
+    if (nv[e] <= 0 || cp[e] == -1) {
+      continue;
+    }
+    next[e] = head[cp[e]];
+    head[cp[e]] = e;
+  }
+  std::vector<uint32_t> order;
+  order.reserve(size);
+  std::vector<int64_t>& stack = w;
+  for (int64_t root = 0; root <= n; ++root) {
+    if (cp[root] != -1) {
+      continue;
+    }
+    int64_t top = 0;
+    stack[0] = root;
+    while (top >= 0) {
+      const int64_t node = stack[top];
+      const int64_t child = head[node];
+      if (child == -1) {
+        --top;
+        if (node < n) {
+          order.push_back(static_cast<uint32_t>(node));
+        }
+      } else {
+        head[node] = next[child];
+        stack[++top] = child;
+      }
+    }
+  }
+  return order;
+}
+
+// off-diagonal entries (r, c), r > c >= first, of the permuted lower
+// triangle by row for the elimination tree and by column for the supernode
+// structure, indexed from `first`. `for_each_entry` calls its argument on
+// each, repeats allowed.
+struct LowerPattern {
+  std::vector<size_t> row_first;
+  std::vector<uint32_t> row_columns;
+  std::vector<size_t> column_first;
+  std::vector<uint32_t> column_rows;
+};
+
+template <typename ForEachEntry>
+LowerPattern lower_pattern(const size_t first, const size_t n,
+                           ForEachEntry&& for_each_entry) {
+  const size_t m = n - first;
+  LowerPattern lower;
+  lower.row_first.assign(m + 1, 0);
+  lower.column_first.assign(m + 1, 0);
+  for_each_entry([&](const uint32_t r, const uint32_t c) {
+    ++lower.row_first[r - first + 1];
+    ++lower.column_first[c - first + 1];
+  });
+  for (size_t k = 0; k < m; ++k) {
+    lower.row_first[k + 1] += lower.row_first[k];
+    lower.column_first[k + 1] += lower.column_first[k];
+  }
+  lower.row_columns.resize(lower.row_first[m]);
+  lower.column_rows.resize(lower.column_first[m]);
+  std::vector<size_t> row_cursor(lower.row_first.begin(),
+                                 lower.row_first.end() - 1);
+  std::vector<size_t> column_cursor(lower.column_first.begin(),
+                                    lower.column_first.end() - 1);
+  for_each_entry([&](const uint32_t r, const uint32_t c) {
+    lower.row_columns[row_cursor[r - first]++] = c;
+    lower.column_rows[column_cursor[c - first]++] = r;
+  });
+  return lower;
+}
+
+// liu's algorithm with path compression for the parents of the columns
+// from `first` on, kNoIndex for roots
+void elimination_tree(const size_t first, const LowerPattern& lower,
+                      std::vector<uint32_t>& parent) {
+  const size_t n = parent.size();
+  std::fill(parent.begin() + static_cast<ptrdiff_t>(first), parent.end(),
+            kNoIndex);
+  std::vector<uint32_t> ancestor(n - first, kNoIndex);
+  for (auto k = static_cast<uint32_t>(first); k < n; ++k) {
+    for (size_t e = lower.row_first[k - first];
+         e < lower.row_first[k - first + 1]; ++e) {
+      uint32_t i = lower.row_columns[e];
+      while (i != kNoIndex && i < k) {
+        const uint32_t up = ancestor[i - first];
+        ancestor[i - first] = k;
+        if (up == kNoIndex) {
+          parent[i] = k;
+        }
+        i = up;
+      }
+    }
+  }
+}
+
+// depth-first postorder of a forest, children in ascending order
+std::vector<uint32_t> postorder(const std::vector<uint32_t>& parent) {
+  const size_t n = parent.size();
+  std::vector<uint32_t> head(n, kNoIndex), next(n, kNoIndex), order;
+  order.reserve(n);
+  for (size_t j = n; j-- > 0;) {
+    if (parent[j] != kNoIndex) {
+      next[j] = head[parent[j]];
+      head[parent[j]] = static_cast<uint32_t>(j);
+    }
+  }
+  std::vector<uint32_t> stack;
+  for (uint32_t root = 0; root < n; ++root) {
+    if (parent[root] != kNoIndex) {
+      continue;
+    }
+    stack.push_back(root);
+    while (!stack.empty()) {
+      const uint32_t node = stack.back();
+      const uint32_t child = head[node];
+      if (child == kNoIndex) {
+        stack.pop_back();
+        order.push_back(node);
+      } else {
+        head[node] = next[child];
+        stack.push_back(child);
+      }
+    }
+  }
+  return order;
+}
+
+// merging the last child s into its parent t makes every column of s as
+// tall as a column of t, adding zeros. the thresholds on the merged width
+// and share of zeros are those of cholmod's relaxed amalgamation.
+bool worth_merging(const size_t width, const size_t below,
+                   const double zeros) {
+  const double entries = static_cast<double>(width) *
+                         (static_cast<double>(width + 1) / 2.0 +
+                          static_cast<double>(below));
+  const double fraction = zeros / entries;
+  return width <= 4 || (width <= 16 && fraction < 0.8) ||
+         (width <= 48 && fraction < 0.1) || fraction < 0.05;
+}
+
+// A = U^T U in place on the first w rows of a w x h row-major block, the
+// upper triangle of its left w x w square and the rows right of it. false
+// on a pivot that is not positive. as the dense cholesky of least squares,
+// panels of rows are factorised in turn and the rows below a panel then
+// updated by all of it, in parallel for large blocks.
+bool cholesky_rows(double* u, const size_t w, const size_t h,
+                   const bool parallel) {
+  for (size_t j0 = 0; j0 < w; j0 += kPanel) {
+    const size_t j1 = std::min(w, j0 + kPanel);
+    for (size_t j = j0; j < j1; ++j) {
+      double* row = u + j * h;
+      if (!(row[j] > 0.0)) {
+        return false;
+      }
+      row[j] = std::sqrt(row[j]);
+      const double inverse = 1.0 / row[j];
+      for (size_t c = j + 1; c < h; ++c) {
+        row[c] *= inverse;
+      }
+      for (size_t i = j + 1; i < j1; ++i) {
+        subtract_scaled(u + i * h + i, row + i, row[i], h - i);
+      }
+    }
+    const auto update = [&](const size_t lo, const size_t hi) {
+      for (size_t i = lo; i < hi; ++i) {
+        size_t k = j0;
+        for (; k + 4 <= j1; k += 4) {
+          const double* rows[4];
+          double scales[4];
+          for (size_t r = 0; r < 4; ++r) {
+            rows[r] = u + (k + r) * h + i;
+            scales[r] = rows[r][0];
+          }
+          subtract_scaled4(u + i * h + i, rows, scales, h - i);
+        }
+        for (; k < j1; ++k) {
+          const double* panel = u + k * h;
+          subtract_scaled(u + i * h + i, panel + i, panel[i], h - i);
+        }
+      }
+    };
+    if (parallel) {
+      parallel_for(j1, w, update,
+                   std::max<size_t>(1, kMinDenseWork / (h * (j1 - j0))));
+    } else {
+      update(j1, w);
+    }
+  }
+  return true;
+}
+
+// an n x n pattern in the form of SparseMat
+std::expected<void, MatError> validate_pattern(
+    const size_t n, const std::span<const size_t> row_offsets,
+    const std::span<const uint32_t> columns) {
+  if (n == 0 || n >= kNoIndex || row_offsets.size() != n + 1 ||
+      row_offsets[0] != 0 || row_offsets[n] != columns.size()) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (row_offsets[i + 1] < row_offsets[i]) {
+      return std::unexpected(MatError::InvalidDimensions);
+    }
+    for (size_t e = row_offsets[i]; e < row_offsets[i + 1]; ++e) {
+      if (columns[e] >= n ||
+          (e > row_offsets[i] && columns[e] <= columns[e - 1])) {
+        return std::unexpected(MatError::OutOfBounds);
+      }
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+std::expected<void, MatError> SparseCholesky::analyze(
+    const SparseMat& a, const SparseOrdering ordering) {
+  if (a.rows() != a.cols()) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  return analyze(a.rows(), a.row_offsets(), a.column_indices(), ordering);
+}
+
+std::expected<void, MatError> SparseCholesky::analyze(
+    const size_t n, const std::span<const size_t> row_offsets,
+    const std::span<const uint32_t> columns, const SparseOrdering ordering) {
+  if (auto valid = validate_pattern(n, row_offsets, columns); !valid) {
+    return valid;
+  }
+  analyzed_ = factorized_ = false;
+  n_ = n;
+  row_offsets_.assign(row_offsets.begin(), row_offsets.end());
+  columns_.assign(columns.begin(), columns.end());
+
+  std::vector<uint32_t> order(n);
+  if (ordering == SparseOrdering::Amd) {
+    std::vector<int64_t> cp(n + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t e = row_offsets_[i]; e < row_offsets_[i + 1]; ++e) {
+        if (columns_[e] > i) {
+          ++cp[i + 1];
+          ++cp[columns_[e] + 1];
+        }
+      }
+    }
+    for (size_t k = 0; k < n; ++k) {
+      cp[k + 1] += cp[k];
+    }
+    std::vector<int64_t> ci(static_cast<size_t>(cp[n]));
+    std::vector<int64_t> cursor(cp.begin(), cp.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t e = row_offsets_[i]; e < row_offsets_[i + 1]; ++e) {
+        if (columns_[e] > i) {
+          ci[static_cast<size_t>(cursor[i]++)] = columns_[e];
+          ci[static_cast<size_t>(cursor[columns_[e]]++)] =
+              static_cast<int64_t>(i);
+        }
+      }
+    }
+    order = amd_order(static_cast<int64_t>(n), std::move(cp), std::move(ci));
+  } else {
+    for (size_t k = 0; k < n; ++k) {
+      order[k] = static_cast<uint32_t>(k);
+    }
+  }
+  symbolic(order);
+  return {};
+}
+
+std::expected<size_t, MatError> SparseCholesky::extend(
+    const size_t n, const std::span<const size_t> row_offsets,
+    const std::span<const uint32_t> columns,
+    const std::span<const double> values,
+    const std::span<const uint32_t> changed) {
+  if (auto valid = validate_pattern(n, row_offsets, columns); !valid) {
+    return std::unexpected(valid.error());
+  }
+  if (!factorized_ || n < n_ || values.size() != columns.size()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  for (const uint32_t i : changed) {
+    if (i >= n) {
+      return std::unexpected(MatError::OutOfBounds);
+    }
+  }
+  // the columns of U before the first changed or new row keep their
+  // structure and values, the analysis starts over at the supernode that
+  // holds that row
+  const size_t old_n = n_;
+  std::vector<uint32_t> changed_old;
+  size_t earliest = old_n;
+  for (const uint32_t i : changed) {
+    if (i < old_n) {
+      changed_old.push_back(i);
+      earliest = std::min<size_t>(earliest, inverse_[i]);
+    }
+  }
+  std::sort(changed_old.begin(), changed_old.end());
+  changed_old.erase(std::unique(changed_old.begin(), changed_old.end()),
+                    changed_old.end());
+  const size_t first = earliest == old_n
+                           ? old_n
+                           : supernodes_[row_supernode_[earliest]].first;
+  const size_t kept = first == 0 ? 0 : row_supernode_[first - 1] + 1;
+
+  // the old entries of a changed row are found along the new row, both
+  // walked from their ends. a pattern that lost one is not an extension.
+  const auto for_each_entry = [&](const uint32_t i, auto&& fn) {
+    size_t to = row_offsets[i + 1];
+    for (size_t e = row_offsets_[i + 1]; e-- > row_offsets_[i];) {
+      while (to > row_offsets[i] && columns[to - 1] > columns_[e]) {
+        --to;
+      }
+      if (to == row_offsets[i] || columns[to - 1] != columns_[e]) {
+        return false;
+      }
+      fn(e, --to);
+    }
+    return true;
+  };
+  for (const uint32_t i : changed_old) {
+    if (!for_each_entry(i, [](size_t, size_t) {})) {
+      return std::unexpected(MatError::IncompatibleDimensions);
+    }
+  }
+  // entries of the kept columns may have moved along their rows as entries
+  // were added before them. groups list their entries in the order of the
+  // pattern, so each is found by bisection, the last first to keep the
+  // group sorted while it is renumbered.
+  for (const uint32_t i : changed_old) {
+    for_each_entry(i, [&](const size_t e, const size_t to) {
+      const uint32_t c = std::min(inverse_[i], inverse_[columns_[e]]);
+      if (columns_[e] < i || c >= first ||
+          to - row_offsets[i] == e - row_offsets_[i]) {
+        return;
+      }
+      const uint32_t s = row_supernode_[c];
+      const Assembly key{i, static_cast<uint32_t>(e - row_offsets_[i]), 0};
+      const auto entry = std::lower_bound(
+          assembly_.begin() + static_cast<ptrdiff_t>(assembly_first_[s]),
+          assembly_.begin() + static_cast<ptrdiff_t>(assembly_first_[s + 1]),
+          key, [](const Assembly& x, const Assembly& y) {
+            return std::pair(x.row, x.index) < std::pair(y.row, y.index);
+          });
+      entry->index = static_cast<uint32_t>(to - row_offsets[i]);
+    });
+  }
+
+  const std::vector<Supernode> old_supernodes(
+      supernodes_.begin() + static_cast<ptrdiff_t>(kept), supernodes_.end());
+  const size_t kept_values =
+      old_supernodes.empty() ? values_.size() : old_supernodes[0].offset;
+  const std::vector<double> old_values(
+      values_.begin() + static_cast<ptrdiff_t>(kept_values), values_.end());
+  n_ = n;
+  row_offsets_.assign(row_offsets.begin(), row_offsets.end());
+  columns_.assign(columns.begin(), columns.end());
+  inverse_.resize(n);
+  for (size_t i = old_n; i < n; ++i) {
+    permutation_.push_back(static_cast<uint32_t>(i));
+    inverse_[i] = static_cast<uint32_t>(i);
+  }
+  restructure(first);
+
+  // the new rows and the changed ones reach the supernodes above them. a
+  // supernode above none of them has the rows and values it had, the same
+  // descendants contributing the same updates, and is copied over.
+  std::vector<uint8_t> active(supernodes_.size(), 0);
+  const auto activate = [&](const uint32_t row) {
+    for (uint32_t s = row_supernode_[row]; s != kNoIndex && !active[s];
+         s = supernodes_[s].parent) {
+      active[s] = 1;
+    }
+  };
+  for (const uint32_t i : changed) {
+    activate(inverse_[i]);
+  }
+  for (size_t k = old_n; k < n; ++k) {
+    activate(static_cast<uint32_t>(k));
+  }
+  size_t recomputed = 0;
+  for (size_t s = kept; s < supernodes_.size(); ++s) {
+    const Supernode& node = supernodes_[s];
+    if (!active[s]) {
+      const auto old = std::ranges::lower_bound(old_supernodes, node.first,
+                                                {}, &Supernode::first);
+      if (old != old_supernodes.end() && old->first == node.first &&
+          old->last == node.last && old->height == node.height) {
+        const auto source = old_values.begin() +
+                            static_cast<ptrdiff_t>(old->offset - kept_values);
+        std::copy(source,
+                  source + static_cast<ptrdiff_t>(
+                               (node.last - node.first) * node.height),
+                  values_.begin() + static_cast<ptrdiff_t>(node.offset));
+        continue;
+      }
+      active[s] = 1;
+    }
+    recomputed += node.last - node.first;
+  }
+  if (auto factored = numeric(values, active); !factored) {
+    return std::unexpected(factored.error());
+  }
+  return recomputed;
+}
+
+void SparseCholesky::symbolic(const std::vector<uint32_t>& order) {
+  const size_t n = n_;
+  inverse_.resize(n);
+  const auto invert = [&] {
+    for (size_t k = 0; k < n; ++k) {
+      inverse_[permutation_[k]] = static_cast<uint32_t>(k);
+    }
+  };
+  permutation_ = order;
+  invert();
+  // the postorder of the elimination tree leaves the fill alone and keeps
+  // the columns of each supernode chain together
+  std::vector<uint32_t> parent(n);
+  elimination_tree(0,
+                   lower_pattern(0, n,
+                                 [&](auto&& fn) {
+                                   for (size_t i = 0; i < n; ++i) {
+                                     for (size_t e = row_offsets_[i];
+                                          e < row_offsets_[i + 1]; ++e) {
+                                       if (columns_[e] > i) {
+                                         const uint32_t a = inverse_[i];
+                                         const uint32_t b =
+                                             inverse_[columns_[e]];
+                                         fn(std::max(a, b), std::min(a, b));
+                                       }
+                                     }
+                                   }
+                                 }),
+                   parent);
+  const std::vector<uint32_t> post = postorder(parent);
+  for (size_t k = 0; k < n; ++k) {
+    permutation_[k] = order[post[k]];
+  }
+  invert();
+  restructure(0);
+}
+
+void SparseCholesky::restructure(const size_t first) {
+  const size_t n = n_;
+  const size_t m = n - first;
+  const size_t kept = first == 0 ? 0 : row_supernode_[first - 1] + 1;
+  // the rows of A that are rows of U from `first` on, in the order of the
+  // pattern, whose entries are all that is read of it
+  std::vector<uint32_t> pattern_rows(
+      permutation_.begin() + static_cast<ptrdiff_t>(first),
+      permutation_.end());
+  std::sort(pattern_rows.begin(), pattern_rows.end());
+
+  // the entries of A between those rows, and for a kept supernode its rows
+  // below from `first` on as entries of the first column from `first` on
+  // above it. the kept supernodes are chains up to their last columns, the
+  // others having their parents in their own supernode, and every column
+  // on the tree path from a column to a row below it has that row too.
+  std::vector<uint32_t> exits(kept);
+  for (size_t s = kept; s-- > 0;) {
+    const uint32_t up = parent_[supernodes_[s].last - 1];
+    exits[s] = up == kNoIndex || up >= first ? up : exits[row_supernode_[up]];
+  }
+  const auto below_from_first = [&](const Supernode& node) {
+    const size_t below = node.height - (node.last - node.first);
+    const uint32_t* begin = below_rows_.data() + node.below;
+    return std::span<const uint32_t>(
+        std::lower_bound(begin, begin + below, static_cast<uint32_t>(first)),
+        begin + below);
+  };
+  const LowerPattern lower = lower_pattern(first, n, [&](auto&& fn) {
+    for (const uint32_t i : pattern_rows) {
+      for (size_t e = row_offsets_[i]; e < row_offsets_[i + 1]; ++e) {
+        const uint32_t a = inverse_[i];
+        const uint32_t b = inverse_[columns_[e]];
+        if (columns_[e] > i && std::min(a, b) >= first) {
+          fn(std::max(a, b), std::min(a, b));
+        }
+      }
+    }
+    for (size_t s = 0; s < kept; ++s) {
+      for (const uint32_t r : below_from_first(supernodes_[s])) {
+        if (r != exits[s]) {
+          fn(r, exits[s]);
+        }
+      }
+    }
+  });
+  parent_.resize(n);
+  elimination_tree(first, lower, parent_);
+
+  // column counts of U^T from the row subtrees: row r of U^T has entries
+  // in the columns on the tree paths from its entries up to r
+  std::vector<size_t> counts(m, 1);
+  std::vector<uint32_t> children(m, 0);
+  {
+    std::vector<uint32_t> visited(m, kNoIndex);
+    for (auto r = static_cast<uint32_t>(first); r < n; ++r) {
+      visited[r - first] = r;
+      for (size_t e = lower.row_first[r - first];
+           e < lower.row_first[r - first + 1]; ++e) {
+        for (uint32_t j = lower.row_columns[e]; visited[j - first] != r;
+             j = parent_[j]) {
+          ++counts[j - first];
+          visited[j - first] = r;
+        }
+      }
+      if (parent_[r] != kNoIndex) {
+        ++children[parent_[r] - first];
+      }
+    }
+    for (size_t s = 0; s < kept; ++s) {
+      const uint32_t up = parent_[supernodes_[s].last - 1];
+      if (up != kNoIndex && up >= first) {
+        ++children[up - first];
+      }
+    }
+  }
+
+  // fundamental supernodes, chains of columns each the only child of the
+  // next with one entry less, then merged with their last children while
+  // that adds few zeros
+  struct Candidate {
+    size_t first, last, below;
+    double zeros;
+  };
+  std::vector<Candidate> merged;
+  for (size_t j = first; j < n;) {
+    size_t last = j + 1;
+    while (last < n && parent_[last - 1] == last &&
+           counts[last - 1 - first] == counts[last - first] + 1 &&
+           children[last - first] == 1) {
+      ++last;
+    }
+    Candidate current{j, last, counts[last - 1 - first] - 1, 0.0};
+    while (!merged.empty() && merged.back().last == current.first &&
+           parent_[current.first - 1] != kNoIndex &&
+           parent_[current.first - 1] < current.last) {
+      const Candidate& child = merged.back();
+      const size_t child_width = child.last - child.first;
+      const size_t width = current.last - current.first;
+      const double zeros =
+          child.zeros + current.zeros +
+          static_cast<double>(child_width) *
+              static_cast<double>(width + current.below - child.below);
+      if (!worth_merging(child_width + width, current.below, zeros)) {
+        break;
+      }
+      current = {child.first, current.last, current.below, zeros};
+      merged.pop_back();
+    }
+    merged.push_back(current);
+    j = last;
+  }
+
+  supernodes_.resize(kept);
+  row_supernode_.resize(n);
+  for (const Candidate& candidate : merged) {
+    const auto s = static_cast<uint32_t>(supernodes_.size());
+    Supernode& node = supernodes_.emplace_back();
+    node.first = static_cast<uint32_t>(candidate.first);
+    node.last = static_cast<uint32_t>(candidate.last);
+    for (size_t j = candidate.first; j < candidate.last; ++j) {
+      row_supernode_[j] = s;
+    }
+  }
+  const size_t count = supernodes_.size();
+  std::vector<size_t> child_first(count + 1, 0);
+  for (size_t s = 0; s < count; ++s) {
+    const uint32_t up = parent_[supernodes_[s].last - 1];
+    supernodes_[s].parent = up == kNoIndex ? kNoIndex : row_supernode_[up];
+    if (up != kNoIndex) {
+      ++child_first[supernodes_[s].parent + 1];
+    }
+  }
+  for (size_t s = 0; s < count; ++s) {
+    child_first[s + 1] += child_first[s];
+  }
+  std::vector<uint32_t> child_list(child_first[count]);
+  {
+    std::vector<size_t> cursor(child_first.begin(), child_first.end() - 1);
+    for (size_t s = 0; s < count; ++s) {
+      if (supernodes_[s].parent != kNoIndex) {
+        child_list[cursor[supernodes_[s].parent]++] =
+            static_cast<uint32_t>(s);
+      }
+    }
+  }
+
+  // the columns of each supernode right of its own rows: the entries of A
+  // there and those of its children's columns
+  size_t offset = 0;
+  size_t kept_below = 0;
+  if (kept > 0) {
+    const Supernode& node = supernodes_[kept - 1];
+    const size_t width = node.last - node.first;
+    kept_below = node.below + node.height - width;
+    offset = node.offset + width * node.height;
+  }
+  below_rows_.resize(kept_below);
+  {
+    std::vector<uint32_t> visited(m, kNoIndex);
+    for (size_t s = kept; s < count; ++s) {
+      Supernode& node = supernodes_[s];
+      const auto tag = static_cast<uint32_t>(s);
+      node.below = below_rows_.size();
+      const auto add = [&](const uint32_t r) {
+        if (r >= node.last && visited[r - first] != tag) {
+          visited[r - first] = tag;
+          below_rows_.push_back(r);
+        }
+      };
+      for (uint32_t c = node.first; c < node.last; ++c) {
+        for (size_t e = lower.column_first[c - first];
+             e < lower.column_first[c - first + 1]; ++e) {
+          add(lower.column_rows[e]);
+        }
+      }
+      for (size_t k = child_first[s]; k < child_first[s + 1]; ++k) {
+        const Supernode& child = supernodes_[child_list[k]];
+        const size_t child_below =
+            child.height - (child.last - child.first);
+        for (size_t t = 0; t < child_below; ++t) {
+          add(below_rows_[child.below + t]);
+        }
+      }
+      std::sort(below_rows_.begin() + static_cast<ptrdiff_t>(node.below),
+                below_rows_.end());
+      const size_t width = node.last - node.first;
+      node.height = width + below_rows_.size() - node.below;
+      node.offset = offset;
+      offset += width * node.height;
+    }
+  }
+  max_height_ = 0;
+  for (const Supernode& node : supernodes_) {
+    max_height_ = std::max(max_height_, node.height);
+  }
+
+  // where each upper entry of A lands, grouped by supernode and in the
+  // order of the pattern
+  const auto target = [&](const uint32_t i, const size_t e) {
+    const uint32_t a = inverse_[i];
+    const uint32_t b = inverse_[columns_[e]];
+    const uint32_t r = std::max(a, b);
+    const uint32_t c = std::min(a, b);
+    const uint32_t s = row_supernode_[c];
+    const Supernode& node = supernodes_[s];
+    const size_t width = node.last - node.first;
+    size_t position = r - node.first;
+    if (r >= node.last) {
+      const auto first_row = below_rows_.begin() +
+                             static_cast<ptrdiff_t>(node.below);
+      const auto last_row =
+          first_row + static_cast<ptrdiff_t>(node.height - width);
+      position = width + static_cast<size_t>(
+                             std::lower_bound(first_row, last_row, r) -
+                             first_row);
+    }
+    return std::pair<uint32_t, Assembly>{
+        s, Assembly{i, static_cast<uint32_t>(e - row_offsets_[i]),
+                    node.offset + (c - node.first) * node.height + position}};
+  };
+  const auto for_each_entry = [&](auto&& fn) {
+    for (const uint32_t i : pattern_rows) {
+      for (size_t e = row_offsets_[i]; e < row_offsets_[i + 1]; ++e) {
+        if (columns_[e] >= i && inverse_[columns_[e]] >= first) {
+          fn(i, e);
+        }
+      }
+    }
+  };
+  assembly_first_.resize(count + 1);
+  std::fill(assembly_first_.begin() + static_cast<ptrdiff_t>(kept) + 1,
+            assembly_first_.end(), 0);
+  for_each_entry([&](const uint32_t i, const size_t e) {
+    const uint32_t c = std::min(inverse_[i], inverse_[columns_[e]]);
+    ++assembly_first_[row_supernode_[c] + 1];
+  });
+  for (size_t s = kept; s < count; ++s) {
+    assembly_first_[s + 1] += assembly_first_[s];
+  }
+  assembly_.resize(assembly_first_[count]);
+  {
+    std::vector<size_t> cursor(assembly_first_.begin(),
+                               assembly_first_.end() - 1);
+    for_each_entry([&](const uint32_t i, const size_t e) {
+      const auto [s, entry] = target(i, e);
+      assembly_[cursor[s]++] = entry;
+    });
+  }
+
+  // the supernodes each one updates, from runs of its rows below that fall
+  // in one supernode, and the work of each for the schedule. the kept
+  // supernodes update each other as before.
+  update_first_.resize(count + 1);
+  std::fill(update_first_.begin() + static_cast<ptrdiff_t>(kept) + 1,
+            update_first_.end(), 0);
+  updates_.resize(update_first_[kept]);
+  work_.resize(count);
+  std::fill(work_.begin() + static_cast<ptrdiff_t>(kept), work_.end(), 0.0);
+  const auto for_each_update = [&](auto&& fn) {
+    for (size_t s = 0; s < count; ++s) {
+      const Supernode& node = supernodes_[s];
+      const size_t width = node.last - node.first;
+      const size_t below = node.height - width;
+      const uint32_t* rows = below_rows_.data() + node.below;
+      for (auto t = static_cast<size_t>(
+               std::lower_bound(rows, rows + below, first) - rows);
+           t < below;) {
+        const uint32_t destination = row_supernode_[rows[t]];
+        size_t run = 1;
+        while (t + run < below &&
+               rows[t + run] < supernodes_[destination].last) {
+          ++run;
+        }
+        fn(destination, Update{static_cast<uint32_t>(s),
+                               static_cast<uint32_t>(width + t),
+                               static_cast<uint32_t>(run)});
+        t += run;
+      }
+    }
+  };
+  for_each_update([&](const uint32_t destination, const Update& update) {
+    ++update_first_[destination + 1];
+    const Supernode& source = supernodes_[update.source];
+    work_[destination] += static_cast<double>(update.count) *
+                          static_cast<double>(source.height - update.start) *
+                          static_cast<double>(source.last - source.first);
+  });
+  for (size_t s = kept; s < count; ++s) {
+    update_first_[s + 1] += update_first_[s];
+    const Supernode& node = supernodes_[s];
+    const double width = node.last - node.first;
+    work_[s] += width * width * static_cast<double>(node.height);
+  }
+  updates_.resize(update_first_[count]);
+  {
+    std::vector<size_t> cursor(update_first_.begin(),
+                               update_first_.end() - 1);
+    for_each_update([&](const uint32_t destination, const Update& update) {
+      updates_[cursor[destination]++] = update;
+    });
+  }
+
+  // independent subtrees for the threads: the heaviest subtree is split
+  // into its children, its root moving to the serial top, until none
+  // outweighs a share of the total. whole subtrees then go to the lightest
+  // bin, heaviest first.
+  std::vector<double> subtree(work_);
+  for (size_t s = 0; s < count; ++s) {
+    if (supernodes_[s].parent != kNoIndex) {
+      subtree[supernodes_[s].parent] += subtree[s];
+    }
+  }
+  double total = 0.0;
+  std::priority_queue<std::pair<double, uint32_t>> heaviest;
+  for (size_t s = 0; s < count; ++s) {
+    if (supernodes_[s].parent == kNoIndex) {
+      total += subtree[s];
+      heaviest.emplace(subtree[s], static_cast<uint32_t>(s));
+    }
+  }
+  const size_t threads =
+      std::min(num_threads(), std::max<size_t>(
+                                  1, static_cast<size_t>(
+                                         total / kMinParallelWork)));
+  top_.clear();
+  std::vector<std::pair<double, uint32_t>> roots;
+  while (!heaviest.empty()) {
+    const auto [weight, s] = heaviest.top();
+    heaviest.pop();
+    if (threads == 1 || weight <= total / static_cast<double>(4 * threads) ||
+        child_first[s] == child_first[s + 1]) {
+      roots.emplace_back(weight, s);
+      continue;
+    }
+    top_.push_back(s);
+    for (size_t k = child_first[s]; k < child_first[s + 1]; ++k) {
+      heaviest.emplace(subtree[child_list[k]], child_list[k]);
+    }
+  }
+  std::sort(top_.begin(), top_.end());
+  std::sort(roots.begin(), roots.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+  std::vector<double> load(threads, 0.0);
+  std::vector<uint32_t> bin_of(count, kNoIndex);
+  for (const uint32_t s : top_) {
+    bin_of[s] = static_cast<uint32_t>(threads);
+  }
+  for (const auto& [weight, s] : roots) {
+    const size_t bin = static_cast<size_t>(
+        std::min_element(load.begin(), load.end()) - load.begin());
+    load[bin] += weight;
+    bin_of[s] = static_cast<uint32_t>(bin);
+  }
+  // descendants come before their subtree root and follow it into its bin
+  bin_first_.assign(threads + 2, 0);
+  for (size_t s = count; s-- > 0;) {
+    if (bin_of[s] == kNoIndex) {
+      bin_of[s] = bin_of[supernodes_[s].parent];
+    }
+    ++bin_first_[bin_of[s] + 1];
+  }
+  bin_first_.pop_back();
+  for (size_t bin = 0; bin < threads; ++bin) {
+    bin_first_[bin + 1] += bin_first_[bin];
+  }
+  bin_supernodes_.resize(bin_first_[threads]);
+  {
+    std::vector<size_t> cursor(bin_first_.begin(), bin_first_.end() - 1);
+    for (size_t s = 0; s < count; ++s) {
+      if (bin_of[s] < threads) {
+        bin_supernodes_[cursor[bin_of[s]]++] = static_cast<uint32_t>(s);
+      }
+    }
+  }
+
+  // the values of the kept supernodes stay where they are
+  values_.resize(offset);
+  analyzed_columns_ = n - first;
+  analyzed_ = true;
+}
+
+std::expected<void, MatError> SparseCholesky::factorize(const SparseMat& a) {
+  if (!analyzed_ || a.rows() != n_ || a.cols() != n_ ||
+      !std::ranges::equal(a.row_offsets(), row_offsets_) ||
+      !std::ranges::equal(a.column_indices(), columns_)) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  const auto values = a.values();
+  input_.assign(values.begin(), values.end());
+  return numeric(input_, {});
+}
+
+std::expected<void, MatError> SparseCholesky::factorize(
+    const std::span<const double> values) {
+  if (!analyzed_ || values.size() != columns_.size()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  return numeric(values, {});
+}
+
+std::expected<size_t, MatError> SparseCholesky::refactorize(
+    const std::span<const double> values,
+    const std::span<const uint32_t> changed) {
+  if (!analyzed_ || values.size() != columns_.size()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  for (const uint32_t i : changed) {
+    if (i >= n_) {
+      return std::unexpected(MatError::OutOfBounds);
+    }
+  }
+  if (!factorized_) {
+    if (auto factored = numeric(values, {}); !factored) {
+      return std::unexpected(factored.error());
+    }
+    return n_;
+  }
+  // a changed row changes its column of U and every later column its
+  // update reaches, those of the supernodes up to the root
+  std::vector<uint8_t> active(supernodes_.size(), 0);
+  size_t columns = 0;
+  for (const uint32_t i : changed) {
+    for (uint32_t s = row_supernode_[inverse_[i]]; s != kNoIndex && !active[s];
+         s = supernodes_[s].parent) {
+      active[s] = 1;
+      columns += supernodes_[s].last - supernodes_[s].first;
+    }
+  }
+  if (auto factored = numeric(values, active); !factored) {
+    return std::unexpected(factored.error());
+  }
+  return columns;
+}
+
+std::expected<void, MatError> SparseCholesky::numeric(
+    const std::span<const double> values,
+    const std::vector<uint8_t>& active) {
+  factorized_ = false;
+  const auto selected = [&](const size_t s) {
+    return active.empty() || active[s] != 0;
+  };
+  const size_t bins = bin_first_.size() - 1;
+  std::vector<uint8_t> valid(bins, 1);
+  parallel_for_chunks(
+      0, bins,
+      [&](size_t, const size_t lo, const size_t hi) {
+        std::vector<uint32_t> positions(n_);
+        std::vector<double> buffer(max_height_);
+        for (size_t bin = lo; bin < hi; ++bin) {
+          for (size_t k = bin_first_[bin]; k < bin_first_[bin + 1]; ++k) {
+            const size_t s = bin_supernodes_[k];
+            if (selected(s) &&
+                !factor_supernode(s, values, positions, buffer, false)) {
+              valid[bin] = 0;
+              return;
+            }
+          }
+        }
+      },
+      1);
+  if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  std::vector<uint32_t> positions(top_.empty() ? 0 : n_);
+  std::vector<double> buffer(max_height_);
+  for (const uint32_t s : top_) {
+    if (selected(s) &&
+        !factor_supernode(s, values, positions, buffer, true)) {
+      return std::unexpected(MatError::InvalidParameter);
+    }
+  }
+  factorized_ = true;
+  return {};
+}
+
+bool SparseCholesky::factor_supernode(const size_t s,
+                                      const std::span<const double> values,
+                                      std::vector<uint32_t>& positions,
+                                      std::vector<double>& buffer,
+                                      const bool parallel) {
+  const Supernode& node = supernodes_[s];
+  const size_t width = node.last - node.first;
+  const size_t height = node.height;
+  double* u = values_.data() + node.offset;
+  std::fill(u, u + width * height, 0.0);
+  for (size_t k = assembly_first_[s]; k < assembly_first_[s + 1]; ++k) {
+    const Assembly& entry = assembly_[k];
+    values_[entry.position] += values[row_offsets_[entry.row] + entry.index];
+  }
+  for (size_t t = 0; t < width; ++t) {
+    positions[node.first + t] = static_cast<uint32_t>(t);
+  }
+  for (size_t t = width; t < height; ++t) {
+    positions[below_rows_[node.below + t - width]] = static_cast<uint32_t>(t);
+  }
+
+  // every row of the supernode takes the updates of its own descendants,
+  // so large ones split their rows across threads
+  double work = 0.0;
+  for (size_t k = update_first_[s]; k < update_first_[s + 1]; ++k) {
+    const Supernode& source = supernodes_[updates_[k].source];
+    work += static_cast<double>(updates_[k].count) *
+            static_cast<double>(source.height - updates_[k].start) *
+            static_cast<double>(source.last - source.first);
+  }
+  if (parallel && work > static_cast<double>(kMinParallelWork)) {
+    const size_t min_rows = std::max<size_t>(
+        1, static_cast<size_t>(static_cast<double>(width) *
+                               static_cast<double>(kMinDenseWork) / work));
+    parallel_for(
+        0, width,
+        [&](const size_t lo, const size_t hi) {
+          std::vector<double> local(max_height_);
+          apply_updates(s, lo, hi, positions, local);
+        },
+        min_rows);
+  } else {
+    apply_updates(s, 0, width, positions, buffer);
+  }
+  return cholesky_rows(u, width, height, parallel);
+}
+
+void SparseCholesky::apply_updates(const size_t s, const size_t row_begin,
+                                   const size_t row_end,
+                                   const std::vector<uint32_t>& positions,
+                                   std::vector<double>& buffer) {
+  const Supernode& node = supernodes_[s];
+  const size_t height = node.height;
+  double* u = values_.data() + node.offset;
+  for (size_t k = update_first_[s]; k < update_first_[s + 1]; ++k) {
+    const Update& update = updates_[k];
+    const Supernode& source = supernodes_[update.source];
+    const size_t source_width = source.last - source.first;
+    const size_t source_height = source.height;
+    const double* v = values_.data() + source.offset + update.start;
+    // the source's columns from update.start, the first update.count of
+    // them rows of this supernode
+    const uint32_t* rows =
+        below_rows_.data() + source.below + update.start - source_width;
+    const size_t q = source_height - update.start;
+    const size_t j0 = static_cast<size_t>(
+        std::lower_bound(rows, rows + update.count,
+                         node.first + static_cast<uint32_t>(row_begin)) -
+        rows);
+    const size_t j1 = static_cast<size_t>(
+        std::lower_bound(rows, rows + update.count,
+                         node.first + static_cast<uint32_t>(row_end)) -
+        rows);
+    // row j of the update, U_k[j]^T U_k[j:] summed over the source's rows,
+    // goes straight into place when the columns it spans are contiguous
+    // here too, through the buffer otherwise
+    const bool contiguous =
+        positions[rows[q - 1]] - positions[rows[0]] == q - 1;
+    for (size_t j = j0; j < j1; ++j) {
+      double* target = u + (rows[j] - node.first) * height;
+      const size_t length = q - j;
+      double* out = contiguous ? target + positions[rows[j]] : buffer.data();
+      if (!contiguous) {
+        std::fill(out, out + length, 0.0);
+      }
+      size_t c = 0;
+      for (; c + 4 <= source_width; c += 4) {
+        const double* columns[4];
+        double scales[4];
+        for (size_t t = 0; t < 4; ++t) {
+          columns[t] = v + (c + t) * source_height + j;
+          scales[t] = columns[t][0];
+        }
+        subtract_scaled4(out, columns, scales, length);
+      }
+      for (; c < source_width; ++c) {
+        const double* column = v + c * source_height + j;
+        subtract_scaled(out, column, column[0], length);
+      }
+      if (!contiguous) {
+        for (size_t i = 0; i < length; ++i) {
+          target[positions[rows[j + i]]] += out[i];
+        }
+      }
+    }
+  }
+}
+
+std::expected<void, MatError> SparseCholesky::solve(const Mat& b,
+                                                    Mat& x) const {
+  if (!factorized_) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (b.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (b.rows() != n_ || b.cols() == 0) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  const size_t k = b.cols();
+  if (&x != &b) {
+    ensure_shape(x, n_, k, 1);
+  }
+  parallel_for(0, k, [&](const size_t lo, const size_t hi) {
+    std::vector<double> y(n_);
+    for (size_t column = lo; column < hi; ++column) {
+      for (size_t i = 0; i < n_; ++i) {
+        y[i] = b(permutation_[i], column);
+      }
+      solve_permuted(y.data());
+      for (size_t i = 0; i < n_; ++i) {
+        x(permutation_[i], column) = static_cast<float>(y[i]);
+      }
+    }
+  });
+  return {};
+}
+
+std::expected<void, MatError> SparseCholesky::solve(
+    const std::span<double> x) const {
+  if (!factorized_) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (x.size() != n_) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  std::vector<double> y(n_);
+  for (size_t i = 0; i < n_; ++i) {
+    y[i] = x[permutation_[i]];
+  }
+  solve_permuted(y.data());
+  for (size_t i = 0; i < n_; ++i) {
+    x[permutation_[i]] = y[i];
+  }
+  return {};
+}
+
+void SparseCholesky::solve_permuted(double* y) const {
+  // U^T z = y by supernodes in order, each scattering into the rows below
+  for (const Supernode& node : supernodes_) {
+    const size_t width = node.last - node.first;
+    const double* u = values_.data() + node.offset;
+    const uint32_t* below = below_rows_.data() + node.below;
+    for (size_t k = 0; k < width; ++k) {
+      const double* row = u + k * node.height;
+      const double value = y[node.first + k] / row[k];
+      y[node.first + k] = value;
+      for (size_t t = k + 1; t < width; ++t) {
+        y[node.first + t] -= row[t] * value;
+      }
+      for (size_t t = width; t < node.height; ++t) {
+        y[below[t - width]] -= row[t] * value;
+      }
+    }
+  }
+  // U x = z in reverse, each gathering from the rows below
+  for (size_t s = supernodes_.size(); s-- > 0;) {
+    const Supernode& node = supernodes_[s];
+    const size_t width = node.last - node.first;
+    const double* u = values_.data() + node.offset;
+    const uint32_t* below = below_rows_.data() + node.below;
+    for (size_t k = width; k-- > 0;) {
+      const double* row = u + k * node.height;
+      double sum = y[node.first + k];
+      for (size_t t = k + 1; t < width; ++t) {
+        sum -= row[t] * y[node.first + t];
+      }
+      for (size_t t = width; t < node.height; ++t) {
+        sum -= row[t] * y[below[t - width]];
+      }
+      y[node.first + k] = sum / row[k];
+    }
+  }
+}
+
+};  // namespace core
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "core/mat.hpp"
+#include "core/sparse_mat.hpp"
+
+namespace core {
+
+enum class SparseOrdering {
+  Amd,     // approximate minimum degree, little fill on most graphs
+  Natural  // the rows as given, up to a postorder that keeps the fill
+};
+
+// A = U^T U for a sparse symmetric positive definite A, held as its upper
+// triangle in compressed sparse row form. entries below the diagonal are
+// ignored, so a matrix with both triangles works as is.
+//
+// analyze() orders the rows to keep the fill of U small and works out the
+// structure of U once, factorize() then only computes values, and can run
+// any number of times for matrices with that pattern. columns of U with
+// the same structure below them are grouped into supernodes, stored as
+// dense row-major blocks with U's rows as their rows, so the factorisation
+// runs as dense panel cholesky and block updates between supernodes.
+// independent subtrees of the supernode tree are factorised in parallel,
+// the few large supernodes above them with parallel dense kernels.
+//
+// values and the factor are double precision. the SparseMat overloads
+// convert the float entries.
+class SparseCholesky {
+ public:
+  [[nodiscard]] std::expected<void, MatError> analyze(
+      const SparseMat& a, SparseOrdering ordering = SparseOrdering::Amd);
+  // the pattern of an n x n matrix in the form of SparseMat, columns
+  // ascending within each row
+  [[nodiscard]] std::expected<void, MatError> analyze(
+      size_t n, std::span<const size_t> row_offsets,
+      std::span<const uint32_t> columns,
+      SparseOrdering ordering = SparseOrdering::Amd);
+
+  // IncompatibleDimensions if the pattern is not the analysed one,
+  // InvalidParameter if the matrix is not positive definite, which leaves
+  // no factor
+  [[nodiscard]] std::expected<void, MatError> factorize(const SparseMat& a);
+  // values in the order of the analysed pattern
+  [[nodiscard]] std::expected<void, MatError> factorize(
+      std::span<const double> values);
+  // refactorises after the entries of the given rows and columns changed,
+  // the rest equal to the last factorisation. only the supernodes holding
+  // them and their ancestors in the supernode tree are recomputed. returns
+  // the number of columns of U recomputed.
+  [[nodiscard]] std::expected<size_t, MatError> refactorize(
+      std::span<const double> values, std::span<const uint32_t> changed);
+  // analyses and factorises a pattern that holds the factorised one and
+  // grows it by rows at the end, as when an incremental problem gains
+  // variables. the old rows keep their order and the new ones go last.
+  // `changed` are the old rows whose entries changed or were added, both
+  // rows of each such entry. the structure of U is worked out again only
+  // from the supernode of the first of them in the order, the columns
+  // before it keep theirs, and only the supernodes above the new rows and
+  // the changed ones are recomputed. the rest of the factor is kept.
+  // IncompatibleDimensions for a pattern that lost an entry of a changed
+  // row, the factorisation then left as it was. returns the number of
+  // columns of U recomputed. the order drifts from a
+  // fill reducing one as rows are added, callers analyze() afresh once
+  // factor_size() has grown too much.
+  [[nodiscard]] std::expected<size_t, MatError> extend(
+      size_t n, std::span<const size_t> row_offsets,
+      std::span<const uint32_t> columns, std::span<const double> values,
+      std::span<const uint32_t> changed);
+
+  // A x = b for an n x k b, `x` keeps its buffer when the shape is
+  // unchanged and may be b
+  [[nodiscard]] std::expected<void, MatError> solve(const Mat& b,
+                                                    Mat& x) const;
+  // in place on a vector of n doubles
+  [[nodiscard]] std::expected<void, MatError> solve(
+      std::span<double> x) const;
+
+  [[nodiscard]] size_t size() const noexcept { return n_; }
+  [[nodiscard]] bool analyzed() const noexcept { return analyzed_; }
+  [[nodiscard]] bool factorized() const noexcept { return factorized_; }
+  // row k of U is row permutation()[k] of A
+  [[nodiscard]] std::span<const uint32_t> permutation() const noexcept {
+    return permutation_;
+  }
+  [[nodiscard]] size_t num_supernodes() const noexcept {
+    return supernodes_.size();
+  }
+  // entries of U stored, including those known to be zero that supernodes
+  // keep to stay dense
+  [[nodiscard]] size_t factor_size() const noexcept { return values_.size(); }
+  // columns of U whose structure the last analyze() or extend() worked out,
+  // the others kept from the analysis before
+  [[nodiscard]] size_t analyzed_columns() const noexcept {
+    return analyzed_columns_;
+  }
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  // rows [first, last) of U as a (last - first) x height block at `offset`
+  // of values_, its columns the rows themselves then the `height - (last -
+  // first)` columns of below_rows_ from `below`
+  struct Supernode {
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t parent = 0;
+    size_t height = 0;
+    size_t below = 0;
+    size_t offset = 0;
+  };
+  // rows [start, start + count) of supernode `source`'s columns fall in the
+  // rows of another supernode, which the product of those columns updates
+  struct Update {
+    uint32_t source = 0;
+    uint32_t start = 0;
+    uint32_t count = 0;
+  };
+  // an upper entry of A, `index` along its row, and its offset in values_
+  struct Assembly {
+    uint32_t row = 0;
+    uint32_t index = 0;
+    size_t position = 0;
+  };
+
+  // the structure of U for rows in `order`, new -> old, postordered by the
+  // elimination tree
+  void symbolic(const std::vector<uint32_t>& order);
+  // the structure of U from column `first` on, a supernode boundary, for
+  // the current pattern and order, that of the columns before it and their
+  // factor values kept. the pattern must have the same entries as before
+  // in those columns, only their places along the rows may have moved and
+  // the caller renumbers them.
+  void restructure(size_t first);
+  // all supernodes for an empty `active`, else those with a nonzero flag
+  std::expected<void, MatError> numeric(std::span<const double> values,
+                                        const std::vector<uint8_t>& active);
+  bool factor_supernode(size_t s, std::span<const double> values,
+                        std::vector<uint32_t>& positions,
+                        std::vector<double>& buffer, bool parallel);
+  void apply_updates(size_t s, size_t row_begin, size_t row_end,
+                     const std::vector<uint32_t>& positions,
+                     std::vector<double>& buffer);
+  void solve_permuted(double* y) const;
+
+  size_t n_ = 0;
+  bool analyzed_ = false;
+  bool factorized_ = false;
+  std::vector<size_t> row_offsets_;
+  std::vector<uint32_t> columns_;
+  std::vector<uint32_t> permutation_;
+  std::vector<uint32_t> inverse_;
+  size_t analyzed_columns_ = 0;
+
+  // the elimination tree over the rows of U, kNoIndex for roots
+  std::vector<uint32_t> parent_;
+  std::vector<Supernode> supernodes_;
+  std::vector<uint32_t> below_rows_;
+  std::vector<uint32_t> row_supernode_;
+  // upper input entries and their offsets into values_, grouped by
+  // supernode from assembly_first_ and sorted by row and index
+  std::vector<size_t> assembly_first_;
+  std::vector<Assembly> assembly_;
+  std::vector<size_t> update_first_;
+  std::vector<Update> updates_;
+  // multiply-adds of each supernode's factorisation, for the schedule
+  std::vector<double> work_;
+  // the supernodes of each thread's subtrees in order, from bin_first_,
+  // then the supernodes above them in order
+  std::vector<size_t> bin_first_;
+  std::vector<uint32_t> bin_supernodes_;
+  std::vector<uint32_t> top_;
+  size_t max_height_ = 0;
+
+  std::vector<double> values_;
+  std::vector<double> input_;
+};
+
+};  // namespace core
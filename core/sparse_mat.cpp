@@ -0,0 +1,340 @@
+#include "core/sparse_mat.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "core/parallel.hpp"
+#include "core/radix_sort.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinEntriesPerChunk = 1 << 14;
+constexpr size_t kMinRowsPerChunk = 16;
+constexpr size_t kMaxIndex = std::numeric_limits<uint32_t>::max();
+
+void ensure_shape(Mat& mat, const size_t rows, const size_t cols,
+                  const size_t channels) {
+  if (mat.rows() != rows || mat.cols() != cols ||
+      mat.channels() != channels) {
+    mat = Mat(rows, cols, channels);
+  }
+}
+
+// first row r in [0, rows] whose band position offsets[r] + r is at least
+// `position`, positions grow by one per row plus one per entry
+size_t row_at(const std::vector<size_t>& offsets, const size_t position) {
+  size_t lo = 0, hi = offsets.size() - 1;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (offsets[mid] + mid < position) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+size_t band_work(const std::vector<size_t>& offsets) {
+  return offsets.size() - 1 + offsets.back();
+}
+
+// runs fn(chunk, row_begin, row_end) over bands of rows that weigh about
+// the same counting one per row and one per entry
+template <typename Fn>
+void parallel_for_bands(const std::vector<size_t>& offsets, Fn&& fn) {
+  parallel_for_chunks(
+      0, band_work(offsets),
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        fn(chunk, row_at(offsets, lo), row_at(offsets, hi));
+      },
+      kMinEntriesPerChunk);
+}
+
+}  // namespace
+
+std::expected<SparseMat, MatError> SparseMat::from_triplets(
+    const size_t rows, const size_t cols,
+    const std::vector<Triplet>& triplets) {
+  if (rows == 0 || cols == 0 || rows > kMaxIndex + 1 ||
+      cols > kMaxIndex + 1 || triplets.size() > kMaxIndex) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  const size_t n = triplets.size();
+  std::vector<uint64_t> keys(n);
+  std::vector<uint32_t> order(n);
+  const size_t chunks = num_chunks(n, kMinEntriesPerChunk);
+  std::vector<uint8_t> outside(chunks, 0), unsorted(chunks, 0);
+  parallel_for_chunks(
+      0, n,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+          const Triplet& triplet = triplets[i];
+          outside[chunk] |= triplet.row >= rows || triplet.col >= cols;
+          keys[i] = uint64_t{triplet.row} * cols + triplet.col;
+          order[i] = static_cast<uint32_t>(i);
+        }
+      },
+      kMinEntriesPerChunk);
+  parallel_for_chunks(
+      0, n,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        for (size_t i = std::max<size_t>(lo, 1); i < hi; ++i) {
+          unsorted[chunk] |= keys[i] < keys[i - 1];
+        }
+      },
+      kMinEntriesPerChunk);
+  const auto any = [](const std::vector<uint8_t>& flags) {
+    return std::ranges::any_of(flags, [](const uint8_t f) { return f != 0; });
+  };
+  if (any(outside)) {
+    return std::unexpected(MatError::OutOfBounds);
+  }
+  // triplets assembled row by row skip the sort
+  if (any(unsorted)) {
+    radix_sort(keys, order);
+  }
+
+  // every run of equal keys becomes one entry, written by the chunk that
+  // holds its first triplet
+  std::vector<size_t> firsts(chunks + 1, 0);
+  parallel_for_chunks(
+      0, n,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        size_t count = 0;
+        for (size_t i = lo; i < hi; ++i) {
+          count += i == 0 || keys[i] != keys[i - 1];
+        }
+        firsts[chunk + 1] = count;
+      },
+      kMinEntriesPerChunk);
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    firsts[chunk + 1] += firsts[chunk];
+  }
+  const size_t nnz = firsts[chunks];
+  SparseMat sparse;
+  sparse.rows_ = rows;
+  sparse.cols_ = cols;
+  sparse.columns_.resize(nnz);
+  sparse.values_.resize(nnz);
+  std::vector<uint32_t> entry_rows(nnz);
+  parallel_for_chunks(
+      0, n,
+      [&](const size_t chunk, const size_t lo, const size_t hi) {
+        size_t entry = firsts[chunk];
+        for (size_t i = lo; i < hi; ++i) {
+          if (i != 0 && keys[i] == keys[i - 1]) {
+            continue;
+          }
+          const Triplet& first = triplets[order[i]];
+          float value = first.value;
+          for (size_t j = i + 1; j < n && keys[j] == keys[i]; ++j) {
+            value += triplets[order[j]].value;
+          }
+          entry_rows[entry] = first.row;
+          sparse.columns_[entry] = first.col;
+          sparse.values_[entry] = value;
+          ++entry;
+        }
+      },
+      kMinEntriesPerChunk);
+
+  // every entry opens the rows from the one after its predecessor's to its
+  // own, the rows past the last entry start at the end
+  sparse.offsets_.resize(rows + 1);
+  parallel_for(
+      0, nnz,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t e = lo; e < hi; ++e) {
+          const size_t first = e == 0 ? 0 : size_t{entry_rows[e - 1]} + 1;
+          for (size_t r = first; r <= entry_rows[e]; ++r) {
+            sparse.offsets_[r] = e;
+          }
+        }
+      },
+      kMinEntriesPerChunk);
+  const size_t last = nnz == 0 ? 0 : size_t{entry_rows[nnz - 1]} + 1;
+  std::fill(sparse.offsets_.begin() + static_cast<std::ptrdiff_t>(last),
+            sparse.offsets_.end(), nnz);
+  return sparse;
+}
+
+std::expected<SparseMat, MatError> SparseMat::from_dense(const Mat& dense) {
+  if (dense.size() == 0 || dense.rows() > kMaxIndex + 1 ||
+      dense.cols() > kMaxIndex + 1) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (dense.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  const size_t rows = dense.rows(), cols = dense.cols();
+  SparseMat sparse;
+  sparse.rows_ = rows;
+  sparse.cols_ = cols;
+  sparse.offsets_.assign(rows + 1, 0);
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t r = lo; r < hi; ++r) {
+          const float* row = dense.data() + r * cols;
+          sparse.offsets_[r + 1] = static_cast<size_t>(
+              std::count_if(row, row + cols,
+                            [](const float v) { return v != 0.0f; }));
+        }
+      },
+      kMinRowsPerChunk);
+  for (size_t r = 0; r < rows; ++r) {
+    sparse.offsets_[r + 1] += sparse.offsets_[r];
+  }
+  sparse.columns_.resize(sparse.offsets_[rows]);
+  sparse.values_.resize(sparse.offsets_[rows]);
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t r = lo; r < hi; ++r) {
+          const float* row = dense.data() + r * cols;
+          size_t entry = sparse.offsets_[r];
+          for (size_t c = 0; c < cols; ++c) {
+            if (row[c] != 0.0f) {
+              sparse.columns_[entry] = static_cast<uint32_t>(c);
+              sparse.values_[entry] = row[c];
+              ++entry;
+            }
+          }
+        }
+      },
+      kMinRowsPerChunk);
+  return sparse;
+}
+
+Mat SparseMat::to_dense() const {
+  Mat dense(rows_, cols_, 1, 0.0f);
+  for (size_t r = 0; r < rows_; ++r) {
+    for (size_t e = offsets_[r]; e < offsets_[r + 1]; ++e) {
+      dense(r, columns_[e]) = values_[e];
+    }
+  }
+  return dense;
+}
+
+std::expected<void, MatError> SparseMat::multiply(const Mat& x,
+                                                  Mat& y) const {
+  if (rows_ == 0 || x.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (x.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (x.rows() != cols_) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  const size_t k = x.cols();
+  ensure_shape(y, rows_, k, 1);
+  const float* in = x.data();
+  float* out = y.data();
+  parallel_for_bands(offsets_, [&](size_t, const size_t lo, const size_t hi) {
+    if (k == 1) {
+      for (size_t r = lo; r < hi; ++r) {
+        float sum = 0.0f;
+        for (size_t e = offsets_[r]; e < offsets_[r + 1]; ++e) {
+          sum += values_[e] * in[columns_[e]];
+        }
+        out[r] = sum;
+      }
+      return;
+    }
+    for (size_t r = lo; r < hi; ++r) {
+      float* __restrict row = out + r * k;
+      std::fill(row, row + k, 0.0f);
+      for (size_t e = offsets_[r]; e < offsets_[r + 1]; ++e) {
+        const float value = values_[e];
+        const float* __restrict source = in + size_t{columns_[e]} * k;
+        for (size_t j = 0; j < k; ++j) {
+          row[j] += value * source[j];
+        }
+      }
+    }
+  });
+  return {};
+}
+
+std::expected<void, MatError> SparseMat::transpose_multiply(const Mat& x,
+                                                            Mat& y) const {
+  if (rows_ == 0 || x.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (x.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (x.rows() != rows_) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  const size_t k = x.cols();
+  const size_t width = cols_ * k;
+  ensure_shape(y, cols_, k, 1);
+  std::fill(y.data(), y.data() + width, 0.0f);
+
+  // the first band scatters into y, the others into partial results
+  const size_t chunks = num_chunks(band_work(offsets_), kMinEntriesPerChunk);
+  std::vector<float> partials((chunks - 1) * width, 0.0f);
+  const float* in = x.data();
+  parallel_for_bands(offsets_, [&](const size_t chunk, const size_t lo,
+                                   const size_t hi) {
+    float* out = chunk == 0 ? y.data() : partials.data() + (chunk - 1) * width;
+    for (size_t r = lo; r < hi; ++r) {
+      const float* __restrict source = in + r * k;
+      for (size_t e = offsets_[r]; e < offsets_[r + 1]; ++e) {
+        const float value = values_[e];
+        float* __restrict row = out + size_t{columns_[e]} * k;
+        for (size_t j = 0; j < k; ++j) {
+          row[j] += value * source[j];
+        }
+      }
+    }
+  });
+  if (chunks > 1) {
+    parallel_for(
+        0, width,
+        [&](const size_t lo, const size_t hi) {
+          float* __restrict out = y.data();
+          for (size_t chunk = 1; chunk < chunks; ++chunk) {
+            const float* __restrict partial =
+                partials.data() + (chunk - 1) * width;
+            for (size_t i = lo; i < hi; ++i) {
+              out[i] += partial[i];
+            }
+          }
+        },
+        kMinEntriesPerChunk);
+  }
+  return {};
+}
+
+SparseMat SparseMat::transposed() const {
+  SparseMat transpose;
+  transpose.rows_ = cols_;
+  transpose.cols_ = rows_;
+  transpose.offsets_.assign(cols_ + 1, 0);
+  transpose.columns_.resize(nnz());
+  transpose.values_.resize(nnz());
+  for (const uint32_t col : columns_) {
+    ++transpose.offsets_[col + 1];
+  }
+  for (size_t c = 0; c < cols_; ++c) {
+    transpose.offsets_[c + 1] += transpose.offsets_[c];
+  }
+  // rows are visited in order, so every column of the transpose ascends
+  std::vector<size_t> cursor(transpose.offsets_.begin(),
+                             transpose.offsets_.end() - 1);
+  for (size_t r = 0; r < rows_; ++r) {
+    for (size_t e = offsets_[r]; e < offsets_[r + 1]; ++e) {
+      const size_t entry = cursor[columns_[e]]++;
+      transpose.columns_[entry] = static_cast<uint32_t>(r);
+      transpose.values_[entry] = values_[e];
+    }
+  }
+  return transpose;
+}
+
+};  // namespace core
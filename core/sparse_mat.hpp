@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <vector>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+struct Triplet {
+  uint32_t row = 0;
+  uint32_t col = 0;
+  float value = 0.0f;
+};
+
+// compressed sparse row matrix of floats. the entries of row r are
+// [row_offsets()[r], row_offsets()[r + 1]) of column_indices() and
+// values(), with ascending unique columns. the compressed sparse column
+// form of a matrix is the row form of its transpose, see transposed().
+//
+// products run over bands of rows holding about the same number of entries
+// and rows, so skewed rows do not leave threads idle. dense operands are
+// single channel Mats, a vector is a single column.
+class SparseMat {
+ public:
+  SparseMat() noexcept = default;
+
+  // duplicate entries are summed in input order, explicit zeros are kept
+  // as structural entries. the triplets are ordered by a parallel radix
+  // sort on (row, col).
+  [[nodiscard]] static std::expected<SparseMat, MatError> from_triplets(
+      size_t rows, size_t cols, const std::vector<Triplet>& triplets);
+  // the non-zero entries of a single channel Mat
+  [[nodiscard]] static std::expected<SparseMat, MatError> from_dense(
+      const Mat& dense);
+  [[nodiscard]] Mat to_dense() const;
+
+  [[nodiscard]] size_t rows() const noexcept { return rows_; }
+  [[nodiscard]] size_t cols() const noexcept { return cols_; }
+  [[nodiscard]] size_t nnz() const noexcept { return values_.size(); }
+
+  [[nodiscard]] std::span<const size_t> row_offsets() const noexcept {
+    return offsets_;
+  }
+  [[nodiscard]] std::span<const uint32_t> column_indices() const noexcept {
+    return columns_;
+  }
+  // values can be rewritten in place, keeping the sparsity pattern
+  [[nodiscard]] std::span<float> values() noexcept { return values_; }
+  [[nodiscard]] std::span<const float> values() const noexcept {
+    return values_;
+  }
+
+  // y = A x for a cols x k x, k = 1 is a matrix-vector product. `y` keeps
+  // its buffer when the shape is unchanged.
+  [[nodiscard]] std::expected<void, MatError> multiply(const Mat& x,
+                                                       Mat& y) const;
+  // y = A^T x for a rows x k x without forming the transpose, threads
+  // scatter into their own partial results which are then summed
+  [[nodiscard]] std::expected<void, MatError> transpose_multiply(
+      const Mat& x, Mat& y) const;
+
+  [[nodiscard]] SparseMat transposed() const;
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  size_t rows_ = 0;
+  size_t cols_ = 0;
+  std::vector<size_t> offsets_;  // rows_ + 1
+  std::vector<uint32_t> columns_;
+  std::vector<float> values_;
+};
+
+};  // namespace core
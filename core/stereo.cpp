@@ -0,0 +1,505 @@
+#include "core/stereo.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr int kCensusRadius = 2;
+constexpr float kCensusMaxCost = 24.0f;
+// sgm works on 8-bit costs, sad is scaled so a difference of 0.25 saturates
+constexpr float kSadScale = 128.0f;
+constexpr float kSadMaxCost = 32.0f;
+// larger than any path cost plus p1, keeps the d -+ 1 lookups in range
+constexpr int16_t kPathSentinel = std::numeric_limits<int16_t>::max() / 2;
+constexpr int kMaxPenalty = 1024;
+constexpr size_t kMinRowsPerChunk = 8;
+
+std::expected<void, MatError> validate(const Mat& left, const Mat& right,
+                                       const StereoParams& params) {
+  if (left.channels() != 1 || right.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (left.rows() != right.rows() || left.cols() != right.cols()) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+  if (left.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (params.min_disparity < 0 || params.num_disparities <= 0 ||
+      params.block_size < 1 || params.block_size % 2 == 0 || params.p1 < 0 ||
+      params.p2 < params.p1 || params.p2 > kMaxPenalty ||
+      (params.num_paths != 4 && params.num_paths != 8) ||
+      params.uniqueness_ratio < 0.0f) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+  return {};
+}
+
+// 24-bit signature of a 5x5 neighbourhood, bit set where neighbour < center
+std::vector<uint32_t> census_transform(const Mat& image) {
+  const int rows = static_cast<int>(image.rows());
+  const int cols = static_cast<int>(image.cols());
+  std::vector<uint32_t> signatures(image.size());
+  parallel_for(
+      0, image.rows(),
+      [&](const size_t lo, const size_t hi) {
+        for (int y = static_cast<int>(lo); y < static_cast<int>(hi); ++y) {
+          for (int x = 0; x < cols; ++x) {
+            const float center = image(y, x);
+            uint32_t signature = 0;
+            for (int dy = -kCensusRadius; dy <= kCensusRadius; ++dy) {
+              const int yy = std::clamp(y + dy, 0, rows - 1);
+              for (int dx = -kCensusRadius; dx <= kCensusRadius; ++dx) {
+                if (dy == 0 && dx == 0) {
+                  continue;
+                }
+                const int xx = std::clamp(x + dx, 0, cols - 1);
+                signature = (signature << 1) |
+                            static_cast<uint32_t>(image(yy, xx) < center);
+              }
+            }
+            signatures[y * cols + x] = signature;
+          }
+        }
+      },
+      kMinRowsPerChunk);
+  return signatures;
+}
+
+// branch-free bit count that vectorises without a hardware popcount
+inline uint32_t bit_count(uint32_t v) {
+  v = v - ((v >> 1) & 0x55555555u);
+  v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+  v = (v + (v >> 4)) & 0x0F0F0F0Fu;
+  v = v + (v >> 8);
+  return (v + (v >> 16)) & 0x3Fu;
+}
+
+struct CostInputs {
+  const Mat& left;
+  const Mat& right;
+  const std::vector<uint32_t>& census_left;
+  const std::vector<uint32_t>& census_right;
+  StereoCost method;
+  int min_disparity;
+  int num_disparities;
+  float sad_scale;
+  float sad_max;
+};
+
+// cost[x * D + d] of one row for disparity min_disparity + d, matches that
+// fall outside the right image get the maximum cost
+template <typename T>
+void compute_row_costs(const CostInputs& in, const size_t y, T* cost) {
+  const int cols = static_cast<int>(in.left.cols());
+  const int D = in.num_disparities;
+  const float max_cost =
+      in.method == StereoCost::Census ? kCensusMaxCost : in.sad_max;
+  const float* left_row = in.left.data() + y * cols;
+  const float* right_row = in.right.data() + y * cols;
+  const uint32_t* census_left = in.census_left.data() + y * cols;
+  const uint32_t* census_right = in.census_right.data() + y * cols;
+
+  for (int x = 0; x < cols; ++x) {
+    T* out = cost + static_cast<size_t>(x) * D;
+    const int in_view = std::clamp(x - in.min_disparity + 1, 0, D);
+    const int base = x - in.min_disparity;
+    if (in.method == StereoCost::Census) {
+      const uint32_t signature = census_left[x];
+      for (int d = 0; d < in_view; ++d) {
+        out[d] = static_cast<T>(
+            bit_count(signature ^ census_right[base - d]));
+      }
+    } else {
+      const float value = left_row[x];
+      for (int d = 0; d < in_view; ++d) {
+        out[d] = static_cast<T>(
+            std::min(std::fabs(value - right_row[base - d]) * in.sad_scale,
+                     in.sad_max));
+      }
+    }
+    std::fill(out + in_view, out + D, static_cast<T>(max_cost));
+  }
+}
+
+// winner-takes-all over one row of aggregated costs with uniqueness and
+// left-right checks, right disparities come from the same cost row by
+// searching along the diagonal x_left = x_right + disparity
+template <typename T>
+void select_row(const T* costs, const size_t cols, const StereoParams& params,
+                std::vector<int>& left_best, std::vector<int>& right_best,
+                float* out) {
+  const int D = params.num_disparities;
+  const int width = static_cast<int>(cols);
+
+  // min first, then its position, so the scan over d vectorises
+  for (int x = 0; x < width; ++x) {
+    const T* c = costs + static_cast<size_t>(x) * D;
+    T min_cost = c[0];
+    for (int d = 1; d < D; ++d) {
+      min_cost = std::min(min_cost, c[d]);
+    }
+    int best = 0;
+    while (c[best] != min_cost) {
+      ++best;
+    }
+    left_best[x] = best;
+  }
+  if (params.lr_max_diff >= 0) {
+    for (int xr = 0; xr < width; ++xr) {
+      int best = -1;
+      T best_cost = std::numeric_limits<T>::max();
+      const int last = std::min(D, width - xr - params.min_disparity);
+      for (int d = 0; d < last; ++d) {
+        const T value =
+            costs[static_cast<size_t>(xr + params.min_disparity + d) * D + d];
+        if (value < best_cost) {
+          best_cost = value;
+          best = d;
+        }
+      }
+      right_best[xr] = best;
+    }
+  }
+
+  for (int x = 0; x < width; ++x) {
+    const T* c = costs + static_cast<size_t>(x) * D;
+    const int best = left_best[x];
+    float disparity = static_cast<float>(params.min_disparity + best);
+
+    bool valid = x - params.min_disparity - best >= 0;
+    if (valid && params.uniqueness_ratio > 0.0f) {
+      // best cost outside the immediate neighbours of the winner
+      T runner_up = std::numeric_limits<T>::max();
+      for (int d = 0; d < best - 1; ++d) {
+        runner_up = std::min(runner_up, c[d]);
+      }
+      for (int d = best + 2; d < D; ++d) {
+        runner_up = std::min(runner_up, c[d]);
+      }
+      valid = static_cast<float>(runner_up) >
+              static_cast<float>(c[best]) * (1.0f + params.uniqueness_ratio);
+    }
+    if (valid && params.lr_max_diff >= 0) {
+      const int xr = x - params.min_disparity - best;
+      valid = right_best[xr] >= 0 &&
+              std::abs(right_best[xr] - best) <= params.lr_max_diff;
+    }
+    if (valid && params.subpixel && best > 0 && best < D - 1) {
+      const float c0 = static_cast<float>(c[best - 1]);
+      const float c1 = static_cast<float>(c[best]);
+      const float c2 = static_cast<float>(c[best + 1]);
+      const float denom = c0 - 2.0f * c1 + c2;
+      if (denom > 0.0f) {
+        disparity += (c0 - c2) / (2.0f * denom);
+      }
+    }
+    out[x] = valid ? disparity : kInvalidDisparity;
+  }
+}
+
+// one step of the sgm path recurrence for predecessor q of pixel p
+//   L(p, d) = C(p, d) + min(L(q, d), L(q, d -+ 1) + P1, min_k L(q, k) + P2)
+//             - min_k L(q, k)
+// prev and cur hold D + 2 entries with sentinels at both ends so the d -+ 1
+// neighbours need no bounds checks and the loop vectorises over d
+inline int16_t path_step(const uint8_t* __restrict cost,
+                         const int16_t* __restrict prev,
+                         const int16_t prev_min, int16_t* __restrict cur,
+                         int16_t* __restrict acc, const int D,
+                         const int16_t p1, const int16_t p2) {
+  const int16_t jump = static_cast<int16_t>(prev_min + p2);
+  int16_t cur_min = kPathSentinel;
+  for (int d = 0; d < D; ++d) {
+    const int16_t smooth =
+        std::min(std::min(prev[d + 1], jump),
+                 static_cast<int16_t>(std::min(prev[d], prev[d + 2]) + p1));
+    const int16_t value = static_cast<int16_t>(cost[d] + smooth - prev_min);
+    cur[d + 1] = value;
+    acc[d] = static_cast<int16_t>(acc[d] + value);
+    cur_min = std::min(cur_min, value);
+  }
+  return cur_min;
+}
+
+// zero path costs with sentinels, the state of a path before its first pixel
+void reset_path(int16_t* path, const int D) {
+  path[0] = kPathSentinel;
+  std::fill(path + 1, path + D + 1, int16_t{0});
+  path[D + 1] = kPathSentinel;
+}
+
+void aggregate_horizontal(const uint8_t* cost_row, int16_t* acc_row,
+                          const size_t cols, const int D, const int16_t p1,
+                          const int16_t p2, std::vector<int16_t>& prev,
+                          std::vector<int16_t>& cur) {
+  reset_path(prev.data(), D);
+  reset_path(cur.data(), D);
+  int16_t prev_min = 0;
+  for (size_t x = 0; x < cols; ++x) {
+    prev_min = path_step(cost_row + x * D, prev.data(), prev_min, cur.data(),
+                         acc_row + x * D, D, p1, p2);
+    std::swap(prev, cur);
+  }
+
+  reset_path(prev.data(), D);
+  prev_min = 0;
+  for (size_t x = cols; x-- > 0;) {
+    prev_min = path_step(cost_row + x * D, prev.data(), prev_min, cur.data(),
+                         acc_row + x * D, D, p1, p2);
+    std::swap(prev, cur);
+  }
+}
+
+// vertical (and optionally both diagonal) paths, rows depend on the previous
+// one so a sweep is sequential over y and keeps one row of path state per
+// direction
+void aggregate_sweep(const uint8_t* costs, int16_t* acc, const size_t rows,
+                     const size_t cols, const int D, const int16_t p1,
+                     const int16_t p2, const bool downward,
+                     const bool diagonals) {
+  constexpr int kOffsets[] = {0, -1, 1};
+  const int num_dirs = diagonals ? 3 : 1;
+  const size_t stride = D + 2;
+  const size_t row_stride = cols * stride;
+
+  std::vector<int16_t> prev(num_dirs * row_stride);
+  std::vector<int16_t> cur(num_dirs * row_stride);
+  std::vector<int16_t> prev_min(num_dirs * cols, 0);
+  std::vector<int16_t> cur_min(num_dirs * cols, 0);
+  std::vector<int16_t> start(stride);
+  reset_path(start.data(), D);
+  for (size_t i = 0; i < num_dirs * cols; ++i) {
+    reset_path(prev.data() + i * stride, D);
+    reset_path(cur.data() + i * stride, D);
+  }
+
+  for (size_t i = 0; i < rows; ++i) {
+    const size_t y = downward ? i : rows - 1 - i;
+    for (int dir = 0; dir < num_dirs; ++dir) {
+      for (size_t x = 0; x < cols; ++x) {
+        const long qx = static_cast<long>(x) + kOffsets[dir];
+        const bool has_pred =
+            i > 0 && qx >= 0 && qx < static_cast<long>(cols);
+        const int16_t* q =
+            has_pred ? prev.data() + dir * row_stride + qx * stride
+                     : start.data();
+        const int16_t q_min = has_pred ? prev_min[dir * cols + qx] : 0;
+        const size_t p = y * cols + x;
+        cur_min[dir * cols + x] =
+            path_step(costs + p * D, q, q_min,
+                      cur.data() + dir * row_stride + x * stride,
+                      acc + p * D, D, p1, p2);
+      }
+    }
+    std::swap(prev, cur);
+    std::swap(prev_min, cur_min);
+  }
+}
+
+};  // namespace
+
+std::expected<Mat, MatError> block_match(const Mat& left, const Mat& right,
+                                         const StereoParams& params) {
+  if (auto valid = validate(left, right, params); !valid) {
+    return std::unexpected(valid.error());
+  }
+
+  const size_t rows = left.rows();
+  const size_t cols = left.cols();
+  const int D = params.num_disparities;
+  const size_t row_size = cols * D;
+  const int radius = params.block_size / 2;
+  const int window = params.block_size;
+
+  std::vector<uint32_t> census_left, census_right;
+  if (params.cost == StereoCost::Census) {
+    census_left = census_transform(left);
+    census_right = census_transform(right);
+  }
+  // raw sad on [0, 1] images, out of view matches cost a full intensity step
+  const CostInputs inputs{left,        right,
+                          census_left, census_right,
+                          params.cost, params.min_disparity,
+                          D,           1.0f,
+                          1.0f};
+
+  Mat disparity(rows, cols, 1);
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        // ring of the last `window` cost rows, column sums over the ring and
+        // the box aggregated row are updated incrementally
+        std::vector<float> ring(window * row_size);
+        std::vector<float> column_sum(row_size, 0.0f);
+        std::vector<float> aggregated(row_size);
+        std::vector<int> left_best(cols), right_best(cols);
+        const auto clamp_row = [rows](const long y) {
+          return static_cast<size_t>(
+              std::clamp<long>(y, 0, static_cast<long>(rows) - 1));
+        };
+        const auto slot = [window](const long y) {
+          return static_cast<size_t>(((y % window) + window) % window);
+        };
+
+        for (long y = static_cast<long>(lo) - radius;
+             y <= static_cast<long>(lo) + radius; ++y) {
+          float* row = ring.data() + slot(y) * row_size;
+          compute_row_costs(inputs, clamp_row(y), row);
+          for (size_t i = 0; i < row_size; ++i) {
+            column_sum[i] += row[i];
+          }
+        }
+
+        for (size_t y = lo; y < hi; ++y) {
+          if (y > lo) {
+            const long incoming = static_cast<long>(y) + radius;
+            float* row = ring.data() + slot(incoming) * row_size;
+            // the slot being overwritten holds row y - radius - 1
+            for (size_t i = 0; i < row_size; ++i) {
+              column_sum[i] -= row[i];
+            }
+            compute_row_costs(inputs, clamp_row(incoming), row);
+            for (size_t i = 0; i < row_size; ++i) {
+              column_sum[i] += row[i];
+            }
+          }
+
+          const auto column = [&](const long x) {
+            return column_sum.data() +
+                   std::clamp<long>(x, 0, static_cast<long>(cols) - 1) * D;
+          };
+          std::fill(aggregated.begin(), aggregated.begin() + D, 0.0f);
+          for (long k = -radius; k <= radius; ++k) {
+            const float* c = column(k);
+            for (int d = 0; d < D; ++d) {
+              aggregated[d] += c[d];
+            }
+          }
+          for (size_t x = 1; x < cols; ++x) {
+            const float* add = column(static_cast<long>(x) + radius);
+            const float* sub = column(static_cast<long>(x) - radius - 1);
+            const float* prev = aggregated.data() + (x - 1) * D;
+            float* cur = aggregated.data() + x * D;
+            for (int d = 0; d < D; ++d) {
+              cur[d] = prev[d] + add[d] - sub[d];
+            }
+          }
+
+          select_row(aggregated.data(), cols, params, left_best, right_best,
+                     disparity.data() + y * cols);
+        }
+      },
+      kMinRowsPerChunk);
+  return disparity;
+}
+
+std::expected<Mat, MatError> semi_global_match(const Mat& left,
+                                               const Mat& right,
+                                               const StereoParams& params) {
+  if (auto valid = validate(left, right, params); !valid) {
+    return std::unexpected(valid.error());
+  }
+
+  const size_t rows = left.rows();
+  const size_t cols = left.cols();
+  const int D = params.num_disparities;
+  const size_t row_size = cols * D;
+  const auto p1 = static_cast<int16_t>(params.p1);
+  const auto p2 = static_cast<int16_t>(params.p2);
+
+  std::vector<uint32_t> census_left, census_right;
+  if (params.cost == StereoCost::Census) {
+    census_left = census_transform(left);
+    census_right = census_transform(right);
+  }
+  const CostInputs inputs{left,        right,
+                          census_left, census_right,
+                          params.cost, params.min_disparity,
+                          D,           kSadScale,
+                          kSadMaxCost};
+
+  std::vector<uint8_t> costs(rows * row_size);
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t y = lo; y < hi; ++y) {
+          compute_row_costs(inputs, y, costs.data() + y * row_size);
+        }
+      },
+      kMinRowsPerChunk);
+
+  // horizontal paths are independent per row, the downward sweep then adds
+  // into the same buffer while the upward sweep fills a second one
+  std::vector<int16_t> forward(rows * row_size, 0);
+  std::vector<int16_t> backward(rows * row_size, 0);
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        std::vector<int16_t> prev(D + 2), cur(D + 2);
+        for (size_t y = lo; y < hi; ++y) {
+          aggregate_horizontal(costs.data() + y * row_size,
+                               forward.data() + y * row_size, cols, D, p1, p2,
+                               prev, cur);
+        }
+      },
+      kMinRowsPerChunk);
+
+  const bool diagonals = params.num_paths == 8;
+  parallel_for(0, 2, [&](const size_t lo, const size_t hi) {
+    for (size_t sweep = lo; sweep < hi; ++sweep) {
+      const bool downward = sweep == 0;
+      aggregate_sweep(costs.data(),
+                      downward ? forward.data() : backward.data(), rows, cols,
+                      D, p1, p2, downward, diagonals);
+    }
+  });
+
+  Mat disparity(rows, cols, 1);
+  parallel_for(
+      0, rows,
+      [&](const size_t lo, const size_t hi) {
+        std::vector<int16_t> total(row_size);
+        std::vector<int> left_best(cols), right_best(cols);
+        for (size_t y = lo; y < hi; ++y) {
+          const int16_t* f = forward.data() + y * row_size;
+          const int16_t* b = backward.data() + y * row_size;
+          for (size_t i = 0; i < row_size; ++i) {
+            total[i] = static_cast<int16_t>(f[i] + b[i]);
+          }
+          select_row(total.data(), cols, params, left_best, right_best,
+                     disparity.data() + y * cols);
+        }
+      },
+      kMinRowsPerChunk);
+  return disparity;
+}
+
+std::expected<Mat, MatError> disparity_to_depth(const Mat& disparity,
+                                                const float focal_px,
+                                                const float baseline) {
+  if (disparity.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (!(focal_px > 0.0f) || !(baseline > 0.0f)) {
+    return std::unexpected(MatError::InvalidParameter);
+  }
+
+  const float scale = focal_px * baseline;
+  Mat depth(disparity.rows(), disparity.cols(), 1);
+  const float* in = disparity.data();
+  float* out = depth.data();
+  for (size_t i = 0; i < disparity.size(); ++i) {
+    out[i] = in[i] > 0.0f ? scale / in[i] : 0.0f;
+  }
+  return depth;
+}
+
+};  // namespace core
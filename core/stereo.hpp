@@ -0,0 +1,53 @@
+#pragma once
+
+#include <expected>
+
+#include "core/mat.hpp"
+
+namespace core {
+
+// disparity value written for pixels without a reliable match
+inline constexpr float kInvalidDisparity = -1.0f;
+
+enum class StereoCost {
+  Sad,     // absolute intensity difference
+  Census,  // hamming distance of 5x5 census signatures
+};
+
+struct StereoParams {
+  int min_disparity = 0;
+  int num_disparities = 64;
+  // odd window size used by block matching (ignored by sgm)
+  int block_size = 9;
+  StereoCost cost = StereoCost::Census;
+
+  // sgm smoothness penalties in matching cost units, census costs are in
+  // [0, 24] and sad costs in [0, 32]
+  int p1 = 3;
+  int p2 = 24;
+  // 4 (horizontal + vertical) or 8 (adds diagonals)
+  int num_paths = 8;
+
+  // best cost must beat the runner up by this fraction, 0 disables
+  float uniqueness_ratio = 0.05f;
+  // max left-right disparity disagreement in pixels, negative disables
+  int lr_max_diff = 1;
+  bool subpixel = true;
+};
+
+// local block matching over rectified single channel images, left is the
+// reference view and disparities are measured as x_left - x_right
+[[nodiscard]] std::expected<Mat, MatError> block_match(
+    const Mat& left, const Mat& right, const StereoParams& params = {});
+
+// semi-global matching (Hirschmuller 2008) with per-pixel matching costs and
+// 4 or 8 aggregation paths
+[[nodiscard]] std::expected<Mat, MatError> semi_global_match(
+    const Mat& left, const Mat& right, const StereoParams& params = {});
+
+// metric depth from disparity, depth = focal_px * baseline / disparity, 0 for
+// invalid or non-positive disparities
+[[nodiscard]] std::expected<Mat, MatError> disparity_to_depth(
+    const Mat& disparity, const float focal_px, const float baseline);
+
+};  // namespace core
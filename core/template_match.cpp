@@ -0,0 +1,566 @@
+#include "core/template_match.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "core/parallel.hpp"
+
+namespace core {
+namespace {
+
+constexpr size_t kMinRowsPerChunk = 8;
+constexpr size_t kMinValuesPerChunk = 1 << 14;
+// columns transformed together, their values stay in cache over all stages
+constexpr size_t kColumnTile = 64;
+// cost of a transform per value and stage, in multiply-adds of the direct
+// correlation
+constexpr double kTransformCost = 4.0;
+// windows and templates with less variance per pixel than this are flat
+constexpr double kFlatVariance = 1e-10;
+
+void ensure_shape(Mat& mat, const size_t rows, const size_t cols,
+                  const size_t channels) {
+  if (mat.rows() != rows || mat.cols() != cols ||
+      mat.channels() != channels) {
+    mat = Mat(rows, cols, channels);
+  }
+}
+
+size_t next_power_of_two(const size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power *= 2;
+  }
+  return power;
+}
+
+void plan(const size_t n, std::vector<uint32_t>& reversed,
+          std::vector<float>& cos, std::vector<float>& sin) {
+  reversed.assign(n, 0);
+  for (size_t i = 1; i < n; ++i) {
+    reversed[i] = static_cast<uint32_t>((reversed[i >> 1] >> 1) |
+                                        ((i & 1) != 0 ? n >> 1 : 0));
+  }
+  cos.assign(n, 0.0f);
+  sin.assign(n, 0.0f);
+  for (size_t half = 1; half < n; half *= 2) {
+    for (size_t j = 0; j < half; ++j) {
+      const double angle = std::numbers::pi * static_cast<double>(j) /
+                           static_cast<double>(half);
+      cos[half + j] = static_cast<float>(std::cos(angle));
+      sin[half + j] = static_cast<float>(-std::sin(angle));
+    }
+  }
+}
+
+// (a, b) <- (a + w b, a - w b) over values [lo, hi) of the four arrays
+void butterfly(float* __restrict ar, float* __restrict ai,
+               float* __restrict br, float* __restrict bi, const float wr,
+               const float wi, const size_t lo, const size_t hi) {
+  for (size_t x = lo; x < hi; ++x) {
+    const float tr = br[x] * wr - bi[x] * wi;
+    const float ti = br[x] * wi + bi[x] * wr;
+    br[x] = ar[x] - tr;
+    bi[x] = ai[x] - ti;
+    ar[x] += tr;
+    ai[x] += ti;
+  }
+}
+
+// (a_j, b_j) <- (a_j + w_j b_j, a_j - w_j b_j) for j in [0, n)
+void twiddled_butterflies(float* __restrict ar, float* __restrict ai,
+                          float* __restrict br, float* __restrict bi,
+                          const float* __restrict wr,
+                          const float* __restrict wi, const size_t n) {
+  for (size_t j = 0; j < n; ++j) {
+    const float tr = br[j] * wr[j] - bi[j] * wi[j];
+    const float ti = br[j] * wi[j] + bi[j] * wr[j];
+    br[j] = ar[j] - tr;
+    bi[j] = ai[j] - ti;
+    ar[j] += tr;
+    ai[j] += ti;
+  }
+}
+
+// forward transform of one contiguous complex sequence. the first two
+// stages run as one radix-4 pass, their twiddles are 1 and -i.
+void fft(float* re, float* im, const std::vector<uint32_t>& reversed,
+         const std::vector<float>& cos, const std::vector<float>& sin) {
+  const size_t n = reversed.size();
+  for (size_t i = 0; i < n; ++i) {
+    const size_t j = reversed[i];
+    if (i < j) {
+      std::swap(re[i], re[j]);
+      std::swap(im[i], im[j]);
+    }
+  }
+  size_t half = 1;
+  if (n >= 4) {
+    for (size_t i = 0; i < n; i += 4) {
+      const float ar = re[i] + re[i + 1], ai = im[i] + im[i + 1];
+      const float br = re[i] - re[i + 1], bi = im[i] - im[i + 1];
+      const float cr = re[i + 2] + re[i + 3], ci = im[i + 2] + im[i + 3];
+      const float dr = re[i + 2] - re[i + 3], di = im[i + 2] - im[i + 3];
+      re[i] = ar + cr;
+      im[i] = ai + ci;
+      re[i + 1] = br + di;
+      im[i + 1] = bi - dr;
+      re[i + 2] = ar - cr;
+      im[i + 2] = ai - ci;
+      re[i + 3] = br - di;
+      im[i + 3] = bi + dr;
+    }
+    half = 4;
+  }
+  for (; half < n; half *= 2) {
+    for (size_t i = 0; i < n; i += 2 * half) {
+      twiddled_butterflies(re + i, im + i, re + i + half, im + i + half,
+                           cos.data() + half, sin.data() + half, half);
+    }
+  }
+}
+
+// forward transforms down columns [lo, hi) of a block of rows `width`
+// values apart, every butterfly running along the rows
+void fft_columns(float* re, float* im, const size_t width, const size_t lo,
+                 const size_t hi, const std::vector<uint32_t>& reversed,
+                 const std::vector<float>& cos,
+                 const std::vector<float>& sin) {
+  const size_t n = reversed.size();
+  for (size_t i = 0; i < n; ++i) {
+    const size_t j = reversed[i];
+    if (i < j) {
+      std::swap_ranges(re + i * width + lo, re + i * width + hi,
+                       re + j * width + lo);
+      std::swap_ranges(im + i * width + lo, im + i * width + hi,
+                       im + j * width + lo);
+    }
+  }
+  for (size_t half = 1; half < n; half *= 2) {
+    for (size_t i = 0; i < n; i += 2 * half) {
+      for (size_t j = 0; j < half; ++j) {
+        const size_t a = (i + j) * width, b = (i + j + half) * width;
+        butterfly(re + a, im + a, re + b, im + b, cos[half + j],
+                  sin[half + j], lo, hi);
+      }
+    }
+  }
+}
+
+// out[x] += sum of taps[k] * in[x + k] over four taps
+void correlate_taps(float* __restrict out, const float* __restrict in,
+                    const float* taps, const size_t n) {
+  const float t0 = taps[0], t1 = taps[1], t2 = taps[2], t3 = taps[3];
+  for (size_t x = 0; x < n; ++x) {
+    out[x] += t0 * in[x] + t1 * in[x + 1] + t2 * in[x + 2] + t3 * in[x + 3];
+  }
+}
+
+void correlate_tap(float* __restrict out, const float* __restrict in,
+                   const float tap, const size_t n) {
+  for (size_t x = 0; x < n; ++x) {
+    out[x] += tap * in[x];
+  }
+}
+
+// parabola vertex through (-1, left), (0, centre), (1, right)
+float vertex(const float left, const float centre, const float right) {
+  const float curvature = left - 2.0f * centre + right;
+  if (curvature == 0.0f) {
+    return 0.0f;
+  }
+  return std::clamp(0.5f * (left - right) / curvature, -0.5f, 0.5f);
+}
+
+}  // namespace
+
+std::expected<void, MatError> TemplateMatcher::set_template(
+    const Mat& templ) {
+  if (templ.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  template_rows_ = templ.rows();
+  template_cols_ = templ.cols();
+  template_channels_ = templ.channels();
+  const size_t area = template_rows_ * template_cols_;
+  template_planes_.resize(area * template_channels_);
+  template_energy_ = 0.0;
+  for (size_t c = 0; c < template_channels_; ++c) {
+    float* plane = template_planes_.data() + c * area;
+    double sum = 0.0;
+    for (size_t i = 0; i < area; ++i) {
+      plane[i] = templ.data()[i * template_channels_ + c];
+      sum += plane[i];
+    }
+    if (method_ == TemplateMethod::NormedCrossCorrelation) {
+      const auto mean = static_cast<float>(sum / static_cast<double>(area));
+      for (size_t i = 0; i < area; ++i) {
+        plane[i] -= mean;
+      }
+    }
+    for (size_t i = 0; i < area; ++i) {
+      template_energy_ += static_cast<double>(plane[i]) * plane[i];
+    }
+  }
+  // the cached spectra belong to the previous template
+  fft_rows_ = 0;
+  fft_cols_ = 0;
+  return {};
+}
+
+std::expected<void, MatError> TemplateMatcher::match(const Mat& image,
+                                                     Mat& scores) {
+  if (template_planes_.empty() || image.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (image.channels() != template_channels_) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  if (image.rows() < template_rows_ || image.cols() < template_cols_) {
+    return std::unexpected(MatError::IncompatibleDimensions);
+  }
+
+  const size_t rows = image.rows(), cols = image.cols();
+  const size_t channels = template_channels_;
+  const size_t out_rows = rows - template_rows_ + 1;
+  const size_t out_cols = cols - template_cols_ + 1;
+  ensure_shape(scores, out_rows, out_cols, 1);
+  if (channels > 1) {
+    image_planes_.resize(rows * cols * channels);
+    parallel_for(
+        0, rows,
+        [&](const size_t lo, const size_t hi) {
+          for (size_t i = lo * cols; i < hi * cols; ++i) {
+            for (size_t c = 0; c < channels; ++c) {
+              image_planes_[c * rows * cols + i] =
+                  image.data()[i * channels + c];
+            }
+          }
+        },
+        kMinRowsPerChunk);
+  }
+
+  const auto direct = static_cast<double>(out_rows * out_cols) *
+                      static_cast<double>(template_planes_.size());
+  const auto padded = static_cast<double>(next_power_of_two(rows) *
+                                          next_power_of_two(cols));
+  const double spectral = kTransformCost * padded * std::log2(padded) *
+                          static_cast<double>(channels + 1);
+  if (direct <= spectral) {
+    correlate_direct(image, scores);
+  } else {
+    correlate_spectra(image, scores);
+  }
+
+  if (method_ != TemplateMethod::CrossCorrelation) {
+    auto computed = integral_.compute(image);
+    if (!computed) {
+      return computed;
+    }
+    normalise(scores);
+  }
+  return {};
+}
+
+void TemplateMatcher::transform(const float* plane, const size_t rows,
+                                const size_t cols, float* re,
+                                float* im) const {
+  // rows are transformed in pairs, one as the real and one as the imaginary
+  // part of a complex sequence, and separated by the symmetry of the
+  // spectra of real sequences
+  const size_t width = fft_cols_ / 2 + 1;
+  const size_t pairs = (rows + 1) / 2;
+  parallel_for(
+      0, pairs,
+      [&](const size_t lo, const size_t hi) {
+        std::vector<float> zr(fft_cols_), zi(fft_cols_);
+        for (size_t pair = lo; pair < hi; ++pair) {
+          const size_t a = 2 * pair, b = a + 1;
+          std::fill(zr.begin(), zr.end(), 0.0f);
+          std::fill(zi.begin(), zi.end(), 0.0f);
+          std::copy_n(plane + a * cols, cols, zr.begin());
+          if (b < rows) {
+            std::copy_n(plane + b * cols, cols, zi.begin());
+          }
+          fft(zr.data(), zi.data(), row_radix_.reversed, row_radix_.cos,
+              row_radix_.sin);
+
+          float* ar = re + a * width;
+          float* ai = im + a * width;
+          for (size_t k = 0; k < width; ++k) {
+            const size_t m = (fft_cols_ - k) & (fft_cols_ - 1);
+            ar[k] = 0.5f * (zr[k] + zr[m]);
+            ai[k] = 0.5f * (zi[k] - zi[m]);
+          }
+          if (b < fft_rows_) {
+            float* br = re + b * width;
+            float* bi = im + b * width;
+            for (size_t k = 0; k < width; ++k) {
+              const size_t m = (fft_cols_ - k) & (fft_cols_ - 1);
+              br[k] = 0.5f * (zi[k] + zi[m]);
+              bi[k] = 0.5f * (zr[m] - zr[k]);
+            }
+          }
+        }
+      },
+      kMinRowsPerChunk / 2);
+  // a single row pads to a single row, its pair half already dropped
+  const size_t filled = std::min(2 * pairs, fft_rows_);
+  std::fill(re + filled * width, re + fft_rows_ * width, 0.0f);
+  std::fill(im + filled * width, im + fft_rows_ * width, 0.0f);
+
+  parallel_for(
+      0, width,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t tile = lo; tile < hi; tile += kColumnTile) {
+          fft_columns(re, im, width, tile, std::min(hi, tile + kColumnTile),
+                      column_radix_.reversed, column_radix_.cos,
+                      column_radix_.sin);
+        }
+      },
+      kColumnTile);
+}
+
+void TemplateMatcher::correlate_direct(const Mat& image, Mat& scores) const {
+  const size_t rows = image.rows(), cols = image.cols();
+  const size_t area = template_rows_ * template_cols_;
+  const size_t out_cols = scores.cols();
+  parallel_for(
+      0, scores.rows(),
+      [&](const size_t lo, const size_t hi) {
+        for (size_t y = lo; y < hi; ++y) {
+          float* out = scores.data() + y * out_cols;
+          std::fill(out, out + out_cols, 0.0f);
+          for (size_t c = 0; c < template_channels_; ++c) {
+            const float* plane = template_channels_ == 1
+                                     ? image.data()
+                                     : image_planes_.data() + c * rows * cols;
+            const float* taps = template_planes_.data() + c * area;
+            for (size_t v = 0; v < template_rows_; ++v) {
+              const float* in = plane + (y + v) * cols;
+              const float* row_taps = taps + v * template_cols_;
+              size_t u = 0;
+              for (; u + 4 <= template_cols_; u += 4) {
+                correlate_taps(out, in + u, row_taps + u, out_cols);
+              }
+              for (; u < template_cols_; ++u) {
+                correlate_tap(out, in + u, row_taps[u], out_cols);
+              }
+            }
+          }
+        }
+      },
+      kMinRowsPerChunk);
+}
+
+void TemplateMatcher::correlate_spectra(const Mat& image, Mat& scores) {
+  const size_t rows = image.rows(), cols = image.cols();
+  const size_t channels = template_channels_;
+  const size_t padded_rows = next_power_of_two(rows);
+  const size_t padded_cols = next_power_of_two(cols);
+  const size_t width = padded_cols / 2 + 1;
+  const size_t size = padded_rows * width;
+  if (padded_rows != fft_rows_ || padded_cols != fft_cols_) {
+    fft_rows_ = padded_rows;
+    fft_cols_ = padded_cols;
+    plan(fft_cols_, row_radix_.reversed, row_radix_.cos, row_radix_.sin);
+    plan(fft_rows_, column_radix_.reversed, column_radix_.cos,
+         column_radix_.sin);
+    template_re_.resize(channels * size);
+    template_im_.resize(channels * size);
+    const size_t area = template_rows_ * template_cols_;
+    for (size_t c = 0; c < channels; ++c) {
+      transform(template_planes_.data() + c * area, template_rows_,
+                template_cols_, template_re_.data() + c * size,
+                template_im_.data() + c * size);
+    }
+  }
+  spectrum_re_.resize(size);
+  spectrum_im_.resize(size);
+  product_re_.resize(size);
+  product_im_.resize(size);
+
+  // the conjugate of the correlation spectrum, sum over c of conj(I_c) T_c,
+  // so a forward transform runs the inverse one up to a conjugation
+  for (size_t c = 0; c < channels; ++c) {
+    const float* plane = channels == 1
+                             ? image.data()
+                             : image_planes_.data() + c * rows * cols;
+    transform(plane, rows, cols, spectrum_re_.data(), spectrum_im_.data());
+    parallel_for(
+        0, size,
+        [&](const size_t lo, const size_t hi) {
+          const float* __restrict ir = spectrum_re_.data();
+          const float* __restrict ii = spectrum_im_.data();
+          const float* __restrict tr = template_re_.data() + c * size;
+          const float* __restrict ti = template_im_.data() + c * size;
+          float* __restrict pr = product_re_.data();
+          float* __restrict pi = product_im_.data();
+          const float keep = c == 0 ? 0.0f : 1.0f;
+          for (size_t i = lo; i < hi; ++i) {
+            pr[i] = keep * pr[i] + ir[i] * tr[i] + ii[i] * ti[i];
+            pi[i] = keep * pi[i] + ir[i] * ti[i] - ii[i] * tr[i];
+          }
+        },
+        kMinValuesPerChunk);
+  }
+  parallel_for(
+      0, width,
+      [&](const size_t lo, const size_t hi) {
+        for (size_t tile = lo; tile < hi; tile += kColumnTile) {
+          fft_columns(product_re_.data(), product_im_.data(), width, tile,
+                      std::min(hi, tile + kColumnTile),
+                      column_radix_.reversed, column_radix_.cos,
+                      column_radix_.sin);
+        }
+      },
+      kColumnTile);
+
+  // pairs of output rows come back through one complex transform, rebuilt
+  // from their half spectra by symmetry and conjugated to run forward
+  const size_t out_rows = scores.rows(), out_cols = scores.cols();
+  const float scale = 1.0f / static_cast<float>(fft_rows_ * fft_cols_);
+  const size_t half = fft_cols_ / 2;
+  parallel_for(
+      0, (out_rows + 1) / 2,
+      [&](const size_t lo, const size_t hi) {
+        std::vector<float> zr(fft_cols_), zi(fft_cols_);
+        const std::vector<float> zeros(width, 0.0f);
+        for (size_t pair = lo; pair < hi; ++pair) {
+          const size_t a = 2 * pair, b = a + 1;
+          const float* ar = product_re_.data() + a * width;
+          const float* ai = product_im_.data() + a * width;
+          const float* br = b < fft_rows_ ? ar + width : zeros.data();
+          const float* bi = b < fft_rows_ ? ai + width : zeros.data();
+          for (size_t k = 0; k <= half; ++k) {
+            zr[k] = ar[k] + bi[k];
+            zi[k] = ai[k] - br[k];
+          }
+          for (size_t k = half + 1; k < fft_cols_; ++k) {
+            const size_t m = fft_cols_ - k;
+            zr[k] = ar[m] - bi[m];
+            zi[k] = -ai[m] - br[m];
+          }
+          fft(zr.data(), zi.data(), row_radix_.reversed, row_radix_.cos,
+              row_radix_.sin);
+          float* out = scores.data() + a * out_cols;
+          for (size_t x = 0; x < out_cols; ++x) {
+            out[x] = zr[x] * scale;
+          }
+          if (b < out_rows) {
+            out += out_cols;
+            for (size_t x = 0; x < out_cols; ++x) {
+              out[x] = -zi[x] * scale;
+            }
+          }
+        }
+      },
+      kMinRowsPerChunk / 2);
+}
+
+void TemplateMatcher::normalise(Mat& scores) const {
+  const size_t out_cols = scores.cols();
+  const size_t channels = template_channels_;
+  const size_t stride = (integral_.cols() + 1) * channels;
+  const size_t reach = template_cols_ * channels;
+  const auto area = static_cast<double>(template_rows_ * template_cols_);
+  const double inverse_area = 1.0 / area;
+  const double flat = kFlatVariance * area;
+  const bool normed = method_ == TemplateMethod::NormedCrossCorrelation;
+  parallel_for(
+      0, scores.rows(),
+      [&](const size_t lo, const size_t hi) {
+        // window sums of squares and of squared deviations from the mean
+        std::vector<double> squares(out_cols), variances(out_cols);
+        for (size_t y = lo; y < hi; ++y) {
+          const double* upper = integral_.sums().data() + y * stride;
+          const double* lower = upper + template_rows_ * stride;
+          const double* upper_squared =
+              integral_.squared_sums().data() + y * stride;
+          const double* lower_squared = upper_squared + template_rows_ * stride;
+          std::fill(squares.begin(), squares.end(), 0.0);
+          std::fill(variances.begin(), variances.end(), 0.0);
+          for (size_t c = 0; c < channels; ++c) {
+            for (size_t x = 0; x < out_cols; ++x) {
+              const size_t i = x * channels + c;
+              const double sum =
+                  lower[i + reach] - lower[i] - upper[i + reach] + upper[i];
+              const double squared = lower_squared[i + reach] -
+                                     lower_squared[i] -
+                                     upper_squared[i + reach] +
+                                     upper_squared[i];
+              squares[x] += squared;
+              variances[x] += squared - sum * sum * inverse_area;
+            }
+          }
+
+          float* out = scores.data() + y * out_cols;
+          if (!normed) {
+            for (size_t x = 0; x < out_cols; ++x) {
+              out[x] = static_cast<float>(std::max(
+                  squares[x] - 2.0 * out[x] + template_energy_, 0.0));
+            }
+            continue;
+          }
+          for (size_t x = 0; x < out_cols; ++x) {
+            const double variance = variances[x];
+            out[x] = variance <= flat || template_energy_ <= flat
+                         ? 0.0f
+                         : static_cast<float>(std::clamp(
+                               out[x] / std::sqrt(variance * template_energy_),
+                               -1.0, 1.0));
+          }
+        }
+      },
+      kMinRowsPerChunk);
+}
+
+std::expected<Mat, MatError> match_template(const Mat& image,
+                                            const Mat& templ,
+                                            const TemplateMethod method) {
+  TemplateMatcher matcher(method);
+  auto prepared = matcher.set_template(templ);
+  if (!prepared) {
+    return std::unexpected(prepared.error());
+  }
+  Mat scores;
+  auto matched = matcher.match(image, scores);
+  if (!matched) {
+    return std::unexpected(matched.error());
+  }
+  return scores;
+}
+
+std::expected<TemplateMatch, MatError> best_match(
+    const Mat& scores, const TemplateMethod method) {
+  if (scores.size() == 0) {
+    return std::unexpected(MatError::InvalidDimensions);
+  }
+  if (scores.channels() != 1) {
+    return std::unexpected(MatError::InvalidChannelsForOperation);
+  }
+  const float* values = scores.data();
+  const float* best =
+      method == TemplateMethod::SquaredDifference
+          ? std::min_element(values, values + scores.size())
+          : std::max_element(values, values + scores.size());
+  const auto index = static_cast<size_t>(best - values);
+  const size_t rows = scores.rows(), cols = scores.cols();
+  const size_t y = index / cols, x = index % cols;
+
+  TemplateMatch match;
+  match.x = static_cast<float>(x);
+  match.y = static_cast<float>(y);
+  match.score = *best;
+  if (x > 0 && x + 1 < cols) {
+    match.x += vertex(best[-1], *best, best[1]);
+  }
+  if (y > 0 && y + 1 < rows) {
+    match.y += vertex(best[-static_cast<std::ptrdiff_t>(cols)], *best,
+                      best[cols]);
+  }
+  return match;
+}
+
+};  // namespace core
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <vector>
+
+#include "core/integral.hpp"
+#include "core/mat.hpp"
+
+namespace core {
+
+enum class TemplateMethod {
+  SquaredDifference,  // sum of squared differences, lower is better
+  CrossCorrelation,   // sum of products
+  // correlation of the mean-free window and template over their norms, in
+  // [-1, 1], windows or templates without variance score 0
+  NormedCrossCorrelation,
+};
+
+// scores of a template at every position where it fits inside an image,
+// summed over the channels. the correlation of the image with the template
+// is computed directly for small templates, vectorised along the output
+// rows, and through the spectra of the image and template otherwise, with
+// the template spectrum cached across images of the same shape. the window
+// sums the squared difference and normalised methods need come from double
+// integral images. the matcher keeps its buffers between calls.
+class TemplateMatcher {
+ public:
+  explicit TemplateMatcher(
+      const TemplateMethod method = TemplateMethod::NormedCrossCorrelation)
+      : method_(method) {}
+
+  [[nodiscard]] std::expected<void, MatError> set_template(const Mat& templ);
+
+  // (rows - template rows + 1) x (cols - template cols + 1) single channel
+  // scores, score (y, x) for the template's top left corner at image (y, x).
+  // `scores` keeps its buffer when the shape is unchanged.
+  [[nodiscard]] std::expected<void, MatError> match(const Mat& image,
+                                                    Mat& scores);
+
+  // DON'T CROSS THIS LINE (•̀ᴗ•́)و ̑̑
+ private:
+  // radix-2 tables of one power of two length: bit reversed indices, and
+  // the twiddles of the butterflies of half width h at [h, 2h)
+  struct Radix2 {
+    std::vector<uint32_t> reversed;
+    std::vector<float> cos, sin;
+  };
+
+  // half spectrum of a rows x cols plane zero padded to the transform size
+  void transform(const float* plane, size_t rows, size_t cols, float* re,
+                 float* im) const;
+  void correlate_direct(const Mat& image, Mat& scores) const;
+  void correlate_spectra(const Mat& image, Mat& scores);
+  void normalise(Mat& scores) const;
+
+  TemplateMethod method_;
+  // template channels as planes, mean-free for the normalised method, and
+  // the sum of their squares
+  std::vector<float> template_planes_;
+  size_t template_rows_ = 0;
+  size_t template_cols_ = 0;
+  size_t template_channels_ = 0;
+  double template_energy_ = 0.0;
+  std::vector<float> image_planes_;
+  IntegralImage<double> integral_;
+  // transform size, both powers of two, and the half spectra of
+  // fft_rows x (fft_cols / 2 + 1) values of every template channel
+  size_t fft_rows_ = 0;
+  size_t fft_cols_ = 0;
+  Radix2 row_radix_;
+  Radix2 column_radix_;
+  std::vector<float> template_re_, template_im_;
+  std::vector<float> spectrum_re_, spectrum_im_;
+  std::vector<float> product_re_, product_im_;
+};
+
+// convenience wrapper around a temporary TemplateMatcher
+[[nodiscard]] std::expected<Mat, MatError> match_template(
+    const Mat& image, const Mat& templ,
+    TemplateMethod method = TemplateMethod::NormedCrossCorrelation);
+
+struct TemplateMatch {
+  // position of the template's top left corner, refined below the pixel
+  float x = 0.0f;
+  float y = 0.0f;
+  float score = 0.0f;
+};
+
+// the best score of a score map, the lowest for squared differences and the
+// highest otherwise, refined by parabolas through its row and column
+// neighbours
+[[nodiscard]] std::expected<TemplateMatch, MatError> best_match(
+    const Mat& scores,
+    TemplateMethod method = TemplateMethod::NormedCrossCorrelation);
+
+};  // namespace core
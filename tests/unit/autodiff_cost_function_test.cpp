@@ -0,0 +1,245 @@
+#include "core/autodiff_cost_function.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "core/lie_group.hpp"
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// the world point seen from a camera at the pose (tx, ty, tz, qw, qx, qy,
+// qz) minus its observation, R^T (p - t) - observed through the conjugate
+// of the unit quaternion
+struct CameraPointResidual {
+  Vec3d observed;
+
+  template <typename T>
+  bool operator()(const T* pose, const T* point, T* residuals) const {
+    using Vector = FixedMat<3, 1, T>;
+    const Vector d(point[0] - pose[0], point[1] - pose[1],
+                   point[2] - pose[2]);
+    const Vector v(-pose[4], -pose[5], -pose[6]);
+    // d + w t + v x t with t = 2 v x d
+    const Vector t = v.cross(d) * T(2);
+    const Vector seen = d + t * pose[3] + v.cross(t);
+    for (size_t r = 0; r < 3; ++r) {
+      residuals[r] = seen[r] - observed[r];
+    }
+    return true;
+  }
+};
+using CameraPointCost = AutoDiffCostFunction<CameraPointResidual, 3, 7, 3>;
+
+// y = exp(m x + c) with m and c in blocks of their own
+struct ExponentialResidual {
+  double x = 0.0;
+  double y = 0.0;
+
+  template <typename T>
+  bool operator()(const T* m, const T* c, T* residuals) const {
+    using std::exp;
+    residuals[0] = exp(m[0] * x + c[0]) - y;
+    return true;
+  }
+};
+
+struct FailingResidual {
+  template <typename T>
+  bool operator()(const T* x, T* residuals) const {
+    residuals[0] = x[0];
+    return false;
+  }
+};
+
+void store_pose(const SE3d& pose, double* values) {
+  for (size_t i = 0; i < 3; ++i) {
+    values[i] = pose.translation()[i];
+  }
+  values[3] = pose.rotation().w();
+  values[4] = pose.rotation().x();
+  values[5] = pose.rotation().y();
+  values[6] = pose.rotation().z();
+}
+}  // namespace
+
+TEST_CASE("Automatic jacobians match numeric ones", "[autodiff]") {
+  static_assert(CameraPointCost::kNumParameters == 10);
+  uint32_t seed = 1;
+  for (size_t trial = 0; trial < 100; ++trial) {
+    const SE3d camera(
+        SO3d::exp(Vec3d(uniform(seed, -2, 2), uniform(seed, -2, 2),
+                        uniform(seed, -2, 2))),
+        Vec3d(uniform(seed, -2, 2), uniform(seed, -2, 2),
+              uniform(seed, -2, 2)));
+    double pose[7];
+    store_pose(camera, pose);
+    double point[3] = {uniform(seed, -2, 2), uniform(seed, -2, 2),
+                       uniform(seed, -2, 2)};
+    const Vec3d observed(uniform(seed, -1, 1), uniform(seed, -1, 1),
+                         uniform(seed, -1, 1));
+    const CameraPointCost cost(CameraPointResidual{observed});
+    REQUIRE(cost.num_residuals() == 3);
+    REQUIRE(cost.parameter_block_sizes().size() == 2);
+
+    // residuals agree with the lie group transform
+    const double* parameters[2] = {pose, point};
+    double residuals[3];
+    REQUIRE(cost.evaluate(parameters, residuals, nullptr));
+    const Vec3d seen =
+        camera.inverse() * Vec3d(point[0], point[1], point[2]);
+    for (size_t r = 0; r < 3; ++r) {
+      REQUIRE(std::fabs(residuals[r] - (seen[r] - observed[r])) < 1e-12);
+    }
+
+    double pose_jacobian[21];
+    double point_jacobian[9];
+    double* jacobians[2] = {pose_jacobian, point_jacobian};
+    double with_jacobians[3];
+    REQUIRE(cost.evaluate(parameters, with_jacobians, jacobians));
+    for (size_t block = 0; block < 2; ++block) {
+      const size_t size = block == 0 ? 7 : 3;
+      double* values = block == 0 ? pose : point;
+      for (size_t k = 0; k < size; ++k) {
+        const double original = values[k];
+        const double h = 1e-6;
+        double plus[3], minus[3];
+        values[k] = original + h;
+        REQUIRE(cost.evaluate(parameters, plus, nullptr));
+        values[k] = original - h;
+        REQUIRE(cost.evaluate(parameters, minus, nullptr));
+        values[k] = original;
+        for (size_t r = 0; r < 3; ++r) {
+          REQUIRE(std::fabs(jacobians[block][r * size + k] -
+                            (plus[r] - minus[r]) / (2 * h)) < 1e-6);
+        }
+      }
+    }
+    for (size_t r = 0; r < 3; ++r) {
+      REQUIRE(with_jacobians[r] == residuals[r]);
+    }
+
+    // a constant block leaves its jacobian untouched
+    double untouched[21];
+    std::fill(untouched, untouched + 21, -7.0);
+    double* pose_only[2] = {untouched, nullptr};
+    REQUIRE(cost.evaluate(parameters, with_jacobians, pose_only));
+    for (size_t i = 0; i < 21; ++i) {
+      REQUIRE(untouched[i] == pose_jacobian[i]);
+    }
+    double* none[2] = {nullptr, nullptr};
+    std::fill(untouched, untouched + 21, -7.0);
+    REQUIRE(cost.evaluate(parameters, with_jacobians, none));
+    REQUIRE(untouched[0] == -7.0);
+  }
+}
+
+TEST_CASE("Automatic differentiation drives least squares", "[autodiff]") {
+  // a curve fit across two blocks
+  double m = 0.0;
+  double c = 0.0;
+  LeastSquaresProblem curve;
+  const size_t mb = *curve.add_parameter_block(&m, 1);
+  const size_t cb = *curve.add_parameter_block(&c, 1);
+  uint32_t seed = 2;
+  for (size_t i = 0; i < 500; ++i) {
+    const double x = static_cast<double>(i) / 100.0;
+    REQUIRE(curve.add_residual_block(
+        std::make_shared<AutoDiffCostFunction<ExponentialResidual, 1, 1, 1>>(
+            ExponentialResidual{
+                x, std::exp(0.3 * x + 0.1) + uniform(seed, -1e-3, 1e-3)}),
+        {mb, cb}));
+  }
+  const auto fitted = solve_least_squares(curve);
+  REQUIRE(fitted.has_value());
+  REQUIRE(fitted->converged);
+  REQUIRE(std::fabs(m - 0.3) < 1e-3);
+  REQUIRE(std::fabs(c - 0.1) < 1e-3);
+
+  // cameras and points on the SE3 manifold, points eliminated, the first
+  // camera fixing the gauge
+  std::vector<SE3d> cameras;
+  std::vector<Vec3d> points;
+  std::vector<double> pose_values(7 * 5);
+  std::vector<double> point_values;
+  for (size_t k = 0; k < 5; ++k) {
+    cameras.push_back(SE3d(SO3d::exp(Vec3d(uniform(seed, -0.3, 0.3),
+                                           uniform(seed, -0.3, 0.3),
+                                           uniform(seed, -0.3, 0.3))),
+                           Vec3d(uniform(seed, -2, 2), uniform(seed, -2, 2),
+                                 uniform(seed, -6, -4))));
+    const SE3d start =
+        k == 0 ? cameras.back()
+               : cameras.back() * SE3d::exp(Vec6d(
+                                      uniform(seed, -0.2, 0.2),
+                                      uniform(seed, -0.2, 0.2),
+                                      uniform(seed, -0.2, 0.2),
+                                      uniform(seed, -0.05, 0.05),
+                                      uniform(seed, -0.05, 0.05),
+                                      uniform(seed, -0.05, 0.05)));
+    store_pose(start, pose_values.data() + 7 * k);
+  }
+  for (size_t p = 0; p < 100; ++p) {
+    points.push_back(Vec3d(uniform(seed, -1, 1), uniform(seed, -1, 1),
+                           uniform(seed, -1, 1)));
+    for (size_t k = 0; k < 3; ++k) {
+      point_values.push_back(points.back()[k] + uniform(seed, -0.1, 0.1));
+    }
+  }
+  LeastSquaresProblem problem;
+  const auto manifold = std::make_shared<SE3Manifold>();
+  for (size_t k = 0; k < cameras.size(); ++k) {
+    REQUIRE(problem.add_parameter_block(pose_values.data() + 7 * k, 7));
+    REQUIRE(problem.set_manifold(k, manifold));
+  }
+  REQUIRE(problem.set_constant(0));
+  for (size_t p = 0; p < points.size(); ++p) {
+    const size_t block =
+        *problem.add_parameter_block(point_values.data() + 3 * p, 3);
+    REQUIRE(problem.set_eliminated(block));
+    for (size_t k = 0; k < cameras.size(); ++k) {
+      REQUIRE(problem.add_residual_block(
+          std::make_shared<CameraPointCost>(
+              CameraPointResidual{cameras[k].inverse() * points[p]}),
+          {k, block}));
+    }
+  }
+  const auto summary = solve_least_squares(problem);
+  REQUIRE(summary.has_value());
+  REQUIRE(summary->converged);
+  REQUIRE(summary->final_cost < 1e-12);
+  for (size_t p = 0; p < points.size(); ++p) {
+    for (size_t k = 0; k < 3; ++k) {
+      REQUIRE(std::fabs(point_values[3 * p + k] - points[p][k]) < 1e-6);
+    }
+  }
+  for (size_t k = 0; k < 3; ++k) {
+    REQUIRE(std::fabs(pose_values[7 * 4 + k] -
+                      cameras[4].translation()[k]) < 1e-6);
+  }
+}
+
+TEST_CASE("Failing functors fail the evaluation", "[autodiff]") {
+  const AutoDiffCostFunction<FailingResidual, 1, 1> cost;
+  double x = 1.0;
+  const double* parameters[1] = {&x};
+  double residual = 0.0;
+  double jacobian = 0.0;
+  double* jacobians[1] = {&jacobian};
+  REQUIRE_FALSE(cost.evaluate(parameters, &residual, nullptr));
+  REQUIRE_FALSE(cost.evaluate(parameters, &residual, jacobians));
+
+  double start = 2.0;
+  LeastSquaresProblem problem;
+  REQUIRE(problem.add_parameter_block(&start, 1));
+  REQUIRE(problem.add_residual_block(
+      std::make_shared<AutoDiffCostFunction<FailingResidual, 1, 1>>(), {0}));
+  REQUIRE(solve_least_squares(problem).error() == MatError::InvalidParameter);
+}
+
+}  // namespace core
@@ -0,0 +1,210 @@
+#include "core/batched_solver.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// M M^T + n I, or for indefinite a symmetric matrix whose diagonal entries
+// are +-2n, both well conditioned
+Mat random_batch(const size_t n, const size_t batch, const bool indefinite,
+                 uint32_t seed) {
+  Mat matrices(n * n, batch, 1);
+  std::vector<float> m(n * n);
+  for (size_t b = 0; b < batch; ++b) {
+    for (float& value : m) {
+      value = uniform<float>(seed, -1.0f, 1.0f);
+    }
+    for (size_t r = 0; r < n; ++r) {
+      for (size_t c = 0; c <= r; ++c) {
+        float value = 0.0f;
+        if (indefinite) {
+          value = r == c ? (next(seed) % 2 == 0 ? 2.0f : -2.0f) *
+                               static_cast<float>(n)
+                         : m[r * n + c];
+        } else {
+          for (size_t k = 0; k < n; ++k) {
+            value += m[r * n + k] * m[c * n + k];
+          }
+          value += r == c ? static_cast<float>(n) : 0.0f;
+        }
+        matrices(r * n + c, b) = value;
+        matrices(c * n + r, b) = value;
+      }
+    }
+  }
+  return matrices;
+}
+
+Mat random_rhs(const size_t rows, const size_t batch, uint32_t seed) {
+  Mat rhs(rows, batch, 1);
+  for (size_t i = 0; i < rhs.size(); ++i) {
+    rhs.data()[i] = uniform<float>(seed, -1.0f, 1.0f);
+  }
+  return rhs;
+}
+
+// largest |A x - b| of matrix b over its k right-hand sides
+double residual(const Mat& matrices, const Mat& x, const Mat& rhs,
+                const size_t n, const size_t b) {
+  const size_t k = rhs.rows() / n;
+  double worst = 0.0;
+  for (size_t column = 0; column < k; ++column) {
+    for (size_t r = 0; r < n; ++r) {
+      double sum = -static_cast<double>(rhs(r * k + column, b));
+      for (size_t c = 0; c < n; ++c) {
+        sum += static_cast<double>(matrices(r * n + c, b)) *
+               x(c * k + column, b);
+      }
+      worst = std::max(worst, std::fabs(sum));
+    }
+  }
+  return worst;
+}
+}  // namespace
+
+TEST_CASE("Batched cholesky solves small systems", "[batched_solver]") {
+  // enough matrices to split across threads, with a ragged last tile
+  for (const auto& [n, batch] :
+       {std::pair<size_t, size_t>{3, 20001}, {6, 3001}, {12, 1001},
+        {1, 5}}) {
+    const Mat matrices = random_batch(n, batch, false, 1);
+    const Mat rhs = random_rhs(n, batch, 2);
+    Mat x;
+    auto failures = solve_batched(matrices, rhs, x);
+    REQUIRE(failures.has_value());
+    REQUIRE(*failures == 0);
+    REQUIRE(x.rows() == n);
+    REQUIRE(x.cols() == batch);
+    for (size_t b = 0; b < batch; b += 3) {
+      REQUIRE(residual(matrices, x, rhs, n, b) < 1e-4);
+    }
+  }
+
+  // L L^T reproduces the matrices, the upper triangle is zero
+  const Mat matrices = random_batch(5, 70, false, 3);
+  BatchedSolver solver;
+  REQUIRE(solver.factorize(matrices));
+  REQUIRE(solver.dimension() == 5);
+  REQUIRE(solver.batch_size() == 70);
+  const Mat& l = solver.factors();
+  for (size_t b = 0; b < 70; ++b) {
+    for (size_t r = 0; r < 5; ++r) {
+      for (size_t c = 0; c < 5; ++c) {
+        double sum = 0.0;
+        for (size_t k = 0; k < 5; ++k) {
+          sum += static_cast<double>(l(r * 5 + k, b)) * l(c * 5 + k, b);
+        }
+        REQUIRE(std::fabs(sum - matrices(r * 5 + c, b)) < 1e-4);
+        if (c > r) {
+          REQUIRE(l(r * 5 + c, b) == 0.0f);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Batched ldlt solves indefinite systems", "[batched_solver]") {
+  for (const size_t n : {3, 7, 12}) {
+    const Mat matrices = random_batch(n, 2000, true, 4);
+    BatchedSolver solver(BatchFactorization::Ldlt);
+    REQUIRE(solver.factorize(matrices));
+    REQUIRE(solver.failures() == 0);
+    // two right-hand sides per matrix, solved in place
+    const Mat rhs = random_rhs(2 * n, 2000, 5);
+    Mat x = rhs.clone();
+    REQUIRE(solver.solve(x, x));
+    for (size_t b = 0; b < 2000; b += 7) {
+      REQUIRE(residual(matrices, x, rhs, n, b) < 1e-4);
+    }
+
+    // cholesky gives up on the same matrices
+    BatchedSolver cholesky;
+    REQUIRE(cholesky.factorize(matrices));
+    REQUIRE(cholesky.failures() > 0);
+  }
+
+  // L D L^T with unit L and D on the diagonal of the factors
+  const Mat matrices = random_batch(4, 9, true, 6);
+  BatchedSolver solver(BatchFactorization::Ldlt);
+  REQUIRE(solver.factorize(matrices));
+  const Mat& f = solver.factors();
+  for (size_t b = 0; b < 9; ++b) {
+    for (size_t r = 0; r < 4; ++r) {
+      for (size_t c = 0; c < 4; ++c) {
+        double sum = 0.0;
+        for (size_t k = 0; k <= std::min(r, c); ++k) {
+          const double lr = k == r ? 1.0 : f(r * 4 + k, b);
+          const double lc = k == c ? 1.0 : f(c * 4 + k, b);
+          sum += lr * f(k * 4 + k, b) * lc;
+        }
+        REQUIRE(std::fabs(sum - matrices(r * 4 + c, b)) < 1e-4);
+      }
+    }
+  }
+}
+
+TEST_CASE("Batched factorisations flag failed matrices",
+          "[batched_solver]") {
+  Mat matrices = random_batch(4, 100, false, 7);
+  // negative definite, singular, and a nan in an entry that is read
+  for (size_t r = 0; r < 16; ++r) {
+    matrices(r, 10) = -matrices(r, 10);
+    matrices(r, 20) = 1.0f;
+  }
+  matrices(9, 30) = std::nanf("");
+  const Mat rhs = random_rhs(4, 100, 8);
+  Mat x;
+  auto failures = solve_batched(matrices, rhs, x);
+  REQUIRE(failures.has_value());
+  REQUIRE(*failures == 3);
+  for (size_t b = 0; b < 100; ++b) {
+    if (b == 10 || b == 20 || b == 30) {
+      for (size_t r = 0; r < 4; ++r) {
+        REQUIRE(x(r, b) == 0.0f);
+      }
+    } else {
+      REQUIRE(residual(matrices, x, rhs, 4, b) < 1e-4);
+    }
+  }
+
+  // ldlt handles the negative definite one but not a zero pivot
+  BatchedSolver ldlt(BatchFactorization::Ldlt);
+  REQUIRE(ldlt.factorize(matrices));
+  REQUIRE(ldlt.valid()[10] == 1);
+  REQUIRE(ldlt.valid()[20] == 0);
+  REQUIRE(ldlt.valid()[21] == 1);
+  REQUIRE(ldlt.solve(rhs, x));
+  REQUIRE(residual(matrices, x, rhs, 4, 10) < 1e-4);
+  REQUIRE(x(2, 20) == 0.0f);
+}
+
+TEST_CASE("Batched solvers reject bad shapes", "[batched_solver]") {
+  BatchedSolver solver;
+  Mat x;
+  REQUIRE(solver.solve(Mat(3, 4, 1), x).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(solver.factorize(Mat()).error() == MatError::InvalidDimensions);
+  REQUIRE(solver.factorize(Mat(8, 4, 1)).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(solver.factorize(Mat(9, 4, 2)).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(solver.factorize(random_batch(3, 4, false, 9)));
+  REQUIRE(solver.solve(Mat(3, 5, 1), x).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(solver.solve(Mat(4, 4, 1), x).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(solver.solve(Mat(3, 4, 2), x).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(solver.solve(Mat(3, 4, 1, 0.0f), x));
+  REQUIRE(x == Mat(3, 4, 1, 0.0f));
+  REQUIRE(solve_batched(Mat(9, 4, 1), Mat(2, 4, 1), x).error() ==
+          MatError::IncompatibleDimensions);
+}
+
+}  // namespace core
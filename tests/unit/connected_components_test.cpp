@@ -0,0 +1,218 @@
+#include "core/connected_components.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+Mat random_mask(const size_t rows, const size_t cols, const uint32_t density,
+                uint32_t seed) {
+  Mat mask(rows, cols, 1);
+  for (size_t i = 0; i < mask.size(); ++i) {
+    mask.data()[i] = (next(seed) >> 16) < density ? 1.0f : 0.0f;
+  }
+  return mask;
+}
+
+// flood fill, components numbered by their first pixel in raster order
+std::vector<size_t> reference_labels(const Mat& mask, const bool eight) {
+  const size_t rows = mask.rows(), cols = mask.cols();
+  std::vector<size_t> labels(rows * cols, 0);
+  std::vector<size_t> stack;
+  size_t count = 0;
+  for (size_t start = 0; start < labels.size(); ++start) {
+    if (mask.data()[start] == 0.0f || labels[start] != 0) {
+      continue;
+    }
+    labels[start] = ++count;
+    stack.push_back(start);
+    while (!stack.empty()) {
+      const size_t i = stack.back();
+      stack.pop_back();
+      const auto y = static_cast<ptrdiff_t>(i / cols);
+      const auto x = static_cast<ptrdiff_t>(i % cols);
+      for (ptrdiff_t dy = -1; dy <= 1; ++dy) {
+        for (ptrdiff_t dx = -1; dx <= 1; ++dx) {
+          if ((!eight && dx != 0 && dy != 0) || y + dy < 0 || x + dx < 0 ||
+              y + dy >= static_cast<ptrdiff_t>(rows) ||
+              x + dx >= static_cast<ptrdiff_t>(cols)) {
+            continue;
+          }
+          const size_t j = static_cast<size_t>(y + dy) * cols +
+                           static_cast<size_t>(x + dx);
+          if (mask.data()[j] != 0.0f && labels[j] == 0) {
+            labels[j] = count;
+            stack.push_back(j);
+          }
+        }
+      }
+    }
+  }
+  return labels;
+}
+
+// labels must partition the mask like the reference, and the stats must
+// describe the labelled pixels
+void require_same_partition(const Mat& mask, const Connectivity connectivity) {
+  auto components = connected_components(mask, connectivity);
+  REQUIRE(components.has_value());
+  const std::vector<size_t> expected =
+      reference_labels(mask, connectivity == Connectivity::Eight);
+  std::map<size_t, size_t> to_reference, from_reference;
+  std::vector<ComponentStats> stats(components->stats.size());
+  std::vector<double> sum_x(stats.size()), sum_y(stats.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    const auto label = static_cast<size_t>(components->labels.data()[i]);
+    REQUIRE((label == 0) == (expected[i] == 0));
+    if (label == 0) {
+      continue;
+    }
+    REQUIRE(label <= stats.size());
+    const auto [to, added] = to_reference.emplace(label, expected[i]);
+    REQUIRE(to->second == expected[i]);
+    const auto [back, unused] = from_reference.emplace(expected[i], label);
+    REQUIRE(back->second == label);
+
+    const size_t x = i % mask.cols(), y = i / mask.cols();
+    ComponentStats& s = stats[label - 1];
+    if (s.area == 0) {
+      s.min_x = s.max_x = x;
+      s.min_y = s.max_y = y;
+    }
+    ++s.area;
+    s.min_x = std::min(s.min_x, x);
+    s.max_x = std::max(s.max_x, x);
+    s.min_y = std::min(s.min_y, y);
+    s.max_y = std::max(s.max_y, y);
+    sum_x[label - 1] += static_cast<double>(x);
+    sum_y[label - 1] += static_cast<double>(y);
+  }
+  REQUIRE(to_reference.size() == stats.size());
+  for (size_t i = 0; i < stats.size(); ++i) {
+    const ComponentStats& s = components->stats[i];
+    REQUIRE(s.area == stats[i].area);
+    REQUIRE(s.min_x == stats[i].min_x);
+    REQUIRE(s.max_x == stats[i].max_x);
+    REQUIRE(s.min_y == stats[i].min_y);
+    REQUIRE(s.max_y == stats[i].max_y);
+    const auto area = static_cast<double>(s.area);
+    REQUIRE(approx_equal(s.centroid_x, static_cast<float>(sum_x[i] / area),
+                         1e-3f));
+    REQUIRE(approx_equal(s.centroid_y, static_cast<float>(sum_y[i] / area),
+                         1e-3f));
+  }
+}
+}  // namespace
+
+TEST_CASE("Connected components match a flood fill", "[connected_components]") {
+  // odd and even sizes, sparse to dense
+  for (const auto& [rows, cols] : {std::pair<size_t, size_t>{64, 64},
+                                  {37, 51},
+                                  {1, 29},
+                                  {30, 1},
+                                  {123, 90}}) {
+    for (const uint32_t density : {20u, 100u, 128u, 180u}) {
+      const Mat mask = random_mask(rows, cols, density, density + rows);
+      require_same_partition(mask, Connectivity::Eight);
+      require_same_partition(mask, Connectivity::Four);
+    }
+  }
+}
+
+TEST_CASE("Connectivity decides whether corners connect",
+          "[connected_components]") {
+  // a diagonal line and a filled 3x4 rectangle
+  Mat mask(10, 12, 1);
+  for (size_t i = 0; i < 6; ++i) {
+    mask(i, i) = 1.0f;
+  }
+  for (size_t y = 5; y < 8; ++y) {
+    for (size_t x = 7; x < 11; ++x) {
+      mask(y, x) = 0.5f;
+    }
+  }
+
+  auto eight = connected_components(mask);
+  REQUIRE(eight.has_value());
+  REQUIRE(eight->stats.size() == 2);
+  REQUIRE(eight->labels(0, 0) == 1.0f);
+  REQUIRE(eight->labels(5, 5) == 1.0f);
+  REQUIRE(eight->labels(6, 9) == 2.0f);
+  REQUIRE(eight->labels(9, 11) == 0.0f);
+  REQUIRE(eight->stats[0].area == 6);
+  REQUIRE(eight->stats[0].centroid_x == 2.5f);
+  const ComponentStats& rectangle = eight->stats[1];
+  REQUIRE(rectangle.area == 12);
+  REQUIRE(rectangle.min_x == 7);
+  REQUIRE(rectangle.max_x == 10);
+  REQUIRE(rectangle.min_y == 5);
+  REQUIRE(rectangle.max_y == 7);
+  REQUIRE(rectangle.centroid_x == 8.5f);
+  REQUIRE(rectangle.centroid_y == 6.0f);
+
+  auto four = connected_components(mask, Connectivity::Four);
+  REQUIRE(four.has_value());
+  REQUIRE(four->stats.size() == 7);
+  REQUIRE(four->labels(3, 3) == 4.0f);
+  REQUIRE(four->stats[6].area == 12);
+}
+
+TEST_CASE("Components spanning many stripes are merged",
+          "[connected_components]") {
+  // a snake running down and back up through every row band, so it crosses
+  // each stripe seam several times
+  const size_t rows = 600, cols = 64;
+  Mat mask(rows, cols, 1);
+  for (size_t x = 0; x < cols; x += 4) {
+    for (size_t y = 0; y < rows; ++y) {
+      mask(y, x) = 1.0f;
+    }
+    const size_t turn = (x / 4) % 2 == 0 ? rows - 1 : 0;
+    for (size_t dx = 1; dx < 4 && x + dx < cols; ++dx) {
+      mask(turn, x + dx) = 1.0f;
+    }
+  }
+  for (const Connectivity connectivity :
+       {Connectivity::Eight, Connectivity::Four}) {
+    auto components = connected_components(mask, connectivity);
+    REQUIRE(components.has_value());
+    REQUIRE(components->stats.size() == 1);
+    REQUIRE(components->stats[0].min_y == 0);
+    REQUIRE(components->stats[0].max_y == rows - 1);
+  }
+  require_same_partition(random_mask(rows, 200, 110, 7), Connectivity::Eight);
+  require_same_partition(random_mask(rows, 200, 128, 8), Connectivity::Four);
+}
+
+TEST_CASE("Component labeler reuses buffers and checks input",
+          "[connected_components]") {
+  ComponentLabeler labeler;
+  Components components;
+  REQUIRE(labeler.label(random_mask(40, 50, 128, 1), components).has_value());
+  const float* data = components.labels.data();
+  const Mat mask = random_mask(40, 50, 60, 2);
+  REQUIRE(labeler.label(mask, components).has_value());
+  REQUIRE(components.labels.data() == data);
+  const auto fresh = connected_components(mask);
+  REQUIRE(components.labels == fresh->labels);
+  REQUIRE(components.stats.size() == fresh->stats.size());
+
+  REQUIRE(connected_components(Mat()).error() == MatError::InvalidDimensions);
+  REQUIRE(connected_components(Mat(8, 8, 3)).error() ==
+          MatError::InvalidChannelsForOperation);
+
+  auto empty = connected_components(Mat(5, 7, 1));
+  REQUIRE(empty.has_value());
+  REQUIRE(empty->stats.empty());
+  REQUIRE(empty->labels.rows() == 5);
+  REQUIRE(empty->labels.cols() == 7);
+}
+}  // namespace core
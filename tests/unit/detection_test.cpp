@@ -0,0 +1,226 @@
+#include "core/detection.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+Boxes random_boxes(const size_t n, const uint32_t num_classes,
+                   uint32_t seed) {
+  Boxes boxes;
+  for (size_t i = 0; i < n; ++i) {
+    const float x = 200.0f * unit_uniform(seed);
+    const float y = 200.0f * unit_uniform(seed);
+    const float w = 5.0f + 40.0f * unit_uniform(seed);
+    const float h = 5.0f + 40.0f * unit_uniform(seed);
+    // quantised scores so ties happen
+    const float score = std::floor(unit_uniform(seed) * 50.0f) / 50.0f;
+    const auto class_id = static_cast<uint32_t>(
+        unit_uniform(seed) * static_cast<float>(num_classes));
+    boxes.push_back(x, y, x + w, y + h, score, class_id);
+  }
+  return boxes;
+}
+
+float reference_iou(const Boxes& boxes, const size_t i, const size_t j) {
+  const float w = std::min(boxes.x1[i], boxes.x1[j]) -
+                  std::max(boxes.x0[i], boxes.x0[j]);
+  const float h = std::min(boxes.y1[i], boxes.y1[j]) -
+                  std::max(boxes.y0[i], boxes.y0[j]);
+  if (w <= 0.0f || h <= 0.0f) {
+    return 0.0f;
+  }
+  const auto area = [&](const size_t k) {
+    return (boxes.x1[k] - boxes.x0[k]) * (boxes.y1[k] - boxes.y0[k]);
+  };
+  return w * h / (area(i) + area(j) - w * h);
+}
+
+// sort everything, then suppress greedily
+std::vector<uint32_t> reference_nms(const Boxes& boxes,
+                                    const NmsParams& params) {
+  std::vector<uint32_t> order(boxes.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return boxes.scores[a] > boxes.scores[b];
+  });
+  std::vector<uint32_t> keep;
+  for (const uint32_t i : order) {
+    if (boxes.scores[i] <= params.score_threshold ||
+        keep.size() == params.max_detections) {
+      continue;
+    }
+    bool suppressed = false;
+    for (const uint32_t k : keep) {
+      suppressed |= (!params.class_aware ||
+                     boxes.classes[k] == boxes.classes[i]) &&
+                    reference_iou(boxes, i, k) > params.iou_threshold;
+    }
+    if (!suppressed) {
+      keep.push_back(i);
+    }
+  }
+  return keep;
+}
+}  // namespace
+
+TEST_CASE("Batched box IoU", "[detection]") {
+  const Boxes a = random_boxes(70, 1, 1);
+  const Boxes b = random_boxes(90, 1, 2);
+  Boxes both = a;
+  for (size_t j = 0; j < b.size(); ++j) {
+    both.push_back(b.x0[j], b.y0[j], b.x1[j], b.y1[j], b.scores[j], 0);
+  }
+  const Mat ious = box_iou(a, b);
+  REQUIRE(ious.rows() == a.size());
+  REQUIRE(ious.cols() == b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    for (size_t j = 0; j < b.size(); ++j) {
+      REQUIRE(approx_equal(ious(i, j),
+                           reference_iou(both, i, a.size() + j), 1e-6f));
+    }
+  }
+  const Mat self = box_iou(a, a);
+  for (size_t i = 0; i < a.size(); ++i) {
+    REQUIRE(approx_equal(self(i, i), 1.0f, 1e-6f));
+  }
+
+  // degenerate boxes have no overlap
+  Boxes points;
+  points.push_back(5.0f, 5.0f, 5.0f, 5.0f, 1.0f, 0);
+  points.push_back(5.0f, 5.0f, 5.0f, 5.0f, 1.0f, 0);
+  REQUIRE(box_iou(points, points)(0, 1) == 0.0f);
+}
+
+TEST_CASE("NMS matches a sort-then-suppress reference", "[detection]") {
+  const Boxes boxes = random_boxes(3000, 4, 3);
+  for (const bool class_aware : {true, false}) {
+    for (const size_t max_detections : {size_t{5}, size_t{300}, size_t{0}}) {
+      NmsParams params;
+      params.class_aware = class_aware;
+      params.max_detections = max_detections;
+      params.score_threshold = 0.1f;
+      auto keep = non_max_suppression(boxes, params);
+      REQUIRE(keep.has_value());
+      REQUIRE(*keep == reference_nms(boxes, params));
+      REQUIRE(keep->size() <= max_detections);
+    }
+  }
+
+  NmsParams params;
+  params.iou_threshold = 1.5f;
+  REQUIRE(non_max_suppression(boxes, params).error() ==
+          MatError::InvalidParameter);
+  Boxes broken = boxes;
+  broken.classes.pop_back();
+  REQUIRE(non_max_suppression(broken).error() ==
+          MatError::IncompatibleDimensions);
+}
+
+TEST_CASE("Soft-NMS decays overlapping scores", "[detection]") {
+  Boxes boxes;
+  boxes.push_back(0.0f, 0.0f, 10.0f, 10.0f, 0.9f, 0);
+  boxes.push_back(0.0f, 5.0f, 10.0f, 15.0f, 0.8f, 0);  // iou 1/3 with 0
+  boxes.push_back(0.0f, 5.0f, 10.0f, 15.0f, 0.7f, 1);  // other class
+  boxes.push_back(50.0f, 50.0f, 60.0f, 60.0f, 0.6f, 0);
+
+  auto keep = soft_nms(boxes);
+  REQUIRE(keep.has_value());
+  REQUIRE(keep->size() == 4);
+  REQUIRE((*keep)[0].index == 0);
+  REQUIRE((*keep)[0].score == 0.9f);
+  REQUIRE((*keep)[1].index == 2);
+  REQUIRE((*keep)[1].score == 0.7f);
+  // 0.8 exp(-(1/3)^2 / 0.5) still beats box 3
+  REQUIRE((*keep)[2].index == 1);
+  REQUIRE(approx_equal((*keep)[2].score,
+                       0.8f * std::exp(-1.0f / 9.0f / 0.5f), 1e-6f));
+  REQUIRE((*keep)[3].index == 3);
+
+  SoftNmsParams params;
+  params.decay = SoftNmsDecay::Linear;
+  params.class_aware = false;
+  params.max_detections = 3;
+  keep = soft_nms(boxes, params);
+  REQUIRE(keep->size() == 3);
+  REQUIRE((*keep)[1].index == 3);
+  REQUIRE(approx_equal((*keep)[2].score, 0.8f * (2.0f / 3.0f), 1e-6f));
+
+  // a zero threshold linear decay of identical boxes is hard nms
+  params.iou_threshold = 0.0f;
+  params.max_detections = 300;
+  Boxes same;
+  same.push_back(0.0f, 0.0f, 4.0f, 4.0f, 0.5f, 0);
+  same.push_back(0.0f, 0.0f, 4.0f, 4.0f, 0.5f, 0);
+  keep = soft_nms(same, params);
+  REQUIRE(keep->size() == 1);
+  REQUIRE((*keep)[0].index == 0);
+
+  params.sigma = 0.0f;
+  REQUIRE(soft_nms(boxes, params).error() == MatError::InvalidParameter);
+}
+
+TEST_CASE("Top-k orders by score then index", "[detection]") {
+  const std::vector<float> scores = {0.5f, 0.9f, 0.1f, 0.9f, 0.7f, 0.5f};
+  REQUIRE(top_k(scores, 4) == std::vector<uint32_t>{1, 3, 4, 0});
+  REQUIRE(top_k(scores, 10) == std::vector<uint32_t>{1, 3, 4, 0, 5, 2});
+  REQUIRE(top_k(scores, 0).empty());
+}
+
+TEST_CASE("YOLO heads decode to boxes", "[detection]") {
+  DecodeParams params;
+  params.num_classes = 3;
+  params.score_threshold = 0.5f;
+  // everything confidently background
+  const std::vector<Anchor> anchors = {{10.0f, 20.0f}, {30.0f, 15.0f}};
+  Mat head(4, 5, 2 * 8, -10.0f);
+  // anchor 1 of cell (row 2, col 3): zero offsets, class 2
+  float* t = &head(2, 3, 8);
+  t[0] = t[1] = t[2] = t[3] = 0.0f;
+  t[4] = 6.0f;
+  t[7] = 5.0f;
+
+  Boxes boxes;
+  REQUIRE(decode_yolo(head, 8.0f, anchors, params, boxes).has_value());
+  REQUIRE(boxes.size() == 1);
+  // center (2 * 0.5 - 0.5 + cell) * 8, size (2 * 0.5)^2 * anchor
+  REQUIRE(approx_equal(boxes.x0[0], 3.5f * 8.0f - 15.0f, 1e-4f));
+  REQUIRE(approx_equal(boxes.y0[0], 2.5f * 8.0f - 7.5f, 1e-4f));
+  REQUIRE(approx_equal(boxes.x1[0], 3.5f * 8.0f + 15.0f, 1e-4f));
+  REQUIRE(approx_equal(boxes.y1[0], 2.5f * 8.0f + 7.5f, 1e-4f));
+  const auto sigmoid = [](const float x) {
+    return 1.0f / (1.0f + std::exp(-x));
+  };
+  REQUIRE(approx_equal(boxes.scores[0], sigmoid(6.0f) * sigmoid(5.0f),
+                       1e-6f));
+  REQUIRE(boxes.classes[0] == 2);
+
+  // anchor free, appended to the same boxes
+  Mat free_head(2, 2, 8, -10.0f);
+  t = &free_head(1, 0, 0);
+  t[0] = 0.5f;
+  t[1] = 0.25f;
+  t[2] = std::log(2.0f);
+  t[3] = 0.0f;
+  t[4] = 4.0f;
+  t[5] = 4.0f;
+  REQUIRE(decode_yolo(free_head, 16.0f, {}, params, boxes).has_value());
+  REQUIRE(boxes.size() == 2);
+  REQUIRE(approx_equal(boxes.x0[1], 8.0f - 16.0f, 1e-4f));
+  REQUIRE(approx_equal(boxes.y1[1], 1.25f * 16.0f + 8.0f, 1e-4f));
+  REQUIRE(boxes.classes[1] == 0);
+
+  REQUIRE(decode_yolo(free_head, 16.0f, anchors, params, boxes).error() ==
+          MatError::IncompatibleDimensions);
+  params.score_threshold = 1.0f;
+  REQUIRE(decode_yolo(free_head, 16.0f, {}, params, boxes).error() ==
+          MatError::InvalidParameter);
+}
+}  // namespace core
@@ -0,0 +1,107 @@
+#include "core/distance_transform.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+Mat random_mask(const size_t rows, const size_t cols, const uint32_t density,
+                uint32_t seed) {
+  Mat mask(rows, cols, 1);
+  for (size_t i = 0; i < mask.size(); ++i) {
+    mask.data()[i] = (next(seed) >> 12) < density ? 1.0f : 0.0f;
+  }
+  return mask;
+}
+
+float distance(const size_t a, const size_t b, const size_t cols) {
+  const auto dx = static_cast<float>(a % cols) - static_cast<float>(b % cols);
+  const auto dy = static_cast<float>(a / cols) - static_cast<float>(b / cols);
+  return std::sqrt(dx * dx + dy * dy);
+}
+}  // namespace
+
+TEST_CASE("Distance transform matches brute force", "[distance_transform]") {
+  for (const auto& [rows, cols] : {std::pair<size_t, size_t>{41, 57},
+                                   {64, 64},
+                                   {1, 90},
+                                   {77, 1}}) {
+    // from a handful of features to a dense mask
+    for (const uint32_t density : {3u, 40u, 1000u}) {
+      const Mat mask = random_mask(rows, cols, density, density + cols);
+      std::vector<size_t> features;
+      for (size_t i = 0; i < mask.size(); ++i) {
+        if (mask.data()[i] != 0.0f) {
+          features.push_back(i);
+        }
+      }
+      if (features.empty()) {
+        continue;
+      }
+      std::vector<uint32_t> nearest;
+      auto distances = distance_transform(mask, nearest);
+      REQUIRE(distances.has_value());
+      REQUIRE(nearest.size() == mask.size());
+      for (size_t i = 0; i < mask.size(); ++i) {
+        float best = std::numeric_limits<float>::infinity();
+        for (const size_t feature : features) {
+          best = std::min(best, distance(i, feature, cols));
+        }
+        REQUIRE(approx_equal(distances->data()[i], best, 1e-4f));
+        // ties may pick any of the nearest features
+        REQUIRE(nearest[i] < mask.size());
+        REQUIRE(mask.data()[nearest[i]] != 0.0f);
+        REQUIRE(approx_equal(distance(i, nearest[i], cols), best, 1e-4f));
+      }
+      REQUIRE(distance_transform(mask).value() == distances.value());
+    }
+  }
+}
+
+TEST_CASE("Distance transform of a single feature", "[distance_transform]") {
+  Mat mask(30, 40, 1);
+  mask(12, 25) = 1.0f;
+  std::vector<uint32_t> nearest;
+  auto distances = distance_transform(mask, nearest);
+  REQUIRE(distances.has_value());
+  for (size_t y = 0; y < 30; ++y) {
+    for (size_t x = 0; x < 40; ++x) {
+      REQUIRE(approx_equal((*distances)(y, x),
+                           std::hypot(static_cast<float>(y) - 12.0f,
+                                      static_cast<float>(x) - 25.0f),
+                           1e-4f));
+      REQUIRE(nearest[y * 40 + x] == 12 * 40 + 25);
+    }
+  }
+}
+
+TEST_CASE("Distance transform without or full of features",
+          "[distance_transform]") {
+  std::vector<uint32_t> nearest;
+  auto distances = distance_transform(Mat(9, 13, 1), nearest);
+  REQUIRE(distances.has_value());
+  for (size_t i = 0; i < distances->size(); ++i) {
+    REQUIRE(std::isinf(distances->data()[i]));
+    REQUIRE(nearest[i] == kNoFeature);
+  }
+
+  distances = distance_transform(Mat(9, 13, 1, 0.5f), nearest);
+  for (size_t i = 0; i < distances->size(); ++i) {
+    REQUIRE(distances->data()[i] == 0.0f);
+    REQUIRE(nearest[i] == i);
+  }
+
+  REQUIRE(distance_transform(Mat()).error() == MatError::InvalidDimensions);
+  REQUIRE(distance_transform(Mat(4, 4, 2), nearest).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(nearest.empty());
+}
+}  // namespace core
@@ -0,0 +1,313 @@
+#include "core/edge_filter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "core/parallel.hpp"
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// solves s a = c for a 3x3 s by cramer's rule
+std::array<double, 3> solve3(const std::array<double, 9>& s,
+                             const std::array<double, 3>& c) {
+  const auto det = [](const std::array<double, 9>& m) {
+    return m[0] * (m[4] * m[8] - m[5] * m[7]) -
+           m[1] * (m[3] * m[8] - m[5] * m[6]) +
+           m[2] * (m[3] * m[7] - m[4] * m[6]);
+  };
+  const double d = det(s);
+  std::array<double, 3> a{};
+  for (size_t k = 0; k < 3; ++k) {
+    std::array<double, 9> m = s;
+    for (size_t r = 0; r < 3; ++r) {
+      m[r * 3 + k] = c[r];
+    }
+    a[k] = det(m) / d;
+  }
+  return a;
+}
+
+// fits the linear model of every window explicitly, then averages the
+// models covering each pixel
+Mat reference_guided(const Mat& guide, const Mat& source, const size_t r,
+                     const double epsilon) {
+  const size_t rows = source.rows(), cols = source.cols();
+  const size_t gc = guide.channels(), channels = source.channels();
+  // per pixel and source channel: gc coefficients then the offset
+  std::vector<double> models(rows * cols * channels * (gc + 1));
+  const auto window = [&](const size_t y, const size_t x, auto&& visit) {
+    for (size_t v = y > r ? y - r : 0; v < std::min(rows, y + r + 1); ++v) {
+      for (size_t u = x > r ? x - r : 0; u < std::min(cols, x + r + 1); ++u) {
+        visit(v, u);
+      }
+    }
+  };
+  for (size_t y = 0; y < rows; ++y) {
+    for (size_t x = 0; x < cols; ++x) {
+      for (size_t c = 0; c < channels; ++c) {
+        double n = 0.0, mean_p = 0.0;
+        std::array<double, 3> mean_i{}, mean_ip{};
+        std::array<double, 9> mean_ii{};
+        window(y, x, [&](const size_t v, const size_t u) {
+          n += 1.0;
+          const double p = source(v, u, c);
+          mean_p += p;
+          for (size_t a = 0; a < gc; ++a) {
+            mean_i[a] += guide(v, u, a);
+            mean_ip[a] += guide(v, u, a) * p;
+            for (size_t b = 0; b < gc; ++b) {
+              mean_ii[a * 3 + b] += guide(v, u, a) * guide(v, u, b);
+            }
+          }
+        });
+        mean_p /= n;
+        std::array<double, 9> sigma{};
+        std::array<double, 3> covariance{};
+        for (size_t a = 0; a < 3; ++a) {
+          sigma[a * 3 + a] = 1.0;
+        }
+        for (size_t a = 0; a < gc; ++a) {
+          mean_i[a] /= n;
+        }
+        for (size_t a = 0; a < gc; ++a) {
+          covariance[a] = mean_ip[a] / n - mean_i[a] * mean_p;
+          for (size_t b = 0; b < gc; ++b) {
+            sigma[a * 3 + b] = mean_ii[a * 3 + b] / n - mean_i[a] * mean_i[b];
+          }
+          sigma[a * 3 + a] += epsilon;
+        }
+        const std::array<double, 3> coefficients = solve3(sigma, covariance);
+        double* model = &models[((y * cols + x) * channels + c) * (gc + 1)];
+        double offset = mean_p;
+        for (size_t a = 0; a < gc; ++a) {
+          model[a] = coefficients[a];
+          offset -= coefficients[a] * mean_i[a];
+        }
+        model[gc] = offset;
+      }
+    }
+  }
+
+  Mat out(rows, cols, channels);
+  for (size_t y = 0; y < rows; ++y) {
+    for (size_t x = 0; x < cols; ++x) {
+      for (size_t c = 0; c < channels; ++c) {
+        double n = 0.0;
+        std::vector<double> mean(gc + 1, 0.0);
+        window(y, x, [&](const size_t v, const size_t u) {
+          n += 1.0;
+          const double* model =
+              &models[((v * cols + u) * channels + c) * (gc + 1)];
+          for (size_t k = 0; k <= gc; ++k) {
+            mean[k] += model[k];
+          }
+        });
+        double q = mean[gc] / n;
+        for (size_t a = 0; a < gc; ++a) {
+          q += mean[a] / n * guide(y, x, a);
+        }
+        out(y, x, c) = static_cast<float>(q);
+      }
+    }
+  }
+  return out;
+}
+
+// 0.2 left of column `step` and 0.8 from it on, plus noise of +-amplitude
+Mat noisy_step(const size_t rows, const size_t cols, const size_t step,
+               const float amplitude, uint32_t seed) {
+  Mat image(rows, cols, 1);
+  for (size_t y = 0; y < rows; ++y) {
+    for (size_t x = 0; x < cols; ++x) {
+      const float noise = unit_uniform(seed) - 0.5f;
+      image(y, x) = (x < step ? 0.2f : 0.8f) + 2.0f * amplitude * noise;
+    }
+  }
+  return image;
+}
+
+// largest distance from the clean step and mean absolute deviation from it
+void step_errors(const Mat& image, const size_t step, float& max_error,
+                 float& mean_error) {
+  max_error = 0.0f;
+  double sum = 0.0;
+  for (size_t y = 0; y < image.rows(); ++y) {
+    for (size_t x = 0; x < image.cols(); ++x) {
+      const float error = std::fabs(image(y, x) - (x < step ? 0.2f : 0.8f));
+      max_error = std::max(max_error, error);
+      sum += error;
+    }
+  }
+  mean_error = static_cast<float>(sum / static_cast<double>(image.size()));
+}
+}  // namespace
+
+TEST_CASE("Guided filter matches explicit window fits", "[edge_filter]") {
+  for (const size_t guide_channels : {size_t{1}, size_t{3}}) {
+    for (const size_t radius : {size_t{0}, size_t{3}, size_t{40}}) {
+      const Mat guide = random_image(23, 31, guide_channels, 7);
+      const Mat source = random_image(23, 31, 2, 8);
+      GuidedFilterParams params;
+      params.radius = radius;
+      params.epsilon = 0.01f;
+      auto filtered = guided_filter(guide, source, params);
+      REQUIRE(filtered.has_value());
+      const Mat expected = reference_guided(guide, source, radius, 0.01);
+      REQUIRE(filtered->channels() == 2);
+      for (size_t i = 0; i < expected.size(); ++i) {
+        REQUIRE(approx_equal(filtered->data()[i], expected.data()[i], 1e-4f));
+      }
+    }
+  }
+}
+
+TEST_CASE("Guided filter keeps edges of its guide", "[edge_filter]") {
+  const Mat image = noisy_step(40, 60, 30, 0.02f, 3);
+  GuidedFilterParams params;
+  params.radius = 4;
+  params.epsilon = 1e-3f;
+  GuidedFilter filter(params);
+  Mat out;
+  REQUIRE(filter.filter(image, image, out).has_value());
+  float noisy_max = 0.0f, noisy_mean = 0.0f, max_error = 0.0f, mean = 0.0f;
+  step_errors(image, 30, noisy_max, noisy_mean);
+  step_errors(out, 30, max_error, mean);
+  REQUIRE(max_error < 0.05f);
+  REQUIRE(mean < 0.5f * noisy_mean);
+
+  // the buffers are reused for a differently shaped call
+  const Mat color = random_image(9, 5, 3, 4);
+  REQUIRE(filter.filter(color, Mat(9, 5, 1, 0.5f), out).has_value());
+  for (size_t i = 0; i < out.size(); ++i) {
+    REQUIRE(approx_equal(out.data()[i], 0.5f, 1e-5f));
+  }
+}
+
+TEST_CASE("Guided filter is the same for a guide far from zero",
+          "[edge_filter]") {
+  // a nearly flat guide offset by 1000: float means of its squares would
+  // cancel its variance away, even below zero
+  const Mat source = random_image(40, 48, 1, 31);
+  const Mat small = random_image(40, 48, 1, 32);
+  Mat far = small.clone();
+  for (size_t i = 0; i < far.size(); ++i) {
+    far.data()[i] = 1000.0f + 0.001f * small.data()[i];
+  }
+  // the same guide about zero, the subtraction exact
+  Mat near = far.clone();
+  for (size_t i = 0; i < near.size(); ++i) {
+    near.data()[i] -= 1000.0f;
+  }
+  const GuidedFilterParams params{4, 1e-8f};
+  auto from_far = guided_filter(far, source, params);
+  auto from_near = guided_filter(near, source, params);
+  REQUIRE(from_far.has_value());
+  REQUIRE(from_near.has_value());
+  for (size_t i = 0; i < source.size(); ++i) {
+    REQUIRE(std::isfinite(from_far->data()[i]));
+    REQUIRE(std::fabs(from_far->data()[i] - from_near->data()[i]) < 1e-2f);
+  }
+}
+
+TEST_CASE("Bilateral grid keeps steps and smooths noise", "[edge_filter]") {
+  const Mat image = noisy_step(64, 80, 37, 0.02f, 5);
+  BilateralParams params;
+  params.sigma_spatial = 4.0f;
+  params.sigma_range = 0.1f;
+  auto filtered = bilateral_filter(image, params);
+  REQUIRE(filtered.has_value());
+  float noisy_max = 0.0f, noisy_mean = 0.0f, max_error = 0.0f, mean = 0.0f;
+  step_errors(image, 37, noisy_max, noisy_mean);
+  step_errors(*filtered, 37, max_error, mean);
+  REQUIRE(max_error < 0.05f);
+  REQUIRE(mean < 0.5f * noisy_mean);
+
+  // constant images and constant channels come back unchanged
+  params.sigma_spatial = 3.0f;
+  params.sigma_range = 0.05f;
+  BilateralGrid grid(params);
+  Mat two(17, 21, 2);
+  for (size_t y = 0; y < 17; ++y) {
+    for (size_t x = 0; x < 21; ++x) {
+      two(y, x, 0) = 0.25f;
+      two(y, x, 1) = image(y, x);
+    }
+  }
+  Mat out;
+  REQUIRE(grid.filter(two, Mat(17, 21, 1, 0.3f), out).has_value());
+  REQUIRE(out.channels() == 2);
+  float plain_mean = 0.0f;
+  for (size_t y = 0; y < 17; ++y) {
+    for (size_t x = 0; x < 21; ++x) {
+      REQUIRE(approx_equal(out(y, x, 0), 0.25f, 1e-5f));
+      plain_mean += out(y, x, 1);
+    }
+  }
+  // a constant edge image makes it a plain gaussian blur, which keeps the
+  // values within their range
+  plain_mean /= 17.0f * 21.0f;
+  REQUIRE(plain_mean > 0.2f);
+  REQUIRE(plain_mean < 0.8f);
+}
+
+TEST_CASE("Bilateral grid is the same for any number of chunks",
+          "[edge_filter]") {
+  // grid rows split two per chunk, every seam between chunks blurred
+  const Mat image = random_image(96, 80, 3, 21);
+  const Mat edge = random_image(96, 80, 1, 22);
+  BilateralParams params;
+  params.sigma_spatial = 4.0f;
+  params.sigma_range = 0.1f;
+  set_num_threads(1);
+  auto serial = joint_bilateral_filter(image, edge, params);
+  set_num_threads(12);
+  auto chunked = joint_bilateral_filter(image, edge, params);
+  set_num_threads(0);
+  REQUIRE(serial.has_value());
+  REQUIRE(chunked.has_value());
+  REQUIRE(std::equal(serial->data(), serial->data() + serial->size(),
+                     chunked->data()));
+}
+
+TEST_CASE("Edge preserving filters reject bad inputs", "[edge_filter]") {
+  const Mat image = random_image(8, 8, 1, 1);
+  REQUIRE(joint_bilateral_filter(Mat(), Mat()).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(bilateral_filter(random_image(8, 8, 3, 1)).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(joint_bilateral_filter(image, random_image(8, 9, 1, 1)).error() ==
+          MatError::IncompatibleDimensions);
+  BilateralParams bilateral;
+  bilateral.sigma_spatial = 0.5f;
+  REQUIRE(bilateral_filter(image, bilateral).error() ==
+          MatError::InvalidParameter);
+  bilateral.sigma_spatial = 4.0f;
+  bilateral.sigma_range = 1e-6f;
+  REQUIRE(bilateral_filter(image, bilateral).error() ==
+          MatError::InvalidParameter);
+  // a grid of pixel sized cells with many range cells outgrows the image
+  bilateral.sigma_spatial = 1.0f;
+  bilateral.sigma_range = 0.01f;
+  const Mat large = random_image(256, 256, 1, 2);
+  REQUIRE(bilateral_filter(large, bilateral).error() ==
+          MatError::InvalidParameter);
+  bilateral.sigma_spatial = 8.0f;
+  REQUIRE(bilateral_filter(large, bilateral).has_value());
+
+  REQUIRE(guided_filter(random_image(8, 8, 2, 1), image).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(guided_filter(image, random_image(9, 8, 1, 1)).error() ==
+          MatError::IncompatibleDimensions);
+  GuidedFilterParams guided;
+  guided.epsilon = 0.0f;
+  REQUIRE(guided_filter(image, image, guided).error() ==
+          MatError::InvalidParameter);
+  REQUIRE(guided_filter(Mat(), Mat()).error() == MatError::InvalidDimensions);
+}
+}  // namespace core
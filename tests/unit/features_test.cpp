@@ -0,0 +1,127 @@
+#include "core/features.hpp"
+
+#include <bit>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// overlapping rectangles of random intensity over a mid-gray background
+Mat rectangles(const size_t size, const size_t count) {
+  Mat image(size, size, 1, 0.5f);
+  uint32_t seed = 7;
+  const auto below = [&seed](const uint32_t range) {
+    return next(seed) % range;
+  };
+  for (size_t i = 0; i < count; ++i) {
+    const size_t x0 = below(static_cast<uint32_t>(size) - 16);
+    const size_t y0 = below(static_cast<uint32_t>(size) - 16);
+    const size_t x1 = std::min(size, x0 + 8 + below(48));
+    const size_t y1 = std::min(size, y0 + 8 + below(48));
+    const float value = static_cast<float>(below(256)) / 255.0f;
+    for (size_t y = y0; y < y1; ++y) {
+      for (size_t x = x0; x < x1; ++x) {
+        image(y, x) = value;
+      }
+    }
+  }
+  return image;
+}
+
+int hamming(const Descriptor& a, const Descriptor& b) {
+  int distance = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    distance += std::popcount(a.words[i] ^ b.words[i]);
+  }
+  return distance;
+}
+}  // namespace
+
+TEST_CASE("ORB finds the corners of a square", "[features]") {
+  Mat image(128, 128, 1, 0.2f);
+  for (size_t y = 40; y < 88; ++y) {
+    for (size_t x = 40; x < 88; ++x) {
+      image(y, x) = 0.8f;
+    }
+  }
+  auto features = extract_orb(image);
+  REQUIRE(features.has_value());
+  REQUIRE(features->descriptors.size() == features->keypoints.size());
+
+  const float corners[4][2] = {{40, 40}, {87, 40}, {40, 87}, {87, 87}};
+  bool found[4] = {};
+  for (const Keypoint& keypoint : features->keypoints) {
+    bool near_corner = false;
+    for (size_t i = 0; i < 4; ++i) {
+      const float dx = keypoint.x - corners[i][0];
+      const float dy = keypoint.y - corners[i][1];
+      if (dx * dx + dy * dy <= 16.0f) {
+        near_corner = true;
+        found[i] |= keypoint.level == 0;
+      }
+    }
+    REQUIRE(near_corner);
+  }
+  for (const bool f : found) {
+    REQUIRE(f);
+  }
+}
+
+TEST_CASE("ORB descriptors follow an image rotation", "[features]") {
+  const size_t size = 256;
+  const Mat image = rectangles(size, 80);
+  // rotated(y', x') = image(x', size - 1 - y'), so a point (x, y) moves to
+  // (y, size - 1 - x)
+  Mat rotated(size, size, 1);
+  for (size_t y = 0; y < size; ++y) {
+    for (size_t x = 0; x < size; ++x) {
+      rotated(y, x) = image(x, size - 1 - y);
+    }
+  }
+
+  OrbParams params;
+  params.max_features = 500;
+  OrbExtractor extractor(params);
+  Features original, turned;
+  REQUIRE(extractor.extract(image, original).has_value());
+  REQUIRE(extractor.extract(rotated, turned).has_value());
+  REQUIRE(original.keypoints.size() > 200);
+
+  size_t matched = 0;
+  for (size_t i = 0; i < original.keypoints.size(); ++i) {
+    const Keypoint& a = original.keypoints[i];
+    const float x = a.y, y = static_cast<float>(size - 1) - a.x;
+    for (size_t j = 0; j < turned.keypoints.size(); ++j) {
+      const Keypoint& b = turned.keypoints[j];
+      if (b.level == a.level && std::abs(b.x - x) < 0.5f &&
+          std::abs(b.y - y) < 0.5f) {
+        matched += hamming(original.descriptors[i], turned.descriptors[j]) <
+                   32;
+        break;
+      }
+    }
+  }
+  REQUIRE(matched > original.keypoints.size() * 3 / 4);
+
+  // the extractor reuses its buffers but not its results
+  Features again;
+  REQUIRE(extractor.extract(image, again).has_value());
+  REQUIRE(again.keypoints.size() == original.keypoints.size());
+  REQUIRE(hamming(again.descriptors.back(), original.descriptors.back()) == 0);
+}
+
+TEST_CASE("ORB input validation", "[features]") {
+  REQUIRE(extract_orb(Mat(64, 64, 3, 0.0f)).error() ==
+          MatError::InvalidChannelsForOperation);
+  // too small for any keypoint
+  REQUIRE(extract_orb(Mat(20, 20, 1, 0.0f))->keypoints.empty());
+  OrbParams params;
+  params.num_levels = 0;
+  REQUIRE(extract_orb(Mat(64, 64, 1, 0.0f), params).error() ==
+          MatError::InvalidParameter);
+}
+}  // namespace core
@@ -0,0 +1,138 @@
+#include "core/fixed_mat.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// diagonally dominant so well conditioned
+template <size_t N, typename T>
+FixedMat<N, N, T> random_matrix(uint32_t seed) {
+  FixedMat<N, N, T> m;
+  for (size_t i = 0; i < N * N; ++i) {
+    m[i] = uniform<T>(seed, -1, 1);
+  }
+  for (size_t i = 0; i < N; ++i) {
+    m(i, i) += static_cast<T>(N);
+  }
+  return m;
+}
+
+template <size_t N, typename T>
+void check_inverse(const uint32_t seed, const T epsilon) {
+  const auto m = random_matrix<N, T>(seed);
+  const auto inv = inverse(m);
+  REQUIRE(inv.has_value());
+  const auto identity = FixedMat<N, N, T>::identity();
+  REQUIRE(approx_equal(m * *inv, identity, epsilon));
+  REQUIRE(approx_equal(*inv * m, identity, epsilon));
+}
+
+constexpr Mat3f kRotation(0.0f, -1.0f, 0.0f,  //
+                          1.0f, 0.0f, 0.0f,   //
+                          0.0f, 0.0f, 1.0f);
+}  // namespace
+
+TEST_CASE("Fixed matrices evaluate at compile time", "[fixed_mat]") {
+  static_assert(sizeof(Mat4f) == 16 * sizeof(float));
+  static_assert(alignof(Mat4f) == 16);
+  static_assert(Mat3f() == Mat3f::zeros());
+  static_assert(kRotation * kRotation.transpose() == Mat3f::identity());
+  static_assert(determinant(kRotation) == 1.0f);
+  static_assert(*inverse(kRotation) == kRotation.transpose());
+  static_assert(!inverse(Mat2f(1.0f, 2.0f, 2.0f, 4.0f)).has_value());
+  static_assert(Vec3f(1, 0, 0).cross(Vec3f(0, 1, 0)) == Vec3f(0, 0, 1));
+  static_assert(Vec3f(1, 2, 3).dot(Vec3f(4, 5, 6)) == 32.0f);
+  static_assert(Mat4d::identity().trace() == 4.0);
+
+  constexpr FixedMat<2, 3> a(1, 2, 3, 4, 5, 6);
+  constexpr FixedMat<3, 1> x(1, 1, 1);
+  static_assert(a * x == FixedMat<2, 1>(6, 15));
+  static_assert(a.row(1) == FixedMat<1, 3>(4, 5, 6));
+  static_assert(a.col(2) == FixedMat<2, 1>(3, 6));
+  static_assert(a.block<2, 2>(0, 1) == FixedMat<2, 2>(2, 3, 5, 6));
+  static_assert(a.transpose().transpose() == a);
+  static_assert(-a + a == FixedMat<2, 3>::zeros());
+  static_assert(2.0f * a - a * 3.0f == -a);
+  static_assert(a / 2.0f == a * 0.5f);
+  static_assert(a.cwise_product(a)(1, 2) == 36.0f);
+  static_assert(Mat3f::filled(2.0f).squared_norm() == 36.0f);
+}
+
+TEST_CASE("Fixed matrix products and inverses", "[fixed_mat]") {
+  for (uint32_t seed = 1; seed < 20; ++seed) {
+    check_inverse<2, float>(seed, 1e-5f);
+    check_inverse<3, float>(seed, 1e-5f);
+    check_inverse<4, float>(seed, 1e-5f);
+    check_inverse<6, float>(seed, 1e-5f);
+    check_inverse<4, double>(seed, 1e-12);
+    check_inverse<7, double>(seed, 1e-12);
+  }
+
+  // products against the textbook triple loop
+  const auto a = random_matrix<4, float>(3);
+  const auto b = random_matrix<4, float>(4);
+  const Mat4f product = a * b;
+  for (size_t r = 0; r < 4; ++r) {
+    for (size_t c = 0; c < 4; ++c) {
+      float sum = 0.0f;
+      for (size_t i = 0; i < 4; ++i) {
+        sum += a(r, i) * b(i, c);
+      }
+      REQUIRE(approx_equal(product(r, c), sum, 1e-5f));
+    }
+  }
+
+  // a row swap is needed for the first pivot
+  const Mat3d permuted(0, 1, 2, 1, 0, 3, 4, -3, 8);
+  const auto solved = solve(permuted, Vec3d(3, 4, 9));
+  REQUIRE(solved.has_value());
+  REQUIRE(approx_equal(*solved, Vec3d(1, 1, 1), 1e-12));
+  REQUIRE_FALSE(solve(Mat3d::zeros(), Vec3d(1, 2, 3)).has_value());
+  REQUIRE_FALSE(inverse(FixedMat<5, 5, double>::filled(1.0)).has_value());
+}
+
+TEST_CASE("Fixed matrix determinants", "[fixed_mat]") {
+  REQUIRE(determinant(FixedMat<1, 1>::filled(-2.5f)) == -2.5f);
+  REQUIRE(determinant(Mat2f(1, 2, 3, 4)) == -2.0f);
+  REQUIRE(determinant(Mat3d(2, 0, 1, 1, 3, 2, 1, 1, 2)) == 6.0);
+  REQUIRE(determinant(Mat4d(1, 0, 2, -1, 3, 0, 0, 5, 2, 1, 4, -3, 1, 0, 5,
+                            0)) == 30.0);
+  REQUIRE(determinant(Mat6d::identity() * 2.0) == 64.0);
+
+  // the closed forms agree with lu on the same matrices
+  for (uint32_t seed = 1; seed < 10; ++seed) {
+    const auto m = random_matrix<4, double>(seed);
+    FixedMat<5, 5, double> padded = FixedMat<5, 5, double>::identity();
+    padded.set_block(1, 1, m);
+    REQUIRE(approx_equal(FixedMat<1, 1, double>::filled(determinant(m)),
+                         FixedMat<1, 1, double>::filled(determinant(padded)),
+                         1e-9));
+  }
+  REQUIRE(determinant(FixedMat<5, 5, double>::zeros()) == 0.0);
+}
+
+TEST_CASE("Fixed matrices convert to and from Mat", "[fixed_mat]") {
+  const Mat4f m = random_matrix<4, float>(7);
+  const Mat dense = m.to_mat();
+  REQUIRE(dense.rows() == 4);
+  REQUIRE(dense.cols() == 4);
+  REQUIRE(dense.channels() == 1);
+  REQUIRE(dense(2, 1) == m(2, 1));
+  const auto back = Mat4f::from_mat(dense);
+  REQUIRE(back.has_value());
+  REQUIRE(*back == m);
+  const auto as_double = Mat4d::from_mat(dense);
+  REQUIRE(as_double.has_value());
+  REQUIRE((*as_double)(3, 3) == static_cast<double>(m(3, 3)));
+
+  REQUIRE(Mat3f::from_mat(dense).error() == MatError::IncompatibleDimensions);
+  REQUIRE(Vec4f::from_mat(dense).error() == MatError::IncompatibleDimensions);
+  REQUIRE(Mat4f::from_mat(Mat(4, 4, 3)).error() ==
+          MatError::InvalidChannelsForOperation);
+}
+
+}  // namespace core
@@ -0,0 +1,117 @@
+#include "core/icp.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+
+namespace core {
+namespace {
+// floor and two walls of a room corner sampled on a grid, three orthogonal
+// planes constrain all six degrees of freedom
+PointCloud room_corner(const size_t n, const float spacing) {
+  PointCloud cloud(3 * n * n);
+  size_t i = 0;
+  for (size_t u = 0; u < n; ++u) {
+    for (size_t v = 0; v < n; ++v) {
+      const float a = static_cast<float>(u) * spacing;
+      const float b = static_cast<float>(v) * spacing;
+      const float planes[3][3] = {{a, b, 0.0f}, {0.0f, a, b}, {a, 0.0f, b}};
+      for (const auto& p : planes) {
+        cloud.x()[i] = p[0] + 0.5f;
+        cloud.y()[i] = p[1] - 1.0f;
+        cloud.z()[i] = p[2] + 2.0f;
+        ++i;
+      }
+    }
+  }
+  return cloud;
+}
+
+RigidTransform small_motion() {
+  // 4 degrees about a tilted axis plus a translation
+  const float angle = 4.0f * 3.14159265f / 180.0f;
+  const float axis[3] = {0.48f, 0.6f, 0.64f};
+  const float c = std::cos(angle), s = std::sin(angle), t = 1.0f - c;
+  const float x = axis[0], y = axis[1], z = axis[2];
+  RigidTransform motion;
+  motion.rotation = {t * x * x + c,     t * x * y - s * z, t * x * z + s * y,
+                     t * x * y + s * z, t * y * y + c,     t * y * z - s * x,
+                     t * x * z - s * y, t * y * z + s * x, t * z * z + c};
+  motion.translation = {0.05f, -0.04f, 0.03f};
+  return motion;
+}
+
+bool near(const RigidTransform& a, const RigidTransform& b, const float eps) {
+  for (size_t i = 0; i < 9; ++i) {
+    if (std::abs(a.rotation[i] - b.rotation[i]) > eps) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    if (std::abs(a.translation[i] - b.translation[i]) > eps) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+TEST_CASE("ICP recovers a rigid motion", "[icp]") {
+  const PointCloud source = room_corner(60, 0.02f);
+  PointCloud target = source;
+  const RigidTransform motion = small_motion();
+  motion.apply(target);
+
+  IcpParams params;
+  params.levels = {{0.1f, 0.3f, 20}, {0.05f, 0.1f, 20}, {0.0f, 0.05f, 30}};
+  for (const IcpMethod method :
+       {IcpMethod::PointToPoint, IcpMethod::PointToPlane}) {
+    params.method = method;
+    auto result = icp(source, target, params);
+    REQUIRE(result.has_value());
+    REQUIRE(result->converged);
+    REQUIRE(near(result->transform, motion, 1e-3f));
+    REQUIRE(result->rmse < 1e-3f);
+    REQUIRE(result->correspondences > source.size() / 2);
+  }
+}
+
+TEST_CASE("ICP starts from the initial estimate", "[icp]") {
+  const PointCloud source = room_corner(40, 0.03f);
+  PointCloud target = source;
+  const RigidTransform motion = small_motion();
+  motion.apply(target);
+
+  // already registered, a single iteration confirms it
+  IcpParams params;
+  params.method = IcpMethod::PointToPoint;
+  params.levels = {{0.0f, 0.01f, 10}};
+  auto result = icp(source, target, params, motion);
+  REQUIRE(result.has_value());
+  REQUIRE(result->converged);
+  REQUIRE(result->iterations <= 2);
+  REQUIRE(near(result->transform, motion, 1e-4f));
+
+  REQUIRE(icp(PointCloud(), target).error() == MatError::InvalidDimensions);
+  params.levels.clear();
+  REQUIRE(icp(source, target, params).error() == MatError::InvalidParameter);
+}
+
+TEST_CASE("Normal estimation", "[icp]") {
+  PointCloud plane(100);
+  for (size_t i = 0; i < 100; ++i) {
+    plane.x()[i] = static_cast<float>(i % 10) * 0.1f;
+    plane.y()[i] = static_cast<float>(i / 10) * 0.1f;
+    plane.z()[i] = 1.0f + 0.5f * plane.x()[i];
+  }
+  REQUIRE(estimate_normals(plane, 8).has_value());
+  REQUIRE(plane.has_normals());
+  // normal of z = 1 + x / 2 facing the origin
+  const float length = std::sqrt(1.25f);
+  for (size_t i = 0; i < 100; ++i) {
+    REQUIRE(std::abs(plane.nx()[i] - 0.5f / length) < 1e-4f);
+    REQUIRE(std::abs(plane.ny()[i]) < 1e-4f);
+    REQUIRE(std::abs(plane.nz()[i] + 1.0f / length) < 1e-4f);
+  }
+  REQUIRE(estimate_normals(plane, 2).error() == MatError::InvalidParameter);
+}
+}  // namespace core
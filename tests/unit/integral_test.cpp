@@ -0,0 +1,154 @@
+#include "core/integral.hpp"
+
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+bool near(const Mat& a, const Mat& b, const float epsilon) {
+  if (a.rows() != b.rows() || a.cols() != b.cols() ||
+      a.channels() != b.channels()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (!approx_equal(a.data()[i], b.data()[i], epsilon)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// clipped window means and variances in double
+void reference_box(const Mat& image, const size_t radius, Mat& mean,
+                   Mat& variance) {
+  const auto r = static_cast<long>(radius);
+  const auto rows = static_cast<long>(image.rows());
+  const auto cols = static_cast<long>(image.cols());
+  mean = Mat(image.rows(), image.cols(), image.channels());
+  variance = Mat(image.rows(), image.cols(), image.channels());
+  for (long y = 0; y < rows; ++y) {
+    for (long x = 0; x < cols; ++x) {
+      for (size_t c = 0; c < image.channels(); ++c) {
+        double sum = 0.0, squared = 0.0, count = 0.0;
+        for (long v = std::max(0L, y - r); v <= std::min(rows - 1, y + r);
+             ++v) {
+          for (long u = std::max(0L, x - r); u <= std::min(cols - 1, x + r);
+               ++u) {
+            const double value = image(v, u, c);
+            sum += value;
+            squared += value * value;
+            count += 1.0;
+          }
+        }
+        const double m = sum / count;
+        mean(y, x, c) = static_cast<float>(m);
+        variance(y, x, c) =
+            static_cast<float>(std::max(0.0, squared / count - m * m));
+      }
+    }
+  }
+}
+}  // namespace
+
+TEST_CASE("Integral tables sum rectangles", "[integral]") {
+  const Mat image = random_image(23, 41, 3, 5);
+  auto double_tables = integral<double>(image);
+  auto float_tables = integral<float>(image);
+  REQUIRE(double_tables.has_value());
+  REQUIRE(float_tables.has_value());
+  REQUIRE(double_tables->sums().size() == 24 * 42 * 3);
+  REQUIRE(double_tables->has_squares());
+
+  for (const auto& [top, left, bottom, right] :
+       {std::array<size_t, 4>{0, 0, 23, 41},
+        {3, 7, 4, 8},
+        {10, 0, 23, 20},
+        {5, 5, 5, 30}}) {
+    for (size_t c = 0; c < 3; ++c) {
+      double sum = 0.0, squared = 0.0;
+      for (size_t y = top; y < bottom; ++y) {
+        for (size_t x = left; x < right; ++x) {
+          sum += image(y, x, c);
+          squared += static_cast<double>(image(y, x, c)) * image(y, x, c);
+        }
+      }
+      REQUIRE(std::abs(double_tables->sum(top, left, bottom, right, c) -
+                       sum) < 1e-9);
+      REQUIRE(std::abs(double_tables->squared_sum(top, left, bottom, right,
+                                                  c) -
+                       squared) < 1e-9);
+      REQUIRE(std::abs(float_tables->sum(top, left, bottom, right, c) -
+                       sum) < 1e-3);
+    }
+  }
+}
+
+TEST_CASE("Box means and variances match clipped windows", "[integral]") {
+  for (const size_t radius : {size_t{0}, size_t{2}, size_t{50}}) {
+    for (const auto& [rows, cols, channels] :
+         {std::array<size_t, 3>{37, 91, 1},
+          {20, 70, 3},
+          {1, 5, 2},
+          {6, 1, 1}}) {
+      const Mat image = random_image(rows, cols, channels, 17);
+      Mat expected_mean, expected_variance;
+      reference_box(image, radius, expected_mean, expected_variance);
+
+      auto mean = box_filter(image, radius);
+      REQUIRE(mean.has_value());
+      REQUIRE(near(*mean, expected_mean, 1e-6f));
+
+      Mat means, variances;
+      REQUIRE(box_mean_variance(image, radius, means, variances));
+      REQUIRE(near(means, expected_mean, 1e-6f));
+      REQUIRE(near(variances, expected_variance, 1e-6f));
+
+      // float tables lose bits as the totals grow
+      REQUIRE(box_mean_variance<float>(image, radius, means, variances));
+      REQUIRE(near(means, expected_mean, 1e-3f));
+      REQUIRE(near(variances, expected_variance, 1e-3f));
+    }
+  }
+}
+
+TEST_CASE("Double tables stay exact on large images", "[integral]") {
+  const Mat image(2048, 2048, 1, 0.7f);
+  Mat means, variances;
+  REQUIRE(box_mean_variance(image, 3, means, variances));
+  REQUIRE(means == image);
+  REQUIRE(std::all_of(variances.data(), variances.data() + variances.size(),
+                      [](const float v) { return v < 1e-7f; }));
+
+  // the same tables reused for another shape
+  IntegralImage<double> tables;
+  REQUIRE(tables.compute(image, false));
+  REQUIRE_FALSE(tables.has_squares());
+  const Mat small = random_image(9, 13, 2, 3);
+  REQUIRE(tables.compute(small));
+  REQUIRE(tables.rows() == 9);
+  REQUIRE(tables.cols() == 13);
+  REQUIRE(tables.channels() == 2);
+  REQUIRE(std::abs(tables.sum(0, 0, 9, 13, 1) -
+                   tables.sums()[tables.sums().size() - 1]) < 1e-12);
+}
+
+TEST_CASE("Integral images reject bad input", "[integral]") {
+  REQUIRE(integral(Mat()).error() == MatError::InvalidDimensions);
+  REQUIRE(box_filter(Mat(), 1).error() == MatError::InvalidDimensions);
+
+  IntegralImage<float> tables;
+  Mat mean, variance;
+  REQUIRE(tables.box_mean(1, mean).error() == MatError::InvalidDimensions);
+  REQUIRE(tables.compute(Mat(4, 4, 1), false));
+  REQUIRE(tables.box_mean(1, mean));
+  REQUIRE(tables.box_mean_variance(1, mean, variance).error() ==
+          MatError::InvalidParameter);
+}
+
+}  // namespace core
@@ -0,0 +1,158 @@
+#include "core/jet.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+using Jet2 = Jet<double, 2>;
+using Jet4 = Jet<double, 4>;
+
+// every <cmath> function of jet.hpp in one expression of two variables,
+// written once for doubles and jets
+template <typename T>
+T composite(const T& x, const T& y) {
+  using std::abs, std::acos, std::asin, std::atan, std::atan2, std::cbrt,
+      std::cos, std::exp, std::hypot, std::log, std::pow, std::sin,
+      std::sqrt, std::tan;
+  return sqrt(x * y + 2.0) + exp(x / 3.0) * log(y) - sin(x) * cos(y) +
+         tan(0.5 * x) + asin(0.5 * y) / acos(-0.3 * x) + atan(x - y) +
+         atan2(y, x) * hypot(x, 1.0 - y) + pow(abs(y - x), 1.5) +
+         cbrt(x + 3.0) - 1.0 / (x + y);
+}
+
+// central differences of composite with respect to x and y
+void numeric_gradient(const double x, const double y, double* gradient) {
+  const double h = 1e-6;
+  gradient[0] = (composite(x + h, y) - composite(x - h, y)) / (2 * h);
+  gradient[1] = (composite(x, y + h) - composite(x, y - h)) / (2 * h);
+}
+
+// the rotation about z by angle, with entries that are jets in the angle
+FixedMat<3, 3, Jet4> rotation(const Jet4& angle) {
+  using std::cos, std::sin;
+  const Jet4 c = cos(angle);
+  const Jet4 s = sin(angle);
+  return FixedMat<3, 3, Jet4>(c, -s, 0.0, s, c, 0.0, 0.0, 0.0, 1.0);
+}
+}  // namespace
+
+TEST_CASE("Jets evaluate at compile time", "[jet]") {
+  static_assert(alignof(Jet2) == 16);
+  static_assert(alignof(Jet4) == 16);
+  static_assert(sizeof(Jet<float, 4>) == 5 * sizeof(float) + 12);
+
+  constexpr Jet2 x(3.0, 0);
+  constexpr Jet2 y(2.0, 1);
+  // d(xy) = (y, x), d(x / y) = (1 / y, -x / y^2)
+  constexpr Jet2 product = x * y;
+  static_assert(product.value == 6.0);
+  static_assert(product.derivatives[0] == 2.0);
+  static_assert(product.derivatives[1] == 3.0);
+  constexpr Jet2 quotient = x / y;
+  static_assert(quotient.value == 1.5);
+  static_assert(quotient.derivatives[0] == 0.5);
+  static_assert(quotient.derivatives[1] == -0.75);
+  constexpr Jet2 reciprocal = 1 / y;
+  static_assert(reciprocal.derivatives[1] == -0.25);
+  constexpr Jet2 affine = 2 * x - y + 1.0;
+  static_assert(affine.value == 5.0);
+  static_assert(affine.derivatives[0] == 2.0);
+  static_assert(affine.derivatives[1] == -1.0);
+  static_assert((5.0 - x).derivatives[0] == -1.0);
+  static_assert((-x).derivatives[0] == -1.0);
+
+  // comparisons see the values only
+  static_assert(x > y && y < 2.5 && 3.0 == x && x != y);
+  static_assert(Jet2(1.0, 0) == Jet2(1.0, 1));
+
+  // jets are matrix entries, the derivative of a x with respect to x is a
+  constexpr FixedMat<2, 2, Jet2> a(1.0, 2.0, 3.0, 4.0);
+  constexpr FixedMat<2, 1, Jet2> v(Jet2(1.0, 0), Jet2(-1.0, 1));
+  constexpr FixedMat<2, 1, Jet2> av = a * v;
+  static_assert(av[0].value == -1.0 && av[1].value == -1.0);
+  static_assert(av[0].derivatives[0] == 1.0 && av[0].derivatives[1] == 2.0);
+  static_assert(av[1].derivatives[0] == 3.0 && av[1].derivatives[1] == 4.0);
+}
+
+TEST_CASE("Jet functions match numeric derivatives", "[jet]") {
+  uint32_t seed = 1;
+  for (size_t trial = 0; trial < 200; ++trial) {
+    const double x = uniform(seed, 0.2, 1.5);
+    const double y = uniform(seed, 0.2, 1.5);
+    const Jet2 result = composite(Jet2(x, 0), Jet2(y, 1));
+    double gradient[2];
+    numeric_gradient(x, y, gradient);
+    REQUIRE(std::fabs(result.value - composite(x, y)) < 1e-12);
+    REQUIRE(std::fabs(result.derivatives[0] - gradient[0]) < 1e-6);
+    REQUIRE(std::fabs(result.derivatives[1] - gradient[1]) < 1e-6);
+    REQUIRE(isfinite(result));
+  }
+
+  // a nan in any lane is caught, and constants have zero derivatives
+  Jet2 bad(1.0, 0);
+  bad.derivatives[1] = std::nan("");
+  REQUIRE_FALSE(isfinite(bad));
+  using std::sqrt;
+  REQUIRE(!isfinite(sqrt(Jet2(0.0, 0))));
+  const Jet2 constant = exp(Jet2(1.0));
+  REQUIRE(constant.derivatives[0] == 0.0);
+  REQUIRE(constant.derivatives[1] == 0.0);
+}
+
+TEST_CASE("Jets differentiate through fixed matrices", "[jet]") {
+  // lanes 0-2 are the entries of b, lane 3 the rotation angle
+  uint32_t seed = 2;
+  for (size_t trial = 0; trial < 50; ++trial) {
+    const double angle = uniform(seed, -3.0, 3.0);
+    const Vec3d b(uniform(seed, -1, 1), uniform(seed, -1, 1),
+                  uniform(seed, -1, 1));
+    const auto r = rotation(Jet4(angle, 3));
+    const FixedMat<3, 1, Jet4> jb(Jet4(b[0], 0), Jet4(b[1], 1),
+                                  Jet4(b[2], 2));
+
+    // rotating leaves norms alone, also in their derivatives
+    const Jet4 norm = (r * jb).norm();
+    REQUIRE(std::fabs(norm.value - b.norm()) < 1e-12);
+    for (size_t k = 0; k < 3; ++k) {
+      REQUIRE(std::fabs(norm.derivatives[k] - b[k] / b.norm()) < 1e-12);
+    }
+    REQUIRE(std::fabs(norm.derivatives[3]) < 1e-12);
+
+    // the inverse is the transpose, in value and in derivative
+    const auto inv = inverse(r);
+    REQUIRE(inv.has_value());
+    const auto transposed = r.transpose();
+    for (size_t i = 0; i < 9; ++i) {
+      REQUIRE(std::fabs((*inv)[i].value - transposed[i].value) < 1e-12);
+      REQUIRE(std::fabs((*inv)[i].derivatives[3] -
+                        transposed[i].derivatives[3]) < 1e-12);
+    }
+
+    // x = R^-1 b by lu, dx/db = R^T and dx/dangle against differences
+    const auto x = solve(r, jb);
+    REQUIRE(x.has_value());
+    const double h = 1e-6;
+    const auto rp = rotation(Jet4(angle + h));
+    const auto rm = rotation(Jet4(angle - h));
+    for (size_t i = 0; i < 3; ++i) {
+      double forward = 0.0;
+      double backward = 0.0;
+      for (size_t k = 0; k < 3; ++k) {
+        REQUIRE(std::fabs((*x)[i].derivatives[k] - r(k, i).value) < 1e-12);
+        forward += rp(k, i).value * b[k];
+        backward += rm(k, i).value * b[k];
+      }
+      REQUIRE(std::fabs((*x)[i].derivatives[3] -
+                        (forward - backward) / (2 * h)) < 1e-8);
+    }
+    REQUIRE(std::fabs(determinant(r).value - 1.0) < 1e-12);
+    REQUIRE(std::fabs(determinant(r).derivatives[3]) < 1e-12);
+  }
+}
+
+}  // namespace core
@@ -0,0 +1,127 @@
+#include "core/kd_tree.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <limits>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+float distance_sq(const Mat& a, const size_t i, const Mat& b, const size_t j) {
+  float sum = 0.0f;
+  for (size_t axis = 0; axis < a.cols(); ++axis) {
+    const float diff = a(i, axis) - b(j, axis);
+    sum += diff * diff;
+  }
+  return sum;
+}
+
+// distances of the k nearest points by exhaustive search
+std::vector<float> brute_knn(const Mat& points, const Mat& queries,
+                             const size_t q, const size_t k) {
+  std::vector<float> distances(points.rows());
+  for (size_t i = 0; i < points.rows(); ++i) {
+    distances[i] = distance_sq(points, i, queries, q);
+  }
+  std::sort(distances.begin(), distances.end());
+  distances.resize(std::min(k, distances.size()));
+  return distances;
+}
+}  // namespace
+
+TEST_CASE("KdTree kNN matches brute force", "[kd_tree]") {
+  for (const size_t dims : {size_t{2}, size_t{3}}) {
+    const Mat points = random_image(2000, dims, 1, 1);
+    const Mat queries = random_image(100, dims, 1, 2);
+    auto tree = KdTree::build(points);
+    REQUIRE(tree.has_value());
+    REQUIRE(tree->size() == 2000);
+    REQUIRE(tree->dims() == dims);
+
+    auto result = tree->knn(queries, 5);
+    REQUIRE(result.has_value());
+    REQUIRE(result->k == 5);
+    for (size_t q = 0; q < queries.rows(); ++q) {
+      const std::vector<float> expected = brute_knn(points, queries, q, 5);
+      for (size_t j = 0; j < 5; ++j) {
+        const uint32_t index = result->indices[q * 5 + j];
+        REQUIRE(approx_equal(result->distances_sq[q * 5 + j], expected[j]));
+        REQUIRE(approx_equal(distance_sq(points, index, queries, q),
+                             expected[j]));
+      }
+    }
+  }
+}
+
+TEST_CASE("KdTree radius search matches brute force", "[kd_tree]") {
+  const Mat points = random_image(3000, 3, 1, 3);
+  const Mat queries = random_image(50, 3, 1, 4);
+  auto tree = KdTree::build(points);
+  REQUIRE(tree.has_value());
+
+  constexpr float kRadius = 0.1f;
+  auto result = tree->radius_search(queries, kRadius);
+  REQUIRE(result.has_value());
+  REQUIRE(result->offsets.size() == 51);
+  for (size_t q = 0; q < queries.rows(); ++q) {
+    size_t expected = 0;
+    for (size_t i = 0; i < points.rows(); ++i) {
+      expected += distance_sq(points, i, queries, q) <= kRadius * kRadius;
+    }
+    const size_t begin = result->offsets[q], end = result->offsets[q + 1];
+    REQUIRE(end - begin == expected);
+    REQUIRE(std::is_sorted(result->distances_sq.begin() + begin,
+                           result->distances_sq.begin() + end));
+  }
+}
+
+TEST_CASE("KdTree over point clouds and channel layouts", "[kd_tree]") {
+  PointCloud cloud(4);
+  const float xs[] = {0.0f, 1.0f, 2.0f, 3.0f};
+  for (size_t i = 0; i < 4; ++i) {
+    cloud.x()[i] = xs[i];
+    cloud.y()[i] = 0.0f;
+    cloud.z()[i] = 0.0f;
+  }
+  auto tree = KdTree::build(cloud);
+  REQUIRE(tree.has_value());
+
+  const float query[3] = {2.2f, 0.0f, 0.0f};
+  uint32_t indices[6];
+  float distances[6];
+  REQUIRE(tree->knn(query, 6, indices, distances) == 4);
+  REQUIRE(indices[0] == 2);
+  REQUIRE(indices[1] == 3);
+  REQUIRE(indices[3] == 0);
+
+  auto padded = tree->knn(cloud, 6);
+  REQUIRE(padded.has_value());
+  REQUIRE(padded->indices[0] == 0);
+  REQUIRE(padded->indices[5] == kNoNeighbor);
+
+  // N x 1 x 3 is the same layout as N x 3
+  Mat interleaved(4, 1, 3, 0.0f);
+  for (size_t i = 0; i < 4; ++i) {
+    interleaved(i, 0, 0) = xs[i];
+  }
+  auto from_channels = KdTree::build(interleaved);
+  REQUIRE(from_channels.has_value());
+  REQUIRE(from_channels->dims() == 3);
+  REQUIRE(from_channels->knn(query, 1, indices, distances) == 1);
+  REQUIRE(indices[0] == 2);
+
+  REQUIRE(KdTree::build(Mat(4, 4, 1, 0.0f)).error() ==
+          MatError::InvalidDimensions);
+  // non-finite coordinates would break the median splits
+  Mat unordered(4, 3, 1, 0.0f);
+  unordered(2, 1) = std::numeric_limits<float>::quiet_NaN();
+  REQUIRE(KdTree::build(unordered).error() == MatError::InvalidParameter);
+  unordered(2, 1) = std::numeric_limits<float>::infinity();
+  REQUIRE(KdTree::build(unordered).error() == MatError::InvalidParameter);
+  REQUIRE(tree->knn(Mat(2, 2, 1, 0.0f), 1).error() ==
+          MatError::IncompatibleDimensions);
+}
+}  // namespace core
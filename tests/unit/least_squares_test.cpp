@@ -0,0 +1,493 @@
+#include "core/least_squares.hpp"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "core/lie_group.hpp"
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// y = exp(m x + c) with its analytic jacobian with respect to (m, c)
+class ExponentialCost final : public CostFunction {
+ public:
+  ExponentialCost(double x, double y) : CostFunction(1, {2}), x_(x), y_(y) {}
+
+  bool evaluate(const double* const* parameters, double* residuals,
+                double* const* jacobians) const override {
+    const double value = std::exp(parameters[0][0] * x_ + parameters[0][1]);
+    residuals[0] = value - y_;
+    if (jacobians != nullptr && jacobians[0] != nullptr) {
+      jacobians[0][0] = value * x_;
+      jacobians[0][1] = value;
+    }
+    return true;
+  }
+
+ private:
+  double x_;
+  double y_;
+};
+
+// the world point (block 1) seen from a camera at the pose (block 0) minus
+// its observation, differentiated numerically
+class CameraPointCost final : public CostFunction {
+ public:
+  explicit CameraPointCost(const Vec3d& observed)
+      : CostFunction(3, {7, 3}), observed_(observed) {}
+
+  bool evaluate(const double* const* parameters, double* residuals,
+                double* const* jacobians) const override {
+    residual(parameters[0], parameters[1], residuals);
+    if (jacobians == nullptr) {
+      return true;
+    }
+    const double h = 1e-6;
+    for (size_t block = 0; block < 2; ++block) {
+      if (jacobians[block] == nullptr) {
+        continue;
+      }
+      const size_t size = block == 0 ? 7 : 3;
+      for (size_t k = 0; k < size; ++k) {
+        double pose[7], point[3], plus[3], minus[3];
+        std::copy(parameters[0], parameters[0] + 7, pose);
+        std::copy(parameters[1], parameters[1] + 3, point);
+        double* moved = block == 0 ? pose + k : point + k;
+        const double original = *moved;
+        *moved = original + h;
+        residual(pose, point, plus);
+        *moved = original - h;
+        residual(pose, point, minus);
+        for (size_t r = 0; r < 3; ++r) {
+          jacobians[block][r * size + k] = (plus[r] - minus[r]) / (2 * h);
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  void residual(const double* pose, const double* point,
+                double* out) const {
+    const SE3d camera(
+        SO3d::from_quaternion(pose[3], pose[4], pose[5], pose[6]),
+        Vec3d(pose[0], pose[1], pose[2]));
+    const Vec3d seen =
+        camera.inverse() * Vec3d(point[0], point[1], point[2]);
+    for (size_t r = 0; r < 3; ++r) {
+      out[r] = seen[r] - observed_[r];
+    }
+  }
+
+  Vec3d observed_;
+};
+
+// rosenbrock's (10 (y - x^2), 1 - x), counting the evaluations and those
+// with jacobians, which fail past `differentiable` of them
+class RosenbrockCost final : public CostFunction {
+ public:
+  explicit RosenbrockCost(
+      const size_t differentiable = std::numeric_limits<size_t>::max())
+      : CostFunction(2, {2}), differentiable_(differentiable) {}
+
+  bool evaluate(const double* const* parameters, double* residuals,
+                double* const* jacobians) const override {
+    ++evaluated;
+    const double x = parameters[0][0], y = parameters[0][1];
+    residuals[0] = 10.0 * (y - x * x);
+    residuals[1] = 1.0 - x;
+    if (jacobians != nullptr && jacobians[0] != nullptr) {
+      if (differentiated == differentiable_) {
+        return false;
+      }
+      ++differentiated;
+      jacobians[0][0] = -20.0 * x;
+      jacobians[0][1] = 10.0;
+      jacobians[0][2] = -1.0;
+      jacobians[0][3] = 0.0;
+    }
+    return true;
+  }
+
+  mutable std::atomic<size_t> evaluated{0};
+  mutable std::atomic<size_t> differentiated{0};
+
+ private:
+  size_t differentiable_;
+};
+
+// x_0 - x_1 for two 2 vectors
+class DifferenceCost final : public CostFunction {
+ public:
+  DifferenceCost() : CostFunction(2, {2, 2}) {}
+
+  bool evaluate(const double* const* parameters, double* residuals,
+                double* const* jacobians) const override {
+    for (size_t r = 0; r < 2; ++r) {
+      residuals[r] = parameters[0][r] - parameters[1][r];
+      for (size_t block = 0; jacobians != nullptr && block < 2; ++block) {
+        if (jacobians[block] != nullptr) {
+          jacobians[block][r * 2] = r == 0 ? 1.0 - 2.0 * block : 0.0;
+          jacobians[block][r * 2 + 1] = r == 1 ? 1.0 - 2.0 * block : 0.0;
+        }
+      }
+    }
+    return true;
+  }
+};
+
+class FailingCost final : public CostFunction {
+ public:
+  FailingCost() : CostFunction(1, {1}) {}
+  bool evaluate(const double* const*, double*,
+                double* const*) const override {
+    return false;
+  }
+};
+
+void store_pose(const SE3d& pose, double* values) {
+  for (size_t i = 0; i < 3; ++i) {
+    values[i] = pose.translation()[i];
+  }
+  values[3] = pose.rotation().w();
+  values[4] = pose.rotation().x();
+  values[5] = pose.rotation().y();
+  values[6] = pose.rotation().z();
+}
+
+SE3d load_pose(const double* values) {
+  return SE3d(SO3d::from_quaternion(values[3], values[4], values[5],
+                                    values[6]),
+              Vec3d(values[0], values[1], values[2]));
+}
+
+// cameras looking at points around the origin, every camera sees every
+// point. the first camera is held constant to fix the gauge.
+struct Scene {
+  std::vector<SE3d> cameras;
+  std::vector<Vec3d> points;
+  std::vector<double> pose_values;
+  std::vector<double> point_values;
+};
+
+Scene make_scene(const size_t cameras, const size_t points, uint32_t seed) {
+  Scene scene;
+  for (size_t c = 0; c < cameras; ++c) {
+    const Vec3d omega(uniform(seed, -0.3, 0.3), uniform(seed, -0.3, 0.3),
+                      uniform(seed, -0.3, 0.3));
+    const Vec3d t(uniform(seed, -2, 2), uniform(seed, -2, 2),
+                  uniform(seed, -6, -4));
+    scene.cameras.push_back(SE3d(SO3d::exp(omega), t));
+    // perturbed starting values, exact for the fixed first camera
+    const SE3d start =
+        c == 0 ? scene.cameras.back()
+               : scene.cameras.back() *
+                     SE3d::exp(Vec6d(uniform(seed, -0.2, 0.2),
+                                     uniform(seed, -0.2, 0.2),
+                                     uniform(seed, -0.2, 0.2),
+                                     uniform(seed, -0.05, 0.05),
+                                     uniform(seed, -0.05, 0.05),
+                                     uniform(seed, -0.05, 0.05)));
+    scene.pose_values.resize(scene.pose_values.size() + 7);
+    store_pose(start, scene.pose_values.data() + 7 * c);
+  }
+  for (size_t p = 0; p < points; ++p) {
+    scene.points.push_back(Vec3d(uniform(seed, -1, 1), uniform(seed, -1, 1),
+                                 uniform(seed, -1, 1)));
+    for (size_t k = 0; k < 3; ++k) {
+      scene.point_values.push_back(scene.points.back()[k] +
+                                   uniform(seed, -0.1, 0.1));
+    }
+  }
+  return scene;
+}
+
+LeastSquaresProblem make_problem(Scene& scene, const bool eliminate) {
+  LeastSquaresProblem problem;
+  const auto manifold = std::make_shared<SE3Manifold>();
+  for (size_t c = 0; c < scene.cameras.size(); ++c) {
+    const size_t block =
+        *problem.add_parameter_block(scene.pose_values.data() + 7 * c, 7);
+    REQUIRE(problem.set_manifold(block, manifold));
+  }
+  REQUIRE(problem.set_constant(0));
+  for (size_t p = 0; p < scene.points.size(); ++p) {
+    const size_t block =
+        *problem.add_parameter_block(scene.point_values.data() + 3 * p, 3);
+    REQUIRE(problem.set_eliminated(block, eliminate));
+  }
+  for (size_t c = 0; c < scene.cameras.size(); ++c) {
+    for (size_t p = 0; p < scene.points.size(); ++p) {
+      const Vec3d seen = scene.cameras[c].inverse() * scene.points[p];
+      REQUIRE(problem.add_residual_block(
+          std::make_shared<CameraPointCost>(seen),
+          {c, scene.cameras.size() + p}));
+    }
+  }
+  return problem;
+}
+}  // namespace
+
+TEST_CASE("Least squares fits a curve", "[least_squares]") {
+  // enough residual blocks to split the evaluation across threads
+  std::vector<std::shared_ptr<const CostFunction>> costs;
+  uint32_t seed = 1;
+  for (size_t i = 0; i < 2000; ++i) {
+    const double x = static_cast<double>(i) / 400.0;
+    const double noise = uniform(seed, -1e-3, 1e-3);
+    costs.push_back(
+        std::make_shared<ExponentialCost>(x, std::exp(0.3 * x + 0.1) + noise));
+  }
+  for (const NlsMethod method :
+       {NlsMethod::GaussNewton, NlsMethod::LevenbergMarquardt}) {
+    // gauss-newton overshoots from far away, levenberg-marquardt does not
+    const bool levenberg = method == NlsMethod::LevenbergMarquardt;
+    double mc[2] = {levenberg ? 0.0 : 0.25, 0.0};
+    LeastSquaresProblem problem;
+    REQUIRE(*problem.add_parameter_block(mc, 2) == 0);
+    for (const auto& cost : costs) {
+      REQUIRE(problem.add_residual_block(cost, {0}));
+    }
+    REQUIRE(problem.num_residuals() == 2000);
+    LeastSquaresParams params;
+    params.method = method;
+    const auto summary = solve_least_squares(problem, params);
+    REQUIRE(summary.has_value());
+    REQUIRE(summary->converged);
+    REQUIRE(summary->final_cost < summary->initial_cost);
+    REQUIRE(summary->final_cost < 2000 * 1e-6);
+    REQUIRE(std::fabs(mc[0] - 0.3) < 1e-3);
+    REQUIRE(std::fabs(mc[1] - 0.1) < 1e-3);
+    REQUIRE(std::fabs(*problem.cost() - summary->final_cost) < 1e-12);
+  }
+
+  // a held block stays put, the other still fits
+  double mc[2] = {0.3, 0.0};
+  LeastSquaresProblem problem;
+  const size_t block = *problem.add_parameter_block(mc, 2);
+  for (const auto& cost : costs) {
+    REQUIRE(problem.add_residual_block(cost, {block}));
+  }
+  REQUIRE(problem.set_constant(block));
+  const auto summary = solve_least_squares(problem);
+  REQUIRE(summary.has_value());
+  REQUIRE(summary->converged);
+  REQUIRE(mc[0] == 0.3);
+  REQUIRE(mc[1] == 0.0);
+}
+
+TEST_CASE("Levenberg-Marquardt differentiates accepted steps only",
+          "[least_squares]") {
+  // the curved valley rejects steps of a small initial damping
+  const auto cost = std::make_shared<RosenbrockCost>();
+  double xy[2] = {-1.2, 1.0};
+  LeastSquaresProblem problem;
+  const size_t block = *problem.add_parameter_block(xy, 2);
+  REQUIRE(problem.add_residual_block(cost, {block}));
+  LeastSquaresParams params;
+  params.initial_lambda = 1e-8;
+  params.max_iterations = 200;
+  const auto summary = solve_least_squares(problem, params);
+  REQUIRE(summary.has_value());
+  REQUIRE(summary->converged);
+  REQUIRE(std::fabs(xy[0] - 1.0) < 1e-6);
+  REQUIRE(std::fabs(xy[1] - 1.0) < 1e-6);
+  REQUIRE(summary->accepted_steps < summary->iterations);
+  // the starting point and every accepted one
+  REQUIRE(cost->differentiated == summary->accepted_steps + 1);
+}
+
+TEST_CASE("Gauss-Newton evaluates each point once", "[least_squares]") {
+  // every step it takes is accepted until the last, so each trial point is
+  // differentiated as it is evaluated. near the valley its steps descend.
+  const auto cost = std::make_shared<RosenbrockCost>();
+  double xy[2] = {0.9, 0.7};
+  LeastSquaresProblem problem;
+  const size_t block = *problem.add_parameter_block(xy, 2);
+  REQUIRE(problem.add_residual_block(cost, {block}));
+  LeastSquaresParams params;
+  params.method = NlsMethod::GaussNewton;
+  params.max_iterations = 50;
+  const auto summary = solve_least_squares(problem, params);
+  REQUIRE(summary.has_value());
+  REQUIRE(summary->converged);
+  REQUIRE(std::fabs(xy[0] - 1.0) < 1e-6);
+  REQUIRE(std::fabs(xy[1] - 1.0) < 1e-6);
+  REQUIRE(summary->accepted_steps >= 2);
+  REQUIRE(cost->evaluated == cost->differentiated);
+}
+
+TEST_CASE("Least squares stops where jacobians fail", "[least_squares]") {
+  // jacobians fail at the third accepted point, which is given up for the
+  // second one
+  const auto cost = std::make_shared<RosenbrockCost>(3);
+  double xy[2] = {-1.2, 1.0};
+  LeastSquaresProblem problem;
+  const size_t block = *problem.add_parameter_block(xy, 2);
+  REQUIRE(problem.add_residual_block(cost, {block}));
+  LeastSquaresParams params;
+  params.max_iterations = 200;
+  const auto summary = solve_least_squares(problem, params);
+  REQUIRE(summary.has_value());
+  REQUIRE_FALSE(summary->converged);
+  REQUIRE(summary->accepted_steps == 2);
+  REQUIRE(summary->final_cost < summary->initial_cost);
+  double residuals[2];
+  const double* parameters[1] = {xy};
+  REQUIRE(cost->evaluate(parameters, residuals, nullptr));
+  REQUIRE(std::fabs(0.5 * (residuals[0] * residuals[0] +
+                           residuals[1] * residuals[1]) -
+                    summary->final_cost) < 1e-12 * summary->final_cost);
+}
+
+TEST_CASE("Least squares adjusts cameras and points", "[least_squares]") {
+  const Scene original = make_scene(6, 200, 2);
+  std::vector<std::vector<double>> poses;
+  std::vector<std::vector<double>> points;
+  for (const auto& [eliminate, solver] :
+       {std::pair{false, LinearSolverType::DenseCholesky},
+        std::pair{true, LinearSolverType::DenseCholesky},
+        std::pair{true, LinearSolverType::Pcg},
+        std::pair{false, LinearSolverType::SparseCholesky},
+        std::pair{true, LinearSolverType::SparseCholesky}}) {
+    Scene scene = original;
+    LeastSquaresProblem problem = make_problem(scene, eliminate);
+    LeastSquaresParams params;
+    params.linear_solver = solver;
+    LeastSquaresSolver least_squares(params);
+    const auto summary = least_squares.solve(problem);
+    REQUIRE(summary.has_value());
+    REQUIRE(summary->converged);
+    REQUIRE(summary->final_cost < 1e-12);
+    REQUIRE((solver == LinearSolverType::Pcg) ==
+            (summary->linear_iterations > 0));
+    for (size_t c = 0; c < scene.cameras.size(); ++c) {
+      REQUIRE(approx_equal(load_pose(scene.pose_values.data() + 7 * c)
+                               .matrix(),
+                           scene.cameras[c].matrix(), 1e-6));
+    }
+    for (size_t p = 0; p < scene.points.size(); ++p) {
+      for (size_t k = 0; k < 3; ++k) {
+        REQUIRE(std::fabs(scene.point_values[3 * p + k] -
+                          scene.points[p][k]) < 1e-6);
+      }
+    }
+    // the quaternions stay unit length
+    const double* q = scene.pose_values.data() + 7 * 3 + 3;
+    REQUIRE(std::fabs(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3] -
+                      1.0) < 1e-12);
+
+    // solving again from the solution needs no step
+    const auto again = least_squares.solve(problem);
+    REQUIRE(again.has_value());
+    REQUIRE(again->accepted_steps == 0);
+  }
+}
+
+TEST_CASE("Manifold plus jacobians match finite differences",
+          "[least_squares]") {
+  uint32_t seed = 3;
+  const SE3Manifold se3;
+  const SO3Manifold so3;
+  for (int i = 0; i < 20; ++i) {
+    double x[7];
+    store_pose(SE3d(SO3d::exp(Vec3d(uniform(seed, -2, 2),
+                                    uniform(seed, -2, 2),
+                                    uniform(seed, -2, 2))),
+                    Vec3d(uniform(seed, -3, 3), uniform(seed, -3, 3),
+                          uniform(seed, -3, 3))),
+               x);
+    for (const Manifold* manifold : {static_cast<const Manifold*>(&se3),
+                                     static_cast<const Manifold*>(&so3)}) {
+      const double* values = manifold == &se3 ? x : x + 3;
+      const size_t n = manifold->ambient_size();
+      const size_t t = manifold->tangent_size();
+      std::vector<double> jacobian(n * t);
+      manifold->plus_jacobian(values, jacobian.data());
+      const double h = 1e-6;
+      for (size_t k = 0; k < t; ++k) {
+        double delta[6] = {};
+        double plus[7], minus[7];
+        delta[k] = h;
+        manifold->plus(values, delta, plus);
+        delta[k] = -h;
+        manifold->plus(values, delta, minus);
+        for (size_t r = 0; r < n; ++r) {
+          REQUIRE(std::fabs((plus[r] - minus[r]) / (2 * h) -
+                            jacobian[r * t + k]) < 1e-8);
+        }
+      }
+      double zero[6] = {};
+      double same[7];
+      manifold->plus(values, zero, same);
+      for (size_t r = 0; r < n; ++r) {
+        REQUIRE(std::fabs(same[r] - values[r]) < 1e-15);
+      }
+    }
+  }
+}
+
+TEST_CASE("Least squares rejects bad problems", "[least_squares]") {
+  double a[3] = {1.0, 2.0, 3.0};
+  double b[3] = {4.0, 5.0, 6.0};
+  LeastSquaresProblem problem;
+  REQUIRE(problem.add_parameter_block(nullptr, 3).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(problem.add_parameter_block(a, 0).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(solve_least_squares(problem).error() ==
+          MatError::InvalidDimensions);
+  const size_t pose = *problem.add_parameter_block(a, 3);
+  const size_t point = *problem.add_parameter_block(b, 3);
+  const auto cost = std::make_shared<CameraPointCost>(Vec3d());
+  REQUIRE(problem.add_residual_block(nullptr, {pose}).error() ==
+          MatError::InvalidParameter);
+  REQUIRE(problem.add_residual_block(cost, {pose}).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(problem.add_residual_block(cost, {pose, 7}).error() ==
+          MatError::OutOfBounds);
+  REQUIRE(problem.add_residual_block(cost, {pose, point}).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(problem.set_manifold(pose, std::make_shared<SO3Manifold>())
+              .error() == MatError::IncompatibleDimensions);
+  REQUIRE(problem.set_constant(2).error() == MatError::OutOfBounds);
+  REQUIRE(problem.set_eliminated(2).error() == MatError::OutOfBounds);
+
+  // two eliminated blocks may not share a residual block
+  const auto difference = std::make_shared<DifferenceCost>();
+  double c[2] = {1.0, 2.0};
+  double d[2] = {3.0, 5.0};
+  LeastSquaresProblem pair;
+  const size_t first = *pair.add_parameter_block(c, 2);
+  const size_t second = *pair.add_parameter_block(d, 2);
+  REQUIRE(pair.add_residual_block(difference, {first, first}).error() ==
+          MatError::InvalidParameter);
+  REQUIRE(pair.add_residual_block(difference, {first, second}));
+  REQUIRE(pair.set_eliminated(first));
+  REQUIRE(pair.set_eliminated(second));
+  REQUIRE(solve_least_squares(pair).error() == MatError::InvalidParameter);
+  // with one of them held both are fine, the other moves onto it
+  REQUIRE(pair.set_constant(first));
+  const auto summary = solve_least_squares(pair);
+  REQUIRE(summary.has_value());
+  REQUIRE(summary->final_cost < 1e-20);
+  REQUIRE(c[0] == 1.0);
+  REQUIRE(std::fabs(d[0] - 1.0) < 1e-12);
+  REQUIRE(std::fabs(d[1] - 2.0) < 1e-12);
+
+  // residuals that cannot be evaluated at the start
+  LeastSquaresProblem failing;
+  const size_t block = *failing.add_parameter_block(a, 1);
+  REQUIRE(failing.add_residual_block(std::make_shared<FailingCost>(),
+                                     {block}));
+  REQUIRE(failing.cost().error() == MatError::InvalidParameter);
+  REQUIRE(solve_least_squares(failing).error() == MatError::InvalidParameter);
+}
+
+}  // namespace core
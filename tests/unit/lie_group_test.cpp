@@ -0,0 +1,259 @@
+#include "core/lie_group.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+template <typename T>
+FixedMat<3, 1, T> random_vector(uint32_t& seed, const T scale) {
+  return FixedMat<3, 1, T>(uniform<T>(seed, -scale, scale),
+                           uniform<T>(seed, -scale, scale),
+                           uniform<T>(seed, -scale, scale));
+}
+
+template <typename T>
+SE3<T> random_pose(uint32_t& seed) {
+  return SE3<T>(SO3<T>::exp(random_vector<T>(seed, T{2})),
+                random_vector<T>(seed, T{5}));
+}
+
+template <typename T>
+bool same_rotation(const SO3<T>& a, const SO3<T>& b, const T epsilon) {
+  return approx_equal(a.matrix(), b.matrix(), epsilon);
+}
+
+template <typename T>
+bool same_pose(const SE3<T>& a, const SE3<T>& b, const T epsilon) {
+  return approx_equal(a.matrix(), b.matrix(), epsilon);
+}
+}  // namespace
+
+TEST_CASE("SO3 maps, products and matrices agree", "[lie_group]") {
+  uint32_t seed = 1;
+  for (int i = 0; i < 200; ++i) {
+    const Vec3d omega = random_vector(seed, 1.7);
+    const SO3d r = SO3d::exp(omega);
+    REQUIRE(approx_equal(r.log(), omega, 1e-12));
+    REQUIRE(same_rotation(SO3d::from_matrix(r.matrix()), r, 1e-12));
+    REQUIRE(approx_equal(r.matrix() * r.matrix().transpose(),
+                         Mat3d::identity(), 1e-12));
+
+    const SO3d s = SO3d::exp(random_vector(seed, 3.0));
+    const Vec3d p = random_vector(seed, 4.0);
+    REQUIRE(approx_equal((r * s).matrix(), r.matrix() * s.matrix(), 1e-12));
+    REQUIRE(approx_equal(r * p, r.matrix() * p, 1e-12));
+    REQUIRE(same_rotation(r * r.inverse(), SO3d(), 1e-12));
+  }
+
+  // the series branch near zero and angles near pi
+  for (const double angle : {0.0, 1e-9, 1e-4, 0.3, 0.316, 0.317,
+                             std::numbers::pi - 1e-6}) {
+    const Vec3d omega = Vec3d(0.48, -0.6, 0.64) * angle;
+    REQUIRE(approx_equal(SO3d::exp(omega).log(), omega, 1e-9));
+    const Vec3d axis = Vec3d(0.48, -0.6, 0.64);
+    REQUIRE(approx_equal(SO3d::exp(omega) * axis, axis, 1e-12));
+  }
+  // -q is the same rotation, log stays within [0, pi]
+  const SO3d q = SO3d::exp(Vec3d(0.0, 0.0, 0.5));
+  const SO3d flipped =
+      SO3d::from_quaternion(-q.w(), -q.x(), -q.y(), -q.z());
+  REQUIRE(approx_equal(flipped.log(), Vec3d(0.0, 0.0, 0.5), 1e-12));
+  REQUIRE(approx_equal(SO3d::from_quaternion(0, 0, 0, 0).log(),
+                       Vec3d::zeros(), 0.0));
+
+  const SO3f rotation = SO3f::exp(Vec3f(0.1f, 0.2f, 0.3f));
+  REQUIRE(approx_equal(rotation.log(), Vec3f(0.1f, 0.2f, 0.3f), 1e-6f));
+}
+
+TEST_CASE("SO3 jacobians match finite differences", "[lie_group]") {
+  uint32_t seed = 2;
+  const double h = 1e-6;
+  for (const double scale : {1e-5, 0.2, 2.5}) {
+    for (int i = 0; i < 20; ++i) {
+      const Vec3d omega = random_vector(seed, scale);
+      const Mat3d left = SO3d::left_jacobian(omega);
+      const Mat3d right = SO3d::right_jacobian(omega);
+      REQUIRE(approx_equal(left * SO3d::left_jacobian_inverse(omega),
+                           Mat3d::identity(), 1e-12));
+      REQUIRE(approx_equal(right * SO3d::right_jacobian_inverse(omega),
+                           Mat3d::identity(), 1e-12));
+      for (size_t k = 0; k < 3; ++k) {
+        Vec3d d;
+        d[k] = h;
+        const SO3d perturbed = SO3d::exp(omega + d);
+        // exp(omega + d) exp(omega)^-1 ~= exp(J_l d)
+        const Vec3d left_change =
+            (perturbed * SO3d::exp(omega).inverse()).log() / h;
+        const Vec3d right_change =
+            (SO3d::exp(omega).inverse() * perturbed).log() / h;
+        REQUIRE(approx_equal(left_change, left.col(k), 1e-5));
+        REQUIRE(approx_equal(right_change, right.col(k), 1e-5));
+      }
+    }
+  }
+}
+
+TEST_CASE("Jacobian coefficients are accurate at every angle",
+          "[lie_group]") {
+  // against the closed forms in long double, which carry 11 more bits.
+  // those of b and the inverse coefficient cancel as the angle vanishes and
+  // are exact enough only from t = 1e-3 on, where every series term that
+  // matters in double still shows.
+  const auto relative = [](const double value, const long double exact) {
+    return static_cast<double>(std::fabs(value - exact) / std::fabs(exact));
+  };
+  const double eps = std::numeric_limits<double>::epsilon();
+  for (double t = 1e-12; t < 9.0; t *= 1.01) {
+    const long double theta = std::sqrt(static_cast<long double>(t));
+    const long double half_sine = std::sin(theta / 2);
+    double a = 0.0, b = 0.0;
+    lie_detail::jacobian_coefficients(t, a, b);
+    REQUIRE(relative(a, 2 * half_sine * half_sine / theta / theta) <
+            8 * eps);
+    REQUIRE(relative(lie_detail::half_sine_ratio(t), half_sine / theta) <
+            8 * eps);
+    if (t < 1e-3) {
+      continue;
+    }
+    REQUIRE(relative(b, (theta - std::sin(theta)) / (theta * theta * theta)) <
+            8 * eps);
+    REQUIRE(relative(lie_detail::inverse_jacobian_coefficient(t),
+                     1 / (theta * theta) - (1 + std::cos(theta)) /
+                                               (2 * theta * std::sin(theta))) <
+            64 * eps);
+  }
+}
+
+TEST_CASE("SE3 maps, inverses, adjoints and interpolation", "[lie_group]") {
+  uint32_t seed = 3;
+  for (int i = 0; i < 100; ++i) {
+    const SE3d a = random_pose<double>(seed);
+    const SE3d b = random_pose<double>(seed);
+    const Vec3d p = random_vector(seed, 3.0);
+    REQUIRE(same_pose(SE3d::exp(a.log()), a, 1e-11));
+    REQUIRE(same_pose(SE3d::from_matrix(a.matrix()), a, 1e-12));
+    REQUIRE(approx_equal((a * b).matrix(), a.matrix() * b.matrix(), 1e-12));
+    REQUIRE(same_pose(a * a.inverse(), SE3d(), 1e-12));
+    REQUIRE(approx_equal(a.inverse() * (a * p), p, 1e-12));
+
+    const Vec6d xi = b.log() * 0.1;
+    REQUIRE(same_pose(a * SE3d::exp(xi) * a.inverse(),
+                      SE3d::exp(a.adjoint() * xi), 1e-11));
+
+    REQUIRE(same_pose(interpolate(a, b, 0.0), a, 1e-12));
+    REQUIRE(same_pose(interpolate(a, b, 1.0), b, 1e-12));
+    const SE3d half = interpolate(a, b, 0.5);
+    REQUIRE(approx_equal(half.translation(),
+                         (a.translation() + b.translation()) * 0.5, 1e-12));
+    // halfway along the relative rotation, from either end
+    const Vec3d relative = (a.rotation().inverse() * b.rotation()).log();
+    REQUIRE(same_rotation(half.rotation(),
+                          a.rotation() * SO3d::exp(relative * 0.5), 1e-9));
+  }
+  // nearly equal rotations take the linear branch
+  const SO3d r = SO3d::exp(Vec3d(0.3, 0.1, 0.0));
+  const SO3d s = r * SO3d::exp(Vec3d(0.0, 0.0, 1e-4));
+  REQUIRE(same_rotation(slerp(r, s, 0.5),
+                        r * SO3d::exp(Vec3d(0.0, 0.0, 5e-5)), 1e-9));
+}
+
+TEST_CASE("Batched pose operations match single poses", "[lie_group]") {
+  // enough columns to split the kernels across threads, and a ragged tile
+  const size_t n = 40003;
+  uint32_t seed = 4;
+  std::vector<SE3f> a_poses, b_poses;
+  Mat points(3, n, 1);
+  for (size_t i = 0; i < n; ++i) {
+    a_poses.push_back(random_pose<float>(seed));
+    b_poses.push_back(random_pose<float>(seed));
+    const Vec3f p = random_vector(seed, 3.0f);
+    for (size_t r = 0; r < 3; ++r) {
+      points(r, i) = p[r];
+    }
+  }
+  const Mat a = poses_to_mat(a_poses);
+  const Mat b = poses_to_mat(b_poses);
+  REQUIRE(same_pose(pose_at(a, 17), a_poses[17], 1e-6f));
+
+  Mat out;
+  REQUIRE(transform_points(a_poses[0], points, out));
+  Mat per_pose;
+  REQUIRE(transform_points(a, points, per_pose));
+  Mat composed, inverted, interpolated, tangents, exponentials;
+  REQUIRE(compose_poses(a, b, composed));
+  REQUIRE(invert_poses(a, inverted));
+  REQUIRE(interpolate_poses(a, b, 0.3f, interpolated));
+  REQUIRE(log_poses(a, tangents));
+  REQUIRE(exp_poses(tangents, exponentials));
+  for (size_t i = 0; i < n; i += 7) {
+    const Vec3f p(points(0, i), points(1, i), points(2, i));
+    REQUIRE(approx_equal(Vec3f(out(0, i), out(1, i), out(2, i)),
+                         a_poses[0] * p, 1e-5f));
+    REQUIRE(approx_equal(
+        Vec3f(per_pose(0, i), per_pose(1, i), per_pose(2, i)),
+        a_poses[i] * p, 1e-5f));
+    REQUIRE(same_pose(pose_at(composed, i), a_poses[i] * b_poses[i], 1e-5f));
+    REQUIRE(same_pose(pose_at(inverted, i), a_poses[i].inverse(), 1e-5f));
+    REQUIRE(same_pose(pose_at(interpolated, i),
+                      interpolate(a_poses[i], b_poses[i], 0.3f), 1e-5f));
+    const Vec6f xi = a_poses[i].log();
+    for (size_t r = 0; r < 6; ++r) {
+      // relative, translations grow large for angles near pi
+      REQUIRE(approx_equal(tangents(r, i), xi[r],
+                           1e-5f * (1.0f + std::fabs(xi[r]))));
+    }
+    REQUIRE(same_pose(pose_at(exponentials, i), a_poses[i], 1e-4f));
+  }
+
+  // a single pose on either side applies to all, outputs may be inputs
+  Mat single = poses_to_mat(std::vector<SE3f>{b_poses[5]});
+  Mat in_place = a.clone();
+  REQUIRE(compose_poses(in_place, single, in_place));
+  REQUIRE(compose_poses(single, a, single));
+  REQUIRE(single.cols() == n);
+  for (size_t i = 0; i < n; i += 101) {
+    REQUIRE(same_pose(pose_at(in_place, i), a_poses[i] * b_poses[5], 1e-5f));
+    REQUIRE(same_pose(pose_at(single, i), b_poses[5] * a_poses[i], 1e-5f));
+  }
+  Mat moved = points.clone();
+  REQUIRE(transform_points(a, moved, moved));
+  REQUIRE(moved == per_pose);
+  Mat twice = a.clone();
+  REQUIRE(invert_poses(twice, twice));
+  REQUIRE(invert_poses(twice, twice));
+  REQUIRE(same_pose(pose_at(twice, n - 1), a_poses[n - 1], 1e-5f));
+}
+
+TEST_CASE("Batched pose operations reject bad shapes", "[lie_group]") {
+  Mat out;
+  REQUIRE(transform_points(SE3f(), Mat(), out).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(transform_points(SE3f(), Mat(4, 5, 1), out).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(transform_points(SE3f(), Mat(3, 5, 2), out).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(transform_points(Mat(7, 4, 1), Mat(3, 5, 1), out).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(compose_poses(Mat(7, 4, 1), Mat(7, 5, 1), out).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(compose_poses(Mat(6, 4, 1), Mat(7, 4, 1), out).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(interpolate_poses(Mat(7, 4, 1), Mat(7, 1, 1), 0.5f, out).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(interpolate_poses(Mat(7, 4, 1), Mat(7, 4, 1), 1.5f, out).error() ==
+          MatError::InvalidParameter);
+  REQUIRE(exp_poses(Mat(7, 4, 1), out).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(log_poses(Mat(6, 4, 1), out).error() ==
+          MatError::InvalidDimensions);
+}
+
+}  // namespace core
@@ -0,0 +1,166 @@
+#include "core/matcher.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+
+namespace core {
+namespace {
+uint64_t next(uint64_t& state) {
+  state = state * 6364136223846793005ull + 1442695040888963407ull;
+  return state ^ (state >> 29);
+}
+
+std::vector<Descriptor> random_descriptors(const size_t n, uint64_t seed) {
+  std::vector<Descriptor> descriptors(n);
+  for (Descriptor& descriptor : descriptors) {
+    for (uint64_t& word : descriptor.words) {
+      word = next(seed);
+    }
+  }
+  return descriptors;
+}
+
+// copies of `source` with `flips` random bits flipped
+std::vector<Descriptor> noisy_copies(const std::vector<Descriptor>& source,
+                                     const size_t flips, uint64_t seed) {
+  std::vector<Descriptor> copies = source;
+  for (Descriptor& descriptor : copies) {
+    for (size_t i = 0; i < flips; ++i) {
+      const uint64_t bit = next(seed) % 256;
+      descriptor.words[bit / 64] ^= uint64_t{1} << (bit % 64);
+    }
+  }
+  return copies;
+}
+
+// nearest train descriptor of every query by exhaustive search, ties going
+// to the lower index
+std::vector<Match> naive_match(const std::vector<Descriptor>& queries,
+                               const std::vector<Descriptor>& train,
+                               const MatchParams& params) {
+  const auto nearest = [](const Descriptor& query,
+                          const std::vector<Descriptor>& candidates,
+                          uint32_t& second) {
+    uint32_t best = 0, best_distance = 257;
+    second = 257;
+    for (uint32_t i = 0; i < candidates.size(); ++i) {
+      const uint32_t distance = hamming_distance(query, candidates[i]);
+      if (distance < best_distance) {
+        second = best_distance;
+        best_distance = distance;
+        best = i;
+      } else if (distance < second) {
+        second = distance;
+      }
+    }
+    return best;
+  };
+  std::vector<Match> matches;
+  for (uint32_t q = 0; q < queries.size(); ++q) {
+    uint32_t second = 0, unused = 0;
+    const uint32_t t = nearest(queries[q], train, second);
+    const uint32_t distance = hamming_distance(queries[q], train[t]);
+    if (distance > params.max_distance ||
+        (params.ratio < 1.0f && second <= 256 &&
+         !(static_cast<float>(distance) <
+           params.ratio * static_cast<float>(second)))) {
+      continue;
+    }
+    if (params.cross_check && nearest(train[t], queries, unused) != q) {
+      continue;
+    }
+    matches.push_back({q, t, distance});
+  }
+  return matches;
+}
+
+void require_equal(const std::vector<Match>& a, const std::vector<Match>& b) {
+  REQUIRE(a.size() == b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    REQUIRE(a[i].query == b[i].query);
+    REQUIRE(a[i].train == b[i].train);
+    REQUIRE(a[i].distance == b[i].distance);
+  }
+}
+}  // namespace
+
+TEST_CASE("Brute-force matching agrees with exhaustive search", "[matcher]") {
+  const auto train = random_descriptors(700, 1);
+  // half the queries are near copies of train descriptors, half are noise
+  auto queries = noisy_copies(
+      std::vector<Descriptor>(train.begin(), train.begin() + 300), 20, 2);
+  const auto noise = random_descriptors(300, 3);
+  queries.insert(queries.end(), noise.begin(), noise.end());
+
+  for (const float ratio : {1.0f, 0.8f}) {
+    for (const bool cross_check : {false, true}) {
+      MatchParams params;
+      params.ratio = ratio;
+      params.cross_check = cross_check;
+      auto matches = match_brute_force(queries, train, params);
+      REQUIRE(matches.has_value());
+      require_equal(*matches, naive_match(queries, train, params));
+    }
+  }
+
+  MatchParams params;
+  params.max_distance = 40;
+  auto matches = match_brute_force(queries, train, params);
+  REQUIRE(matches->size() == 300);
+  for (size_t i = 0; i < matches->size(); ++i) {
+    REQUIRE((*matches)[i].query == i);
+    REQUIRE((*matches)[i].train == i);
+  }
+}
+
+TEST_CASE("Multi-index hashing matches brute force", "[matcher]") {
+  const auto train = random_descriptors(3000, 4);
+  auto queries = noisy_copies(
+      std::vector<Descriptor>(train.begin() + 500, train.begin() + 1500), 12,
+      5);
+  const auto noise = random_descriptors(200, 6);
+  queries.insert(queries.end(), noise.begin(), noise.end());
+
+  const MultiIndexHash index = MultiIndexHash::build(train);
+  REQUIRE(index.size() == train.size());
+  for (const float ratio : {1.0f, 0.8f}) {
+    for (const bool cross_check : {false, true}) {
+      for (const uint32_t max_distance : {256u, 30u}) {
+        MatchParams params;
+        params.ratio = ratio;
+        params.cross_check = cross_check;
+        params.max_distance = max_distance;
+        auto hashed = index.match(queries, params);
+        auto exhaustive = match_brute_force(queries, train, params);
+        REQUIRE(hashed.has_value());
+        require_equal(*hashed, *exhaustive);
+      }
+    }
+  }
+}
+
+TEST_CASE("Matcher input validation", "[matcher]") {
+  const auto descriptors = random_descriptors(10, 7);
+  MatchParams params;
+  params.ratio = 0.0f;
+  REQUIRE(match_brute_force(descriptors, descriptors, params).error() ==
+          MatError::InvalidParameter);
+  REQUIRE(MultiIndexHash::build(descriptors)
+              .match(descriptors, params)
+              .error() == MatError::InvalidParameter);
+
+  REQUIRE(match_brute_force({}, descriptors)->empty());
+  REQUIRE(match_brute_force(descriptors, {})->empty());
+  REQUIRE(MultiIndexHash().match(descriptors)->empty());
+
+  // a descriptor set matched against itself pairs every element with itself
+  params = {};
+  params.cross_check = true;
+  auto matches = MultiIndexHash::build(descriptors).match(descriptors, params);
+  REQUIRE(matches->size() == descriptors.size());
+  for (const Match& match : *matches) {
+    REQUIRE(match.query == match.train);
+    REQUIRE(match.distance == 0);
+  }
+}
+}  // namespace core
@@ -0,0 +1,119 @@
+#include "core/median_blur.hpp"
+
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// uniform values, or multiples of 1 / 255 with `levels`
+// 8-bit levels, so plenty of ties
+Mat random_levels(const size_t rows, const size_t cols, const size_t channels,
+                  uint32_t seed) {
+  Mat image(rows, cols, channels);
+  for (size_t i = 0; i < image.size(); ++i) {
+    image.data()[i] = static_cast<float>(next(seed) >> 16) / 255.0f;
+  }
+  return image;
+}
+
+Mat reference_median(const Mat& image, const size_t radius) {
+  const auto r = static_cast<int>(radius);
+  const auto rows = static_cast<int>(image.rows());
+  const auto cols = static_cast<int>(image.cols());
+  Mat out(image.rows(), image.cols(), image.channels());
+  std::vector<float> window;
+  for (int y = 0; y < rows; ++y) {
+    for (int x = 0; x < cols; ++x) {
+      for (size_t c = 0; c < image.channels(); ++c) {
+        window.clear();
+        for (int dy = -r; dy <= r; ++dy) {
+          for (int dx = -r; dx <= r; ++dx) {
+            window.push_back(image(std::clamp(y + dy, 0, rows - 1),
+                                   std::clamp(x + dx, 0, cols - 1), c));
+          }
+        }
+        std::nth_element(window.begin(), window.begin() + window.size() / 2,
+                         window.end());
+        out(y, x, c) = window[window.size() / 2];
+      }
+    }
+  }
+  return out;
+}
+}  // namespace
+
+TEST_CASE("Small median windows are exact on floats", "[median_blur]") {
+  for (const size_t radius : {size_t{1}, size_t{2}}) {
+    for (const auto& [rows, cols, channels] :
+         {std::array<size_t, 3>{37, 91, 1},
+          {20, 70, 3},
+          {1, 5, 1},
+          {6, 1, 2}}) {
+      const Mat image = random_image(rows, cols, channels, 11);
+      auto filtered = median_blur(image, radius);
+      REQUIRE(filtered.has_value());
+      REQUIRE(*filtered == reference_median(image, radius));
+    }
+  }
+  const Mat image = random_image(4, 4, 1, 2);
+  REQUIRE(median_blur(image, 0).value() == image);
+}
+
+TEST_CASE("Large median windows are exact on 8-bit levels",
+          "[median_blur]") {
+  for (const size_t radius : {size_t{3}, size_t{7}, size_t{30}}) {
+    for (const auto& [rows, cols, channels] :
+         {std::array<size_t, 3>{45, 67, 1}, {19, 23, 2}}) {
+      const Mat image = random_levels(rows, cols, channels, 5);
+      auto filtered = median_blur(image, radius);
+      REQUIRE(filtered.has_value());
+      const Mat expected = reference_median(image, radius);
+      for (size_t i = 0; i < expected.size(); ++i) {
+        REQUIRE(approx_equal(filtered->data()[i], expected.data()[i], 1e-6f));
+      }
+    }
+  }
+
+  // levels over another range, values beyond it are clamped
+  Mat depth(30, 30, 1, 2.0f);
+  depth(3, 4) = 10.0f;
+  depth(20, 20) = -5.0f;
+  auto filtered = median_blur(depth, 4, 0.0f, 5.1f);
+  REQUIRE(filtered.has_value());
+  for (size_t i = 0; i < filtered->size(); ++i) {
+    REQUIRE(approx_equal(filtered->data()[i], 2.0f, 1e-5f));
+  }
+}
+
+TEST_CASE("Median blur removes salt and pepper noise", "[median_blur]") {
+  Mat image(60, 80, 1, 100.0f / 255.0f);
+  uint32_t seed = 9;
+  for (size_t i = 0; i < image.size(); ++i) {
+    const uint32_t bits = next(seed);
+    if ((bits >> 16) < 20) {
+      image.data()[i] = bits % 2 == 0 ? 0.0f : 1.0f;
+    }
+  }
+  for (const size_t radius : {size_t{2}, size_t{5}, size_t{10}}) {
+    auto filtered = median_blur(image, radius);
+    REQUIRE(filtered.has_value());
+    for (size_t i = 0; i < filtered->size(); ++i) {
+      REQUIRE(approx_equal(filtered->data()[i], 100.0f / 255.0f, 1e-6f));
+    }
+  }
+}
+
+TEST_CASE("Median blur rejects bad inputs", "[median_blur]") {
+  REQUIRE(median_blur(Mat(), 1).error() == MatError::InvalidDimensions);
+  const Mat image(5, 5, 1);
+  REQUIRE(median_blur(image, 128).error() == MatError::InvalidParameter);
+  REQUIRE(median_blur(image, 3, 1.0f, 1.0f).error() ==
+          MatError::InvalidParameter);
+}
+}  // namespace core
@@ -0,0 +1,190 @@
+#include "core/optical_flow.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+
+namespace core {
+namespace {
+// smooth texture with structure in every direction, shifted by (dx, dy)
+Mat texture(const size_t rows, const size_t cols, const float dx,
+            const float dy) {
+  Mat image(rows, cols, 1);
+  for (size_t y = 0; y < rows; ++y) {
+    for (size_t x = 0; x < cols; ++x) {
+      const float u = static_cast<float>(x) - dx;
+      const float v = static_cast<float>(y) - dy;
+      image(y, x) = 0.5f + 0.15f * std::sin(0.21f * u + 0.07f * v) +
+                    0.15f * std::cos(0.05f * u - 0.19f * v) +
+                    0.1f * std::sin(0.13f * u + 0.17f * v + 1.0f);
+    }
+  }
+  return image;
+}
+
+Pyramid build(const Mat& image) {
+  Pyramid pyramid;
+  REQUIRE(pyramid.build(image).has_value());
+  return pyramid;
+}
+}  // namespace
+
+TEST_CASE("KLT recovers a subpixel translation", "[optical_flow]") {
+  const float dx = 5.3f, dy = -3.6f;
+  const Pyramid previous = build(texture(160, 200, 0.0f, 0.0f));
+  const Pyramid next = build(texture(160, 200, dx, dy));
+  REQUIRE(previous.num_levels() == 4);
+
+  std::vector<Point2> points;
+  for (float y = 30.0f; y < 130.0f; y += 10.0f) {
+    for (float x = 30.0f; x < 170.0f; x += 10.0f) {
+      points.push_back({x + 0.25f, y + 0.5f});
+    }
+  }
+  auto tracks = track_klt(previous, next, points);
+  REQUIRE(tracks.has_value());
+  REQUIRE(tracks->size() == points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    const Track& track = (*tracks)[i];
+    REQUIRE(track.status == TrackStatus::Tracked);
+    REQUIRE(std::abs(track.x - points[i].x - dx) < 0.05f);
+    REQUIRE(std::abs(track.y - points[i].y - dy) < 0.05f);
+    REQUIRE(track.forward_backward_error < 0.1f);
+  }
+
+  // a good guess is kept, without pyramid levels to fall back on
+  PyramidParams single;
+  single.num_levels = 1;
+  Pyramid flat_previous(single), flat_next(single);
+  REQUIRE(flat_previous.build(previous.level(0)).has_value());
+  REQUIRE(flat_next.build(next.level(0)).has_value());
+  std::vector<Point2> guesses;
+  for (const Point2& point : points) {
+    guesses.push_back({point.x + dx + 0.8f, point.y + dy - 0.8f});
+  }
+  tracks = track_klt(flat_previous, flat_next, points, {}, guesses);
+  for (size_t i = 0; i < points.size(); ++i) {
+    REQUIRE(std::abs((*tracks)[i].x - points[i].x - dx) < 0.05f);
+    REQUIRE(std::abs((*tracks)[i].y - points[i].y - dy) < 0.05f);
+  }
+}
+
+TEST_CASE("KLT flags untrackable points", "[optical_flow]") {
+  Mat first = texture(128, 128, 0.0f, 0.0f);
+  Mat second = texture(128, 128, 2.0f, 1.0f);
+  // flat in both frames
+  for (size_t y = 0; y < 40; ++y) {
+    for (size_t x = 0; x < 40; ++x) {
+      first(y, x) = 0.3f;
+      second(y, x) = 0.3f;
+    }
+  }
+  // the texture under this point is replaced by an unrelated one
+  const Mat other = texture(128, 128, 40.0f, 17.0f);
+  for (size_t y = 70; y < 110; ++y) {
+    for (size_t x = 70; x < 110; ++x) {
+      second(y, x) = 1.0f - other(x, y);
+    }
+  }
+  const Pyramid previous = build(first);
+  const Pyramid next = build(second);
+  const std::vector<Point2> points = {{15.0f, 15.0f}, {90.0f, 90.0f},
+                                      {126.0f, 60.0f}, {60.0f, 60.0f}};
+  std::vector<Point2> guesses = {
+      {15.0f, 15.0f}, {92.0f, 91.0f}, {200.0f, 61.0f}, {62.0f, 61.0f}};
+  KltParams params;
+  params.max_forward_backward_error = 0.5f;
+  auto tracks = track_klt(previous, next, points, params, guesses);
+  REQUIRE(tracks.has_value());
+  REQUIRE((*tracks)[0].status == TrackStatus::Untextured);
+  REQUIRE((*tracks)[1].status != TrackStatus::Tracked);
+  REQUIRE((*tracks)[2].status == TrackStatus::Lost);
+  REQUIRE((*tracks)[3].status == TrackStatus::Tracked);
+
+  params.forward_backward_check = false;
+  tracks = track_klt(previous, next, points, params, guesses);
+  REQUIRE((*tracks)[3].status == TrackStatus::Tracked);
+  REQUIRE((*tracks)[3].forward_backward_error == 0.0f);
+}
+
+TEST_CASE("DIS flow follows a smoothly varying motion", "[optical_flow]") {
+  const size_t rows = 120, cols = 160;
+  // next(y, x) = previous(y - v, x - u) for the flow below, so the flow at
+  // previous pixel (x, y) is (u, v) up to the slow variation of the field
+  const auto u = [](const float x, const float y) {
+    return 2.5f + 0.02f * (y - 60.0f) + 0.0f * x;
+  };
+  const auto v = [](const float x, const float y) {
+    return -1.5f + 0.015f * (x - 80.0f) + 0.0f * y;
+  };
+  const Mat first = texture(rows, cols, 0.0f, 0.0f);
+  Mat second(rows, cols, 1);
+  for (size_t y = 0; y < rows; ++y) {
+    for (size_t x = 0; x < cols; ++x) {
+      const auto fx = static_cast<float>(x), fy = static_cast<float>(y);
+      second(y, x) = texture(1, 1, u(fx, fy) - fx, v(fx, fy) - fy)(0, 0);
+    }
+  }
+  const Pyramid previous = build(first);
+  const Pyramid next = build(second);
+
+  for (const size_t finest : {0, 2}) {
+    for (const size_t variational : {0, 5}) {
+      DisParams params;
+      params.finest_level = finest;
+      params.variational_iterations = variational;
+      Mat flow;
+      DisFlow estimator(params);
+      REQUIRE(estimator.compute(previous, next, flow).has_value());
+      REQUIRE(flow.rows() == rows);
+      REQUIRE(flow.cols() == cols);
+      REQUIRE(flow.channels() == 2);
+
+      float error = 0.0f;
+      size_t count = 0;
+      for (size_t y = 10; y + 10 < rows; ++y) {
+        for (size_t x = 10; x + 10 < cols; ++x) {
+          const auto fx = static_cast<float>(x), fy = static_cast<float>(y);
+          error += std::hypot(flow(y, x, 0) - u(fx, fy),
+                              flow(y, x, 1) - v(fx, fy));
+          ++count;
+        }
+      }
+      REQUIRE(error / static_cast<float>(count) < 0.2f);
+    }
+  }
+}
+
+TEST_CASE("DIS flow of identical frames is zero", "[optical_flow]") {
+  const Pyramid pyramid = build(texture(96, 128, 0.0f, 0.0f));
+  auto flow = dis_flow(pyramid, pyramid);
+  REQUIRE(flow.has_value());
+  for (size_t i = 0; i < flow->size(); ++i) {
+    REQUIRE(std::abs(flow->data()[i]) < 0.01f);
+  }
+}
+
+TEST_CASE("KLT input validation", "[optical_flow]") {
+  const Pyramid small = build(Mat(64, 64, 1, 0.0f));
+  const Pyramid large = build(Mat(128, 128, 1, 0.0f));
+  const Pyramid color = build(Mat(64, 64, 3, 0.0f));
+  const std::vector<Point2> points(3);
+  REQUIRE(track_klt(small, large, points).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(track_klt(color, color, points).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(track_klt(small, small, points, {}, std::vector<Point2>(2))
+              .error() == MatError::IncompatibleDimensions);
+  KltParams params;
+  params.epsilon = 0.0f;
+  REQUIRE(track_klt(small, small, points, params).error() ==
+          MatError::InvalidParameter);
+  REQUIRE(track_klt(small, small, {})->empty());
+
+  REQUIRE(dis_flow(small, large).error() == MatError::IncompatibleDimensions);
+  REQUIRE(dis_flow(color, color).error() ==
+          MatError::InvalidChannelsForOperation);
+  DisParams dis;
+  dis.patch_stride = 16;
+  REQUIRE(dis_flow(small, small, dis).error() == MatError::InvalidParameter);
+}
+}  // namespace core
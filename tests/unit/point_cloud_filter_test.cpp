@@ -0,0 +1,129 @@
+#include "core/point_cloud_filter.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <limits>
+
+namespace core {
+namespace {
+// n^3 points on a lattice with the given spacing, starting at the origin
+PointCloud lattice(const size_t n, const float spacing) {
+  PointCloud cloud(n * n * n);
+  size_t i = 0;
+  for (size_t z = 0; z < n; ++z) {
+    for (size_t y = 0; y < n; ++y) {
+      for (size_t x = 0; x < n; ++x, ++i) {
+        cloud.x()[i] = static_cast<float>(x) * spacing;
+        cloud.y()[i] = static_cast<float>(y) * spacing;
+        cloud.z()[i] = static_cast<float>(z) * spacing;
+      }
+    }
+  }
+  return cloud;
+}
+
+bool contains(const PointCloud& cloud, const float x, const float y,
+              const float z) {
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    if (approx_equal(cloud.x()[i], x) && approx_equal(cloud.y()[i], y) &&
+        approx_equal(cloud.z()[i], z)) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace
+
+TEST_CASE("Voxel downsampling to centroids", "[point_cloud_filter]") {
+  // 8x8x8 lattice at spacing 1 collapses 2x2x2 blocks into one voxel each
+  PointCloud cloud = lattice(8, 1.0f);
+  cloud.enable_colors();
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    cloud.r()[i] = static_cast<float>(i % 2);
+  }
+
+  auto down = voxel_downsample(cloud, 2.0f);
+  REQUIRE(down.has_value());
+  REQUIRE(down->size() == 64);
+  REQUIRE(down->has_colors());
+  REQUIRE(contains(*down, 0.5f, 0.5f, 0.5f));
+  REQUIRE(contains(*down, 6.5f, 2.5f, 4.5f));
+  REQUIRE(approx_equal(down->r()[0], 0.5f));
+}
+
+TEST_CASE("Voxel downsampling keeps first points", "[point_cloud_filter]") {
+  PointCloud cloud(5);
+  // voxels are aligned to the minimum corner of the finite points
+  const float xs[] = {0.9f, 0.1f, 5.0f, 0.5f, 5.05f};
+  for (size_t i = 0; i < 5; ++i) {
+    cloud.x()[i] = xs[i];
+    cloud.y()[i] = 0.0f;
+    cloud.z()[i] = 0.0f;
+  }
+  cloud.y()[3] = std::numeric_limits<float>::quiet_NaN();
+
+  auto down = voxel_downsample(cloud, 1.0f, VoxelMode::First);
+  REQUIRE(down.has_value());
+  REQUIRE(down->size() == 2);
+  REQUIRE(down->x()[0] == 0.9f);
+  REQUIRE(down->x()[1] == 5.0f);
+
+  REQUIRE(voxel_downsample(cloud, 0.0f).error() == MatError::InvalidParameter);
+  REQUIRE(voxel_downsample(PointCloud(), 1.0f)->empty());
+}
+
+TEST_CASE("Outlier removal", "[point_cloud_filter]") {
+  PointCloud cloud = lattice(6, 0.1f);
+  const size_t inliers = cloud.size();
+  cloud.resize(inliers + 2);
+  cloud.x()[inliers] = 3.0f;
+  cloud.y()[inliers] = 3.0f;
+  cloud.z()[inliers] = 3.0f;
+  cloud.x()[inliers + 1] = -2.0f;
+  cloud.y()[inliers + 1] = 0.2f;
+  cloud.z()[inliers + 1] = 0.2f;
+
+  auto by_radius = remove_radius_outliers(cloud, 0.15f, 3);
+  REQUIRE(by_radius.has_value());
+  REQUIRE(by_radius->size() == inliers);
+  REQUIRE_FALSE(contains(*by_radius, 3.0f, 3.0f, 3.0f));
+
+  auto by_statistics = remove_statistical_outliers(cloud, 8, 1.0f);
+  REQUIRE(by_statistics.has_value());
+  REQUIRE_FALSE(contains(*by_statistics, 3.0f, 3.0f, 3.0f));
+  REQUIRE_FALSE(contains(*by_statistics, -2.0f, 0.2f, 0.2f));
+  REQUIRE(contains(*by_statistics, 0.2f, 0.2f, 0.2f));
+  REQUIRE(by_statistics->size() > inliers / 2);
+
+  REQUIRE(remove_statistical_outliers(cloud, 0, 1.0f).error() ==
+          MatError::InvalidParameter);
+}
+
+TEST_CASE("Outlier removal drops non-finite points", "[point_cloud_filter]") {
+  PointCloud cloud = lattice(4, 0.1f);
+  const size_t finite = cloud.size();
+  cloud.resize(finite + 3);
+  for (size_t i = finite; i < finite + 3; ++i) {
+    cloud.x()[i] = 0.1f;
+    cloud.y()[i] = 0.1f;
+    cloud.z()[i] = 0.1f;
+  }
+  cloud.x()[finite] = std::numeric_limits<float>::quiet_NaN();
+  cloud.y()[finite + 1] = std::numeric_limits<float>::infinity();
+  cloud.z()[finite + 2] = -std::numeric_limits<float>::infinity();
+
+  auto by_radius = remove_radius_outliers(cloud, 0.15f, 1);
+  REQUIRE(by_radius.has_value());
+  REQUIRE(by_radius->size() == finite);
+  auto by_statistics = remove_statistical_outliers(cloud, 4, 10.0f);
+  REQUIRE(by_statistics.has_value());
+  REQUIRE(by_statistics->size() == finite);
+  for (const PointCloud* out : {&*by_radius, &*by_statistics}) {
+    for (size_t i = 0; i < out->size(); ++i) {
+      REQUIRE(std::isfinite(out->x()[i]));
+      REQUIRE(std::isfinite(out->y()[i]));
+      REQUIRE(std::isfinite(out->z()[i]));
+    }
+  }
+}
+}  // namespace core
@@ -0,0 +1,101 @@
+#include "core/point_cloud.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <limits>
+
+namespace core {
+TEST_CASE("PointCloud container", "[point_cloud]") {
+  PointCloud cloud(4);
+  REQUIRE(cloud.size() == 4);
+  REQUIRE_FALSE(cloud.has_colors());
+  REQUIRE(cloud.r() == nullptr);
+
+  cloud.enable_colors();
+  cloud.enable_normals();
+  REQUIRE(cloud.has_colors());
+  REQUIRE(cloud.has_normals());
+  cloud.x()[3] = 1.0f;
+  cloud.r()[3] = 0.5f;
+  cloud.nz()[3] = 1.0f;
+
+  cloud.resize(10);
+  REQUIRE(cloud.size() == 10);
+  REQUIRE(cloud.x()[3] == 1.0f);
+  REQUIRE(cloud.r()[3] == 0.5f);
+  REQUIRE(cloud.nz()[3] == 1.0f);
+
+  const Mat mat = cloud.to_mat();
+  REQUIRE(mat.rows() == 10);
+  REQUIRE(mat.cols() == 3);
+  REQUIRE(mat(3, 0) == 1.0f);
+
+  cloud.clear();
+  REQUIRE(cloud.empty());
+}
+
+TEST_CASE("Depth projection through a pinhole camera", "[point_cloud]") {
+  const CameraIntrinsics intrinsics{100.0f, 200.0f, 2.0f, 1.0f};
+  Mat depth(3, 4, 1, 2.0f);
+  depth(0, 0) = 0.0f;
+  depth(1, 1) = -1.0f;
+  depth(2, 3) = std::numeric_limits<float>::quiet_NaN();
+  depth(2, 2) = std::numeric_limits<float>::infinity();
+
+  auto cloud = depth_to_points(depth, intrinsics);
+  REQUIRE(cloud.has_value());
+  REQUIRE(cloud->size() == 8);
+
+  // first valid pixel is (row 0, col 1)
+  REQUIRE(approx_equal(cloud->x()[0], (1.0f - 2.0f) * 2.0f / 100.0f));
+  REQUIRE(approx_equal(cloud->y()[0], (0.0f - 1.0f) * 2.0f / 200.0f));
+  REQUIRE(cloud->z()[0] == 2.0f);
+  // last valid pixel is (row 2, col 1)
+  REQUIRE(approx_equal(cloud->x()[7], (1.0f - 2.0f) * 2.0f / 100.0f));
+  REQUIRE(approx_equal(cloud->y()[7], (2.0f - 1.0f) * 2.0f / 200.0f));
+
+  auto strided = depth_to_points(depth, intrinsics, 2);
+  REQUIRE(strided.has_value());
+  // samples (0,0) (0,2) (2,0) (2,2), two of them invalid
+  REQUIRE(strided->size() == 2);
+  REQUIRE(approx_equal(strided->x()[0], 0.0f));
+  REQUIRE(approx_equal(strided->y()[1], (2.0f - 1.0f) * 2.0f / 200.0f));
+}
+
+TEST_CASE("Depth projection reuses the output buffer", "[point_cloud]") {
+  const CameraIntrinsics intrinsics{500.0f, 500.0f, 320.0f, 240.0f};
+  Mat depth(480, 640, 1, 1.5f);
+  for (size_t x = 0; x < 640; ++x) {
+    depth(100, x) = 0.0f;
+  }
+
+  PointCloud cloud;
+  cloud.reserve(max_point_count(480, 640, 1));
+  const float* storage = cloud.x();
+  for (int frame = 0; frame < 3; ++frame) {
+    REQUIRE(depth_to_points(depth, intrinsics, 1, cloud).has_value());
+    REQUIRE(cloud.size() == 479 * 640);
+    REQUIRE(cloud.x() == storage);
+  }
+  REQUIRE(approx_equal(cloud.y()[100 * 640], (101.0f - 240.0f) * 1.5f / 500.0f,
+                       1e-5f));
+
+  Mat color(480, 640, 3, 0.25f);
+  REQUIRE(depth_to_points(depth, color, intrinsics, 4, cloud).has_value());
+  REQUIRE(cloud.has_colors());
+  // row 100 is sampled and has no depth
+  REQUIRE(cloud.size() == max_point_count(480, 640, 4) - 160);
+  REQUIRE(cloud.g()[cloud.size() - 1] == 0.25f);
+}
+
+TEST_CASE("Depth projection rejects bad inputs", "[point_cloud]") {
+  const CameraIntrinsics intrinsics;
+  PointCloud cloud;
+  REQUIRE(depth_to_points(Mat(2, 2, 3, 1.0f), intrinsics).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(depth_to_points(Mat(2, 2, 1, 1.0f), intrinsics, 0).error() ==
+          MatError::InvalidParameter);
+  REQUIRE(depth_to_points(Mat(2, 2, 1, 1.0f), Mat(3, 2, 3, 1.0f), intrinsics,
+                          1, cloud)
+              .error() == MatError::IncompatibleDimensions);
+}
+}  // namespace core
@@ -0,0 +1,232 @@
+#include "core/pose_graph.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <utility>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+Vec6d random_tangent(uint32_t& seed, const double scale) {
+  Vec6d v;
+  for (size_t i = 0; i < 6; ++i) {
+    v[i] = uniform(seed, -scale, scale);
+  }
+  return v;
+}
+
+// a helix of `laps` laps with `per_lap` poses each, the same place of each
+// lap close to the one of the lap before
+std::vector<SE3d> helix(const size_t laps, const size_t per_lap) {
+  std::vector<SE3d> poses(1);
+  const double turn = 2.0 * std::numbers::pi / static_cast<double>(per_lap);
+  for (size_t i = 1; i < laps * per_lap; ++i) {
+    poses.push_back(poses.back() *
+                    SE3d::exp(Vec6d(1.0, 0.0, 0.05, 0.02, 0.0, turn)));
+  }
+  return poses;
+}
+
+SE3d relative(const std::vector<SE3d>& poses, const size_t from,
+              const size_t to) {
+  return poses[from].inverse() * poses[to];
+}
+
+double pose_distance(const SE3d& a, const SE3d& b) {
+  const Vec6d d = (a.inverse() * b).log();
+  return std::sqrt(d.squared_norm());
+}
+}  // namespace
+
+TEST_CASE("Pose graph recovers consistent measurements", "[pose_graph]") {
+  uint32_t seed = 3;
+  const size_t per_lap = 12;
+  const std::vector<SE3d> truth = helix(3, per_lap);
+  PoseGraph graph;
+  for (size_t i = 0; i < truth.size(); ++i) {
+    graph.add_pose(i == 0 ? truth[0]
+                          : truth[i] * SE3d::exp(random_tangent(seed, 0.1)),
+                   i == 0);
+  }
+  for (size_t i = 1; i < truth.size(); ++i) {
+    REQUIRE(graph.add_factor(i - 1, i, relative(truth, i - 1, i)).has_value());
+    // loop closures both ways round, so fixed and free poses show up as
+    // either end of a factor
+    if (i >= per_lap) {
+      const size_t j = i - per_lap;
+      REQUIRE((i % 2 == 0 ? graph.add_factor(j, i, relative(truth, j, i))
+                          : graph.add_factor(i, j, relative(truth, i, j)))
+                  .has_value());
+    }
+  }
+  REQUIRE(graph.cost() > 1e-3);
+
+  const auto summary = graph.optimize();
+  REQUIRE(summary.has_value());
+  REQUIRE(summary->converged);
+  REQUIRE(summary->reordered);
+  REQUIRE(summary->iterations <= 8);
+  REQUIRE(graph.cost() < 1e-20);
+  for (size_t i = 0; i < truth.size(); ++i) {
+    REQUIRE(pose_distance(graph.pose(i), truth[i]) < 1e-9);
+  }
+
+  // a single factor to a fixed pose pulls the other pose onto it, whichever
+  // end is fixed
+  for (const bool fixed_from : {true, false}) {
+    PoseGraph pair;
+    const SE3d anchor = SE3d::exp(random_tangent(seed, 1.0));
+    const SE3d measured = SE3d::exp(random_tangent(seed, 1.0));
+    const SE3d start = SE3d::exp(random_tangent(seed, 1.0));
+    pair.add_pose(fixed_from ? anchor : start, fixed_from);
+    pair.add_pose(fixed_from ? start : anchor, !fixed_from);
+    REQUIRE(pair.add_factor(0, 1, measured).has_value());
+    REQUIRE(pair.optimize().has_value());
+    REQUIRE(pose_distance(pair.pose(0) * measured, pair.pose(1)) < 1e-9);
+    REQUIRE(pose_distance(pair.pose(fixed_from ? 0 : 1), anchor) < 1e-12);
+  }
+}
+
+TEST_CASE("Pose graph updates incrementally", "[pose_graph]") {
+  uint32_t seed = 11;
+  const size_t per_lap = 40;
+  const std::vector<SE3d> truth = helix(5, per_lap);
+  PoseGraphParams params;
+  params.relinearize_threshold = 1e-3;
+  PoseGraph incremental(params);
+  PoseGraph batch(params);
+  size_t num_edges = 0;
+
+  size_t partial = 0;
+  size_t extended = 0;
+  for (size_t i = 0; i < truth.size(); ++i) {
+    std::vector<std::pair<size_t, SE3d>> added;
+    if (i > 0) {
+      added.emplace_back(i - 1, relative(truth, i - 1, i) *
+                                    SE3d::exp(random_tangent(seed, 0.01)));
+    }
+    if (i >= per_lap) {
+      added.emplace_back(i - per_lap,
+                         relative(truth, i - per_lap, i) *
+                             SE3d::exp(random_tangent(seed, 0.01)));
+    }
+    // new poses start from odometry off the current estimate
+    const SE3d initial =
+        i == 0 ? truth[0] : incremental.pose(i - 1) * added[0].second;
+    REQUIRE(incremental.add_pose(initial, i == 0) == i);
+    batch.add_pose(initial, i == 0);
+    for (const auto& [from, z] : added) {
+      REQUIRE(incremental.add_factor(from, i, z).value() == num_edges++);
+      REQUIRE(batch.add_factor(from, i, z).has_value());
+    }
+    const auto summary = incremental.update();
+    REQUIRE(summary.has_value());
+    if (i >= 2 * per_lap && !summary->reordered) {
+      ++extended;
+      partial += summary->recomputed_columns < 6 * (i - 1);
+    }
+  }
+  // most steps refactorise a part of the factor only
+  REQUIRE(extended > per_lap);
+  REQUIRE(partial * 10 >= extended * 9);
+
+  // further updates without new data settle where batch gauss-newton goes
+  for (int i = 0; i < 5; ++i) {
+    REQUIRE(incremental.update().has_value());
+  }
+  const auto summary = batch.optimize();
+  REQUIRE(summary.has_value());
+  REQUIRE(summary->converged);
+  REQUIRE(incremental.cost() < batch.cost() * 1.01 + 1e-9);
+  for (size_t i = 0; i < truth.size(); ++i) {
+    REQUIRE(pose_distance(incremental.pose(i), batch.pose(i)) < 1e-2);
+  }
+
+  // update() continues from the batch result without moving it
+  const SE3d last = batch.pose(truth.size() - 1);
+  const auto step = batch.update();
+  REQUIRE(step.has_value());
+  REQUIRE(step->relinearized == 0);
+  REQUIRE(pose_distance(batch.pose(truth.size() - 1), last) < 1e-9);
+}
+
+TEST_CASE("Pose graph robust losses limit a false loop closure",
+          "[pose_graph]") {
+  uint32_t seed = 5;
+  const size_t per_lap = 16;
+  const std::vector<SE3d> truth = helix(2, per_lap);
+  std::vector<double> worst_by_loss;
+  for (const RobustLoss loss :
+       {RobustLoss::None, RobustLoss::Huber, RobustLoss::Cauchy}) {
+    PoseGraphParams params;
+    params.loss = loss;
+    params.max_iterations = 50;
+    PoseGraph graph(params);
+    // measurements good to about 1e-2
+    const Mat6d information = Mat6d::identity() * 1e4;
+    for (size_t i = 0; i < truth.size(); ++i) {
+      graph.add_pose(truth[i], i == 0);
+    }
+    for (size_t i = 1; i < truth.size(); ++i) {
+      REQUIRE(graph
+                  .add_factor(i - 1, i,
+                              relative(truth, i - 1, i) *
+                                  SE3d::exp(random_tangent(seed, 1e-3)),
+                              information)
+                  .has_value());
+    }
+    // a closure between places metres apart, as if they looked alike
+    REQUIRE(
+        graph.add_factor(3, per_lap + 6, SE3d(), information).has_value());
+    const auto summary = graph.optimize();
+    REQUIRE(summary.has_value());
+
+    double worst = 0.0;
+    for (size_t i = 0; i < truth.size(); ++i) {
+      worst = std::max(worst, pose_distance(graph.pose(i), truth[i]));
+    }
+    worst_by_loss.push_back(worst);
+    if (loss == RobustLoss::Cauchy) {
+      REQUIRE(summary->converged);
+    }
+  }
+  // squared errors spread the closure over the loop, huber bounds its pull
+  // and cauchy leaves it all but ignored
+  REQUIRE(worst_by_loss[0] > 1.0);
+  REQUIRE(worst_by_loss[1] < worst_by_loss[0]);
+  REQUIRE(worst_by_loss[2] < 0.05);
+}
+
+TEST_CASE("Pose graph rejects invalid input", "[pose_graph]") {
+  PoseGraph graph;
+  REQUIRE(graph.update().has_value());
+  REQUIRE(graph.optimize()->converged);
+  REQUIRE(graph.add_pose(SE3d()) == 0);
+  REQUIRE(graph.add_pose(SE3d::exp(Vec6d(1, 0, 0, 0, 0, 0))) == 1);
+  REQUIRE(graph.add_factor(0, 2, SE3d()).error() == MatError::OutOfBounds);
+  REQUIRE(graph.add_factor(1, 1, SE3d()).error() ==
+          MatError::InvalidParameter);
+  REQUIRE(graph.add_factor(0, 1, SE3d()).value() == 0);
+  REQUIRE(graph.num_poses() == 2);
+  REQUIRE(graph.num_factors() == 1);
+
+  // nothing holds the pair in place
+  REQUIRE(graph.update().error() == MatError::InvalidParameter);
+  REQUIRE(graph.optimize().error() == MatError::InvalidParameter);
+
+  // a fixed pose anchors it
+  REQUIRE(graph.add_pose(SE3d(), true) == 2);
+  REQUIRE(graph.add_factor(2, 0, SE3d()).has_value());
+  REQUIRE(graph.update().has_value());
+  REQUIRE(graph.optimize()->converged);
+  REQUIRE(graph.cost() < 1e-20);
+  REQUIRE(pose_distance(graph.pose(1), SE3d()) < 1e-9);
+}
+
+};  // namespace core
@@ -0,0 +1,123 @@
+#include "core/pyramid.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// [1 3 3 1] / 8 in both directions around fine pixel 2x + 0.5, borders
+// replicated
+Mat reference_gaussian(const Mat& fine) {
+  const float weights[4] = {1.0f, 3.0f, 3.0f, 1.0f};
+  Mat coarse(fine.rows() / 2, fine.cols() / 2, fine.channels());
+  const auto clamp = [](const ptrdiff_t i, const size_t n) {
+    return static_cast<size_t>(
+        std::clamp<ptrdiff_t>(i, 0, static_cast<ptrdiff_t>(n) - 1));
+  };
+  for (size_t y = 0; y < coarse.rows(); ++y) {
+    for (size_t x = 0; x < coarse.cols(); ++x) {
+      for (size_t c = 0; c < fine.channels(); ++c) {
+        float sum = 0.0f;
+        for (ptrdiff_t i = 0; i < 4; ++i) {
+          for (ptrdiff_t j = 0; j < 4; ++j) {
+            sum += weights[i] * weights[j] *
+                   fine(clamp(2 * static_cast<ptrdiff_t>(y) - 1 + i,
+                              fine.rows()),
+                        clamp(2 * static_cast<ptrdiff_t>(x) - 1 + j,
+                              fine.cols()),
+                        c);
+          }
+        }
+        coarse(y, x, c) = sum / 64.0f;
+      }
+    }
+  }
+  return coarse;
+}
+
+void require_near(const Mat& a, const Mat& b) {
+  REQUIRE(a.rows() == b.rows());
+  REQUIRE(a.cols() == b.cols());
+  REQUIRE(a.channels() == b.channels());
+  for (size_t i = 0; i < a.size(); ++i) {
+    REQUIRE(approx_equal(a.data()[i], b.data()[i], 1e-5f));
+  }
+}
+}  // namespace
+
+TEST_CASE("Pyramid levels halve the image", "[pyramid]") {
+  const Mat image = random_image(101, 64, 1, 1);
+  PyramidParams params;
+  params.num_levels = 10;
+  params.filter = PyramidFilter::Box;
+  Pyramid pyramid(params);
+  REQUIRE(pyramid.build(image).has_value());
+  // 101x64, 50x32, 25x16, 12x8, then 6x4 is below min_size
+  REQUIRE(pyramid.num_levels() == 4);
+  REQUIRE(pyramid.levels().size() == 4);
+  REQUIRE(pyramid.level(0) == image);
+  REQUIRE(pyramid.level(3).rows() == 12);
+  REQUIRE(pyramid.level(3).cols() == 8);
+
+  for (size_t l = 1; l < pyramid.num_levels(); ++l) {
+    const Mat& fine = pyramid.level(l - 1);
+    const Mat& coarse = pyramid.level(l);
+    for (size_t y = 0; y < coarse.rows(); ++y) {
+      for (size_t x = 0; x < coarse.cols(); ++x) {
+        const float mean = (fine(2 * y, 2 * x) + fine(2 * y, 2 * x + 1) +
+                            fine(2 * y + 1, 2 * x) +
+                            fine(2 * y + 1, 2 * x + 1)) /
+                           4.0f;
+        REQUIRE(approx_equal(coarse(y, x), mean, 1e-6f));
+      }
+    }
+  }
+  REQUIRE(Pyramid::to_level(Pyramid::from_level(3.0f, 2), 2) == 3.0f);
+  REQUIRE(Pyramid::from_level(0.0f, 1) == 0.5f);
+}
+
+TEST_CASE("Gaussian pyramid matches a direct convolution", "[pyramid]") {
+  for (const size_t channels : {1, 2, 3}) {
+    const Mat image = random_image(37, 50, channels, 2);
+    Mat coarse;
+    pyramid_down(image, coarse);
+    require_near(coarse, reference_gaussian(image));
+  }
+
+  // a constant image stays constant, borders included
+  Pyramid pyramid;
+  REQUIRE(pyramid.build(Mat(64, 48, 1, 0.25f)).has_value());
+  REQUIRE(pyramid.num_levels() == 3);
+  for (const Mat& level : pyramid.levels()) {
+    for (size_t i = 0; i < level.size(); ++i) {
+      REQUIRE(approx_equal(level.data()[i], 0.25f));
+    }
+  }
+}
+
+TEST_CASE("Pyramid reuses its buffers", "[pyramid]") {
+  Pyramid pyramid;
+  REQUIRE(pyramid.build(random_image(80, 80, 1, 3)).has_value());
+  const float* data = pyramid.level(1).data();
+
+  const Mat next = random_image(80, 80, 1, 4);
+  REQUIRE(pyramid.build(next).has_value());
+  REQUIRE(pyramid.level(1).data() == data);
+  Mat expected;
+  pyramid_down(next, expected);
+  require_near(pyramid.level(1), expected);
+
+  // a smaller frame uses fewer levels
+  REQUIRE(pyramid.build(random_image(20, 20, 1, 5)).has_value());
+  REQUIRE(pyramid.num_levels() == 2);
+  REQUIRE(pyramid.level(1).rows() == 10);
+
+  REQUIRE(pyramid.build(Mat()).error() == MatError::InvalidDimensions);
+  PyramidParams params;
+  params.num_levels = 0;
+  REQUIRE(Pyramid(params).build(next).error() == MatError::InvalidParameter);
+}
+}  // namespace core
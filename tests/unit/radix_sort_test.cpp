@@ -0,0 +1,39 @@
+#include "core/radix_sort.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <numeric>
+
+namespace core {
+TEST_CASE("Radix sort orders keys and carries values", "[radix_sort]") {
+  std::vector<uint64_t> keys(100000);
+  uint64_t state = 7;
+  for (uint64_t& key : keys) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    key = state >> 40;
+  }
+  std::vector<uint32_t> values(keys.size());
+  std::iota(values.begin(), values.end(), 0u);
+  const std::vector<uint64_t> original = keys;
+
+  radix_sort(keys, values);
+  REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+  for (size_t i = 0; i < keys.size(); ++i) {
+    REQUIRE(original[values[i]] == keys[i]);
+  }
+}
+
+TEST_CASE("Radix sort is stable", "[radix_sort]") {
+  std::vector<uint64_t> keys{5, 1, 5, 1, 1ull << 60, 5, 0};
+  std::vector<uint32_t> values{0, 1, 2, 3, 4, 5, 6};
+  radix_sort(keys, values);
+  REQUIRE(keys == std::vector<uint64_t>{0, 1, 1, 5, 5, 5, 1ull << 60});
+  REQUIRE(values == std::vector<uint32_t>{6, 1, 3, 0, 2, 5, 4});
+
+  std::vector<uint64_t> same(10, 42);
+  std::vector<uint32_t> order(10);
+  std::iota(order.begin(), order.end(), 0u);
+  radix_sort(same, order);
+  REQUIRE(std::is_sorted(order.begin(), order.end()));
+}
+}  // namespace core
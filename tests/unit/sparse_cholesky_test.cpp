@@ -0,0 +1,509 @@
+#include "core/sparse_cholesky.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// a symmetric matrix with both triangles in compressed sparse row form
+struct Symmetric {
+  size_t n = 0;
+  std::vector<size_t> offsets;
+  std::vector<uint32_t> columns;
+  std::vector<double> values;
+};
+
+// from the entries (i, j, v) with i < j and the diagonal
+Symmetric assemble(const size_t n,
+                   const std::vector<std::vector<double>>& rows) {
+  Symmetric a{n, {0}, {}, {}};
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      if (rows[i][j] != 0.0) {
+        a.columns.push_back(static_cast<uint32_t>(j));
+        a.values.push_back(rows[i][j]);
+      }
+    }
+    a.offsets.push_back(a.columns.size());
+  }
+  return a;
+}
+
+// the 5-point laplacian of a side x side grid with its rows shuffled plus
+// random diagonal shifts, or with random weights on the edges
+Symmetric grid(const size_t side, uint32_t& seed, const bool shuffled) {
+  const size_t n = side * side;
+  std::vector<size_t> label(n);
+  for (size_t i = 0; i < n; ++i) {
+    label[i] = i;
+  }
+  for (size_t i = n; shuffled && i > 1; --i) {
+    std::swap(label[i - 1], label[next(seed) % i]);
+  }
+  std::vector<std::vector<double>> rows(n, std::vector<double>(n, 0.0));
+  for (size_t y = 0; y < side; ++y) {
+    for (size_t x = 0; x < side; ++x) {
+      const size_t i = label[y * side + x];
+      rows[i][i] += uniform(seed, 0.01, 0.1);
+      for (const size_t neighbour :
+           {x + 1 < side ? y * side + x + 1 : n,
+            y + 1 < side ? (y + 1) * side + x : n}) {
+        if (neighbour == n) {
+          continue;
+        }
+        const size_t j = label[neighbour];
+        const double weight = uniform(seed, 0.5, 2.0);
+        rows[i][j] -= weight;
+        rows[j][i] -= weight;
+        rows[i][i] += weight;
+        rows[j][j] += weight;
+      }
+    }
+  }
+  return assemble(n, rows);
+}
+
+// |A x - b| / |b|
+double relative_residual(const Symmetric& a, const std::vector<double>& x,
+                         const std::vector<double>& b) {
+  double error = 0.0;
+  double norm = 0.0;
+  for (size_t i = 0; i < a.n; ++i) {
+    double sum = -b[i];
+    for (size_t e = a.offsets[i]; e < a.offsets[i + 1]; ++e) {
+      sum += a.values[e] * x[a.columns[e]];
+    }
+    error += sum * sum;
+    norm += b[i] * b[i];
+  }
+  return std::sqrt(error / norm);
+}
+
+std::vector<double> random_vector(const size_t n, uint32_t& seed) {
+  std::vector<double> b(n);
+  for (double& v : b) {
+    v = uniform(seed, -1, 1);
+  }
+  return b;
+}
+}  // namespace
+
+TEST_CASE("Sparse cholesky solves grid systems", "[sparse_cholesky]") {
+  uint32_t seed = 1;
+  const Symmetric a = grid(40, seed, true);
+  const std::vector<double> b = random_vector(a.n, seed);
+
+  size_t fill[2] = {};
+  for (const SparseOrdering ordering :
+       {SparseOrdering::Amd, SparseOrdering::Natural}) {
+    SparseCholesky cholesky;
+    REQUIRE(cholesky.analyze(a.n, a.offsets, a.columns, ordering));
+    REQUIRE(cholesky.analyzed());
+    REQUIRE(cholesky.size() == a.n);
+    REQUIRE(cholesky.num_supernodes() < a.n);
+
+    // the permutation is one
+    std::vector<uint8_t> seen(a.n, 0);
+    for (const uint32_t i : cholesky.permutation()) {
+      REQUIRE(i < a.n);
+      REQUIRE(seen[i] == 0);
+      seen[i] = 1;
+    }
+
+    REQUIRE(cholesky.factorize(a.values));
+    std::vector<double> x = b;
+    REQUIRE(cholesky.solve(x));
+    REQUIRE(relative_residual(a, x, b) < 1e-10);
+    fill[ordering == SparseOrdering::Amd ? 0 : 1] = cholesky.factor_size();
+  }
+  // the shuffled grid leaves the natural order with much more fill
+  REQUIRE(fill[0] * 4 < fill[1]);
+
+  // a random sparse pattern given by its upper triangle only, through
+  // SparseMat and several right hand sides
+  const size_t n = 300;
+  std::vector<std::vector<double>> rows(n, std::vector<double>(n, 0.0));
+  for (size_t i = 0; i < n; ++i) {
+    rows[i][i] = 1.0;
+    for (size_t k = 0; k < 4; ++k) {
+      const size_t j = next(seed) % n;
+      if (j > i) {
+        rows[i][j] = uniform(seed, -1, 1);
+      }
+    }
+  }
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = i + 1; j < n; ++j) {
+      rows[i][i] += std::fabs(rows[i][j]);
+      rows[j][j] += std::fabs(rows[i][j]);
+    }
+  }
+  std::vector<Triplet> triplets;
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = i; j < n; ++j) {
+      if (rows[i][j] != 0.0) {
+        triplets.push_back({static_cast<uint32_t>(i),
+                            static_cast<uint32_t>(j),
+                            static_cast<float>(rows[i][j])});
+        rows[i][j] = triplets.back().value;
+        rows[j][i] = triplets.back().value;
+        if (i == j) {
+          rows[i][i] = triplets.back().value;
+        }
+      }
+    }
+  }
+  const auto sparse = SparseMat::from_triplets(n, n, triplets);
+  REQUIRE(sparse.has_value());
+  const Symmetric full = assemble(n, rows);
+  SparseCholesky cholesky;
+  REQUIRE(cholesky.analyze(*sparse));
+  REQUIRE(cholesky.factorize(*sparse));
+  Mat rhs(n, 3, 1);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t k = 0; k < 3; ++k) {
+      rhs(i, k) = static_cast<float>(uniform(seed, -1, 1));
+    }
+  }
+  Mat solution;
+  REQUIRE(cholesky.solve(rhs, solution));
+  REQUIRE(solution.rows() == n);
+  REQUIRE(solution.cols() == 3);
+  for (size_t k = 0; k < 3; ++k) {
+    std::vector<double> x(n), column(n);
+    for (size_t i = 0; i < n; ++i) {
+      x[i] = solution(i, k);
+      column[i] = rhs(i, k);
+    }
+    REQUIRE(relative_residual(full, x, column) < 1e-5);
+  }
+}
+
+TEST_CASE("Sparse cholesky reuses its analysis", "[sparse_cholesky]") {
+  uint32_t seed = 2;
+  Symmetric a = grid(30, seed, false);
+  SparseCholesky cholesky;
+  REQUIRE(cholesky.analyze(a.n, a.offsets, a.columns));
+  const size_t supernodes = cholesky.num_supernodes();
+  for (size_t round = 0; round < 3; ++round) {
+    // new values on the same pattern, symmetric again
+    for (size_t i = 0; i < a.n; ++i) {
+      for (size_t e = a.offsets[i]; e < a.offsets[i + 1]; ++e) {
+        if (a.columns[e] == i) {
+          a.values[e] += uniform(seed, 0.0, 1.0);
+        }
+      }
+    }
+    REQUIRE(cholesky.factorize(a.values));
+    REQUIRE(cholesky.num_supernodes() == supernodes);
+    const std::vector<double> b = random_vector(a.n, seed);
+    std::vector<double> x = b;
+    REQUIRE(cholesky.solve(x));
+    REQUIRE(relative_residual(a, x, b) < 1e-10);
+  }
+
+  // other patterns and sizes are refused
+  REQUIRE(cholesky.factorize(std::vector<double>(a.values.size() - 1))
+              .error() == MatError::IncompatibleDimensions);
+  const auto other =
+      SparseMat::from_triplets(a.n, a.n, {{0, 0, 1.0f}, {1, 1, 1.0f}});
+  REQUIRE(cholesky.factorize(*other).error() ==
+          MatError::IncompatibleDimensions);
+  std::vector<double> wrong(a.n + 1);
+  REQUIRE(cholesky.solve(wrong).error() == MatError::IncompatibleDimensions);
+  REQUIRE(SparseCholesky().solve(wrong).error() ==
+          MatError::InvalidDimensions);
+}
+
+TEST_CASE("Sparse cholesky refactorises changed rows",
+          "[sparse_cholesky]") {
+  uint32_t seed = 3;
+  Symmetric a = grid(40, seed, true);
+  SparseCholesky partial;
+  SparseCholesky fresh;
+  REQUIRE(partial.analyze(a.n, a.offsets, a.columns));
+  REQUIRE(fresh.analyze(a.n, a.offsets, a.columns));
+  REQUIRE(partial.factorize(a.values));
+
+  for (size_t round = 0; round < 5; ++round) {
+    // one edge (i, j) reweighted, its two rows changing
+    const uint32_t i = next(seed) % a.n;
+    size_t entry = a.offsets[i];
+    while (a.columns[entry] == i) {
+      ++entry;
+    }
+    const uint32_t j = a.columns[entry];
+    const double delta = uniform(seed, 0.1, 1.0);
+    for (size_t e = a.offsets[i]; e < a.offsets[i + 1]; ++e) {
+      a.values[e] += a.columns[e] == i ? delta : a.columns[e] == j ? -delta
+                                                                   : 0.0;
+    }
+    for (size_t e = a.offsets[j]; e < a.offsets[j + 1]; ++e) {
+      a.values[e] += a.columns[e] == j ? delta : a.columns[e] == i ? -delta
+                                                                   : 0.0;
+    }
+    const uint32_t changed[2] = {i, j};
+    const auto columns = partial.refactorize(a.values, changed);
+    REQUIRE(columns.has_value());
+    REQUIRE(*columns > 0);
+    REQUIRE(*columns < a.n);
+
+    REQUIRE(fresh.factorize(a.values));
+    const std::vector<double> b = random_vector(a.n, seed);
+    std::vector<double> x = b;
+    std::vector<double> y = b;
+    REQUIRE(partial.solve(x));
+    REQUIRE(fresh.solve(y));
+    for (size_t k = 0; k < a.n; ++k) {
+      REQUIRE(std::fabs(x[k] - y[k]) < 1e-10 * (1.0 + std::fabs(y[k])));
+    }
+  }
+  const uint32_t outside[1] = {static_cast<uint32_t>(a.n)};
+  REQUIRE(partial.refactorize(a.values, outside).error() ==
+          MatError::OutOfBounds);
+}
+
+TEST_CASE("Sparse cholesky extends a factorisation", "[sparse_cholesky]") {
+  // a grid growing row by row, new rows numbered after the old ones
+  uint32_t seed = 4;
+  const size_t side = 20;
+  Symmetric a = grid(side, seed, false);
+  SparseCholesky growing;
+  REQUIRE(growing.analyze(a.n, a.offsets, a.columns));
+  REQUIRE(growing.factorize(a.values));
+  for (size_t rows = side + 1; rows <= side + 4; ++rows) {
+    std::vector<std::vector<double>> dense(
+        rows * side, std::vector<double>(rows * side, 0.0));
+    for (size_t i = 0; i < a.n; ++i) {
+      for (size_t e = a.offsets[i]; e < a.offsets[i + 1]; ++e) {
+        dense[i][a.columns[e]] = a.values[e];
+      }
+    }
+    // the new row hangs off the last one, whose diagonal changes
+    std::vector<uint32_t> changed;
+    for (size_t x = 0; x < side; ++x) {
+      const size_t i = (rows - 2) * side + x;
+      const size_t j = (rows - 1) * side + x;
+      dense[i][j] = dense[j][i] = -1.0;
+      dense[i][i] += 1.0;
+      dense[j][j] += 1.1;
+      if (x + 1 < side) {
+        dense[j][j + 1] = dense[j + 1][j] = -1.0;
+        dense[j][j] += 1.0;
+        dense[j + 1][j + 1] += 1.0;
+      }
+      changed.push_back(static_cast<uint32_t>(i));
+    }
+    a = assemble(rows * side, dense);
+    const size_t before = growing.size();
+    const auto columns =
+        growing.extend(a.n, a.offsets, a.columns, a.values, changed);
+    REQUIRE(columns.has_value());
+    REQUIRE(*columns >= a.n - before);
+    REQUIRE(*columns < a.n);
+    REQUIRE(growing.size() == a.n);
+    // the old order is kept, the new rows come last
+    for (size_t k = before; k < a.n; ++k) {
+      REQUIRE(growing.permutation()[k] == k);
+    }
+    const std::vector<double> b = random_vector(a.n, seed);
+    std::vector<double> x = b;
+    REQUIRE(growing.solve(x));
+    REQUIRE(relative_residual(a, x, b) < 1e-10);
+  }
+
+  // a new edge between two old rows, no rows added
+  std::vector<std::vector<double>> dense(a.n, std::vector<double>(a.n, 0.0));
+  for (size_t i = 0; i < a.n; ++i) {
+    for (size_t e = a.offsets[i]; e < a.offsets[i + 1]; ++e) {
+      dense[i][a.columns[e]] = a.values[e];
+    }
+  }
+  const uint32_t closure[2] = {0, static_cast<uint32_t>(a.n - side / 2)};
+  dense[closure[0]][closure[1]] = dense[closure[1]][closure[0]] = -0.5;
+  dense[closure[0]][closure[0]] += 0.5;
+  dense[closure[1]][closure[1]] += 0.5;
+  a = assemble(a.n, dense);
+  REQUIRE(growing.extend(a.n, a.offsets, a.columns, a.values, closure));
+  const std::vector<double> b = random_vector(a.n, seed);
+  std::vector<double> x = b;
+  REQUIRE(growing.solve(x));
+  REQUIRE(relative_residual(a, x, b) < 1e-10);
+
+  // a smaller pattern or no factorisation to extend
+  REQUIRE(growing.extend(side, std::vector<size_t>(side + 1, 0), {}, {}, {})
+              .error() == MatError::IncompatibleDimensions);
+  // a pattern that moved the entry (0, 2) to (0, 1) does not hold the old
+  // one, which stays factorised
+  const Symmetric corner = assemble(
+      3, {{2.0, 0.0, -1.0}, {0.0, 2.0, 0.0}, {-1.0, 0.0, 2.0}});
+  const Symmetric moved = assemble(
+      3, {{2.0, -1.0, 0.0}, {-1.0, 2.0, 0.0}, {0.0, 0.0, 2.0}});
+  SparseCholesky small;
+  REQUIRE(small.analyze(corner.n, corner.offsets, corner.columns));
+  REQUIRE(small.factorize(corner.values));
+  const uint32_t all[3] = {0, 1, 2};
+  REQUIRE(small.extend(moved.n, moved.offsets, moved.columns, moved.values,
+                       all)
+              .error() == MatError::IncompatibleDimensions);
+  std::vector<double> y = {1.0, 2.0, 3.0};
+  REQUIRE(small.solve(y));
+  REQUIRE(relative_residual(corner, y, {1.0, 2.0, 3.0}) < 1e-12);
+  REQUIRE(SparseCholesky()
+              .extend(a.n, a.offsets, a.columns, a.values, {})
+              .error() == MatError::IncompatibleDimensions);
+}
+
+TEST_CASE("Sparse cholesky extends only the changed suffix",
+          "[sparse_cholesky]") {
+  // a chain growing at its end with edges between rows late in the order,
+  // as a trajectory closing small loops: the structure and values of U are
+  // worked out again only from the first changed row on
+  uint32_t seed = 8;
+  size_t n = 400;
+  std::vector<std::vector<double>> dense(n, std::vector<double>(n, 0.0));
+  const auto connect = [&](const size_t i, const size_t j, const double w) {
+    dense[i][j] -= w;
+    dense[j][i] -= w;
+    dense[i][i] += w;
+    dense[j][j] += w;
+  };
+  for (size_t i = 0; i < n; ++i) {
+    dense[i][i] += 0.1;
+    if (i > 0) {
+      connect(i - 1, i, uniform(seed, 0.5, 2.0));
+    }
+  }
+  Symmetric a = assemble(n, dense);
+  SparseCholesky growing;
+  REQUIRE(growing.analyze(a.n, a.offsets, a.columns));
+  REQUIRE(growing.factorize(a.values));
+  REQUIRE(growing.analyzed_columns() == n);
+  // the first new row hangs off the last row of U, each later one off the
+  // row before it
+  uint32_t last = growing.permutation()[n - 1];
+  for (size_t round = 0; round < 30; ++round) {
+    for (auto& row : dense) {
+      row.push_back(0.0);
+    }
+    dense.emplace_back(n + 1, 0.0);
+    dense[n][n] = 0.1;
+    connect(last, n, uniform(seed, 0.5, 2.0));
+    std::vector<uint32_t> changed = {last};
+    if (round % 3 == 2) {
+      const uint32_t i = growing.permutation()[n - 1 - next(seed) % 20];
+      const uint32_t j = growing.permutation()[n - 1 - next(seed) % 20];
+      if (i != j) {
+        connect(i, j, uniform(seed, 0.5, 2.0));
+        changed.push_back(i);
+        changed.push_back(j);
+      }
+    }
+    last = static_cast<uint32_t>(n++);
+    a = assemble(n, dense);
+    const auto columns =
+        growing.extend(a.n, a.offsets, a.columns, a.values, changed);
+    REQUIRE(columns.has_value());
+    REQUIRE(*columns <= growing.analyzed_columns());
+    REQUIRE(growing.analyzed_columns() < n / 8);
+    const std::vector<double> b = random_vector(a.n, seed);
+    std::vector<double> x = b;
+    REQUIRE(growing.solve(x));
+    REQUIRE(relative_residual(a, x, b) < 1e-10);
+  }
+
+  // on a shuffled grid an edge between two rows late in the order lands
+  // in row i before the entry of an early column c, which is kept
+  Symmetric g = grid(20, seed, true);
+  SparseCholesky closing;
+  REQUIRE(closing.analyze(g.n, g.offsets, g.columns));
+  REQUIRE(closing.factorize(g.values));
+  std::vector<size_t> position(g.n);
+  for (size_t k = 0; k < g.n; ++k) {
+    position[closing.permutation()[k]] = k;
+  }
+  std::vector<std::vector<double>> rows(g.n, std::vector<double>(g.n, 0.0));
+  for (size_t r = 0; r < g.n; ++r) {
+    for (size_t e = g.offsets[r]; e < g.offsets[r + 1]; ++e) {
+      rows[r][g.columns[e]] = g.values[e];
+    }
+  }
+  size_t i = 0;
+  size_t j = 0;
+  size_t latest = 0;
+  for (size_t r = 0; r < g.n; ++r) {
+    for (size_t e = g.offsets[r]; e < g.offsets[r + 1]; ++e) {
+      const size_t c = g.columns[e];
+      for (size_t k = 0; k < c && c > r; ++k) {
+        const size_t later = std::min(position[r], position[k]);
+        if (k != r && rows[r][k] == 0.0 && position[c] + g.n / 4 < later &&
+            later > latest) {
+          i = r;
+          j = k;
+          latest = later;
+        }
+      }
+    }
+  }
+  REQUIRE(latest > 0);
+  rows[i][j] = rows[j][i] = -0.5;
+  rows[i][i] += 0.5;
+  rows[j][j] += 0.5;
+  g = assemble(g.n, rows);
+  const uint32_t closure[2] = {static_cast<uint32_t>(i),
+                               static_cast<uint32_t>(j)};
+  REQUIRE(closing.extend(g.n, g.offsets, g.columns, g.values, closure));
+  REQUIRE(closing.analyzed_columns() < g.n);
+  const std::vector<double> b = random_vector(g.n, seed);
+  std::vector<double> x = b;
+  REQUIRE(closing.solve(x));
+  REQUIRE(relative_residual(g, x, b) < 1e-10);
+  // the kept columns find their entries of A again when refactorised
+  REQUIRE(closing.factorize(g.values));
+  x = b;
+  REQUIRE(closing.solve(x));
+  REQUIRE(relative_residual(g, x, b) < 1e-10);
+}
+
+TEST_CASE("Sparse cholesky rejects bad input", "[sparse_cholesky]") {
+  SparseCholesky cholesky;
+  REQUIRE(cholesky.analyze(0, std::vector<size_t>{0}, {}).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(cholesky.analyze(2, std::vector<size_t>{0, 1}, {}).error() ==
+          MatError::InvalidDimensions);
+  const std::vector<size_t> offsets = {0, 2, 3};
+  REQUIRE(cholesky.analyze(2, offsets, std::vector<uint32_t>{0, 2, 1})
+              .error() == MatError::OutOfBounds);
+  REQUIRE(cholesky.analyze(2, offsets, std::vector<uint32_t>{1, 0, 1})
+              .error() == MatError::OutOfBounds);
+  const auto rectangular = SparseMat::from_triplets(2, 3, {{0, 0, 1.0f}});
+  REQUIRE(cholesky.analyze(*rectangular).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE_FALSE(cholesky.analyzed());
+  REQUIRE(cholesky.factorize(std::vector<double>{}).error() ==
+          MatError::IncompatibleDimensions);
+
+  // [[1, 2], [2, 1]] is indefinite, [[1, 2], [2, 5]] is fine
+  const std::vector<uint32_t> columns = {0, 1, 1};
+  REQUIRE(cholesky.analyze(2, offsets, columns));
+  REQUIRE(cholesky.factorize(std::vector<double>{1.0, 2.0, 1.0}).error() ==
+          MatError::InvalidParameter);
+  REQUIRE_FALSE(cholesky.factorized());
+  REQUIRE(cholesky.factorize(std::vector<double>{1.0, 2.0, 5.0}));
+  std::vector<double> x = {1.0, 2.0};
+  REQUIRE(cholesky.solve(x));
+  REQUIRE(std::fabs(x[0] - 1.0) < 1e-12);
+  REQUIRE(std::fabs(x[1]) < 1e-12);
+  Mat multichannel(2, 1, 2);
+  Mat out;
+  REQUIRE(cholesky.solve(multichannel, out).error() ==
+          MatError::InvalidChannelsForOperation);
+}
+
+}  // namespace core
@@ -0,0 +1,227 @@
+#include "core/sparse_mat.hpp"
+
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// random entries with duplicates, empty rows and one dense row
+std::vector<Triplet> random_triplets(const uint32_t rows, const uint32_t cols,
+                                     const size_t count, uint32_t seed) {
+  std::vector<Triplet> triplets;
+  for (size_t i = 0; i < count; ++i) {
+    Triplet triplet;
+    triplet.row = next(seed) % rows;
+    triplet.col = next(seed) % cols;
+    triplet.value = uniform<float>(seed, -1.0f, 1.0f);
+    if (triplet.row % 7 == 3) {
+      continue;
+    }
+    triplets.push_back(triplet);
+  }
+  for (uint32_t c = 0; c < cols; ++c) {
+    Triplet triplet;
+    triplet.row = 0;
+    triplet.col = c;
+    triplet.value = 0.5f;
+    triplets.push_back(triplet);
+  }
+  return triplets;
+}
+
+Mat random_dense(const size_t rows, const size_t cols, uint32_t seed) {
+  Mat dense(rows, cols, 1);
+  for (size_t i = 0; i < dense.size(); ++i) {
+    dense.data()[i] = uniform<float>(seed, -1.0f, 1.0f);
+  }
+  return dense;
+}
+
+// dense product in double, transposing `a` with `transpose`
+Mat reference_product(const Mat& a, const Mat& x, const bool transpose) {
+  const size_t rows = transpose ? a.cols() : a.rows();
+  const size_t inner = transpose ? a.rows() : a.cols();
+  Mat y(rows, x.cols(), 1);
+  for (size_t r = 0; r < rows; ++r) {
+    for (size_t j = 0; j < x.cols(); ++j) {
+      double sum = 0.0;
+      for (size_t i = 0; i < inner; ++i) {
+        sum += static_cast<double>(transpose ? a(i, r) : a(r, i)) * x(i, j);
+      }
+      y(r, j) = static_cast<float>(sum);
+    }
+  }
+  return y;
+}
+
+bool near(const Mat& a, const Mat& b, const float epsilon) {
+  if (a.rows() != b.rows() || a.cols() != b.cols() ||
+      a.channels() != b.channels()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (!approx_equal(a.data()[i], b.data()[i], epsilon)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+TEST_CASE("Sparse matrices build from triplets", "[sparse_mat]") {
+  std::vector<Triplet> triplets = random_triplets(40, 30, 300, 1);
+  Triplet zero;
+  zero.row = 3;
+  zero.col = 4;
+  triplets.push_back(zero);
+  auto sparse = SparseMat::from_triplets(40, 30, triplets);
+  REQUIRE(sparse.has_value());
+  REQUIRE(sparse->rows() == 40);
+  REQUIRE(sparse->cols() == 30);
+
+  Mat expected(40, 30, 1, 0.0f);
+  std::vector<uint8_t> present(40 * 30, 0);
+  for (const Triplet& triplet : triplets) {
+    expected(triplet.row, triplet.col) += triplet.value;
+    present[triplet.row * 30 + triplet.col] = 1;
+  }
+  REQUIRE(near(sparse->to_dense(), expected, 1e-5f));
+
+  // one entry per distinct position, explicit zeros included, columns
+  // ascending within rows
+  size_t distinct = 0;
+  for (const uint8_t p : present) {
+    distinct += p;
+  }
+  REQUIRE(sparse->nnz() == distinct);
+  const auto offsets = sparse->row_offsets();
+  const auto columns = sparse->column_indices();
+  REQUIRE(offsets.size() == 41);
+  REQUIRE(offsets[3] + 1 == offsets[4]);
+  REQUIRE(columns[offsets[3]] == 4);
+  for (size_t r = 0; r < 40; ++r) {
+    for (size_t e = offsets[r] + 1; e < offsets[r + 1]; ++e) {
+      REQUIRE(columns[e - 1] < columns[e]);
+    }
+  }
+
+  // triplets already in row order skip the sort
+  std::vector<Triplet> ordered;
+  for (uint32_t r = 0; r < 6; r += 2) {
+    for (uint32_t c = 0; c < 4; ++c) {
+      Triplet triplet;
+      triplet.row = r;
+      triplet.col = c;
+      triplet.value = static_cast<float>(r + c);
+      ordered.push_back(triplet);
+      ordered.push_back(triplet);
+    }
+  }
+  auto from_ordered = SparseMat::from_triplets(6, 4, ordered);
+  REQUIRE(from_ordered.has_value());
+  REQUIRE(from_ordered->nnz() == 12);
+  for (size_t r = 0; r < 6; ++r) {
+    for (size_t c = 0; c < 4; ++c) {
+      REQUIRE(from_ordered->to_dense()(r, c) ==
+              (r % 2 == 0 ? 2.0f * static_cast<float>(r + c) : 0.0f));
+    }
+  }
+
+  auto empty = SparseMat::from_triplets(5, 6, {});
+  REQUIRE(empty.has_value());
+  REQUIRE(empty->nnz() == 0);
+  REQUIRE(empty->to_dense() == Mat(5, 6, 1, 0.0f));
+}
+
+TEST_CASE("Sparse products match dense ones", "[sparse_mat]") {
+  // enough entries to split the products across threads
+  for (const auto& [rows, cols, count] :
+       {std::array<size_t, 3>{500, 300, 60000}, {17, 9, 40}, {1, 1, 1}}) {
+    auto sparse = SparseMat::from_triplets(
+        rows, cols,
+        random_triplets(static_cast<uint32_t>(rows),
+                        static_cast<uint32_t>(cols), count, 5));
+    REQUIRE(sparse.has_value());
+    const Mat dense = sparse->to_dense();
+    for (const size_t k : {size_t{1}, size_t{5}}) {
+      const Mat x = random_dense(cols, k, 7);
+      Mat y;
+      REQUIRE(sparse->multiply(x, y));
+      REQUIRE(near(y, reference_product(dense, x, false), 1e-3f));
+
+      const Mat z = random_dense(rows, k, 9);
+      REQUIRE(sparse->transpose_multiply(z, y));
+      REQUIRE(near(y, reference_product(dense, z, true), 1e-3f));
+    }
+  }
+}
+
+TEST_CASE("Sparse transposes and dense conversions round trip",
+          "[sparse_mat]") {
+  auto sparse = SparseMat::from_triplets(60, 45,
+                                         random_triplets(60, 45, 500, 3));
+  REQUIRE(sparse.has_value());
+  const SparseMat transpose = sparse->transposed();
+  REQUIRE(transpose.rows() == 45);
+  REQUIRE(transpose.cols() == 60);
+  REQUIRE(transpose.nnz() == sparse->nnz());
+  const Mat dense = sparse->to_dense();
+  const Mat dense_transpose = transpose.to_dense();
+  for (size_t r = 0; r < 60; ++r) {
+    for (size_t c = 0; c < 45; ++c) {
+      REQUIRE(dense(r, c) == dense_transpose(c, r));
+    }
+  }
+  REQUIRE(transpose.transposed().to_dense() == dense);
+
+  const Mat values = random_dense(12, 8, 11);
+  Mat sparse_values = values.clone();
+  for (size_t i = 0; i < sparse_values.size(); i += 3) {
+    sparse_values.data()[i] = 0.0f;
+  }
+  auto from_dense = SparseMat::from_dense(sparse_values);
+  REQUIRE(from_dense.has_value());
+  REQUIRE(from_dense->to_dense() == sparse_values);
+
+  // values can be rewritten on the same pattern
+  for (float& value : from_dense->values()) {
+    value *= 2.0f;
+  }
+  REQUIRE(from_dense->to_dense() == sparse_values * 2.0f);
+}
+
+TEST_CASE("Sparse matrices reject bad input", "[sparse_mat]") {
+  Triplet outside;
+  outside.row = 2;
+  outside.col = 5;
+  REQUIRE(SparseMat::from_triplets(3, 5, {outside}).error() ==
+          MatError::OutOfBounds);
+  REQUIRE(SparseMat::from_triplets(0, 5, {}).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(SparseMat::from_dense(Mat()).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(SparseMat::from_dense(Mat(2, 2, 2)).error() ==
+          MatError::InvalidChannelsForOperation);
+
+  Mat y;
+  REQUIRE(SparseMat().multiply(Mat(1, 1, 1), y).error() ==
+          MatError::InvalidDimensions);
+  auto sparse = SparseMat::from_triplets(3, 4, {});
+  REQUIRE(sparse.has_value());
+  REQUIRE(sparse->multiply(Mat(3, 1, 1), y).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(sparse->multiply(Mat(4, 1, 2), y).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(sparse->transpose_multiply(Mat(4, 1, 1), y).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(sparse->multiply(Mat(4, 2, 1, 1.0f), y));
+  REQUIRE(y == Mat(3, 2, 1, 0.0f));
+}
+
+}  // namespace core
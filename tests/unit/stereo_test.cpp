@@ -0,0 +1,109 @@
+#include "core/stereo.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+// random texture, right view is the left view shifted by `disparity` pixels
+std::pair<Mat, Mat> shifted_pair(const size_t rows, const size_t cols,
+                                 const int disparity) {
+  const Mat left = random_image(rows, cols, 1, 12345u);
+  Mat right(rows, cols, 1, 0.0f);
+  for (size_t y = 0; y < rows; ++y) {
+    for (size_t x = 0; x + disparity < cols; ++x) {
+      right(y, x) = left(y, x + disparity);
+    }
+  }
+  return {left, right};
+}
+
+float valid_fraction_near(const Mat& disparity, const float expected,
+                          const size_t margin) {
+  size_t total = 0, near = 0;
+  for (size_t y = margin; y < disparity.rows() - margin; ++y) {
+    for (size_t x = margin; x < disparity.cols() - margin; ++x) {
+      ++total;
+      near += std::fabs(disparity(y, x) - expected) < 0.5f;
+    }
+  }
+  return static_cast<float>(near) / static_cast<float>(total);
+}
+}  // namespace
+
+TEST_CASE("Block matching recovers a constant shift", "[stereo]") {
+  const auto [left, right] = shifted_pair(48, 96, 7);
+  StereoParams params;
+  params.num_disparities = 16;
+
+  for (const StereoCost cost : {StereoCost::Sad, StereoCost::Census}) {
+    params.cost = cost;
+    auto disparity = block_match(left, right, params);
+    REQUIRE(disparity.has_value());
+    REQUIRE(disparity->rows() == 48);
+    REQUIRE(disparity->cols() == 96);
+    REQUIRE(valid_fraction_near(*disparity, 7.0f, 12) > 0.95f);
+  }
+}
+
+TEST_CASE("Semi-global matching recovers a constant shift", "[stereo]") {
+  const auto [left, right] = shifted_pair(48, 96, 5);
+  StereoParams params;
+  params.num_disparities = 16;
+
+  for (const int paths : {4, 8}) {
+    params.num_paths = paths;
+    for (const StereoCost cost : {StereoCost::Sad, StereoCost::Census}) {
+      params.cost = cost;
+      auto disparity = semi_global_match(left, right, params);
+      REQUIRE(disparity.has_value());
+      REQUIRE(valid_fraction_near(*disparity, 5.0f, 12) > 0.95f);
+    }
+  }
+
+  // pixels whose match falls off the right image are rejected
+  params.lr_max_diff = 1;
+  auto disparity = semi_global_match(left, right, params);
+  REQUIRE(disparity.has_value());
+  REQUIRE((*disparity)(10, 2) == kInvalidDisparity);
+}
+
+TEST_CASE("Stereo rejects bad inputs", "[stereo]") {
+  const Mat gray(8, 8, 1, 0.0f);
+  const Mat rgb(8, 8, 3, 0.0f);
+  const Mat small(4, 8, 1, 0.0f);
+
+  REQUIRE(block_match(rgb, rgb).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(semi_global_match(gray, small).error() ==
+          MatError::IncompatibleDimensions);
+
+  StereoParams even_block;
+  even_block.block_size = 4;
+  REQUIRE(block_match(gray, gray, even_block).error() ==
+          MatError::InvalidParameter);
+  StereoParams bad_paths;
+  bad_paths.num_paths = 3;
+  REQUIRE(semi_global_match(gray, gray, bad_paths).error() ==
+          MatError::InvalidParameter);
+}
+
+TEST_CASE("Disparity to metric depth", "[stereo]") {
+  Mat disparity(1, 3, 1, 0.0f);
+  disparity(0, 0) = 10.0f;
+  disparity(0, 1) = kInvalidDisparity;
+  disparity(0, 2) = 0.0f;
+
+  auto depth = disparity_to_depth(disparity, 500.0f, 0.1f);
+  REQUIRE(depth.has_value());
+  REQUIRE(approx_equal((*depth)(0, 0), 5.0f));
+  REQUIRE((*depth)(0, 1) == 0.0f);
+  REQUIRE((*depth)(0, 2) == 0.0f);
+
+  REQUIRE(disparity_to_depth(disparity, 0.0f, 0.1f).error() ==
+          MatError::InvalidParameter);
+}
+}  // namespace core
@@ -0,0 +1,209 @@
+#include "core/template_match.hpp"
+
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+
+#include "tests/unit/test_util.hpp"
+
+namespace core {
+using namespace test;
+namespace {
+Mat crop(const Mat& image, const size_t top, const size_t left,
+         const size_t rows, const size_t cols) {
+  Mat out(rows, cols, image.channels());
+  for (size_t y = 0; y < rows; ++y) {
+    for (size_t x = 0; x < cols; ++x) {
+      for (size_t c = 0; c < image.channels(); ++c) {
+        out(y, x, c) = image(top + y, left + x, c);
+      }
+    }
+  }
+  return out;
+}
+
+Mat reference_match(const Mat& image, const Mat& templ,
+                    const TemplateMethod method) {
+  const size_t rows = templ.rows(), cols = templ.cols();
+  const size_t channels = templ.channels();
+  const auto area = static_cast<double>(rows * cols);
+  std::array<double, 4> template_means{};
+  for (size_t c = 0; c < channels; ++c) {
+    for (size_t y = 0; y < rows; ++y) {
+      for (size_t x = 0; x < cols; ++x) {
+        template_means[c] += templ(y, x, c) / area;
+      }
+    }
+  }
+  Mat scores(image.rows() - rows + 1, image.cols() - cols + 1, 1);
+  for (size_t oy = 0; oy < scores.rows(); ++oy) {
+    for (size_t ox = 0; ox < scores.cols(); ++ox) {
+      double score = 0.0, window_norm = 0.0, template_norm = 0.0;
+      for (size_t c = 0; c < channels; ++c) {
+        double mean = 0.0;
+        for (size_t y = 0; y < rows; ++y) {
+          for (size_t x = 0; x < cols; ++x) {
+            mean += image(oy + y, ox + x, c) / area;
+          }
+        }
+        for (size_t y = 0; y < rows; ++y) {
+          for (size_t x = 0; x < cols; ++x) {
+            const double i = image(oy + y, ox + x, c);
+            const double t = templ(y, x, c);
+            if (method == TemplateMethod::SquaredDifference) {
+              score += (i - t) * (i - t);
+            } else if (method == TemplateMethod::CrossCorrelation) {
+              score += i * t;
+            } else {
+              const double dt = t - template_means[c];
+              score += (i - mean) * dt;
+              window_norm += (i - mean) * (i - mean);
+              template_norm += dt * dt;
+            }
+          }
+        }
+      }
+      if (method == TemplateMethod::NormedCrossCorrelation) {
+        score /= std::sqrt(window_norm * template_norm);
+      }
+      scores(oy, ox, 0) = static_cast<float>(score);
+    }
+  }
+  return scores;
+}
+
+bool near(const Mat& a, const Mat& b, const float epsilon) {
+  if (a.rows() != b.rows() || a.cols() != b.cols() ||
+      a.channels() != b.channels()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (!approx_equal(a.data()[i], b.data()[i], epsilon)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+TEST_CASE("Template scores match brute force", "[template_match]") {
+  // small templates correlate directly, large ones through their spectra,
+  // single rows included
+  for (const auto& [rows, cols, template_rows, template_cols] :
+       {std::array<size_t, 4>{30, 45, 3, 5},
+        {64, 80, 40, 40},
+        {37, 50, 20, 33},
+        {1, 9, 1, 1},
+        {1, 4096, 1, 2048}}) {
+    for (const size_t channels : {size_t{1}, size_t{3}}) {
+      const Mat image = random_image(rows, cols, channels, 7);
+      const Mat templ = random_image(template_rows, template_cols, channels,
+                                     11);
+      for (const TemplateMethod method :
+           {TemplateMethod::SquaredDifference,
+            TemplateMethod::CrossCorrelation,
+            TemplateMethod::NormedCrossCorrelation}) {
+        auto scores = match_template(image, templ, method);
+        REQUIRE(scores.has_value());
+        Mat expected = reference_match(image, templ, method);
+        if (method == TemplateMethod::NormedCrossCorrelation &&
+            template_rows * template_cols == 1) {
+          // a single pixel template has no variance
+          expected = Mat(expected.rows(), expected.cols(), 1, 0.0f);
+        }
+        const float tolerance =
+            method == TemplateMethod::NormedCrossCorrelation
+                ? 1e-4f
+                : 2e-6f * static_cast<float>(template_rows * template_cols *
+                                             channels);
+        REQUIRE(near(*scores, expected, tolerance));
+      }
+    }
+  }
+}
+
+TEST_CASE("Best matches are refined below the pixel", "[template_match]") {
+  // a smooth blob centred at a fractional position
+  const float cx = 40.3f, cy = 25.7f;
+  Mat image(64, 96, 1);
+  for (size_t y = 0; y < 64; ++y) {
+    for (size_t x = 0; x < 96; ++x) {
+      const float dx = static_cast<float>(x) - cx;
+      const float dy = static_cast<float>(y) - cy;
+      image(y, x, 0) = std::exp(-(dx * dx + dy * dy) / 50.0f);
+    }
+  }
+  Mat templ(21, 21, 1);
+  for (size_t y = 0; y < 21; ++y) {
+    for (size_t x = 0; x < 21; ++x) {
+      const float dx = static_cast<float>(x) - 10.0f;
+      const float dy = static_cast<float>(y) - 10.0f;
+      templ(y, x, 0) = std::exp(-(dx * dx + dy * dy) / 50.0f);
+    }
+  }
+
+  for (const TemplateMethod method :
+       {TemplateMethod::SquaredDifference,
+        TemplateMethod::NormedCrossCorrelation}) {
+    auto scores = match_template(image, templ, method);
+    REQUIRE(scores.has_value());
+    auto match = best_match(*scores, method);
+    REQUIRE(match.has_value());
+    REQUIRE(std::abs(match->x - (cx - 10.0f)) < 0.1f);
+    REQUIRE(std::abs(match->y - (cy - 10.0f)) < 0.1f);
+  }
+
+  // an exact copy of a patch is found at its pixel
+  const Mat noise = random_image(50, 70, 3, 3);
+  auto scores = match_template(noise, crop(noise, 12, 31, 9, 9));
+  REQUIRE(scores.has_value());
+  auto match = best_match(*scores);
+  REQUIRE(match.has_value());
+  REQUIRE(std::abs(match->x - 31.0f) < 0.5f);
+  REQUIRE(std::abs(match->y - 12.0f) < 0.5f);
+  REQUIRE(match->score > 0.999f);
+}
+
+TEST_CASE("Template matchers are reusable across image shapes",
+          "[template_match]") {
+  TemplateMatcher matcher(TemplateMethod::NormedCrossCorrelation);
+  REQUIRE(matcher.set_template(random_image(24, 24, 1, 5)));
+  Mat scores;
+  for (const auto& [rows, cols] :
+       {std::array<size_t, 2>{100, 120}, {60, 200}, {100, 120}}) {
+    const Mat image = random_image(rows, cols, 1, 9);
+    REQUIRE(matcher.match(image, scores));
+    auto fresh = match_template(image, random_image(24, 24, 1, 5));
+    REQUIRE(fresh.has_value());
+    REQUIRE(scores == *fresh);
+  }
+
+  // flat windows and templates score zero
+  REQUIRE(matcher.match(Mat(30, 30, 1, 0.5f), scores));
+  REQUIRE(scores == Mat(7, 7, 1, 0.0f));
+  REQUIRE(matcher.set_template(Mat(4, 4, 1, 0.2f)));
+  REQUIRE(matcher.match(random_image(10, 10, 1, 2), scores));
+  REQUIRE(scores == Mat(7, 7, 1, 0.0f));
+}
+
+TEST_CASE("Template matching rejects bad input", "[template_match]") {
+  TemplateMatcher matcher;
+  Mat scores;
+  REQUIRE(matcher.match(Mat(8, 8, 1), scores).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(matcher.set_template(Mat()).error() == MatError::InvalidDimensions);
+  REQUIRE(matcher.set_template(Mat(4, 4, 1)));
+  REQUIRE(matcher.match(Mat(), scores).error() ==
+          MatError::InvalidDimensions);
+  REQUIRE(matcher.match(Mat(8, 8, 3), scores).error() ==
+          MatError::InvalidChannelsForOperation);
+  REQUIRE(matcher.match(Mat(3, 8, 1), scores).error() ==
+          MatError::IncompatibleDimensions);
+  REQUIRE(best_match(Mat()).error() == MatError::InvalidDimensions);
+  REQUIRE(best_match(Mat(2, 2, 2)).error() ==
+          MatError::InvalidChannelsForOperation);
+}
+
+}  // namespace core
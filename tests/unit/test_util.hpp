@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "core/mat.hpp"
+
+// random inputs for the unit tests. a fixed linear congruential generator
+// rather than <random> so every test sees the same numbers on every platform
+
+namespace core::test {
+
+// the next 24 random bits
+inline uint32_t next(uint32_t& seed) {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+// uniform in [0, 1) in steps of 2^-24
+inline float unit_uniform(uint32_t& seed) {
+  return static_cast<float>(next(seed)) / 16777216.0f;
+}
+
+// uniform in [lo, hi] in 100000 steps, double unless asked otherwise
+template <typename T = double>
+T uniform(uint32_t& seed, const std::type_identity_t<T> lo,
+          const std::type_identity_t<T> hi) {
+  return lo + (hi - lo) * static_cast<T>(next(seed) % 100001) / T{100000};
+}
+
+// every element uniform in [0, 1)
+inline Mat random_image(const size_t rows, const size_t cols,
+                        const size_t channels, uint32_t seed) {
+  Mat image(rows, cols, channels);
+  for (size_t i = 0; i < image.size(); ++i) {
+    image.data()[i] = unit_uniform(seed);
+  }
+  return image;
+}
+
+};  // namespace core::test